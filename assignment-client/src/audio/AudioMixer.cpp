@@ -32,8 +32,10 @@
 #include <glm/gtx/vector_angle.hpp>
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
 #include <QtCore/QTimer>
 
+#include <AudioMixKernel.h>
 #include <Logging.h>
 #include <NodeList.h>
 #include <Node.h>
@@ -54,6 +56,8 @@ const short JITTER_BUFFER_SAMPLES = JITTER_BUFFER_MSECS * (SAMPLE_RATE / 1000.0)
 
 const char AUDIO_MIXER_LOGGING_TARGET_NAME[] = "audio-mixer";
 
+const int MIX_STATS_INTERVAL_FRAMES = 1000;
+
 void attachNewBufferToNode(Node *newNode) {
     if (!newNode->getLinkedData()) {
         newNode->setLinkedData(new AudioMixerClientData());
@@ -61,149 +65,104 @@ void attachNewBufferToNode(Node *newNode) {
 }
 
 AudioMixer::AudioMixer(const QByteArray& packet) :
-    ThreadedAssignment(packet)
+    ThreadedAssignment(packet),
+    _workerPool(),
+    _maxMixedSources(DEFAULT_MAX_MIXED_SOURCES),
+    _statsFrames(0),
+    _totalListeners(0),
+    _totalSourcesMixed(0),
+    _totalSourcesInaudible(0),
+    _totalSourcesOverCap(0)
 {
 
 }
 
-void AudioMixer::addBufferToMixForListeningNodeWithBuffer(PositionalAudioRingBuffer* bufferToAdd,
-                                                          AvatarAudioRingBuffer* listeningNodeBuffer) {
-    float bearingRelativeAngleToSource = 0.0f;
-    float attenuationCoefficient = 1.0f;
-    int numSamplesDelay = 0;
-    float weakChannelAmplitudeRatio = 1.0f;
+void AudioMixer::parsePayload() {
+    QStringList options = QString(getPayload()).split(" ", QString::SkipEmptyParts);
 
-    const int PHASE_DELAY_AT_90 = 20;
+    const QString MAX_MIXED_SOURCES_OPTION = "--maxMixedSources";
+    int optionIndex = options.indexOf(MAX_MIXED_SOURCES_OPTION);
+    if (optionIndex >= 0 && optionIndex + 1 < options.size()) {
+        _maxMixedSources = options[optionIndex + 1].toInt();
+    }
+    qDebug() << "AudioMixer mixing at most" << _maxMixedSources << "sources per listener, 0 means no limit";
+}
 
-    if (bufferToAdd != listeningNodeBuffer) {
-        // if the two buffer pointers do not match then these are different buffers
+void AudioMixer::mixListener(int listenerIndex) {
+    Node* node = _frameListeners[listenerIndex].data();
+    AudioMixerClientData* nodeClientData = (AudioMixerClientData*) node->getLinkedData();
+    AvatarAudioRingBuffer* nodeRingBuffer = nodeClientData->getAvatarAudioRingBuffer();
 
-        glm::vec3 listenerPosition = listeningNodeBuffer->getPosition();
-        glm::vec3 relativePosition = bufferToAdd->getPosition() - listeningNodeBuffer->getPosition();
-        glm::quat inverseOrientation = glm::inverse(listeningNodeBuffer->getOrientation());
+    // loop through all the buffers that have sufficient audio to mix, and keep the ones this node can hear
+    std::vector<AudibleSource>& audibleSources = nodeClientData->getAudibleSources();
+    audibleSources.clear();
+    int sourcesInaudible = 0;
 
-        float distanceSquareToSource = glm::dot(relativePosition, relativePosition);
-        float radius = 0.0f;
+    for (unsigned int i = 0; i < _frameSources.size(); i++) {
+        const FrameSource& source = _frameSources[i];
 
-        if (bufferToAdd->getType() == PositionalAudioRingBuffer::Injector) {
-            InjectedAudioRingBuffer* injectedBuffer = (InjectedAudioRingBuffer*) bufferToAdd;
-            radius = injectedBuffer->getRadius();
-            attenuationCoefficient *= injectedBuffer->getAttenuationRatio();
+        if (source.node == node && !source.buffer->shouldLoopbackForNode()) {
+            continue;
         }
 
-        if (radius == 0 || (distanceSquareToSource > radius * radius)) {
-            // this is either not a spherical source, or the listener is outside the sphere
-
-            if (radius > 0) {
-                // this is a spherical source - the distance used for the coefficient
-                // needs to be the closest point on the boundary to the source
-
-                // ovveride the distance to the node with the distance to the point on the
-                // boundary of the sphere
-                distanceSquareToSource -= (radius * radius);
-
-            } else {
-                // calculate the angle delivery for off-axis attenuation
-                glm::vec3 rotatedListenerPosition = glm::inverse(bufferToAdd->getOrientation()) * relativePosition;
-
-                float angleOfDelivery = glm::angle(glm::vec3(0.0f, 0.0f, -1.0f),
-                                                   glm::normalize(rotatedListenerPosition));
-
-                const float MAX_OFF_AXIS_ATTENUATION = 0.2f;
-                const float OFF_AXIS_ATTENUATION_FORMULA_STEP = (1 - MAX_OFF_AXIS_ATTENUATION) / 2.0f;
-
-                float offAxisCoefficient = MAX_OFF_AXIS_ATTENUATION +
-                    (OFF_AXIS_ATTENUATION_FORMULA_STEP * (angleOfDelivery / 90.0f));
-
-                // multiply the current attenuation coefficient by the calculated off axis coefficient
-                attenuationCoefficient *= offAxisCoefficient;
-            }
-
-            glm::vec3 rotatedSourcePosition = inverseOrientation * relativePosition;
-
-            const float DISTANCE_SCALE = 2.5f;
-            const float GEOMETRIC_AMPLITUDE_SCALAR = 0.3f;
-            const float DISTANCE_LOG_BASE = 2.5f;
-            const float DISTANCE_SCALE_LOG = logf(DISTANCE_SCALE) / logf(DISTANCE_LOG_BASE);
-
-            // calculate the distance coefficient using the distance to this node
-            float distanceCoefficient = powf(GEOMETRIC_AMPLITUDE_SCALAR,
-                                             DISTANCE_SCALE_LOG +
-                                             (0.5f * logf(distanceSquareToSource) / logf(DISTANCE_LOG_BASE)) - 1);
-            distanceCoefficient = std::min(1.0f, distanceCoefficient);
-
-            // multiply the current attenuation coefficient by the distance coefficient
-            attenuationCoefficient *= distanceCoefficient;
-
-            // project the rotated source position vector onto the XZ plane
-            rotatedSourcePosition.y = 0.0f;
-
-            // produce an oriented angle about the y-axis
-            bearingRelativeAngleToSource = glm::orientedAngle(glm::vec3(0.0f, 0.0f, -1.0f),
-                                                              glm::normalize(rotatedSourcePosition),
-                                                              glm::vec3(0.0f, 1.0f, 0.0f));
-
-            const float PHASE_AMPLITUDE_RATIO_AT_90 = 0.5;
-
-            // figure out the number of samples of delay and the ratio of the amplitude
-            // in the weak channel for audio spatialization
-            float sinRatio = fabsf(sinf(glm::radians(bearingRelativeAngleToSource)));
-            numSamplesDelay = PHASE_DELAY_AT_90 * sinRatio;
-            weakChannelAmplitudeRatio = 1 - (PHASE_AMPLITUDE_RATIO_AT_90 * sinRatio);
+        if (source.buffer->getFramePeak() == 0.0f) {
+            // silence, don't bother working out where it is
+            sourcesInaudible++;
+            continue;
         }
-    }
-
-    // if the bearing relative angle to source is > 0 then the delayed channel is the right one
-    int delayedChannelOffset = (bearingRelativeAngleToSource > 0.0f) ? 1 : 0;
-    int goodChannelOffset = delayedChannelOffset == 0 ? 1 : 0;
 
-    for (int s = 0; s < NETWORK_BUFFER_LENGTH_SAMPLES_STEREO; s += 2) {
-        if ((s / 2) < numSamplesDelay) {
-            // pull the earlier sample for the delayed channel
-            int earlierSample = (*bufferToAdd)[(s / 2) - numSamplesDelay] * attenuationCoefficient * weakChannelAmplitudeRatio;
-            _clientSamples[s + delayedChannelOffset] = glm::clamp(_clientSamples[s + delayedChannelOffset] + earlierSample,
-                                                                    MIN_SAMPLE_VALUE, MAX_SAMPLE_VALUE);
+        AudioSourceMix sourceMix(source.buffer, nodeRingBuffer);
+        if (source.buffer->getFramePeak() * sourceMix.attenuation < MIN_AUDIBLE_AMPLITUDE) {
+            // too far away or too quiet for any of its samples to amount to anything
+            sourcesInaudible++;
+            continue;
         }
 
-        // pull the current sample for the good channel
-        int16_t currentSample = (*bufferToAdd)[s / 2] * attenuationCoefficient;
-        _clientSamples[s + goodChannelOffset] = glm::clamp(_clientSamples[s + goodChannelOffset] + currentSample,
-                                                           MIN_SAMPLE_VALUE, MAX_SAMPLE_VALUE);
-
-        if ((s / 2) + numSamplesDelay < NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL) {
-            // place the current sample at the right spot in the delayed channel
-            int16_t clampedSample = glm::clamp((int) (_clientSamples[s + (numSamplesDelay * 2) + delayedChannelOffset]
-                                               + (currentSample * weakChannelAmplitudeRatio)),
-                                               MIN_SAMPLE_VALUE, MAX_SAMPLE_VALUE);
-            _clientSamples[s + (numSamplesDelay * 2) + delayedChannelOffset] = clampedSample;
-        }
+        float loudness = source.buffer->getFrameLoudness() * sourceMix.attenuation;
+        audibleSources.push_back(AudibleSource(i, sourceMix, loudness));
     }
-}
 
-void AudioMixer::prepareMixForListeningNode(Node* node) {
-    AvatarAudioRingBuffer* nodeRingBuffer = ((AudioMixerClientData*) node->getLinkedData())->getAvatarAudioRingBuffer();
+    int sourcesOverCap = keepLoudestSources(audibleSources, _maxMixedSources);
 
     // zero out the client mix for this node
-    memset(_clientSamples, 0, sizeof(_clientSamples));
+    AudioMixAccumulator& mix = nodeClientData->getMixAccumulator();
+    mix.clear();
 
-    // loop through all other nodes that have sufficient audio to mix
-    foreach (const SharedNodePointer& otherNode, NodeList::getInstance()->getNodeHash()) {
-        if (otherNode->getLinkedData()) {
+    for (unsigned int i = 0; i < audibleSources.size(); i++) {
+        const AudibleSource& audibleSource = audibleSources[i];
+        mix.addSource(_frameSources[audibleSource.sourceIndex].buffer->getLinearFrame(), audibleSource.sourceMix);
+    }
 
-            AudioMixerClientData* otherNodeClientData = (AudioMixerClientData*) otherNode->getLinkedData();
+    // clamp to 16 bit samples once, now that everything is in
+    mix.writeSamples(nodeClientData->getMixedSamples());
 
-            // enumerate the ARBs attached to the otherNode and add all that should be added to mix
-            for (unsigned int i = 0; i < otherNodeClientData->getRingBuffers().size(); i++) {
-                PositionalAudioRingBuffer* otherNodeBuffer = otherNodeClientData->getRingBuffers()[i];
+    nodeClientData->setMixStats(audibleSources.size(), sourcesInaudible, sourcesOverCap);
+}
 
-                if ((*otherNode != *node
-                     || otherNodeBuffer->shouldLoopbackForNode())
-                    && otherNodeBuffer->willBeAddedToMix()) {
-                    addBufferToMixForListeningNodeWithBuffer(otherNodeBuffer, nodeRingBuffer);
-                }
-            }
-        }
+void AudioMixer::updateMixStats() {
+    for (unsigned int i = 0; i < _frameListeners.size(); i++) {
+        AudioMixerClientData* nodeClientData = (AudioMixerClientData*) _frameListeners[i]->getLinkedData();
+        _totalSourcesMixed += nodeClientData->getSourcesMixed();
+        _totalSourcesInaudible += nodeClientData->getSourcesInaudible();
+        _totalSourcesOverCap += nodeClientData->getSourcesOverCap();
+    }
+    _totalListeners += _frameListeners.size();
+
+    if (++_statsFrames < MIX_STATS_INTERVAL_FRAMES) {
+        return;
+    }
+
+    if (_totalListeners > 0) {
+        qDebug("AudioMixer mix stats over %d frames... per listener: sources mixed=%.1f inaudible=%.1f over cap=%.1f",
+               _statsFrames, (float) _totalSourcesMixed / _totalListeners,
+               (float) _totalSourcesInaudible / _totalListeners, (float) _totalSourcesOverCap / _totalListeners);
     }
+
+    _statsFrames = 0;
+    _totalListeners = 0;
+    _totalSourcesMixed = 0;
+    _totalSourcesInaudible = 0;
+    _totalSourcesOverCap = 0;
 }
 
 
@@ -239,6 +198,8 @@ void AudioMixer::run() {
 
     nodeList->linkedDataCreateCallback = attachNewBufferToNode;
 
+    parsePayload();
+
     int nextFrame = 0;
     timeval startTime;
 
@@ -253,6 +214,8 @@ void AudioMixer::run() {
     #endif
     populatePacketHeader(reinterpret_cast<char*>(clientPacket), PacketTypeMixedAudio);
 
+    _workerPool.start();
+
     while (!_isFinished) {
 
         QCoreApplication::processEvents();
@@ -261,21 +224,42 @@ void AudioMixer::run() {
             break;
         }
 
+        _frameListeners.clear();
+        _frameSources.clear();
+
         foreach (const SharedNodePointer& node, nodeList->getNodeHash()) {
             if (node->getLinkedData()) {
-                ((AudioMixerClientData*) node->getLinkedData())->checkBuffersBeforeFrameSend(JITTER_BUFFER_SAMPLES);
+                AudioMixerClientData* nodeClientData = (AudioMixerClientData*) node->getLinkedData();
+                nodeClientData->checkBuffersBeforeFrameSend(JITTER_BUFFER_SAMPLES);
+
+                // enumerate the ARBs attached to the node and keep all that should be added to the mix
+                for (unsigned int i = 0; i < nodeClientData->getRingBuffers().size(); i++) {
+                    PositionalAudioRingBuffer* nodeBuffer = nodeClientData->getRingBuffers()[i];
+                    if (nodeBuffer->willBeAddedToMix()) {
+                        FrameSource source = { node.data(), nodeBuffer };
+                        _frameSources.push_back(source);
+                    }
+                }
+
+                if (node->getType() == NodeType::Agent && node->getActiveSocket()
+                    && nodeClientData->getAvatarAudioRingBuffer()) {
+                    _frameListeners.push_back(node);
+                }
             }
         }
 
-        foreach (const SharedNodePointer& node, nodeList->getNodeHash()) {
-            if (node->getType() == NodeType::Agent && node->getActiveSocket() && node->getLinkedData()
-                && ((AudioMixerClientData*) node->getLinkedData())->getAvatarAudioRingBuffer()) {
-                prepareMixForListeningNode(node.data());
+        // mix for all of the listeners across the worker threads, then send the mixes from here
+        _workerPool.runJobs(this, _frameListeners.size());
+        updateMixStats();
 
-                memcpy(clientPacket + numBytesPacketHeader, _clientSamples, sizeof(_clientSamples));
-                nodeList->writeDatagram((char*) clientPacket, sizeof(clientPacket), node);
-            }
+        for (unsigned int i = 0; i < _frameListeners.size(); i++) {
+            const SharedNodePointer& node = _frameListeners[i];
+            AudioMixerClientData* nodeClientData = (AudioMixerClientData*) node->getLinkedData();
+            memcpy(clientPacket + numBytesPacketHeader, nodeClientData->getMixedSamples(),
+                   NETWORK_BUFFER_LENGTH_BYTES_STEREO);
+            nodeList->queueDatagram((char*) clientPacket, sizeof(clientPacket), node);
         }
+        nodeList->flushQueuedDatagrams();
 
         // push forward the next output pointers for any audio buffers we used
         foreach (const SharedNodePointer& node, nodeList->getNodeHash()) {
@@ -293,4 +277,6 @@ void AudioMixer::run() {
         }
 
     }
+
+    _workerPool.stop();
 }
@@ -9,33 +9,63 @@
 #ifndef __hifi__AudioMixer__
 #define __hifi__AudioMixer__
 
+#include <vector>
+
 #include <AudioRingBuffer.h>
 
+#include <NodeList.h>
 #include <ThreadedAssignment.h>
+#include <WorkerPool.h>
 
 class PositionalAudioRingBuffer;
-class AvatarAudioRingBuffer;
+
+// by default a listener hears the 32 loudest sources around it, --maxMixedSources 0 in the payload mixes them all
+const int DEFAULT_MAX_MIXED_SOURCES = 32;
 
 /// Handles assignments of type AudioMixer - mixing streams of audio and re-distributing to various clients.
-class AudioMixer : public ThreadedAssignment {
+class AudioMixer : public ThreadedAssignment, public WorkerPoolJobs {
     Q_OBJECT
 public:
     AudioMixer(const QByteArray& packet);
+    
+    /// prepares the mix for one of this frame's listeners, called from the mix worker threads
+    virtual void runJob(int listenerIndex) { mixListener(listenerIndex); }
 public slots:
     /// threaded run of assignment
     void run();
     
     void readPendingDatagrams();
 private:
-    /// adds one buffer to the mix for a listening node
-    void addBufferToMixForListeningNodeWithBuffer(PositionalAudioRingBuffer* bufferToAdd,
-                                                  AvatarAudioRingBuffer* listeningNodeBuffer);
+    /// picks up options from the assignment payload
+    void parsePayload();
+    
+    /// sums what went into each listener's mix this frame and logs the totals every so often
+    void updateMixStats();
+    
+    /// a buffer with audio for this frame, and the node it came from
+    class FrameSource {
+    public:
+        Node* node;
+        PositionalAudioRingBuffer* buffer;
+    };
+    
+    /// prepares the mix for one of this frame's listeners
+    void mixListener(int listenerIndex);
+    
+    WorkerPool _workerPool;
     
-    /// prepares and sends a mix to one Node
-    void prepareMixForListeningNode(Node* node);
+    // the current frame, only changed between frames by the assignment thread
+    std::vector<SharedNodePointer> _frameListeners;
+    std::vector<FrameSource> _frameSources;
     
+    int _maxMixedSources;
     
-    int16_t _clientSamples[NETWORK_BUFFER_LENGTH_SAMPLES_STEREO];
+    // stats since they were last logged
+    int _statsFrames;
+    quint64 _totalListeners;
+    quint64 _totalSourcesMixed;
+    quint64 _totalSourcesInaudible;
+    quint64 _totalSourcesOverCap;
 };
 
 #endif /* defined(__hifi__AudioMixer__) */
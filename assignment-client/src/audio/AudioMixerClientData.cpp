@@ -13,6 +13,13 @@
 
 #include "AudioMixerClientData.h"
 
+AudioMixerClientData::AudioMixerClientData() :
+    _sourcesMixed(0),
+    _sourcesInaudible(0),
+    _sourcesOverCap(0)
+{
+}
+
 AudioMixerClientData::~AudioMixerClientData() {
     for (unsigned int i = 0; i < _ringBuffers.size(); i++) {
         // delete this attached PositionalAudioRingBuffer
@@ -80,6 +87,9 @@ void AudioMixerClientData::checkBuffersBeforeFrameSend(int jitterBufferLengthSam
             // this is a ring buffer that is ready to go
             // set its flag so we know to push its buffer when all is said and done
             _ringBuffers[i]->setWillBeAddedToMix(true);
+
+            // every listener's mix reads this frame, so pull it out of the ring once
+            _ringBuffers[i]->linearizeFrame();
         }
     }
 }
@@ -101,3 +111,9 @@ void AudioMixerClientData::pushBuffersAfterFrameSend() {
         }
     }
 }
+
+void AudioMixerClientData::setMixStats(int sourcesMixed, int sourcesInaudible, int sourcesOverCap) {
+    _sourcesMixed = sourcesMixed;
+    _sourcesInaudible = sourcesInaudible;
+    _sourcesOverCap = sourcesOverCap;
+}
@@ -11,6 +11,7 @@
 
 #include <vector>
 
+#include <AudioMixKernel.h>
 #include <NodeData.h>
 #include <PositionalAudioRingBuffer.h>
 
@@ -18,6 +19,7 @@
 
 class AudioMixerClientData : public NodeData {
 public:
+    AudioMixerClientData();
     ~AudioMixerClientData();
     
     const std::vector<PositionalAudioRingBuffer*> getRingBuffers() const { return _ringBuffers; }
@@ -26,8 +28,25 @@ public:
     int parseData(const QByteArray& packet);
     void checkBuffersBeforeFrameSend(int jitterBufferLengthSamples);
     void pushBuffersAfterFrameSend();
+    
+    /// this node's mix for the current frame, a mix worker owns it while mixing the frame
+    AudioMixAccumulator& getMixAccumulator() { return _mixAccumulator; }
+    int16_t* getMixedSamples() { return _mixedSamples; }
+    std::vector<AudibleSource>& getAudibleSources() { return _audibleSources; }
+    
+    /// what went into this node's mix for the current frame
+    void setMixStats(int sourcesMixed, int sourcesInaudible, int sourcesOverCap);
+    int getSourcesMixed() const { return _sourcesMixed; }
+    int getSourcesInaudible() const { return _sourcesInaudible; }
+    int getSourcesOverCap() const { return _sourcesOverCap; }
 private:
     std::vector<PositionalAudioRingBuffer*> _ringBuffers;
+    AudioMixAccumulator _mixAccumulator;
+    int16_t _mixedSamples[NETWORK_BUFFER_LENGTH_SAMPLES_STEREO];
+    std::vector<AudibleSource> _audibleSources;
+    int _sourcesMixed;
+    int _sourcesInaudible;
+    int _sourcesOverCap;
 };
 
 #endif /* defined(__hifi__AudioMixerClientData__) */
@@ -26,10 +26,12 @@
 
 const char AVATAR_MIXER_LOGGING_NAME[] = "avatar-mixer";
 
-const unsigned int AVATAR_DATA_SEND_INTERVAL_USECS = (1 / 60.0) * 1000 * 1000;
+const int AVATAR_MIXER_BROADCASTS_PER_SECOND = 60;
+const unsigned int AVATAR_DATA_SEND_INTERVAL_USECS = (1.0 / AVATAR_MIXER_BROADCASTS_PER_SECOND) * 1000 * 1000;
 
 AvatarMixer::AvatarMixer(const QByteArray& packet) :
-    ThreadedAssignment(packet)
+    ThreadedAssignment(packet),
+    _interestManager(AVATAR_MIXER_BROADCASTS_PER_SECOND)
 {
     // make sure we hear about node kills so we can tell the other nodes
     connect(NodeList::getInstance(), &NodeList::nodeKilled, this, &AvatarMixer::nodeKilled);
@@ -44,49 +46,57 @@ void attachAvatarDataToNode(Node* newNode) {
 // NOTE: some additional optimizations to consider.
 //    1) use the view frustum to cull those avatars that are out of view. Since avatar data doesn't need to be present
 //       if the avatar is not in view or in the keyhole.
-//    2) after culling for view frustum, sort order the avatars by distance, send the closest ones first.
-//    3) if we need to rate limit the amount of data we send, we can use a distance weighted "semi-random" function to
-//       determine which avatars are included in the packet stream
-//    4) we should optimize the avatar data format to be more compact (100 bytes is pretty wasteful).
-void broadcastAvatarData() {
+//    2) we should optimize the avatar data format to be more compact (100 bytes is pretty wasteful).
+void broadcastAvatarData(AvatarInterestManager& interestManager) {
     static QByteArray mixedAvatarByteArray;
+    static std::vector<int> selectedAvatars;
     
     int numPacketHeaderBytes = populatePacketHeader(mixedAvatarByteArray, PacketTypeBulkAvatarData);
     
     NodeList* nodeList = NodeList::getInstance();
     
+    // serialize each avatar once for this frame, every receiver gets the same bytes
+    interestManager.beginFrame();
+    foreach (const SharedNodePointer& node, nodeList->getNodeHash()) {
+        if (node->getLinkedData()) {
+            AvatarMixerClientData* nodeData = reinterpret_cast<AvatarMixerClientData*>(node->getLinkedData());
+            QByteArray avatarByteArray = node->getUUID().toRfc4122();
+            avatarByteArray.append(nodeData->toByteArray());
+            interestManager.addAvatar(node->getUUID(), nodeData->getPosition(), avatarByteArray);
+        }
+    }
+    
     foreach (const SharedNodePointer& node, nodeList->getNodeHash()) {
         if (node->getLinkedData() && node->getType() == NodeType::Agent && node->getActiveSocket()) {
             
             // reset packet pointers for this node
             mixedAvatarByteArray.resize(numPacketHeaderBytes);
             
-            // this is an AGENT we have received head data from
-            // send back a packet with other active node data to this node
-            foreach (const SharedNodePointer& otherNode, nodeList->getNodeHash()) {
-                if (otherNode->getLinkedData() && otherNode->getUUID() != node->getUUID()) {
-                    
-                    QByteArray avatarByteArray;
-                    avatarByteArray.append(otherNode->getUUID().toRfc4122());
-                    
-                    AvatarMixerClientData* nodeData = reinterpret_cast<AvatarMixerClientData*>(otherNode->getLinkedData());
-                    avatarByteArray.append(nodeData->toByteArray());
-                    
-                    if (avatarByteArray.size() + mixedAvatarByteArray.size() > MAX_PACKET_SIZE) {
-                        nodeList->writeDatagram(mixedAvatarByteArray, node);
-                        
-                        // reset the packet
-                        mixedAvatarByteArray.resize(numPacketHeaderBytes);
-                    }
+            // this is an AGENT we have received head data from, send back a packet with the other avatars that are
+            // near enough and due for it this frame
+            AvatarMixerClientData* nodeData = reinterpret_cast<AvatarMixerClientData*>(node->getLinkedData());
+            interestManager.selectForReceiver(node->getUUID(), nodeData->getPosition(), nodeData->getReceiverState(),
+                                              selectedAvatars);
+            
+            for (size_t i = 0; i < selectedAvatars.size(); i++) {
+                const QByteArray& avatarByteArray = interestManager.getPayload(selectedAvatars[i]);
+                
+                if (avatarByteArray.size() + mixedAvatarByteArray.size() > MAX_PACKET_SIZE) {
+                    nodeList->queueDatagram(mixedAvatarByteArray.constData(), mixedAvatarByteArray.size(), node);
                     
-                    // copy the avatar into the mixedAvatarByteArray packet
-                    mixedAvatarByteArray.append(avatarByteArray);
+                    // reset the packet
+                    mixedAvatarByteArray.resize(numPacketHeaderBytes);
                 }
+                
+                // copy the avatar into the mixedAvatarByteArray packet
+                mixedAvatarByteArray.append(avatarByteArray);
             }
             
-            nodeList->writeDatagram(mixedAvatarByteArray, node);
+            nodeList->queueDatagram(mixedAvatarByteArray.constData(), mixedAvatarByteArray.size(), node);
         }
     }
+    
+    nodeList->flushQueuedDatagrams();
 }
 
 void broadcastIdentityPacket() {
@@ -133,6 +143,14 @@ void AvatarMixer::nodeKilled(SharedNodePointer killedNode) {
         
         NodeList::getInstance()->broadcastToNodes(killPacket,
                                                   NodeSet() << NodeType::Agent);
+        
+        // and stop keeping track of when we last sent it to them
+        foreach (const SharedNodePointer& node, NodeList::getInstance()->getNodeHash()) {
+            if (node->getLinkedData()) {
+                AvatarMixerClientData* nodeData = reinterpret_cast<AvatarMixerClientData*>(node->getLinkedData());
+                nodeData->getReceiverState().forgetAvatar(killedNode->getUUID());
+            }
+        }
     }
 }
 
@@ -210,7 +228,7 @@ void AvatarMixer::run() {
             break;
         }
         
-        broadcastAvatarData();
+        broadcastAvatarData(_interestManager);
         
         if (identityTimer.elapsed() >= AVATAR_IDENTITY_KEYFRAME_MSECS) {
             // it's time to broadcast the keyframe identity packets
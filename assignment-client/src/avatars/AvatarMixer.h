@@ -9,6 +9,7 @@
 #ifndef __hifi__AvatarMixer__
 #define __hifi__AvatarMixer__
 
+#include <AvatarInterestManager.h>
 #include <ThreadedAssignment.h>
 
 /// Handles assignments of type AvatarMixer - distribution of avatar data to various clients
@@ -24,6 +25,9 @@ public slots:
     void nodeKilled(SharedNodePointer killedNode);
     
     void readPendingDatagrams();
+    
+private:
+    AvatarInterestManager _interestManager;
 };
 
 #endif /* defined(__hifi__AvatarMixer__) */
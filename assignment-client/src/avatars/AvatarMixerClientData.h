@@ -12,6 +12,7 @@
 #include <QtCore/QUrl>
 
 #include <AvatarData.h>
+#include <AvatarInterestManager.h>
 
 class AvatarMixerClientData : public AvatarData {
     Q_OBJECT
@@ -21,9 +22,12 @@ public:
     bool hasSentIdentityBetweenKeyFrames() const { return _hasSentIdentityBetweenKeyFrames; }
     void setHasSentIdentityBetweenKeyFrames(bool hasSentIdentityBetweenKeyFrames)
         { _hasSentIdentityBetweenKeyFrames = hasSentIdentityBetweenKeyFrames; }
+    
+    AvatarReceiverState& getReceiverState() { return _receiverState; }
 private:
    
     bool _hasSentIdentityBetweenKeyFrames;
+    AvatarReceiverState _receiverState;
 };
 
 #endif /* defined(__hifi__AvatarMixerClientData__) */
@@ -8,6 +8,8 @@
 //  Threaded or non-threaded network packet processor for the voxel-server
 //
 
+#include <algorithm>
+
 #include <PacketHeaders.h>
 #include <PerfStat.h>
 
@@ -17,6 +19,9 @@
 
 static QUuid DEFAULT_NODE_ID_REF;
 
+// the most edits applied under one hold of the write lock, so a big import can't keep the send threads out for long
+const int MAX_EDIT_BATCH_RECORDS = 10000;
+
 OctreeInboundPacketProcessor::OctreeInboundPacketProcessor(OctreeServer* myServer) :
     _myServer(myServer),
     _receivedPacketCount(0),
@@ -24,7 +29,11 @@ OctreeInboundPacketProcessor::OctreeInboundPacketProcessor(OctreeServer* myServe
     _totalProcessTime(0),
     _totalLockWaitTime(0),
     _totalElementsInPacket(0),
-    _totalPackets(0)
+    _totalPackets(0),
+    _totalEditBatches(0),
+    _totalBatchedElements(0),
+    _totalLocks(0),
+    _totalLockHoldTime(0)
 {
 }
 
@@ -34,10 +43,120 @@ void OctreeInboundPacketProcessor::resetStats() {
     _totalLockWaitTime = 0;
     _totalElementsInPacket = 0;
     _totalPackets = 0;
+    _totalEditBatches = 0;
+    _totalBatchedElements = 0;
+    _totalLocks = 0;
+    _totalLockHoldTime = 0;
+    resetQueueWaitStats();
 
     _singleSenderStats.clear();
 }
 
+bool OctreeInboundPacketProcessor::process() {
+    std::vector<PacketBuffer*> packets;
+    takeQueuedPackets(packets);
+    if (packets.empty() && !_dontSleep) {
+        usleep(RECEIVED_THREAD_SLEEP_INTERVAL);
+        takeQueuedPackets(packets);
+    }
+
+    Octree* tree = _myServer->getOctree();
+    for (size_t i = 0; i < packets.size(); i++) {
+        QByteArray packet = packets[i]->getByteArray();
+        if (tree->handlesEditBatchPacketType(packetTypeForPacket(packet))) {
+            // the batch gives the buffer back once it has been applied
+            addPacketToEditBatch(packets[i]);
+            if (_editBatch.size() >= MAX_EDIT_BATCH_RECORDS) {
+                processEditBatch();
+            }
+        } else {
+            // the batched edits arrived first, so they go first
+            processEditBatch();
+            processPacket(packets[i]->getSendingNode(), packet);
+            releasePacket(packets[i]);
+        }
+    }
+    processEditBatch();
+
+    return isStillRunning();  // keep running till they terminate us
+}
+
+void OctreeInboundPacketProcessor::addPacketToEditBatch(PacketBuffer* buffer) {
+    _receivedPacketCount++;
+    QByteArray packet = buffer->getByteArray();
+
+    PacketType packetType = packetTypeForPacket(packet);
+    int numBytesPacketHeader = numBytesForPacketHeader(packet);
+    const unsigned char* packetData = reinterpret_cast<const unsigned char*>(packet.data());
+
+    BatchedEditPacket batchedPacket;
+    batchedPacket.buffer = buffer;
+    batchedPacket.sendingNode = buffer->getSendingNode();
+    batchedPacket.packet = packet;
+    batchedPacket.sequence = (*((unsigned short int*)(packetData + numBytesPacketHeader)));
+    quint64 sentAt = (*((quint64*)(packetData + numBytesPacketHeader + sizeof(batchedPacket.sequence))));
+    batchedPacket.transitTime = usecTimestampNow() - sentAt;
+    batchedPacket.editsInPacket = 0;
+
+    if (_myServer->wantsDebugReceiving()) {
+        qDebug() << "PROCESSING THREAD: batching '" << packetType << "' packet - " << _receivedPacketCount
+                << " command from client receivedBytes=" << packet.size()
+                << " sequence=" << batchedPacket.sequence << " transitTime=" << batchedPacket.transitTime << " usecs";
+    }
+
+    // the records point straight into the pooled buffer, which is held until the batch has been applied
+    _editBatch.addPacket(packet);
+    int atByte = numBytesPacketHeader + sizeof(batchedPacket.sequence) + sizeof(sentAt);
+    while (atByte < packet.size()) {
+        const unsigned char* editData = packetData + atByte;
+        int editDataSize = _myServer->getOctree()->getEditRecordSize(packetType, editData, packet.size() - atByte);
+        if (editDataSize == 0) {
+            break; // the rest of the packet can't be read
+        }
+        _editBatch.addRecord(packetType, editData, editDataSize);
+        batchedPacket.editsInPacket++;
+        atByte += editDataSize;
+    }
+    _batchedPackets.push_back(batchedPacket);
+}
+
+void OctreeInboundPacketProcessor::processEditBatch() {
+    if (_batchedPackets.empty()) {
+        return;
+    }
+
+    // sorting only needs the records, so it's done before taking the lock
+    _editBatch.sort();
+
+    quint64 startLock = usecTimestampNow();
+    _myServer->getOctree()->lockForWrite();
+    quint64 startProcess = usecTimestampNow();
+    _myServer->getOctree()->processEditBatch(_editBatch);
+    _myServer->getOctree()->unlock();
+    quint64 endProcess = usecTimestampNow();
+
+    quint64 processTime = endProcess - startProcess;
+    quint64 lockWaitTime = startProcess - startLock;
+    _totalEditBatches++;
+    _totalBatchedElements += _editBatch.size();
+    _totalLocks++;
+    _totalLockHoldTime += processTime;
+
+    // the packets split the time by how many of the edits were theirs
+    int editsInBatch = std::max(_editBatch.size(), 1);
+    for (size_t i = 0; i < _batchedPackets.size(); i++) {
+        const BatchedEditPacket& batchedPacket = _batchedPackets[i];
+        finishPacket(batchedPacket.sendingNode, batchedPacket.packet, batchedPacket.sequence, batchedPacket.transitTime,
+                     batchedPacket.editsInPacket, processTime * batchedPacket.editsInPacket / editsInBatch,
+                     lockWaitTime * batchedPacket.editsInPacket / editsInBatch);
+    }
+    _editBatch.clear();
+    for (size_t i = 0; i < _batchedPackets.size(); i++) {
+        releasePacket(_batchedPackets[i].buffer);
+    }
+    _batchedPackets.clear();
+}
+
 
 void OctreeInboundPacketProcessor::processPacket(const SharedNodePointer& sendingNode, const QByteArray& packet) {
 
@@ -97,6 +216,8 @@ void OctreeInboundPacketProcessor::processPacket(const SharedNodePointer& sendin
             quint64 thisLockWaitTime = startProcess - startLock;
             processTime += thisProcessTime;
             lockWaitTime += thisLockWaitTime;
+            _totalLocks++;
+            _totalLockHoldTime += thisProcessTime;
 
             // skip to next voxel edit record in the packet
             editData += editDataBytesRead;
@@ -109,25 +230,39 @@ void OctreeInboundPacketProcessor::processPacket(const SharedNodePointer& sendin
                     packetType, packetData, packet.size(), editData, atByte);
         }
 
-        // Make sure our Node and NodeList knows we've heard from this node.
-        QUuid& nodeUUID = DEFAULT_NODE_ID_REF;
-        if (sendingNode) {
-            sendingNode->setLastHeardMicrostamp(usecTimestampNow());
-            nodeUUID = sendingNode->getUUID();
-            if (debugProcessPacket) {
-                qDebug() << "sender has uuid=" << nodeUUID;
-            }
-        } else {
-            if (debugProcessPacket) {
-                qDebug() << "sender has no known nodeUUID.";
-            }
-        }
-        trackInboundPackets(nodeUUID, sequence, transitTime, editsInPacket, processTime, lockWaitTime);
+        finishPacket(sendingNode, packet, sequence, transitTime, editsInPacket, processTime, lockWaitTime);
     } else {
         qDebug("unknown packet ignored... packetType=%d", packetType);
     }
 }
 
+void OctreeInboundPacketProcessor::finishPacket(const SharedNodePointer& sendingNode, const QByteArray& packet,
+            int sequence, quint64 transitTime, int editsInPacket, quint64 processTime, quint64 lockWaitTime) {
+
+    bool debugProcessPacket = _myServer->wantsVerboseDebug();
+
+    // now that all of its edits are applied, the packet can go in the journal
+    OctreePersistThread* persistThread = _myServer->getPersistThread();
+    if (persistThread) {
+        persistThread->journalEditPacket(packet);
+    }
+
+    // Make sure our Node and NodeList knows we've heard from this node.
+    QUuid& nodeUUID = DEFAULT_NODE_ID_REF;
+    if (sendingNode) {
+        sendingNode->setLastHeardMicrostamp(usecTimestampNow());
+        nodeUUID = sendingNode->getUUID();
+        if (debugProcessPacket) {
+            qDebug() << "sender has uuid=" << nodeUUID;
+        }
+    } else {
+        if (debugProcessPacket) {
+            qDebug() << "sender has no known nodeUUID.";
+        }
+    }
+    trackInboundPackets(nodeUUID, sequence, transitTime, editsInPacket, processTime, lockWaitTime);
+}
+
 void OctreeInboundPacketProcessor::trackInboundPackets(const QUuid& nodeUUID, int sequence, quint64 transitTime,
             int editsInPacket, quint64 processTime, quint64 lockWaitTime) {
 
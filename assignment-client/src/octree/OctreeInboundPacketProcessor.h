@@ -12,8 +12,11 @@
 #define __octree_server__OctreeInboundPacketProcessor__
 
 #include <map>
+#include <vector>
 
+#include <OctreeEditBatch.h>
 #include <ReceivedPacketProcessor.h>
+#include <SharedUtil.h>
 class OctreeServer;
 
 class SingleSenderStats {
@@ -57,6 +60,12 @@ public:
                 { return _totalElementsInPacket == 0 ? 0 : _totalProcessTime / _totalElementsInPacket; }
     quint64 getAverageLockWaitTimePerElement() const 
                 { return _totalElementsInPacket == 0 ? 0 : _totalLockWaitTime / _totalElementsInPacket; }
+    quint64 getElementsPerSecond() const
+                { return _totalProcessTime == 0 ? 0 : _totalElementsInPacket * USECS_PER_SECOND / _totalProcessTime; }
+    quint64 getTotalEditBatches() const { return _totalEditBatches; }
+    float getAverageElementsPerBatch() const
+                { return _totalEditBatches == 0 ? 0 : (float)_totalBatchedElements / _totalEditBatches; }
+    quint64 getAverageLockHoldTime() const { return _totalLocks == 0 ? 0 : _totalLockHoldTime / _totalLocks; }
 
     void resetStats();
 
@@ -65,7 +74,25 @@ public:
 protected:
     virtual void processPacket(const SharedNodePointer& sendingNode, const QByteArray& packet);
 
+    /// Takes every queued packet at once. The edits in packets the tree can batch are gathered up and applied under one
+    /// write lock, any other packet first applies the batch so far and is then processed on its own.
+    virtual bool process();
+
 private:
+    class BatchedEditPacket {
+    public:
+        PacketBuffer* buffer; // held until the batch is applied, the batch's records point into it
+        SharedNodePointer sendingNode;
+        QByteArray packet;
+        unsigned short int sequence;
+        quint64 transitTime;
+        int editsInPacket;
+    };
+
+    void addPacketToEditBatch(PacketBuffer* buffer);
+    void processEditBatch();
+    void finishPacket(const SharedNodePointer& sendingNode, const QByteArray& packet, int sequence,
+            quint64 transitTime, int editsInPacket, quint64 processTime, quint64 lockWaitTime);
     void trackInboundPackets(const QUuid& nodeUUID, int sequence, quint64 transitTime, 
             int voxelsInPacket, quint64 processTime, quint64 lockWaitTime);
 
@@ -77,7 +104,14 @@ private:
     quint64 _totalLockWaitTime;
     quint64 _totalElementsInPacket;
     quint64 _totalPackets;
+    quint64 _totalEditBatches;
+    quint64 _totalBatchedElements;
+    quint64 _totalLocks;
+    quint64 _totalLockHoldTime;
     
     NodeToSenderStatsMap _singleSenderStats;
+
+    OctreeEditBatch _editBatch;
+    std::vector<BatchedEditPacket> _batchedPackets;
 };
 #endif // __octree_server__OctreeInboundPacketProcessor__
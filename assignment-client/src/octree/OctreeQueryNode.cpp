@@ -12,6 +12,7 @@
 #include <cstring>
 #include <cstdio>
 #include "OctreeSendThread.h"
+#include "OctreeServer.h"
 
 OctreeQueryNode::OctreeQueryNode() :
     _viewSent(false),
@@ -38,9 +39,10 @@ OctreeQueryNode::OctreeQueryNode() :
 }
 
 void OctreeQueryNode::initializeOctreeSendThread(OctreeServer* octreeServer, const QUuid& nodeUUID) {
-    // Create octree sending thread...
+    // Create octree sending state, it runs non-threaded on the server's shared send scheduler
     _octreeSendThread = new OctreeSendThread(nodeUUID, octreeServer);
-    _octreeSendThread->initialize(true);
+    _octreeSendThread->initialize(false);
+    octreeServer->getSendScheduler()->addClient(nodeUUID);
 }
 
 bool OctreeQueryNode::packetIsDuplicate() const {
@@ -270,7 +272,7 @@ void OctreeQueryNode::dumpOutOfView() {
         while (!tempBag.isEmpty()) {
             OctreeElement* node = tempBag.extract();
             if (node->isInView(_currentViewFrustum)) {
-                nodeBag.insert(node);
+                nodeBag.insert(node, node->getEncodePriority(&_currentViewFrustum));
             }
         }
     }
@@ -17,6 +17,7 @@
 #include <CoverageMap.h>
 #include <OctreeConstants.h>
 #include <OctreeElementBag.h>
+#include <OctreeKnownState.h>
 #include <OctreeSceneStats.h>
 
 class OctreeSendThread;
@@ -50,6 +51,7 @@ public:
 
     OctreeElementBag nodeBag;
     CoverageMap map;
+    OctreeKnownState knownState; // what this client has already been sent, only kept for clients that want deltas
 
     ViewFrustum& getCurrentViewFrustum() { return _currentViewFrustum; }
     ViewFrustum& getLastKnownViewFrustum() { return _lastKnownViewFrustum; }
@@ -82,6 +84,7 @@ public:
     
     void initializeOctreeSendThread(OctreeServer* octreeServer, const QUuid& nodeUUID);
     bool isOctreeSendThreadInitalized() { return _octreeSendThread; }
+    OctreeSendThread* getOctreeSendThread() const { return _octreeSendThread; }
     
     void dumpOutOfView();
     
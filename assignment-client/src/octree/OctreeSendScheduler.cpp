@@ -0,0 +1,209 @@
+//
+//  OctreeSendScheduler.cpp
+//  octree-server
+//
+//  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
+//
+//  Shared pool of worker threads that services the per-client octree send jobs
+//
+
+#include <QtCore/QThread>
+
+#include <NodeList.h>
+#include <SharedUtil.h>
+
+#include "OctreeQueryNode.h"
+#include "OctreeSendScheduler.h"
+#include "OctreeSendThread.h"
+#include "OctreeServerConsts.h"
+
+const unsigned long MAX_IDLE_WAIT_MSECS = 100; // so that the workers notice when they are terminated
+
+OctreeSendWorker::OctreeSendWorker(OctreeSendScheduler* scheduler) :
+    _scheduler(scheduler)
+{
+}
+
+bool OctreeSendWorker::process() {
+    return _scheduler->processNextJob() && isStillRunning();
+}
+
+OctreeSendScheduler::OctreeSendScheduler(OctreeServer* myServer, int numberOfWorkers, int packetsPerInterval) :
+    _myServer(myServer),
+    _numberOfWorkers(numberOfWorkers),
+    _packetsPerInterval(packetsPerInterval),
+    _stopping(false),
+    _currentIntervalStart(0),
+    _packetsSentThisInterval(0),
+    _totalJobs(0),
+    _totalPackets(0),
+    _totalJobTime(0),
+    _totalLateness(0),
+    _maxLateness(0),
+    _totalBudgetDeferrals(0),
+    _totalMissedLocks(0)
+{
+    if (_numberOfWorkers < 1) {
+        _numberOfWorkers = std::max(1, QThread::idealThreadCount());
+    }
+}
+
+OctreeSendScheduler::~OctreeSendScheduler() {
+    stop();
+}
+
+void OctreeSendScheduler::start() {
+    _stopping = false;
+    for (int i = 0; i < _numberOfWorkers; i++) {
+        OctreeSendWorker* worker = new OctreeSendWorker(this);
+        worker->initialize(true);
+        _workers.append(worker);
+    }
+    qDebug("OctreeSendScheduler started with %d send workers, server packets per interval=%d",
+           _numberOfWorkers, _packetsPerInterval);
+}
+
+void OctreeSendScheduler::stop() {
+    _mutex.lock();
+    _stopping = true;
+    _jobAvailable.wakeAll();
+    _mutex.unlock();
+
+    foreach (OctreeSendWorker* worker, _workers) {
+        worker->terminate();
+        worker->deleteLater();
+    }
+    _workers.clear();
+}
+
+void OctreeSendScheduler::addClient(const QUuid& nodeUUID) {
+    QMutexLocker locker(&_mutex);
+    if (!_clients.contains(nodeUUID)) {
+        _clients.insert(nodeUUID);
+        _runQueue.insert(usecTimestampNow(), nodeUUID);
+        _jobAvailable.wakeOne();
+    }
+}
+
+void OctreeSendScheduler::resetStats() {
+    QMutexLocker locker(&_mutex);
+    _totalJobs = 0;
+    _totalPackets = 0;
+    _totalJobTime = 0;
+    _totalLateness = 0;
+    _maxLateness = 0;
+    _totalBudgetDeferrals = 0;
+    _totalMissedLocks = 0;
+}
+
+// NOTE: must be called with _mutex locked
+int OctreeSendScheduler::availablePacketBudget(quint64 now) {
+    if (_packetsPerInterval <= 0) {
+        return INT_MAX;
+    }
+    if (now >= _currentIntervalStart + OCTREE_SEND_INTERVAL_USECS) {
+        _currentIntervalStart = now;
+        _packetsSentThisInterval = 0;
+    }
+    return std::max(0, _packetsPerInterval - _packetsSentThisInterval);
+}
+
+bool OctreeSendScheduler::processNextJob() {
+    _mutex.lock();
+
+    if (_stopping) {
+        _mutex.unlock();
+        return false;
+    }
+
+    if (_runQueue.isEmpty()) {
+        _jobAvailable.wait(&_mutex, MAX_IDLE_WAIT_MSECS);
+        _mutex.unlock();
+        return true;
+    }
+
+    quint64 now = usecTimestampNow();
+    QMultiMap<quint64, QUuid>::iterator nextJob = _runQueue.begin();
+    quint64 deadline = nextJob.key();
+
+    if (deadline > now) {
+        // wait for the earliest deadline, we will be woken early if a client is added or rescheduled
+        unsigned long waitMsecs = std::min((unsigned long)((deadline - now) / USECS_PER_MSEC), MAX_IDLE_WAIT_MSECS);
+        if (waitMsecs > 0) {
+            _jobAvailable.wait(&_mutex, waitMsecs);
+            _mutex.unlock();
+            return true;
+        }
+        // less than a msec to go, close enough...
+    }
+
+    QUuid nodeUUID = nextJob.value();
+    _runQueue.erase(nextJob);
+
+    int packetBudget = availablePacketBudget(now);
+    if (packetBudget == 0) {
+        // the server wide budget for this interval is spent, try this client again at the start of the next interval
+        _runQueue.insert(_currentIntervalStart + OCTREE_SEND_INTERVAL_USECS, nodeUUID);
+        _totalBudgetDeferrals++;
+        _mutex.unlock();
+        return true;
+    }
+
+    _mutex.unlock();
+
+    runJob(nodeUUID, deadline, packetBudget);
+    return true;
+}
+
+void OctreeSendScheduler::runJob(const QUuid& nodeUUID, quint64 deadline, int packetBudget) {
+    quint64 start = usecTimestampNow();
+    int packetsSent = 0;
+    bool gotLock = true;
+    bool clientGone = true;
+
+    // holding the shared pointer keeps the node, and therefore its OctreeQueryNode and send state, alive during the job
+    SharedNodePointer node = NodeList::getInstance()->nodeWithUUID(nodeUUID);
+    if (node) {
+        OctreeQueryNode* nodeData = (OctreeQueryNode*) node->getLinkedData();
+        OctreeSendThread* sendThread = nodeData ? nodeData->getOctreeSendThread() : NULL;
+        if (sendThread) {
+            clientGone = false;
+            sendThread->setPacketBudget(packetBudget);
+            sendThread->threadRoutine();
+            packetsSent = sendThread->getPacketsSentLastProcess();
+            gotLock = sendThread->getGotNodeLockLastProcess();
+        }
+    }
+
+    quint64 end = usecTimestampNow();
+
+    QMutexLocker locker(&_mutex);
+
+    if (clientGone) {
+        _clients.remove(nodeUUID);
+        return;
+    }
+
+    quint64 lateness = start > deadline ? start - deadline : 0;
+    _totalJobs++;
+    _totalPackets += packetsSent;
+    _totalJobTime += end - start;
+    _totalLateness += lateness;
+    _maxLateness = std::max(_maxLateness, lateness);
+    _packetsSentThisInterval += packetsSent;
+
+    quint64 nextDeadline;
+    if (gotLock) {
+        // don't try to catch up on intervals we've missed, that would only starve the other clients
+        nextDeadline = std::max(deadline + OCTREE_SEND_INTERVAL_USECS, end);
+    } else {
+        // something else had the node locked, try again as soon as possible
+        _totalMissedLocks++;
+        nextDeadline = end;
+    }
+
+    if (!_stopping) {
+        _runQueue.insert(nextDeadline, nodeUUID);
+        _jobAvailable.wakeOne();
+    }
+}
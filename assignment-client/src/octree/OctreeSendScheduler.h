@@ -0,0 +1,104 @@
+//
+//  OctreeSendScheduler.h
+//  octree-server
+//
+//  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
+//
+//  Shared pool of worker threads that services the per-client octree send jobs
+//
+
+#ifndef __octree_server__OctreeSendScheduler__
+#define __octree_server__OctreeSendScheduler__
+
+#include <QtCore/QMultiMap>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
+#include <QtCore/QUuid>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+#include <GenericThread.h>
+
+class OctreeSendScheduler;
+class OctreeServer;
+
+/// Worker thread for the OctreeSendScheduler, runs whichever client send job is due next.
+class OctreeSendWorker : public GenericThread {
+public:
+    OctreeSendWorker(OctreeSendScheduler* scheduler);
+
+protected:
+    /// Implements generic processing behavior for this thread.
+    virtual bool process();
+
+private:
+    OctreeSendScheduler* _scheduler;
+};
+
+/// Schedules the per-client OctreeSendThread work across a fixed size pool of worker threads. Each client has a single
+/// entry in a deadline ordered run queue, workers always run the client with the earliest deadline and then reschedule
+/// it one send interval later. This replaces having a dedicated, usleep()ing thread per client. In addition to each
+/// client's packets per interval, an optional server wide packets per interval budget is shared across all clients.
+class OctreeSendScheduler {
+public:
+    /// \param int numberOfWorkers number of worker threads, if < 1 then QThread::idealThreadCount() is used
+    /// \param int packetsPerInterval server wide packets per interval budget, 0 means no limit
+    OctreeSendScheduler(OctreeServer* myServer, int numberOfWorkers = 0, int packetsPerInterval = 0);
+    ~OctreeSendScheduler();
+
+    /// Starts the worker threads
+    void start();
+
+    /// Stops and deletes the worker threads
+    void stop();
+
+    /// Adds a client to the run queue, the client will be dropped automatically once its node goes away
+    void addClient(const QUuid& nodeUUID);
+
+    /// Called by the workers, waits for the next job to be due and runs it. Returns false if the scheduler is stopping.
+    bool processNextJob();
+
+    int getWorkerCount() const { return _workers.size(); }
+    int getClientCount() const { return _clients.size(); }
+    int getPacketsPerInterval() const { return _packetsPerInterval; }
+
+    quint64 getTotalJobs() const { return _totalJobs; }
+    quint64 getTotalPackets() const { return _totalPackets; }
+    quint64 getTotalBudgetDeferrals() const { return _totalBudgetDeferrals; }
+    quint64 getTotalMissedLocks() const { return _totalMissedLocks; }
+    quint64 getAverageJobTime() const { return _totalJobs == 0 ? 0 : _totalJobTime / _totalJobs; }
+    quint64 getAverageLateness() const { return _totalJobs == 0 ? 0 : _totalLateness / _totalJobs; }
+    quint64 getMaxLateness() const { return _maxLateness; }
+
+    void resetStats();
+
+private:
+    void runJob(const QUuid& nodeUUID, quint64 deadline, int packetBudget);
+    int availablePacketBudget(quint64 now);
+
+    OctreeServer* _myServer;
+    int _numberOfWorkers;
+    int _packetsPerInterval;
+
+    QMutex _mutex;
+    QWaitCondition _jobAvailable;
+    QMultiMap<quint64, QUuid> _runQueue; // keyed by deadline
+    QSet<QUuid> _clients;
+    QVector<OctreeSendWorker*> _workers;
+    bool _stopping;
+
+    // server wide budget
+    quint64 _currentIntervalStart;
+    int _packetsSentThisInterval;
+
+    // stats
+    quint64 _totalJobs;
+    quint64 _totalPackets;
+    quint64 _totalJobTime;
+    quint64 _totalLateness;
+    quint64 _maxLateness;
+    quint64 _totalBudgetDeferrals;
+    quint64 _totalMissedLocks;
+};
+
+#endif // __octree_server__OctreeSendScheduler__
@@ -20,13 +20,17 @@ quint64 endSceneSleepTime = 0;
 OctreeSendThread::OctreeSendThread(const QUuid& nodeUUID, OctreeServer* myServer) :
     _nodeUUID(nodeUUID),
     _myServer(myServer),
-    _packetData()
+    _packetData(),
+    _packetBudget(INT_MAX),
+    _packetsSentLastProcess(0),
+    _gotNodeLockLastProcess(false)
 {
 }
 
 bool OctreeSendThread::process() {
     quint64  start = usecTimestampNow();
     bool gotLock = false;
+    _packetsSentLastProcess = 0;
 
     // don't do any send processing until the initial load of the octree is complete...
     if (_myServer->isInitialLoadComplete()) {
@@ -52,6 +56,8 @@ bool OctreeSendThread::process() {
                 }
 
                 node->getMutex().unlock(); // we're done with this node for now.
+
+                _packetsSentLastProcess = packetsSent;
             }
         }
     } else {
@@ -60,8 +66,12 @@ bool OctreeSendThread::process() {
         }
     }
 
-    // Only sleep if we're still running and we got the lock last time we tried, otherwise try to get the lock asap
-    if (isStillRunning() && gotLock) {
+    // Except when we're not loaded yet, the scheduler treats a missed node lock as a reason to retry asap
+    _gotNodeLockLastProcess = gotLock || !_myServer->isInitialLoadComplete();
+
+    // When threaded, only sleep if we're still running and we got the lock last time we tried, otherwise try to get the
+    // lock asap. When non-threaded, the OctreeSendScheduler takes care of the pacing.
+    if (isThreaded() && isStillRunning() && gotLock) {
         // dynamically sleep until we need to fire off the next set of octree elements
         int elapsed = (usecTimestampNow() - start);
         int usecToSleep =  OCTREE_SEND_INTERVAL_USECS - elapsed;
@@ -381,6 +391,7 @@ int OctreeSendThread::packetDistributor(const SharedNodePointer& node, OctreeQue
 
         int clientMaxPacketsPerInterval = std::max(1,(nodeData->getMaxOctreePacketsPerSecond() / INTERVALS_PER_SECOND));
         int maxPacketsPerInterval = std::min(clientMaxPacketsPerInterval, _myServer->getPacketsPerClientPerInterval());
+        maxPacketsPerInterval = std::min(maxPacketsPerInterval, _packetBudget);
 
         if (_myServer->wantsDebugSending() && _myServer->wantsVerboseDebug()) {
             qDebug("truePacketsSent=%d packetsSentThisInterval=%d maxPacketsPerInterval=%d server PPI=%d nodePPS=%d nodePPI=%d",
@@ -399,6 +410,9 @@ int OctreeSendThread::packetDistributor(const SharedNodePointer& node, OctreeQue
 
             bool lastNodeDidntFit = false; // assume each node fits
             if (!nodeData->nodeBag.isEmpty()) {
+                // with snapshot reads enabled this doesn't take the tree lock, so we won't stall behind edits. We enter
+                // the snapshot before extracting so that the element can't be reclaimed out from under us.
+                quint64 snapshotToken = _myServer->getOctree()->beginSnapshotRead();
                 OctreeElement* subTree = nodeData->nodeBag.extract();
                 bool wantOcclusionCulling = nodeData->getWantOcclusionCulling();
                 CoverageMap* coverageMap = wantOcclusionCulling ? &nodeData->map : IGNORE_COVERAGE_MAP;
@@ -418,9 +432,15 @@ int OctreeSendThread::packetDistributor(const SharedNodePointer& node, OctreeQue
                                              wantOcclusionCulling, coverageMap, boundaryLevelAdjust, voxelSizeScale,
                                              nodeData->getLastTimeBagEmpty(),
                                              isFullScene, &nodeData->stats, _myServer->getJurisdiction());
+                params.encodeCache = _myServer->getEncodeCache();
 
+                // clients that want deltas keep what we send them, so we can skip the subtrees they already have
+                if (nodeData->getWantDelta() && wantColor) {
+                    params.knownState = &nodeData->knownState;
+                } else if (nodeData->knownState.getKnownSubtreeCount() > 0) {
+                    nodeData->knownState.clear();
+                }
 
-                _myServer->getOctree()->lockForRead();
                 nodeData->stats.encodeStarted();
                 bytesWritten = _myServer->getOctree()->encodeTreeBitstream(subTree, &_packetData, nodeData->nodeBag, params);
 
@@ -446,7 +466,7 @@ int OctreeSendThread::packetDistributor(const SharedNodePointer& node, OctreeQue
                 }
 
                 nodeData->stats.encodeStopped();
-                _myServer->getOctree()->unlock();
+                _myServer->getOctree()->endSnapshotRead(snapshotToken);
             } else {
                 // If the bag was empty then we didn't even attempt to encode, and so we know the bytesWritten were 0
                 bytesWritten = 0;
@@ -16,11 +16,18 @@
 #include "OctreeQueryNode.h"
 #include "OctreeServer.h"
 
-/// Threaded processor for sending voxel packets to a single client
+/// Processor for sending voxel packets to a single client. Normally runs non-threaded, driven once per send interval by
+/// the server's OctreeSendScheduler, but can still run on its own thread.
 class OctreeSendThread : public GenericThread {
 public:
     OctreeSendThread(const QUuid& nodeUUID, OctreeServer* myServer);
 
+    /// Limits the number of packets the next process() may send, used by the scheduler's server wide budget
+    void setPacketBudget(int packetBudget) { _packetBudget = packetBudget; }
+
+    int getPacketsSentLastProcess() const { return _packetsSentLastProcess; }
+    bool getGotNodeLockLastProcess() const { return _gotNodeLockLastProcess; }
+
     static quint64 _totalBytes;
     static quint64 _totalWastedBytes;
     static quint64 _totalPackets;
@@ -40,6 +47,10 @@ private:
     int packetDistributor(const SharedNodePointer& node, OctreeQueryNode* nodeData, bool viewFrustumChanged);
 
     OctreePacketData _packetData;
+
+    int _packetBudget;
+    int _packetsSentLastProcess;
+    bool _gotNodeLockLastProcess;
 };
 
 #endif // __octree_server__OctreeSendThread__
@@ -13,6 +13,10 @@
 #include <time.h>
 #include <HTTPConnection.h>
 #include <Logging.h>
+#include <OctreeEncodeCache.h>
+#include <OctreeEpochManager.h>
+#include <OctreeMemoryPool.h>
+#include <PacketBufferPool.h>
 #include <UUID.h>
 
 #include "OctreeServer.h"
@@ -44,6 +48,8 @@ OctreeServer::OctreeServer(const QByteArray& packet) :
     _jurisdictionSender(NULL),
     _octreeInboundPacketProcessor(NULL),
     _persistThread(NULL),
+    _sendScheduler(NULL),
+    _encodeCache(NULL),
     _started(time(0)),
     _startedUSecs(usecTimestampNow())
 {
@@ -58,6 +64,12 @@ OctreeServer::~OctreeServer() {
         delete[] _parsedArgV;
     }
 
+    if (_sendScheduler) {
+        _sendScheduler->stop();
+        delete _sendScheduler;
+        _sendScheduler = NULL;
+    }
+
     if (_jurisdictionSender) {
         _jurisdictionSender->terminate();
         _jurisdictionSender->deleteLater();
@@ -76,6 +88,10 @@ OctreeServer::~OctreeServer() {
     delete _jurisdiction;
     _jurisdiction = NULL;
 
+    // the send workers are stopped and the other threads have been told to terminate, so nothing is encoding anymore
+    delete _encodeCache;
+    _encodeCache = NULL;
+
     qDebug() << "OctreeServer::run()... DONE";
 }
 
@@ -115,6 +131,12 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
             showStats = true;
         } else if (path == "/resetStats") {
             _octreeInboundPacketProcessor->resetStats();
+            if (_sendScheduler) {
+                _sendScheduler->resetStats();
+            }
+            if (_encodeCache) {
+                _encodeCache->resetStats();
+            }
             showStats = true;
         }
     }
@@ -192,6 +214,33 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
             }
             statsString += "\r\n";
 
+            if (_persistThread && _persistThread->isIndexedFile()) {
+                statsString += "\r\n";
+                statsString += QString("%1 Indexed Persist File...\r\n").arg(getMyServerName());
+                if (_persistThread->isLazyLoadComplete()) {
+                    statsString += QString("  All Subtrees Loaded In: %1 usecs\r\n")
+                        .arg(QString::number(_persistThread->getLazyLoadElapsedTime()).rightJustified(16, ' '));
+                } else {
+                    statsString += QString("  Subtrees Left To Load: %1 subtrees\r\n")
+                        .arg(QString::number(_tree->getUnloadedSubtreeCount()).rightJustified(16, ' '));
+                }
+            }
+
+            if (_persistThread && _persistThread->isJournalEnabled()) {
+                statsString += "\r\n";
+                statsString += QString("%1 Edit Journal Enabled...\r\n").arg(getMyServerName());
+                statsString += QString("     Replayed At Load: %1 packets\r\n")
+                    .arg(QString::number(_persistThread->getReplayedPackets()).rightJustified(16, ' '));
+                statsString += QString("      Total Journaled: %1 packets\r\n")
+                    .arg(QString::number(_persistThread->getTotalJournaledPackets()).rightJustified(16, ' '));
+                statsString += QString("         Journal Size: %1 bytes\r\n")
+                    .arg(QString::number(_persistThread->getJournalSize()).rightJustified(16, ' '));
+                statsString += QString("    Total Checkpoints: %1 checkpoints\r\n")
+                    .arg(QString::number(_persistThread->getTotalCheckpoints()).rightJustified(16, ' '));
+                statsString += QString("      Last Checkpoint: %1 usecs\r\n")
+                    .arg(QString::number(_persistThread->getLastCheckpointElapsedTime()).rightJustified(16, ' '));
+            }
+
         } else {
             statsString += "Voxels not yet loaded...\r\n";
         }
@@ -253,6 +302,66 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
         statsString += "\r\n";
         statsString += "\r\n";
 
+        // display send scheduler stats
+        if (_sendScheduler) {
+            statsString += QString("<b>%1 Send Scheduler Statistics...</b>\r\n").arg(getMyServerName());
+            statsString += QString("                     Send Workers: %1 threads\r\n")
+                .arg(locale.toString(_sendScheduler->getWorkerCount()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("                Scheduled Clients: %1 clients\r\n")
+                .arg(locale.toString(_sendScheduler->getClientCount()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("       Packets/Client/Interval: %1 packets\r\n")
+                .arg(locale.toString(getPacketsPerClientPerInterval()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("       Packets/Server/Interval: %1\r\n")
+                .arg(_sendScheduler->getPacketsPerInterval() > 0
+                     ? locale.toString(_sendScheduler->getPacketsPerInterval()).rightJustified(COLUMN_WIDTH, ' ')
+                     : QString("unlimited").rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("                  Total Send Jobs: %1 jobs\r\n")
+                .arg(locale.toString((uint)_sendScheduler->getTotalJobs()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("             Total Packets Queued: %1 packets\r\n")
+                .arg(locale.toString((uint)_sendScheduler->getTotalPackets()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("            Average Time/Send Job: %1 usecs\r\n")
+                .arg(locale.toString((uint)_sendScheduler->getAverageJobTime()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("         Average Lateness/Send Job: %1 usecs\r\n")
+                .arg(locale.toString((uint)_sendScheduler->getAverageLateness()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("             Max Lateness/Send Job: %1 usecs\r\n")
+                .arg(locale.toString((uint)_sendScheduler->getMaxLateness()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("          Server Budget Deferrals: %1 jobs\r\n")
+                .arg(locale.toString((uint)_sendScheduler->getTotalBudgetDeferrals()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("               Missed Node Locks: %1 jobs\r\n")
+                .arg(locale.toString((uint)_sendScheduler->getTotalMissedLocks()).rightJustified(COLUMN_WIDTH, ' '));
+
+            statsString += "\r\n";
+            statsString += "\r\n";
+        }
+
+        // display encode cache stats
+        if (_encodeCache) {
+            statsString += QString("<b>%1 Encode Cache Statistics...</b>\r\n").arg(getMyServerName());
+            statsString += QString("                          Entries: %1 subtrees\r\n")
+                .arg(locale.toString(_encodeCache->getEntryCount()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("                       Bytes Held: %1 bytes\r\n")
+                .arg(locale.toString((uint)_encodeCache->getBytesHeld()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("                        Max Bytes: %1 bytes\r\n")
+                .arg(locale.toString((uint)_encodeCache->getMaxBytes()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("                          Lookups: %1 subtrees\r\n")
+                .arg(locale.toString((uint)_encodeCache->getLookups()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("                             Hits: %1 subtrees\r\n")
+                .arg(locale.toString((uint)_encodeCache->getHits()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString().sprintf("                         Hit Rate: %10.2f %%\r\n",
+                                             _encodeCache->getHitRate() * AS_PERCENT);
+            statsString += QString("                      Bytes Saved: %1 bytes\r\n")
+                .arg(locale.toString((uint)_encodeCache->getBytesSaved()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("                          Encodes: %1 subtrees\r\n")
+                .arg(locale.toString((uint)_encodeCache->getEncodes()).rightJustified(COLUMN_WIDTH, ' '));
+            statsString += QString("                    Invalidations: %1 entries\r\n")
+                .arg(locale.toString((uint)_encodeCache->getInvalidations()).rightJustified(COLUMN_WIDTH, ' '));
+
+            statsString += "\r\n";
+            statsString += "\r\n";
+        }
+
+        statsString += getMyServerStats();
+
         // display inbound packet stats
         statsString += QString().sprintf("<b>%s Edit Statistics... <a href='/resetStats'>[RESET]</a></b>\r\n",
                                          getMyServerName());
@@ -281,6 +390,36 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
             .arg(locale.toString((uint)averageProcessTimePerElement).rightJustified(COLUMN_WIDTH, ' '));
         statsString += QString("  Average Wait Lock Time/Element: %1 usecs\r\n")
             .arg(locale.toString((uint)averageLockWaitTimePerElement).rightJustified(COLUMN_WIDTH, ' '));
+        statsString += QString("         Elements Applied/Second: %1 elements/sec\r\n")
+            .arg(locale.toString((uint)_octreeInboundPacketProcessor->getElementsPerSecond())
+                 .rightJustified(COLUMN_WIDTH, ' '));
+        statsString += QString("              Total Edit Batches: %1 batches\r\n")
+            .arg(locale.toString((uint)_octreeInboundPacketProcessor->getTotalEditBatches())
+                 .rightJustified(COLUMN_WIDTH, ' '));
+        statsString += QString().sprintf("  Average Inbound Elements/Batch: %f elements/batch\r\n",
+                                         _octreeInboundPacketProcessor->getAverageElementsPerBatch());
+        statsString += QString("    Average Write Lock Hold Time: %1 usecs\r\n")
+            .arg(locale.toString((uint)_octreeInboundPacketProcessor->getAverageLockHoldTime())
+                 .rightJustified(COLUMN_WIDTH, ' '));
+        statsString += QString("             Inbound Queue Depth: %1 packets\r\n")
+            .arg(locale.toString((uint)_octreeInboundPacketProcessor->packetsToProcessCount())
+                 .rightJustified(COLUMN_WIDTH, ' '));
+        statsString += QString("       Average Queue Wait/Packet: %1 usecs\r\n")
+            .arg(locale.toString((uint)_octreeInboundPacketProcessor->getAverageQueueWaitTime())
+                 .rightJustified(COLUMN_WIDTH, ' '));
+        statsString += QString("           Max Queue Wait/Packet: %1 usecs\r\n")
+            .arg(locale.toString((uint)_octreeInboundPacketProcessor->getMaxQueueWaitTime())
+                 .rightJustified(COLUMN_WIDTH, ' '));
+        statsString += QString("         Dropped Inbound Packets: %1 packets\r\n")
+            .arg(locale.toString((uint)_octreeInboundPacketProcessor->getDroppedPackets())
+                 .rightJustified(COLUMN_WIDTH, ' '));
+
+        PacketBufferPool& packetBufferPool = PacketBufferPool::getInstance();
+        statsString += QString("           Packet Buffers In Use: %1 buffers\r\n")
+            .arg(locale.toString((uint)packetBufferPool.getNumInUse()).rightJustified(COLUMN_WIDTH, ' '));
+        statsString += QString("        Packet Buffers Allocated: %1 of %2 buffers\r\n")
+            .arg(locale.toString((uint)packetBufferPool.getNumAllocated()).rightJustified(COLUMN_WIDTH, ' '))
+            .arg(locale.toString((uint)packetBufferPool.getMaxBuffers()));
 
 
         int senderNumber = 0;
@@ -352,6 +491,38 @@ bool OctreeServer::handleHTTPRequest(HTTPConnection* connection, const QString&
                                          OctreeElement::getTotalMemoryUsage() / memoryScale, memoryScaleLabel);
         statsString += "\r\n";
 
+        // what the same elements would cost allocated one at a time, versus what the slab pools actually hold
+        const int MALLOC_OVERHEAD_PER_ALLOCATION = 16;
+        quint64 elementCount = std::max((quint64)OctreeElement::getNodeCount(), (quint64)1);
+        quint64 unpooledBytes = OctreeElement::getTotalMemoryUsage()
+                                    + OctreeMemoryPool::getTotalBlocksInUse() * MALLOC_OVERHEAD_PER_ALLOCATION;
+        quint64 pooledBytes = OctreeMemoryPool::getTotalReservedBytes() + OctreeElement::getUnpooledOctcodeMemoryUsage();
+        statsString += QString().sprintf("Unpooled Estimate Per Voxel:     %8.2f bytes\r\n",
+                                         (float)unpooledBytes / elementCount);
+        statsString += QString().sprintf("Pooled Bytes Per Voxel:          %8.2f bytes\r\n",
+                                         (float)pooledBytes / elementCount);
+        foreach (OctreeMemoryPool* pool, OctreeMemoryPool::getPools()) {
+            statsString += QString().sprintf("   %-18s %12llu blocks in use, %5d slabs, %8.2f %s reserved\r\n",
+                                             qPrintable(QString(pool->getName()) + ":"),
+                                             pool->getBlocksInUse(), pool->getSlabCount(),
+                                             pool->getReservedBytes() / memoryScale, memoryScaleLabel);
+        }
+        statsString += "\r\n";
+
+        if (_tree->getWantSnapshotReads()) {
+            OctreeEpochManager* epochManager = OctreeEpochManager::getInstance();
+            statsString += "Snapshot Reads Enabled...\r\n";
+            statsString += QString("      Active Snapshot Readers: %1 readers\r\n")
+                .arg(locale.toString(epochManager->getActiveReaders()).rightJustified(16, ' '));
+            statsString += QString("   Retired Waiting to Reclaim: %1 items\r\n")
+                .arg(locale.toString((uint)epochManager->getPendingCount()).rightJustified(16, ' '));
+            statsString += QString("                Total Retired: %1 items\r\n")
+                .arg(locale.toString((uint)epochManager->getTotalRetired()).rightJustified(16, ' '));
+            statsString += QString("              Total Reclaimed: %1 items\r\n")
+                .arg(locale.toString((uint)epochManager->getTotalReclaimed()).rightJustified(16, ' '));
+            statsString += "\r\n";
+        }
+
         statsString += "OctreeElement Children Population Statistics...\r\n";
         checkSum = 0;
         for (int i=0; i <= NUMBER_OF_CHILDREN; i++) {
@@ -572,6 +743,33 @@ void OctreeServer::run() {
     _debugReceiving =  cmdOptionExists(_argc, _argv, DEBUG_RECEIVING);
     qDebug("debugReceiving=%s", debug::valueOf(_debugReceiving));
 
+    // Snapshot reads let our send workers encode without waiting on the tree lock while edits are being applied
+    const char* SNAPSHOT_READS = "--snapshotReads";
+    if (cmdOptionExists(_argc, _argv, SNAPSHOT_READS)) {
+        _tree->setWantSnapshotReads(true);
+    }
+    qDebug("snapshotReads=%s", debug::valueOf(_tree->getWantSnapshotReads()));
+
+    // Folding packs the subtrees nobody has edited in a while into a few bytes per voxel, so we can hold more of them
+    const char* FOLD_SUBTREES = "--foldSubtrees";
+    if (cmdOptionExists(_argc, _argv, FOLD_SUBTREES)) {
+        _tree->setWantFolding(true);
+    }
+    qDebug("foldSubtrees=%s", debug::valueOf(_tree->getWantFolding()));
+
+    // The encode cache lets clients looking at the same region share one encoding of it, it's off unless given a size.
+    // NOTE: it registers element hooks, so it must be created before the persist and send threads start.
+    const char* ENCODE_CACHE_SIZE = "--encodeCacheSize";
+    const char* encodeCacheSizeOption = getCmdOption(_argc, _argv, ENCODE_CACHE_SIZE);
+    if (encodeCacheSizeOption) {
+        int encodeCacheMegabytes = atoi(encodeCacheSizeOption);
+        if (encodeCacheMegabytes > 0) {
+            const quint64 BYTES_PER_MEGABYTE = 1024 * 1024;
+            _encodeCache = new OctreeEncodeCache(encodeCacheMegabytes * BYTES_PER_MEGABYTE);
+        }
+    }
+    qDebug("encodeCacheSize=%llu bytes", _encodeCache ? _encodeCache->getMaxBytes() : 0);
+
     // By default we will persist, if you want to disable this, then pass in this parameter
     const char* NO_PERSIST = "--NoPersist";
     if (cmdOptionExists(_argc, _argv, NO_PERSIST)) {
@@ -593,8 +791,28 @@ void OctreeServer::run() {
 
         qDebug("persistFilename=%s", _persistFilename);
 
+        // By default edits are journaled and the whole tree is only checkpointed occasionally, for trees that support it
+        const char* NO_PERSIST_JOURNAL = "--NoPersistJournal";
+        bool wantPersistJournal = !cmdOptionExists(_argc, _argv, NO_PERSIST_JOURNAL);
+
+        int checkpointInterval = OctreePersistThread::DEFAULT_CHECKPOINT_INTERVAL;
+        const char* CHECKPOINT_INTERVAL = "--checkpointInterval";
+        const char* checkpointIntervalOption = getCmdOption(_argc, _argv, CHECKPOINT_INTERVAL);
+        if (checkpointIntervalOption) {
+            checkpointInterval = atoi(checkpointIntervalOption);
+            qDebug("checkpointInterval=%s", checkpointIntervalOption);
+        }
+
+        // Indexed persist files let the server start serving before the whole tree is loaded. Existing indexed files are
+        // always loaded lazily, this option makes checkpoints convert a plain persist file.
+        const char* PERSIST_INDEXED = "--persistIndexed";
+        bool wantPersistIndexed = cmdOptionExists(_argc, _argv, PERSIST_INDEXED);
+        qDebug("wantPersistIndexed=%s", debug::valueOf(wantPersistIndexed));
+
         // now set up PersistThread
-        _persistThread = new OctreePersistThread(_tree, _persistFilename);
+        _persistThread = new OctreePersistThread(_tree, _persistFilename, OctreePersistThread::DEFAULT_PERSIST_INTERVAL,
+                                                 wantPersistJournal, checkpointInterval, wantPersistIndexed);
+        qDebug("wantPersistJournal=%s", debug::valueOf(_persistThread->isJournalEnabled()));
         if (_persistThread) {
             _persistThread->initialize(true);
         }
@@ -622,6 +840,29 @@ void OctreeServer::run() {
         qDebug("packetsPerSecond=%s PACKETS_PER_CLIENT_PER_INTERVAL=%d", packetsPerSecond, _packetsPerClientPerInterval);
     }
 
+    // Check to see if the user passed in a command line option for limiting the total packet send rate of the server
+    int packetsPerServerPerInterval = 0; // unlimited
+    const char* TOTAL_PACKETS_PER_SECOND = "--totalPacketsPerSecond";
+    const char* totalPacketsPerSecond = getCmdOption(_argc, _argv, TOTAL_PACKETS_PER_SECOND);
+    if (totalPacketsPerSecond) {
+        packetsPerServerPerInterval = std::max(1, atoi(totalPacketsPerSecond) / INTERVALS_PER_SECOND);
+        qDebug("totalPacketsPerSecond=%s PACKETS_PER_SERVER_PER_INTERVAL=%d",
+               totalPacketsPerSecond, packetsPerServerPerInterval);
+    }
+
+    // Check to see if the user passed in a command line option for the number of send worker threads
+    int sendThreads = 0; // default to the number of cores
+    const char* SEND_THREADS = "--sendThreads";
+    const char* sendThreadsOption = getCmdOption(_argc, _argv, SEND_THREADS);
+    if (sendThreadsOption) {
+        sendThreads = atoi(sendThreadsOption);
+        qDebug("sendThreads=%s", sendThreadsOption);
+    }
+
+    // set up the shared pool that sends octree packets to all of our clients
+    _sendScheduler = new OctreeSendScheduler(this, sendThreads, packetsPerServerPerInterval);
+    _sendScheduler->start();
+
     HifiSockAddr senderSockAddr;
 
     // set up our jurisdiction broadcaster...
@@ -20,10 +20,13 @@
 #include <EnvironmentData.h>
 
 #include "OctreePersistThread.h"
+#include "OctreeSendScheduler.h"
 #include "OctreeSendThread.h"
 #include "OctreeServerConsts.h"
 #include "OctreeInboundPacketProcessor.h"
 
+class OctreeEncodeCache;
+
 /// Handles assignments of type OctreeServer - sending octrees to various clients.
 class OctreeServer : public ThreadedAssignment, public HTTPRequestHandler {
     Q_OBJECT
@@ -42,10 +45,13 @@ public:
     JurisdictionMap* getJurisdiction() { return _jurisdiction; }
 
     int getPacketsPerClientPerInterval() const { return _packetsPerClientPerInterval; }
+    OctreeSendScheduler* getSendScheduler() { return _sendScheduler; }
+    OctreeEncodeCache* getEncodeCache() { return _encodeCache; }
 
     bool isInitialLoadComplete() const { return (_persistThread) ? _persistThread->isInitialLoadComplete() : true; }
     bool isPersistEnabled() const { return (_persistThread) ? true : false; }
     quint64 getLoadElapsedTime() const { return (_persistThread) ? _persistThread->getLoadElapsedTime() : 0; }
+    OctreePersistThread* getPersistThread() { return _persistThread; }
 
     // Subclasses must implement these methods
     virtual OctreeQueryNode* createOctreeQueryNode() = 0;
@@ -61,6 +67,9 @@ public:
     virtual bool hasSpecialPacketToSend(const SharedNodePointer& node) { return false; }
     virtual int sendSpecialPacket(const SharedNodePointer& node) { return 0; }
 
+    /// \return stats of the particular kind of server, for the stats page
+    virtual QString getMyServerStats() { return QString(); }
+
     static void attachQueryNodeToNode(Node* newNode);
 
     bool handleHTTPRequest(HTTPConnection* connection, const QString& path);
@@ -90,6 +99,8 @@ protected:
     JurisdictionSender* _jurisdictionSender;
     OctreeInboundPacketProcessor* _octreeInboundPacketProcessor;
     OctreePersistThread* _persistThread;
+    OctreeSendScheduler* _sendScheduler;
+    OctreeEncodeCache* _encodeCache;
 
     static OctreeServer* _instance;
 
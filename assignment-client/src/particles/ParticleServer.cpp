@@ -6,6 +6,7 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <QLocale>
 #include <QTimer>
 #include <ParticleTree.h>
 
@@ -17,13 +18,20 @@ const char* PARTICLE_SERVER_NAME = "Particle";
 const char* PARTICLE_SERVER_LOGGING_TARGET_NAME = "particle-server";
 const char* LOCAL_PARTICLES_PERSIST_FILE = "resources/particles.svo";
 
-ParticleServer::ParticleServer(const QByteArray& packet) : OctreeServer(packet) {
-    // nothing special to do here...
+ParticleServer::ParticleServer(const QByteArray& packet) :
+    OctreeServer(packet),
+    _updateWorkerPool() {
 }
 
 ParticleServer::~ParticleServer() {
     ParticleTree* tree = (ParticleTree*)_tree;
     tree->removeNewlyCreatedHook(this);
+
+    // the persist thread may be in the middle of an update with our workers
+    tree->lockForWrite();
+    tree->setUpdateWorkerPool(NULL);
+    tree->unlock();
+    _updateWorkerPool.stop();
 }
 
 OctreeQueryNode* ParticleServer::createOctreeQueryNode() {
@@ -37,6 +45,10 @@ Octree* ParticleServer::createTree() {
 }
 
 void ParticleServer::beforeRun() {
+    // the particles are simulated on the persist thread, spread that across the cores
+    _updateWorkerPool.start();
+    static_cast<ParticleTree*>(_tree)->setUpdateWorkerPool(&_updateWorkerPool);
+
     QTimer* pruneDeletedParticlesTimer = new QTimer(this);
     connect(pruneDeletedParticlesTimer, SIGNAL(timeout()), this, SLOT(pruneDeletedParticles()));
     const int PRUNE_DELETED_PARTICLES_INTERVAL_MSECS = 1 * 1000; // once every second
@@ -112,6 +124,22 @@ int ParticleServer::sendSpecialPacket(const SharedNodePointer& node) {
     return packetLength;
 }
 
+QString ParticleServer::getMyServerStats() {
+    ParticleTree* tree = static_cast<ParticleTree*>(_tree);
+    QLocale locale(QLocale::English);
+    const int COLUMN_WIDTH = 10;
+    QString statsString = QString("<b>%1 Script Statistics...</b>\r\n").arg(getMyServerName());
+    statsString += QString("      Script Callbacks Last Tick: %1 callbacks\r\n")
+        .arg(locale.toString(tree->getLastTickCallbacks()).rightJustified(COLUMN_WIDTH, ' '));
+    statsString += QString("           Script Time Last Tick: %1 usecs\r\n")
+        .arg(locale.toString((uint)tree->getLastTickScriptUsecs()).rightJustified(COLUMN_WIDTH, ' '));
+    statsString += QString("               Total Script Time: %1 usecs\r\n")
+        .arg(locale.toString((qulonglong)tree->getTotalScriptUsecs()).rightJustified(COLUMN_WIDTH, ' '));
+    statsString += "\r\n";
+    statsString += "\r\n";
+    return statsString;
+}
+
 void ParticleServer::pruneDeletedParticles() {
     ParticleTree* tree = static_cast<ParticleTree*>(_tree);
     if (tree->hasAnyDeletedParticles()) {
@@ -10,6 +10,8 @@
 #ifndef __particle_server__ParticleServer__
 #define __particle_server__ParticleServer__
 
+#include <WorkerPool.h>
+
 #include "../octree/OctreeServer.h"
 
 #include "Particle.h"
@@ -36,6 +38,7 @@ public:
     virtual void beforeRun();
     virtual bool hasSpecialPacketToSend(const SharedNodePointer& node);
     virtual int sendSpecialPacket(const SharedNodePointer& node);
+    virtual QString getMyServerStats();
 
     virtual void particleCreated(const Particle& newParticle, const SharedNodePointer& senderNode);
 
@@ -43,6 +46,7 @@ public slots:
     void pruneDeletedParticles();
 
 private:
+    WorkerPool _updateWorkerPool;
 };
 
 #endif // __particle_server__ParticleServer__
@@ -3284,7 +3284,7 @@ void Application::displayStats() {
     verticalOffset = 0;
     horizontalOffset = _glWidget->width() - (mirrorEnabled ? 300 : 410);
 
-    lines = _statsExpanded ? 11 : 3;
+    lines = _statsExpanded ? 13 : 3;
     displayStatsBackground(backgroundColor, horizontalOffset, 0, _glWidget->width() - horizontalOffset, lines * STATS_PELS_PER_LINE + 10);
     horizontalOffset += 5;
 
@@ -3371,12 +3371,33 @@ void Application::displayStats() {
         voxelStats.str("");
         QString packetsString = locale.toString((int)voxelPacketsToProcess);
         QString maxString = locale.toString((int)_recentMaxPackets);
+        QString droppedString = locale.toString((int)_voxelProcessor.getPacketRing().getDroppedPackets());
         voxelStats << "Voxel Packets to Process: " << packetsString.toLocal8Bit().constData()
-                    << " [Recent Max: " << maxString.toLocal8Bit().constData() << "]";        
+                    << " [Recent Max: " << maxString.toLocal8Bit().constData() << "]"
+                    << " [Dropped: " << droppedString.toLocal8Bit().constData() << "]";
         verticalOffset += STATS_PELS_PER_LINE;
         drawtext(horizontalOffset, verticalOffset, 0.10f, 0, 1.0, 2, (char*)voxelStats.str().c_str(), .93f, .93f, .93f);
     }
 
+    // Outgoing edit packets
+    if (_statsExpanded) {
+        const PacketSender* editSenders[] = { &_voxelEditSender, &_particleEditSender };
+        const char* editSenderNames[] = { "Voxel", "Particle" };
+        for (int i = 0; i < 2; i++) {
+            QString toSendString = locale.toString(editSenders[i]->packetsToSendCount());
+            QString waitString = locale.toString((uint)editSenders[i]->getAverageQueueWaitTime());
+            QString maxWaitString = locale.toString((uint)editSenders[i]->getMaxQueueWaitTime());
+            QString droppedString = locale.toString(editSenders[i]->getDroppedPackets());
+            voxelStats.str("");
+            voxelStats << editSenderNames[i] << " Edits to Send: " << toSendString.toLocal8Bit().constData()
+                << " [Wait: " << waitString.toLocal8Bit().constData()
+                << " usecs, Max: " << maxWaitString.toLocal8Bit().constData()
+                << "] [Dropped: " << droppedString.toLocal8Bit().constData() << "]";
+            verticalOffset += STATS_PELS_PER_LINE;
+            drawtext(horizontalOffset, verticalOffset, 0.10f, 0, 1.0, 2, (char*)voxelStats.str().c_str(), .93f, .93f, .93f);
+        }
+    }
+
     if (_resetRecentMaxPacketsSoon && voxelPacketsToProcess > 0) {
         _recentMaxPackets = 0;
         _resetRecentMaxPacketsSoon = false;
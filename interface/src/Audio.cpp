@@ -62,6 +62,7 @@ Audio::Audio(Oscilloscope* scope, int16_t initialJitterBufferSamples, QObject* p
     _proceduralOutputDevice(NULL),
     _inputRingBuffer(0),
     _ringBuffer(NETWORK_BUFFER_LENGTH_BYTES_PER_CHANNEL),
+    _receivedAudioPackets(RECEIVED_AUDIO_RING_CAPACITY),
     _scope(scope),
     _averagedLatency(0.0),
     _measuredJitter(0),
@@ -497,6 +498,15 @@ void Audio::handleAudioInput() {
     }
 }
 
+void Audio::processReceivedAudio() {
+    _receivedAudioPackets.startDraining();
+    PacketBuffer* buffer;
+    while ((buffer = _receivedAudioPackets.front())) {
+        addReceivedAudioToBuffer(buffer->getByteArray());
+        _receivedAudioPackets.pop();
+    }
+}
+
 void Audio::addReceivedAudioToBuffer(const QByteArray& audioByteArray) {
     const int NUM_INITIAL_PACKETS_DISCARD = 3;
     const int STANDARD_DEVIATION_SAMPLE_COUNT = 500;
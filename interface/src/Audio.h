@@ -25,6 +25,7 @@
 
 #include <AbstractAudioInterface.h>
 #include <AudioRingBuffer.h>
+#include <PacketRing.h>
 #include <StdDev.h>
 
 #include "Oscilloscope.h"
@@ -33,6 +34,9 @@
 
 static const int NUM_AUDIO_CHANNELS = 2;
 
+// the most mixed audio packets that can be waiting for the audio thread before newly received ones are dropped
+static const int RECEIVED_AUDIO_RING_CAPACITY = 64;
+
 class QAudioInput;
 class QAudioOutput;
 class QIODevice;
@@ -70,9 +74,13 @@ public:
     void init(QGLWidget *parent = 0);
     bool mousePressEvent(int x, int y);
     
+    /// The ring the network receive thread pushes mixed audio packets onto, call processReceivedAudio() to drain it.
+    PacketRing& getReceivedAudioPackets() { return _receivedAudioPackets; }
+    
 public slots:
     void start();
     void addReceivedAudioToBuffer(const QByteArray& audioByteArray);
+    void processReceivedAudio();
     void handleAudioInput();
     void reset();
     void toggleMute();
@@ -102,6 +110,7 @@ private:
     QIODevice* _proceduralOutputDevice;
     AudioRingBuffer _inputRingBuffer;
     AudioRingBuffer _ringBuffer;
+    PacketRing _receivedAudioPackets;
     
     Oscilloscope* _scope;
     StDev _stdev;
@@ -8,6 +8,7 @@
 
 #include <QtCore/QWeakPointer>
 
+#include <PacketRing.h>
 #include <PerfStat.h>
 
 #include "Application.h"
@@ -16,114 +17,181 @@
 #include "DatagramProcessor.h"
 
 DatagramProcessor::DatagramProcessor(QObject* parent) :
-    QObject(parent)
+    QObject(parent),
+    _spareBuffer(new PacketBuffer()),
+    _packetCount(0),
+    _byteCount(0)
 {
     
 }
 
+DatagramProcessor::~DatagramProcessor() {
+    delete _spareBuffer;
+}
+
 void DatagramProcessor::processDatagrams() {
     PerformanceWarning warn(Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings),
                             "DatagramProcessor::processDatagrams()");
     
-    HifiSockAddr senderSockAddr;
-    
-    static QByteArray incomingPacket;
-    
     Application* application = Application::getInstance();
     NodeList* nodeList = NodeList::getInstance();
+    QUdpSocket& nodeSocket = nodeList->getNodeSocket();
     
-    while (NodeList::getInstance()->getNodeSocket().hasPendingDatagrams()) {
-        incomingPacket.resize(nodeList->getNodeSocket().pendingDatagramSize());
-        nodeList->getNodeSocket().readDatagram(incomingPacket.data(), incomingPacket.size(),
-                                               senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
+    while (nodeSocket.hasPendingDatagrams()) {
+        int datagramSize = nodeSocket.pendingDatagramSize();
+        
+        if (datagramSize > MAX_PACKET_SIZE) {
+            // none of the packets that go onto a ring are this big, read it on its own and handle it here
+            HifiSockAddr senderSockAddr;
+            QByteArray oversizePacket(datagramSize, 0);
+            nodeSocket.readDatagram(oversizePacket.data(), oversizePacket.size(),
+                                    senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
+            
+            _packetCount++;
+            _byteCount += oversizePacket.size();
+            
+            if (nodeList->packetVersionAndHashMatch(oversizePacket)) {
+                processPacket(oversizePacket, senderSockAddr);
+            }
+            continue;
+        }
+        
+        // read straight into the spare buffer, if the packet goes onto a ring the buffer goes with it
+        PacketBuffer* buffer = _spareBuffer;
+        HifiSockAddr& senderSockAddr = buffer->getSenderSockAddr();
+        int packetSize = nodeSocket.readDatagram(buffer->getData(), MAX_PACKET_SIZE,
+                                                 senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
+        if (packetSize < 0) {
+            continue;
+        }
+        buffer->setSize(packetSize);
         
         _packetCount++;
-        _byteCount += incomingPacket.size();
+        _byteCount += packetSize;
+        
+        QByteArray incomingPacket = buffer->getByteArray();
         
-        if (nodeList->packetVersionAndHashMatch(incomingPacket)) {
+        if (!nodeList->packetVersionAndHashMatch(incomingPacket)) {
             // only process this packet if we have a match on the packet version
-            switch (packetTypeForPacket(incomingPacket)) {
-                case PacketTypeTransmitterData:
-                    //  V2 = IOS transmitter app
-                    application->getAvatar()->getTransmitter().processIncomingData(reinterpret_cast<unsigned char*>(incomingPacket.data()),
-                                                                    incomingPacket.size());
-                    
-                    break;
-                case PacketTypeMixedAudio:
-                    QMetaObject::invokeMethod(&application->_audio, "addReceivedAudioToBuffer", Qt::QueuedConnection,
-                                              Q_ARG(QByteArray, incomingPacket));
-                    break;
-                    
-                case PacketTypeParticleAddResponse:
-                    // this will keep creatorTokenIDs to IDs mapped correctly
-                    Particle::handleAddParticleResponse(incomingPacket);
-                    application->getParticles()->getTree()->handleAddParticleResponse(incomingPacket);
-                    break;
-                    
-                case PacketTypeParticleData:
-                case PacketTypeParticleErase:
-                case PacketTypeVoxelData:
-                case PacketTypeVoxelErase:
-                case PacketTypeOctreeStats:
-                case PacketTypeEnvironmentData: {
-                    PerformanceWarning warn(Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings),
-                                            "Application::networkReceive()... _voxelProcessor.queueReceivedPacket()");
-                    
-                    bool wantExtraDebugging = application->getLogger()->extraDebugging();
-                    if (wantExtraDebugging && packetTypeForPacket(incomingPacket) == PacketTypeVoxelData) {
-                        int numBytesPacketHeader = numBytesForPacketHeader(incomingPacket);
-                        unsigned char* dataAt = reinterpret_cast<unsigned char*>(incomingPacket.data()) + numBytesPacketHeader;
-                        dataAt += sizeof(OCTREE_PACKET_FLAGS);
-                        OCTREE_PACKET_SEQUENCE sequence = (*(OCTREE_PACKET_SEQUENCE*)dataAt);
-                        dataAt += sizeof(OCTREE_PACKET_SEQUENCE);
-                        OCTREE_PACKET_SENT_TIME sentAt = (*(OCTREE_PACKET_SENT_TIME*)dataAt);
-                        dataAt += sizeof(OCTREE_PACKET_SENT_TIME);
-                        OCTREE_PACKET_SENT_TIME arrivedAt = usecTimestampNow();
-                        int flightTime = arrivedAt - sentAt;
-                        
-                        printf("got PacketType_VOXEL_DATA, sequence:%d flightTime:%d\n", sequence, flightTime);
-                    }
+            continue;
+        }
+        
+        switch (packetTypeForPacket(incomingPacket)) {
+            case PacketTypeMixedAudio: {
+                Audio* audio = application->getAudio();
+                if (pushSpareBuffer(audio->getReceivedAudioPackets())
+                        && audio->getReceivedAudioPackets().shouldWakeConsumer()) {
+                    QMetaObject::invokeMethod(audio, "processReceivedAudio", Qt::QueuedConnection);
+                }
+                break;
+            }
+            case PacketTypeParticleData:
+            case PacketTypeParticleErase:
+            case PacketTypeVoxelData:
+            case PacketTypeVoxelErase:
+            case PacketTypeOctreeStats:
+            case PacketTypeEnvironmentData: {
+                PerformanceWarning warn(Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings),
+                                        "DatagramProcessor::processDatagrams()... push onto the voxel packet ring");
+                
+                bool wantExtraDebugging = application->getLogger()->extraDebugging();
+                if (wantExtraDebugging && packetTypeForPacket(incomingPacket) == PacketTypeVoxelData) {
+                    int numBytesPacketHeader = numBytesForPacketHeader(incomingPacket);
+                    const unsigned char* dataAt = reinterpret_cast<const unsigned char*>(incomingPacket.constData())
+                        + numBytesPacketHeader;
+                    dataAt += sizeof(OCTREE_PACKET_FLAGS);
+                    OCTREE_PACKET_SEQUENCE sequence = (*(OCTREE_PACKET_SEQUENCE*)dataAt);
+                    dataAt += sizeof(OCTREE_PACKET_SEQUENCE);
+                    OCTREE_PACKET_SENT_TIME sentAt = (*(OCTREE_PACKET_SENT_TIME*)dataAt);
+                    dataAt += sizeof(OCTREE_PACKET_SENT_TIME);
+                    OCTREE_PACKET_SENT_TIME arrivedAt = usecTimestampNow();
+                    int flightTime = arrivedAt - sentAt;
                     
-                    SharedNodePointer matchedNode = NodeList::getInstance()->sendingNodeForPacket(incomingPacket);
+                    printf("got PacketType_VOXEL_DATA, sequence:%d flightTime:%d\n", sequence, flightTime);
+                }
+                
+                SharedNodePointer matchedNode = nodeList->sendingNodeForPacket(incomingPacket);
+                
+                if (matchedNode) {
+                    // Make sure our Node and NodeList knows we've heard from this node.
+                    matchedNode->setLastHeardMicrostamp(usecTimestampNow());
                     
-                    if (matchedNode) {
-                        // add this packet to our list of voxel packets and process them on the voxel processing
-                        application->_voxelProcessor.queueReceivedPacket(matchedNode, incomingPacket);
+                    // hand this packet to the voxel processing thread, which polls its ring so it needs no wake up
+                    buffer->setSendingNode(matchedNode);
+                    if (!pushSpareBuffer(application->_voxelProcessor.getPacketRing())) {
+                        buffer->setSendingNode(SharedNodePointer());
                     }
-                    
-                    break;
                 }
-                case PacketTypeMetavoxelData:
-                    application->_metavoxels.processData(incomingPacket, senderSockAddr);
-                    break;
-                case PacketTypeBulkAvatarData:
-                case PacketTypeKillAvatar:
-                case PacketTypeAvatarIdentity: {
-                    // update having heard from the avatar-mixer and record the bytes received
-                    SharedNodePointer avatarMixer = nodeList->sendingNodeForPacket(incomingPacket);
+                
+                break;
+            }
+            case PacketTypeBulkAvatarData:
+            case PacketTypeKillAvatar:
+            case PacketTypeAvatarIdentity: {
+                // update having heard from the avatar-mixer and record the bytes received
+                SharedNodePointer avatarMixer = nodeList->sendingNodeForPacket(incomingPacket);
+                
+                if (avatarMixer) {
+                    avatarMixer->setLastHeardMicrostamp(usecTimestampNow());
+                    avatarMixer->recordBytesReceived(incomingPacket.size());
                     
-                    if (avatarMixer) {
-                        avatarMixer->setLastHeardMicrostamp(usecTimestampNow());
-                        avatarMixer->recordBytesReceived(incomingPacket.size());
-                        
-                        QMetaObject::invokeMethod(&application->getAvatarManager(), "processAvatarMixerDatagram",
-                                                  Q_ARG(const QByteArray&, incomingPacket),
-                                                  Q_ARG(const QWeakPointer<Node>&, avatarMixer));
+                    AvatarManager& avatarManager = application->getAvatarManager();
+                    buffer->setSendingNode(avatarMixer);
+                    if (!pushSpareBuffer(avatarManager.getAvatarMixerPackets())) {
+                        buffer->setSendingNode(SharedNodePointer());
+                    } else if (avatarManager.getAvatarMixerPackets().shouldWakeConsumer()) {
+                        QMetaObject::invokeMethod(&avatarManager, "processAvatarMixerPackets", Qt::QueuedConnection);
                     }
-                    
-                    application->_bandwidthMeter.inputStream(BandwidthMeter::AVATARS).updateValue(incomingPacket.size());
-                    break;
                 }
-                case PacketTypeDataServerGet:
-                case PacketTypeDataServerPut:
-                case PacketTypeDataServerSend:
-                case PacketTypeDataServerConfirm:
-                    DataServerClient::processMessageFromDataServer(incomingPacket);
-                    break;
-                default:
-                    nodeList->processNodeData(senderSockAddr, incomingPacket);
-                    break;
+                
+                application->_bandwidthMeter.inputStream(BandwidthMeter::AVATARS).updateValue(incomingPacket.size());
+                break;
             }
+            default:
+                processPacket(incomingPacket, senderSockAddr);
+                break;
         }
     }
 }
+
+void DatagramProcessor::processPacket(const QByteArray& packet, const HifiSockAddr& senderSockAddr) {
+    Application* application = Application::getInstance();
+    
+    switch (packetTypeForPacket(packet)) {
+        case PacketTypeTransmitterData:
+            //  V2 = IOS transmitter app
+            application->getAvatar()->getTransmitter().processIncomingData(
+                reinterpret_cast<unsigned char*>(const_cast<char*>(packet.constData())), packet.size());
+            
+            break;
+            
+        case PacketTypeParticleAddResponse:
+            // this will keep creatorTokenIDs to IDs mapped correctly
+            Particle::handleAddParticleResponse(packet);
+            application->getParticles()->getTree()->handleAddParticleResponse(packet);
+            break;
+            
+        case PacketTypeMetavoxelData:
+            // the metavoxel system queues the packet to the main thread, so it needs a copy of its own
+            application->_metavoxels.processData(QByteArray(packet.constData(), packet.size()), senderSockAddr);
+            break;
+        case PacketTypeDataServerGet:
+        case PacketTypeDataServerPut:
+        case PacketTypeDataServerSend:
+        case PacketTypeDataServerConfirm:
+            DataServerClient::processMessageFromDataServer(packet);
+            break;
+        default:
+            NodeList::getInstance()->processNodeData(senderSockAddr, packet);
+            break;
+    }
+}
+
+bool DatagramProcessor::pushSpareBuffer(PacketRing& ring) {
+    PacketBuffer* emptyBuffer = ring.push(_spareBuffer);
+    if (!emptyBuffer) {
+        return false;
+    }
+    _spareBuffer = emptyBuffer;
+    return true;
+}
@@ -11,10 +11,19 @@
 
 #include <QtCore/QObject>
 
+#include <HifiSockAddr.h>
+
+class PacketBuffer;
+class PacketRing;
+
+/// Reads the datagrams from the NodeList socket on the network receive thread. Voxel, mixed audio and avatar mixer
+/// packets are read straight into pooled buffers and pushed onto the rings of the threads that process them, every
+/// other packet is handled where it is read.
 class DatagramProcessor : public QObject {
     Q_OBJECT
 public:
     DatagramProcessor(QObject* parent = 0);
+    ~DatagramProcessor();
     
     int getPacketCount() const { return _packetCount; }
     int getByteCount() const { return _byteCount; }
@@ -24,6 +33,16 @@ public slots:
     void processDatagrams();
     
 private:
+    DatagramProcessor(const DatagramProcessor&); // not copyable, it owns its spare buffer
+    DatagramProcessor& operator=(const DatagramProcessor&);
+    
+    void processPacket(const QByteArray& packet, const HifiSockAddr& senderSockAddr);
+    
+    /// Pushes the spare buffer onto the ring, and takes the empty buffer it gets back as the new spare.
+    /// \return false if the ring was full, in which case the packet is dropped and the spare is reused
+    bool pushSpareBuffer(PacketRing& ring);
+    
+    PacketBuffer* _spareBuffer;
     int _packetCount;
     int _byteCount;
 };
@@ -14,6 +14,24 @@
 #include "Menu.h"
 #include "VoxelPacketProcessor.h"
 
+VoxelPacketProcessor::VoxelPacketProcessor() :
+    _packetRing(VOXEL_PACKET_RING_CAPACITY)
+{
+}
+
+bool VoxelPacketProcessor::process() {
+    if (!hasPacketsToProcess() && !_dontSleep) {
+        usleep(RECEIVED_THREAD_SLEEP_INTERVAL);
+    }
+    PacketBuffer* buffer;
+    while ((buffer = _packetRing.front())) {
+        // the packet is a view of the buffer, which goes back to the receive thread once it has been processed
+        processPacket(buffer->getSendingNode(), buffer->getByteArray());
+        _packetRing.pop();
+    }
+    return isStillRunning();  // keep running till they terminate us
+}
+
 void VoxelPacketProcessor::processPacket(const SharedNodePointer& sendingNode, const QByteArray& packet) {
     PerformanceWarning warn(Menu::getInstance()->isOptionChecked(MenuOption::PipelineWarnings),
                             "VoxelPacketProcessor::processPacket()");
@@ -11,12 +11,31 @@
 #ifndef __shared__VoxelPacketProcessor__
 #define __shared__VoxelPacketProcessor__
 
+#include <PacketRing.h>
 #include <ReceivedPacketProcessor.h>
 
-/// Handles processing of incoming voxel packets for the interface application. As with other ReceivedPacketProcessor classes 
-/// the user is responsible for reading inbound packets and adding them to the processing queue by calling queueReceivedPacket()
+// the most voxel packets that can be waiting before newly received ones are dropped
+const int VOXEL_PACKET_RING_CAPACITY = 1024;
+
+/// Handles processing of incoming voxel packets for the interface application. The network receive thread reads the
+/// packets straight into buffers it pushes onto getPacketRing(), and this processor takes them off the ring without
+/// locking or copying them.
 class VoxelPacketProcessor : public ReceivedPacketProcessor {
+public:
+    VoxelPacketProcessor();
+
+    /// The ring the network receive thread pushes voxel, particle, environment and stats packets onto.
+    PacketRing& getPacketRing() { return _packetRing; }
+
+    virtual bool hasPacketsToProcess() const { return _packetRing.size() > 0; }
+    virtual int packetsToProcessCount() const { return _packetRing.size(); }
+
 protected:
     virtual void processPacket(const SharedNodePointer& sendingNode, const QByteArray& packet);
+
+    virtual bool process();
+
+private:
+    PacketRing _packetRing;
 };
 #endif // __shared__VoxelPacketProcessor__
@@ -23,7 +23,8 @@
 const QUuid MY_AVATAR_KEY;  // NULL key
 
 AvatarManager::AvatarManager(QObject* parent) :
-    _avatarFades() {
+    _avatarFades(),
+    _avatarMixerPackets(AVATAR_MIXER_PACKET_RING_CAPACITY) {
     // register a meta type for the weak pointer we'll use for the owning avatar mixer for each avatar
     qRegisterMetaType<QWeakPointer<Node> >("NodeWeakPointer");
     _myAvatar = QSharedPointer<MyAvatar>(new MyAvatar());
@@ -141,6 +142,15 @@ void AvatarManager::processAvatarMixerDatagram(const QByteArray& datagram, const
     }
 }
 
+void AvatarManager::processAvatarMixerPackets() {
+    _avatarMixerPackets.startDraining();
+    PacketBuffer* buffer;
+    while ((buffer = _avatarMixerPackets.front())) {
+        processAvatarMixerDatagram(buffer->getByteArray(), buffer->getSendingNode());
+        _avatarMixerPackets.pop();
+    }
+}
+
 void AvatarManager::processAvatarDataPacket(const QByteArray &datagram, const QWeakPointer<Node> &mixerWeakPointer) {
     int bytesRead = numBytesForPacketHeader(datagram);
     
@@ -15,11 +15,15 @@
 
 #include <AvatarHashMap.h>
 #include <DataServerClient.h>
+#include <PacketRing.h>
 
 #include "Avatar.h"
 
 class MyAvatar;
 
+// the most avatar mixer packets that can be waiting for the main thread before newly received ones are dropped
+const int AVATAR_MIXER_PACKET_RING_CAPACITY = 256;
+
 class AvatarManager : public QObject, public AvatarHashMap {
     Q_OBJECT
 public:
@@ -34,8 +38,12 @@ public:
     
     void clearOtherAvatars();
 
+    /// The ring the network receive thread pushes avatar mixer packets onto, drained by processAvatarMixerPackets().
+    PacketRing& getAvatarMixerPackets() { return _avatarMixerPackets; }
+
 public slots:
     void processAvatarMixerDatagram(const QByteArray& datagram, const QWeakPointer<Node>& mixerWeakPointer);
+    void processAvatarMixerPackets();
     
 private:
     AvatarManager(const AvatarManager& other);
@@ -52,6 +60,7 @@ private:
     
     QVector<AvatarSharedPointer> _avatarFades;
     QSharedPointer<MyAvatar> _myAvatar;
+    PacketRing _avatarMixerPackets;
 };
 
 #endif /* defined(__hifi__AvatarManager__) */
@@ -0,0 +1,219 @@
+//
+//  AudioMixKernel.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Spatialization and vectorized sample mixing for the audio mixer
+//
+
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/vector_angle.hpp>
+
+#include "InjectedAudioRingBuffer.h"
+
+#include "AudioMixKernel.h"
+
+// the SIMD paths are picked at compile time from the instruction sets the build targets
+#if defined(__AVX__)
+#define AUDIO_MIX_AVX
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_MIX_SSE2
+#include <emmintrin.h>
+#endif
+
+AudioSourceMix::AudioSourceMix(const PositionalAudioRingBuffer* source, const PositionalAudioRingBuffer* listener) :
+    attenuation(1.0f),
+    delayedAttenuation(1.0f),
+    numSamplesDelay(0),
+    isRightDelayed(false)
+{
+    if (source == listener) {
+        return;
+    }
+
+    float bearingRelativeAngleToSource = 0.0f;
+    float weakChannelAmplitudeRatio = 1.0f;
+
+    glm::vec3 relativePosition = source->getPosition() - listener->getPosition();
+    glm::quat inverseOrientation = glm::inverse(listener->getOrientation());
+
+    float distanceSquareToSource = glm::dot(relativePosition, relativePosition);
+    float radius = 0.0f;
+
+    if (source->getType() == PositionalAudioRingBuffer::Injector) {
+        const InjectedAudioRingBuffer* injectedBuffer = (const InjectedAudioRingBuffer*) source;
+        radius = injectedBuffer->getRadius();
+        attenuation *= injectedBuffer->getAttenuationRatio();
+    }
+
+    if (radius == 0 || (distanceSquareToSource > radius * radius)) {
+        // this is either not a spherical source, or the listener is outside the sphere
+
+        if (radius > 0) {
+            // this is a spherical source - the distance used for the coefficient
+            // needs to be the closest point on the boundary to the source
+
+            // ovveride the distance to the node with the distance to the point on the
+            // boundary of the sphere
+            distanceSquareToSource -= (radius * radius);
+
+        } else {
+            // calculate the angle delivery for off-axis attenuation
+            glm::vec3 rotatedListenerPosition = glm::inverse(source->getOrientation()) * relativePosition;
+
+            float angleOfDelivery = glm::angle(glm::vec3(0.0f, 0.0f, -1.0f),
+                                               glm::normalize(rotatedListenerPosition));
+
+            const float MAX_OFF_AXIS_ATTENUATION = 0.2f;
+            const float OFF_AXIS_ATTENUATION_FORMULA_STEP = (1 - MAX_OFF_AXIS_ATTENUATION) / 2.0f;
+
+            float offAxisCoefficient = MAX_OFF_AXIS_ATTENUATION +
+                (OFF_AXIS_ATTENUATION_FORMULA_STEP * (angleOfDelivery / 90.0f));
+
+            // multiply the current attenuation coefficient by the calculated off axis coefficient
+            attenuation *= offAxisCoefficient;
+        }
+
+        glm::vec3 rotatedSourcePosition = inverseOrientation * relativePosition;
+
+        const float DISTANCE_SCALE = 2.5f;
+        const float GEOMETRIC_AMPLITUDE_SCALAR = 0.3f;
+        const float DISTANCE_LOG_BASE = 2.5f;
+        const float DISTANCE_SCALE_LOG = logf(DISTANCE_SCALE) / logf(DISTANCE_LOG_BASE);
+
+        // calculate the distance coefficient using the distance to this node
+        float distanceCoefficient = powf(GEOMETRIC_AMPLITUDE_SCALAR,
+                                         DISTANCE_SCALE_LOG +
+                                         (0.5f * logf(distanceSquareToSource) / logf(DISTANCE_LOG_BASE)) - 1);
+        distanceCoefficient = std::min(1.0f, distanceCoefficient);
+
+        // multiply the current attenuation coefficient by the distance coefficient
+        attenuation *= distanceCoefficient;
+
+        // project the rotated source position vector onto the XZ plane
+        rotatedSourcePosition.y = 0.0f;
+
+        // produce an oriented angle about the y-axis
+        bearingRelativeAngleToSource = glm::orientedAngle(glm::vec3(0.0f, 0.0f, -1.0f),
+                                                          glm::normalize(rotatedSourcePosition),
+                                                          glm::vec3(0.0f, 1.0f, 0.0f));
+
+        const float PHASE_AMPLITUDE_RATIO_AT_90 = 0.5;
+
+        // figure out the number of samples of delay and the ratio of the amplitude
+        // in the weak channel for audio spatialization
+        float sinRatio = fabsf(sinf(glm::radians(bearingRelativeAngleToSource)));
+        numSamplesDelay = MAX_PHASE_DELAY_SAMPLES * sinRatio;
+        weakChannelAmplitudeRatio = 1 - (PHASE_AMPLITUDE_RATIO_AT_90 * sinRatio);
+    }
+
+    // if the bearing relative angle to source is > 0 then the delayed channel is the right one
+    isRightDelayed = bearingRelativeAngleToSource > 0.0f;
+    delayedAttenuation = attenuation * weakChannelAmplitudeRatio;
+}
+
+int keepLoudestSources(std::vector<AudibleSource>& audibleSources, int maxSources) {
+    if (maxSources <= 0 || (int) audibleSources.size() <= maxSources) {
+        return 0;
+    }
+    int numberDropped = audibleSources.size() - maxSources;
+    std::nth_element(audibleSources.begin(), audibleSources.begin() + maxSources, audibleSources.end());
+    audibleSources.resize(maxSources, audibleSources[0]);
+    return numberDropped;
+}
+
+AudioMixAccumulator::AudioMixAccumulator() {
+    clear();
+}
+
+void AudioMixAccumulator::clear() {
+    memset(_left, 0, sizeof(_left));
+    memset(_right, 0, sizeof(_right));
+}
+
+void AudioMixAccumulator::addSource(const float* linearFrame, const AudioSourceMix& sourceMix) {
+    float* goodChannel = sourceMix.isRightDelayed ? _left : _right;
+    float* delayedChannel = sourceMix.isRightDelayed ? _right : _left;
+
+    mixSamples(goodChannel, linearFrame, sourceMix.attenuation, NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL);
+
+    // the delayed channel starts with the end of the previous frame, which the linear frame keeps in front of this one
+    mixSamples(delayedChannel, linearFrame - sourceMix.numSamplesDelay, sourceMix.delayedAttenuation,
+               NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL);
+}
+
+void AudioMixAccumulator::writeSamples(int16_t* destination) const {
+    saturateAndInterleave(_left, _right, destination, NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL);
+}
+
+void mixSamplesScalar(float* destination, const float* source, float gain, int numSamples) {
+    for (int i = 0; i < numSamples; i++) {
+        destination[i] += source[i] * gain;
+    }
+}
+
+void mixSamples(float* destination, const float* source, float gain, int numSamples) {
+    int i = 0;
+
+#if defined(AUDIO_MIX_AVX)
+    __m256 wideGain = _mm256_set1_ps(gain);
+    for (; i + 8 <= numSamples; i += 8) {
+        __m256 mixed = _mm256_add_ps(_mm256_loadu_ps(destination + i),
+                                     _mm256_mul_ps(_mm256_loadu_ps(source + i), wideGain));
+        _mm256_storeu_ps(destination + i, mixed);
+    }
+#endif
+
+#if defined(AUDIO_MIX_SSE2)
+    __m128 gains = _mm_set1_ps(gain);
+    for (; i + 4 <= numSamples; i += 4) {
+        __m128 mixed = _mm_add_ps(_mm_loadu_ps(destination + i), _mm_mul_ps(_mm_loadu_ps(source + i), gains));
+        _mm_storeu_ps(destination + i, mixed);
+    }
+#endif
+
+    // whatever is left over
+    mixSamplesScalar(destination + i, source + i, gain, numSamples - i);
+}
+
+void saturateAndInterleave(const float* left, const float* right, int16_t* destination, int numSamples) {
+    int i = 0;
+
+#if defined(AUDIO_MIX_SSE2)
+    __m128 minimum = _mm_set1_ps((float) MIN_SAMPLE_VALUE);
+    __m128 maximum = _mm_set1_ps((float) MAX_SAMPLE_VALUE);
+    for (; i + 4 <= numSamples; i += 4) {
+        // clamp before converting, out of range floats don't convert to anything useful
+        __m128i leftSamples = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(left + i), minimum), maximum));
+        __m128i rightSamples = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(right + i), minimum), maximum));
+
+        // L0 R0 L1 R1 and L2 R2 L3 R3, packed down to 16 bits
+        __m128i interleaved = _mm_packs_epi32(_mm_unpacklo_epi32(leftSamples, rightSamples),
+                                              _mm_unpackhi_epi32(leftSamples, rightSamples));
+        _mm_storeu_si128((__m128i*) (destination + 2 * i), interleaved);
+    }
+#endif
+
+    for (; i < numSamples; i++) {
+        destination[2 * i] = (int16_t) glm::clamp(left[i], (float) MIN_SAMPLE_VALUE, (float) MAX_SAMPLE_VALUE);
+        destination[2 * i + 1] = (int16_t) glm::clamp(right[i], (float) MIN_SAMPLE_VALUE, (float) MAX_SAMPLE_VALUE);
+    }
+}
+
+const char* getMixKernelName() {
+#if defined(AUDIO_MIX_AVX)
+    return "AVX";
+#elif defined(AUDIO_MIX_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
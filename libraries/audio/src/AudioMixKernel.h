@@ -0,0 +1,81 @@
+//
+//  AudioMixKernel.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Spatialization and vectorized sample mixing for the audio mixer
+//
+
+#ifndef __hifi__AudioMixKernel__
+#define __hifi__AudioMixKernel__
+
+#include <stdint.h>
+#include <vector>
+
+#include "PositionalAudioRingBuffer.h"
+
+// a source that stays below one sample value for a listener is left out of that listener's mix
+const float MIN_AUDIBLE_AMPLITUDE = 1.0f;
+
+/// How one source is heard by one listener, worked out once per source per listener per frame.
+class AudioSourceMix {
+public:
+    /// Spatializes source for listener, the same source and listener buffer means the listener hears itself unchanged.
+    AudioSourceMix(const PositionalAudioRingBuffer* source, const PositionalAudioRingBuffer* listener);
+
+    float attenuation; // gain of the good channel
+    float delayedAttenuation; // gain of the delayed channel, the attenuation times the weak channel amplitude ratio
+    int numSamplesDelay; // 0 to MAX_PHASE_DELAY_SAMPLES
+    bool isRightDelayed; // the source is to the right of the listener, so the right channel hears it late
+};
+
+/// A source that a listener can hear this frame.
+class AudibleSource {
+public:
+    AudibleSource(int sourceIndex, const AudioSourceMix& sourceMix, float loudness) :
+        sourceIndex(sourceIndex), sourceMix(sourceMix), loudness(loudness) { }
+
+    /// louder sources sort first
+    bool operator<(const AudibleSource& other) const { return loudness > other.loudness; }
+
+    int sourceIndex;
+    AudioSourceMix sourceMix;
+    float loudness; // the source's frame loudness after attenuation
+};
+
+/// Drops all but the maxSources loudest of audibleSources, keeps them all if maxSources is 0.
+/// \return the number of sources dropped
+int keepLoudestSources(std::vector<AudibleSource>& audibleSources, int maxSources);
+
+/// Accumulates the mix for one listener in float, and saturates it to 16 bit samples once every source has been added.
+class AudioMixAccumulator {
+public:
+    AudioMixAccumulator();
+
+    void clear();
+
+    /// Adds a frame linearized by PositionalAudioRingBuffer::linearizeFrame() to the mix.
+    void addSource(const float* linearFrame, const AudioSourceMix& sourceMix);
+
+    /// Writes the mix as interleaved stereo, NETWORK_BUFFER_LENGTH_SAMPLES_STEREO samples.
+    void writeSamples(int16_t* destination) const;
+
+private:
+    float _left[NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL];
+    float _right[NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL];
+};
+
+/// destination[i] += source[i] * gain, with the widest SIMD instructions the build targets (AVX, SSE2, or none).
+void mixSamples(float* destination, const float* source, float gain, int numSamples);
+
+/// The plain C++ version of mixSamples(), for comparison.
+void mixSamplesScalar(float* destination, const float* source, float gain, int numSamples);
+
+/// Clamps the left and right channels to the 16 bit sample range and interleaves them into destination.
+void saturateAndInterleave(const float* left, const float* right, int16_t* destination, int numSamples);
+
+/// The instruction set mixSamples() was built for, "AVX", "SSE2" or "scalar".
+const char* getMixKernelName();
+
+#endif /* defined(__hifi__AudioMixKernel__) */
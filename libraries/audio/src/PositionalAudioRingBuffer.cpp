@@ -6,6 +6,8 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 
 #include <QtCore/QDataStream>
@@ -29,9 +31,11 @@ PositionalAudioRingBuffer::PositionalAudioRingBuffer(PositionalAudioRingBuffer::
     _orientation(0.0f, 0.0f, 0.0f, 0.0f),
     _willBeAddedToMix(false),
     _shouldLoopbackForNode(false),
-    _shouldOutputStarveDebug(true)
+    _shouldOutputStarveDebug(true),
+    _frameLoudness(0.0f),
+    _framePeak(0.0f)
 {
-
+    memset(_linearFrame, 0, sizeof(_linearFrame));
 }
 
 PositionalAudioRingBuffer::~PositionalAudioRingBuffer() {
@@ -65,6 +69,31 @@ int PositionalAudioRingBuffer::parsePositionalData(const QByteArray& positionalB
     return packetStream.device()->pos();
 }
 
+void PositionalAudioRingBuffer::linearizeFrame() {
+    int16_t* start = shiftedPositionAccomodatingWrap(_nextOutput, -MAX_PHASE_DELAY_SAMPLES);
+    int numSamplesToEnd = std::min((int) ((_buffer + _sampleCapacity) - start), LINEAR_FRAME_SAMPLES);
+
+    for (int i = 0; i < numSamplesToEnd; i++) {
+        _linearFrame[i] = start[i];
+    }
+
+    // the rest of the frame wraps around to the beginning of the ring
+    for (int i = numSamplesToEnd; i < LINEAR_FRAME_SAMPLES; i++) {
+        _linearFrame[i] = _buffer[i - numSamplesToEnd];
+    }
+
+    float totalLoudness = 0.0f;
+    _framePeak = 0.0f;
+    for (int i = 0; i < LINEAR_FRAME_SAMPLES; i++) {
+        float loudness = std::fabs(_linearFrame[i]);
+        _framePeak = std::max(_framePeak, loudness);
+        if (i >= MAX_PHASE_DELAY_SAMPLES) {
+            totalLoudness += loudness;
+        }
+    }
+    _frameLoudness = totalLoudness / NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL;
+}
+
 bool PositionalAudioRingBuffer::shouldBeAddedToMix(int numJitterBufferSamples) {
     if (!isNotStarvedOrHasMinimumSamples(NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL + numJitterBufferSamples)) {
         if (_shouldOutputStarveDebug) {
@@ -14,6 +14,10 @@
 
 #include "AudioRingBuffer.h"
 
+// the most a mixer delays the weak channel of a source by, for a source at 90 degrees to the listener
+const int MAX_PHASE_DELAY_SAMPLES = 20;
+const int LINEAR_FRAME_SAMPLES = MAX_PHASE_DELAY_SAMPLES + NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL;
+
 class PositionalAudioRingBuffer : public AudioRingBuffer {
 public:
     enum Type {
@@ -39,6 +43,21 @@ public:
     const glm::vec3& getPosition() const { return _position; }
     const glm::quat& getOrientation() const { return _orientation; }
     
+    /// Copies the next frame, along with the MAX_PHASE_DELAY_SAMPLES before it, out of the ring as floats, so that the
+    /// mixer can read it without a wrap check per sample no matter how many listeners it is mixed for. Also measures how
+    /// loud the frame is.
+    void linearizeFrame();
+    
+    /// The frame copied by linearizeFrame(), indices -MAX_PHASE_DELAY_SAMPLES through
+    /// NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL - 1 are valid.
+    const float* getLinearFrame() const { return _linearFrame + MAX_PHASE_DELAY_SAMPLES; }
+    
+    /// mean absolute sample value of the linearized frame
+    float getFrameLoudness() const { return _frameLoudness; }
+    
+    /// largest absolute sample value of the linearized frame, including the phase delay samples
+    float getFramePeak() const { return _framePeak; }
+    
 protected:
     // disallow copying of PositionalAudioRingBuffer objects
     PositionalAudioRingBuffer(const PositionalAudioRingBuffer&);
@@ -50,6 +69,9 @@ protected:
     bool _willBeAddedToMix;
     bool _shouldLoopbackForNode;
     bool _shouldOutputStarveDebug;
+    float _linearFrame[LINEAR_FRAME_SAMPLES];
+    float _frameLoudness;
+    float _framePeak;
 };
 
 #endif /* defined(__hifi__PositionalAudioRingBuffer__) */
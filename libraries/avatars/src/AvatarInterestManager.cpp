@@ -0,0 +1,135 @@
+//
+//  AvatarInterestManager.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Decides which avatars each receiver of the avatar mixer is sent every frame
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "AvatarInterestManager.h"
+
+// let a receiver that was under budget catch up with this many frames worth of bytes
+const int MAX_BUDGET_FRAMES = 2;
+
+// avatars a receiver has never been sent go first
+const float NEVER_SENT_OVERDUE = 1000.0f;
+
+const int CELL_COORDINATE_BITS = 21;
+const int CELL_COORDINATE_OFFSET = 1 << (CELL_COORDINATE_BITS - 1);
+const quint64 CELL_COORDINATE_MASK = (1 << CELL_COORDINATE_BITS) - 1;
+
+AvatarReceiverState::AvatarReceiverState() :
+    _budget(0)
+{
+}
+
+AvatarInterestManager::AvatarInterestManager(int framesPerSecond, int bytesPerReceiverPerSecond) :
+    _frame(0),
+    _bytesPerReceiverPerFrame(bytesPerReceiverPerSecond / framesPerSecond)
+{
+}
+
+quint64 AvatarInterestManager::cellKey(int x, int y, int z) {
+    return (((quint64)(x + CELL_COORDINATE_OFFSET) & CELL_COORDINATE_MASK) << (2 * CELL_COORDINATE_BITS)) |
+        (((quint64)(y + CELL_COORDINATE_OFFSET) & CELL_COORDINATE_MASK) << CELL_COORDINATE_BITS) |
+        ((quint64)(z + CELL_COORDINATE_OFFSET) & CELL_COORDINATE_MASK);
+}
+
+void AvatarInterestManager::cellForPosition(const glm::vec3& position, int& x, int& y, int& z) {
+    x = (int)floorf(position.x / MAX_AVATAR_BROADCAST_DISTANCE);
+    y = (int)floorf(position.y / MAX_AVATAR_BROADCAST_DISTANCE);
+    z = (int)floorf(position.z / MAX_AVATAR_BROADCAST_DISTANCE);
+}
+
+int AvatarInterestManager::sendIntervalForDistance(float distance) {
+    if (distance > MAX_AVATAR_BROADCAST_DISTANCE) {
+        return 0;
+    }
+    int interval = 1;
+    for (float fullRateDistance = FULL_RATE_AVATAR_DISTANCE; distance > fullRateDistance; fullRateDistance *= 2.0f) {
+        interval *= 2;
+    }
+    return std::min(interval, MAX_AVATAR_SEND_INTERVAL_FRAMES);
+}
+
+void AvatarInterestManager::beginFrame() {
+    _frame++;
+    _avatars.clear();
+    _grid.clear();
+}
+
+void AvatarInterestManager::addAvatar(const QUuid& uuid, const glm::vec3& position, const QByteArray& payload) {
+    Avatar avatar;
+    avatar.uuid = uuid;
+    avatar.position = position;
+    avatar.payload = payload;
+    _avatars.push_back(avatar);
+
+    int x, y, z;
+    cellForPosition(position, x, y, z);
+    _grid[cellKey(x, y, z)].push_back(_avatars.size() - 1);
+}
+
+void AvatarInterestManager::selectForReceiver(const QUuid& receiverUUID, const glm::vec3& receiverPosition,
+                                              AvatarReceiverState& receiverState, std::vector<int>& selected) {
+    selected.clear();
+    receiverState._budget = std::min(receiverState._budget + _bytesPerReceiverPerFrame,
+                                     MAX_BUDGET_FRAMES * _bytesPerReceiverPerFrame);
+
+    // our cells are as big as the broadcast distance, so everything we might send is in the cells around us
+    _candidates.clear();
+    int receiverX, receiverY, receiverZ;
+    cellForPosition(receiverPosition, receiverX, receiverY, receiverZ);
+    for (int x = receiverX - 1; x <= receiverX + 1; x++) {
+        for (int y = receiverY - 1; y <= receiverY + 1; y++) {
+            for (int z = receiverZ - 1; z <= receiverZ + 1; z++) {
+                QHash<quint64, std::vector<int> >::const_iterator cell = _grid.constFind(cellKey(x, y, z));
+                if (cell == _grid.constEnd()) {
+                    continue;
+                }
+                const std::vector<int>& indexes = cell.value();
+                for (size_t i = 0; i < indexes.size(); i++) {
+                    const Avatar& avatar = _avatars[indexes[i]];
+                    if (avatar.uuid == receiverUUID) {
+                        continue;
+                    }
+                    float distance = glm::distance(avatar.position, receiverPosition);
+                    int interval = sendIntervalForDistance(distance);
+                    if (interval == 0) {
+                        continue;
+                    }
+
+                    Candidate candidate;
+                    candidate.index = indexes[i];
+                    candidate.distance = distance;
+                    QHash<QUuid, quint64>::const_iterator lastSent = receiverState._lastSentFrames.constFind(avatar.uuid);
+                    if (lastSent == receiverState._lastSentFrames.constEnd()) {
+                        candidate.overdue = NEVER_SENT_OVERDUE;
+                    } else {
+                        quint64 framesSinceSent = _frame - lastSent.value();
+                        if (framesSinceSent < (quint64)interval) {
+                            continue; // not due yet
+                        }
+                        candidate.overdue = (float)framesSinceSent / interval;
+                    }
+                    _candidates.push_back(candidate);
+                }
+            }
+        }
+    }
+
+    std::sort(_candidates.begin(), _candidates.end());
+    for (size_t i = 0; i < _candidates.size(); i++) {
+        const Avatar& avatar = _avatars[_candidates[i].index];
+        if (avatar.payload.size() > receiverState._budget) {
+            break; // the rest stay due, and will be more overdue next frame
+        }
+        receiverState._budget -= avatar.payload.size();
+        receiverState._lastSentFrames.insert(avatar.uuid, _frame);
+        selected.push_back(_candidates[i].index);
+    }
+}
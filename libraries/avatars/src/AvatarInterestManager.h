@@ -0,0 +1,99 @@
+//
+//  AvatarInterestManager.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Decides which avatars each receiver of the avatar mixer is sent every frame
+//
+
+#ifndef __hifi__AvatarInterestManager__
+#define __hifi__AvatarInterestManager__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QUuid>
+
+const float FULL_RATE_AVATAR_DISTANCE = 10.0f; // meters, avatars this close are sent every frame
+const float MAX_AVATAR_BROADCAST_DISTANCE = 320.0f; // meters, avatars further away aren't sent at all
+const int MAX_AVATAR_SEND_INTERVAL_FRAMES = 32;
+const int DEFAULT_AVATAR_BYTES_PER_RECEIVER_PER_SECOND = 128 * 1024;
+
+/// What one receiver has been sent, the mixer keeps it with the rest of the receiver's data.
+class AvatarReceiverState {
+public:
+    AvatarReceiverState();
+
+    /// call when an avatar goes away, so that we don't hold on to it
+    void forgetAvatar(const QUuid& avatarUUID) { _lastSentFrames.remove(avatarUUID); }
+
+private:
+    friend class AvatarInterestManager;
+
+    QHash<QUuid, quint64> _lastSentFrames;
+    int _budget; // bytes we may still send this receiver, refilled every frame
+};
+
+/// Each frame the mixer adds every avatar along with its payload, serialized once, and then asks which of them each
+/// receiver should get. Avatars are bucketed in a grid of MAX_AVATAR_BROADCAST_DISTANCE sized cells, so a receiver only
+/// looks at the avatars in the cells around it. Avatars within FULL_RATE_AVATAR_DISTANCE are due every frame, and every
+/// doubling of distance beyond that halves their rate, down to once every MAX_AVATAR_SEND_INTERVAL_FRAMES. The due
+/// avatars are then sent most overdue (and then nearest) first, until the receiver's bandwidth budget runs out, the rest
+/// stay due for the next frame.
+class AvatarInterestManager {
+public:
+    AvatarInterestManager(int framesPerSecond, int bytesPerReceiverPerSecond = DEFAULT_AVATAR_BYTES_PER_RECEIVER_PER_SECOND);
+
+    /// Forgets the last frame's avatars
+    void beginFrame();
+
+    /// Adds an avatar to this frame, the payload is what receivers are sent for it
+    void addAvatar(const QUuid& uuid, const glm::vec3& position, const QByteArray& payload);
+
+    /// Fills selected with the indexes of the avatars to send this receiver this frame, and records them as sent
+    void selectForReceiver(const QUuid& receiverUUID, const glm::vec3& receiverPosition,
+                           AvatarReceiverState& receiverState, std::vector<int>& selected);
+
+    int getAvatarCount() const { return _avatars.size(); }
+    const QByteArray& getPayload(int index) const { return _avatars[index].payload; }
+
+    quint64 getFrameCount() const { return _frame; }
+    int getBytesPerReceiverPerFrame() const { return _bytesPerReceiverPerFrame; }
+
+    /// how many frames apart an avatar this far from the receiver is sent, 0 if it's not sent at all
+    static int sendIntervalForDistance(float distance);
+
+private:
+    class Avatar {
+    public:
+        QUuid uuid;
+        glm::vec3 position;
+        QByteArray payload;
+    };
+
+    class Candidate {
+    public:
+        int index;
+        float overdue; // frames since last sent, in send intervals
+        float distance;
+
+        bool operator<(const Candidate& other) const {
+            return overdue > other.overdue || (overdue == other.overdue && distance < other.distance);
+        }
+    };
+
+    static quint64 cellKey(int x, int y, int z);
+    static void cellForPosition(const glm::vec3& position, int& x, int& y, int& z);
+
+    std::vector<Avatar> _avatars;
+    QHash<quint64, std::vector<int> > _grid;
+    std::vector<Candidate> _candidates; // kept to avoid allocating each receiver
+    quint64 _frame;
+    int _bytesPerReceiverPerFrame;
+};
+
+#endif /* defined(__hifi__AvatarInterestManager__) */
@@ -172,6 +172,7 @@ JurisdictionMap::JurisdictionMap(const char* rootHexCode, const char* endNodesHe
         myDebugPrintOctalCode(endNodeOctcode, true);
 
     }    
+    compile();
 }
 
 
@@ -179,29 +180,85 @@ void JurisdictionMap::init(unsigned char* rootOctalCode, const std::vector<unsig
     clear(); // clean up our own memory
     _rootOctalCode = rootOctalCode;
     _endNodes = endNodes;
+    compile();
 }
 
-JurisdictionMap::Area JurisdictionMap::isMyJurisdiction(const unsigned char* nodeOctalCode, int childIndex) const {
-    // to be in our jurisdiction, we must be under the root...
+void JurisdictionMap::compile() {
+    _rootCodeLength = _rootOctalCode ? numberOfThreeBitSectionsInCode(_rootOctalCode) : -1;
 
-    // if the node is an ancestor of my root, then we return ABOVE
-    if (isAncestorOf(nodeOctalCode, _rootOctalCode)) {
-        return ABOVE;
+    EndNodeTrieEntry emptyEntry;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        emptyEntry.children[i] = -1;
     }
-    
-    // otherwise...
-    bool isInJurisdiction = isAncestorOf(_rootOctalCode, nodeOctalCode, childIndex);
-    // if we're under the root, then we can't be under any of the endpoints
-    if (isInJurisdiction) {
-        for (size_t i = 0; i < _endNodes.size(); i++) {
-            bool isUnderEndNode = isAncestorOf(_endNodes[i], nodeOctalCode);
-            if (isUnderEndNode) {
-                isInJurisdiction = false;
-                break;
+    emptyEntry.isEndNode = false;
+
+    _endNodeTrie.clear();
+    _endNodeTrie.push_back(emptyEntry);
+    for (size_t i = 0; i < _endNodes.size(); i++) {
+        if (!_endNodes[i]) {
+            continue;
+        }
+        int entry = 0;
+        int codeLength = numberOfThreeBitSectionsInCode(_endNodes[i]);
+        for (int section = 0; section < codeLength; section++) {
+            int sectionValue = getOctalCodeSectionValue(_endNodes[i], section);
+            if (_endNodeTrie[entry].children[sectionValue] == -1) {
+                _endNodeTrie[entry].children[sectionValue] = _endNodeTrie.size();
+                _endNodeTrie.push_back(emptyEntry);
             }
+            entry = _endNodeTrie[entry].children[sectionValue];
         }
+        _endNodeTrie[entry].isEndNode = true;
+    }
+}
+
+JurisdictionMap::Area JurisdictionMap::isMyJurisdiction(const unsigned char* nodeOctalCode, int childIndex) const {
+    JurisdictionPosition position = getPosition(nodeOctalCode);
+    if (childIndex != CHECK_NODE_ONLY) {
+        position = getChildPosition(position, childIndex);
+    }
+    return getArea(position);
+}
+
+JurisdictionPosition JurisdictionMap::getPosition(const unsigned char* octalCode) const {
+    // start at the top of the tree, which is an ancestor of every root, and then follow the code down
+    JurisdictionPosition position;
+    position.depth = 0;
+    position.onRootPath = (_rootCodeLength >= 0 && octalCode);
+    position.underRoot = (_rootCodeLength == 0 && octalCode);
+    position.endNodeTrieIndex = 0;
+    position.underEndNode = _endNodeTrie[0].isEndNode;
+
+    int codeLength = octalCode ? numberOfThreeBitSectionsInCode(octalCode) : 0;
+    for (int section = 0; section < codeLength; section++) {
+        position = getChildPosition(position, getOctalCodeSectionValue(octalCode, section));
+    }
+    return position;
+}
+
+JurisdictionPosition JurisdictionMap::getChildPosition(const JurisdictionPosition& position, int childIndex) const {
+    JurisdictionPosition childPosition;
+    childPosition.depth = position.depth + 1;
+
+    // the child stays on the path to the root only as long as it takes the same branch the root's code does
+    childPosition.onRootPath = position.onRootPath && position.depth < _rootCodeLength &&
+        getOctalCodeSectionValue(_rootOctalCode, position.depth) == childIndex;
+    childPosition.underRoot = position.underRoot ||
+        (childPosition.onRootPath && childPosition.depth == _rootCodeLength);
+
+    childPosition.endNodeTrieIndex = (position.endNodeTrieIndex == -1) ? -1 :
+        _endNodeTrie[position.endNodeTrieIndex].children[childIndex];
+    childPosition.underEndNode = position.underEndNode ||
+        (childPosition.endNodeTrieIndex != -1 && _endNodeTrie[childPosition.endNodeTrieIndex].isEndNode);
+    return childPosition;
+}
+
+JurisdictionMap::Area JurisdictionMap::getArea(const JurisdictionPosition& position) const {
+    // the root itself counts as above, the same as its ancestors, and the end nodes are the first elements below
+    if (position.onRootPath) {
+        return ABOVE;
     }
-    return isInJurisdiction ? WITHIN : BELOW;
+    return (position.underRoot && !position.underEndNode) ? WITHIN : BELOW;
 }
 
 
@@ -228,6 +285,7 @@ bool JurisdictionMap::readFromFile(const char* filename) {
         _endNodes.push_back(octcode);
     }
     settings.endGroup();
+    compile();
     return true;
 }
 
@@ -368,6 +426,7 @@ int JurisdictionMap::unpackFromMessage(const unsigned char* sourceBuffer, int av
             }
         }
     }
+    compile();
     
     return sourceBuffer - startPosition; // includes header!
 }
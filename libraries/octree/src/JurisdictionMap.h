@@ -18,6 +18,19 @@
 
 #include <Node.h>
 
+#include "OctreeConstants.h"
+
+/// Where an element is relative to a JurisdictionMap, so that a traversal can find where each of the element's children
+/// is in one step, rather than looking their octal codes up from the top.
+class JurisdictionPosition {
+public:
+    int depth;
+    bool onRootPath; // the element is the jurisdiction's root or one of its ancestors
+    bool underRoot; // the element is the jurisdiction's root or one of its descendants
+    int endNodeTrieIndex; // the element's entry in the trie of end nodes, -1 once it's off the trie
+    bool underEndNode; // the element is one of the end nodes or one of their descendants
+};
+
 class JurisdictionMap {
 public:
     enum Area {
@@ -47,6 +60,14 @@ public:
 
     Area isMyJurisdiction(const unsigned char* nodeOctalCode, int childIndex) const;
 
+    /// \return the position of the element with the given octal code, in one step for each of the code's sections
+    JurisdictionPosition getPosition(const unsigned char* octalCode) const;
+
+    /// \return the position of a child of the element at the given position, in one step
+    JurisdictionPosition getChildPosition(const JurisdictionPosition& position, int childIndex) const;
+
+    Area getArea(const JurisdictionPosition& position) const;
+
     bool writeToFile(const char* filename);
     bool readFromFile(const char* filename);
 
@@ -71,10 +92,22 @@ private:
     void copyContents(const JurisdictionMap& other); // use assignment instead
     void clear();
     void init(unsigned char* rootOctalCode, const std::vector<unsigned char*>& endNodes);
+    void compile();
+
+    // one entry of the trie of end node octal codes, by way of which each lookup only descends the tree once, rather
+    // than comparing against every end node
+    class EndNodeTrieEntry {
+    public:
+        int children[NUMBER_OF_CHILDREN]; // -1 where no end node is below
+        bool isEndNode;
+    };
 
     unsigned char* _rootOctalCode;
     std::vector<unsigned char*> _endNodes;
     NodeType_t _nodeType;
+
+    int _rootCodeLength; // -1 when there's no root, in which case nothing is within the jurisdiction
+    std::vector<EndNodeTrieEntry> _endNodeTrie;
 };
 
 /// Map between node IDs and their reported JurisdictionMap. Typically used by classes that need to know which nodes are 
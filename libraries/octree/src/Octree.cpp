@@ -32,6 +32,9 @@
 #include "ViewFrustum.h"
 #include "OctreeConstants.h"
 #include "OctreeElementBag.h"
+#include "OctreeEncodeCache.h"
+#include "OctreeEpochManager.h"
+#include "OctreeKnownState.h"
 #include "Octree.h"
 
 float boundaryDistanceForRenderLevel(unsigned int renderLevel, float voxelSizeScale) {
@@ -41,7 +44,10 @@ float boundaryDistanceForRenderLevel(unsigned int renderLevel, float voxelSizeSc
 Octree::Octree(bool shouldReaverage) :
     _isDirty(true),
     _shouldReaverage(shouldReaverage),
-    _stopImport(false) {
+    _stopImport(false),
+    _wantSnapshotReads(false),
+    _wantFolding(false),
+    _indexedFile(NULL) {
     _rootNode = NULL;
     _isViewing = false;
 }
@@ -50,6 +56,7 @@ Octree::~Octree() {
     // delete the children of the root node
     // this recursively deletes the tree
     delete _rootNode;
+    delete _indexedFile;
 }
 
 // Recurses voxel tree calling the RecurseOctreeOperation function for each node.
@@ -436,11 +443,73 @@ void Octree::deleteOctalCodeFromTreeRecursion(OctreeElement* node, void* extraDa
 }
 
 void Octree::eraseAllOctreeElements() {
-    delete _rootNode; // this will recurse and delete all children
+    OctreeElement* oldRoot = _rootNode;
     _rootNode = createNewElement();
+    if (_wantSnapshotReads) {
+        _rootNode->makeSnapshotSafe();
+    }
+    OctreeElement::disposeElement(oldRoot); // this will recurse and delete all children
     _isDirty = true;
 }
 
+void Octree::setWantSnapshotReads(bool wantSnapshotReads) {
+    if (wantSnapshotReads && !supportsSnapshotReads()) {
+        qDebug("Octree::setWantSnapshotReads()... this tree doesn't support snapshot reads, ignoring.");
+        return;
+    }
+    // the child encoding is picked when elements are created, so start over with a fresh root using the new encoding
+    lockForWrite();
+    _wantSnapshotReads = wantSnapshotReads;
+    eraseAllOctreeElements();
+    unlock();
+}
+
+void Octree::setWantFolding(bool wantFolding) {
+    if (wantFolding && !supportsFolding()) {
+        qDebug("Octree::setWantFolding()... this tree doesn't support folding, ignoring.");
+        return;
+    }
+    // subtrees that are already folded stay folded until something reaches them
+    _wantFolding = wantFolding;
+}
+
+quint64 Octree::beginSnapshotRead() {
+    if (_wantSnapshotReads) {
+        return OctreeEpochManager::getInstance()->enterReader();
+    }
+    lockForRead();
+    return 0;
+}
+
+void Octree::endSnapshotRead(quint64 snapshotToken) {
+    if (_wantSnapshotReads) {
+        OctreeEpochManager::getInstance()->exitReader(snapshotToken);
+    } else {
+        unlock();
+    }
+}
+
+void Octree::lockForWrite() {
+    lock.lockForWrite();
+    reclaimRetiredElements();
+}
+
+bool Octree::tryLockForWrite() {
+    if (!lock.tryLockForWrite()) {
+        return false;
+    }
+    reclaimRetiredElements();
+    return true;
+}
+
+// Frees whatever the snapshot readers have let go of since the last write. This is done here, with the write lock held,
+// rather than when the readers exit, so that element destructors and delete hooks never race a writer.
+void Octree::reclaimRetiredElements() {
+    if (_wantSnapshotReads) {
+        OctreeEpochManager::getInstance()->reclaim();
+    }
+}
+
 void Octree::processRemoveOctreeElementsBitstream(const unsigned char* bitstream, int bufferSizeBytes) {
     //unsigned short int itemNumber = (*((unsigned short int*)&bitstream[sizeof(PACKET_HEADER)]));
 
@@ -463,6 +532,7 @@ void Octree::processRemoveOctreeElementsBitstream(const unsigned char* bitstream
         int voxelDataSize = bytesRequiredForCodeLength(codeLength) + SIZE_OF_COLOR_DATA;
 
         if (atByte + voxelDataSize <= bufferSizeBytes) {
+            loadSubtreesForEdit(voxelCode);
             deleteOctalCodeFromTree(voxelCode, COLLAPSE_EMPTY_TREE);
             voxelCode += voxelDataSize;
             atByte += voxelDataSize;
@@ -510,8 +580,9 @@ void Octree::reaverageOctreeElements(OctreeElement* startNode) {
     }
 }
 
-OctreeElement* Octree::getOctreeElementAt(float x, float y, float z, float s) const {
+OctreeElement* Octree::getOctreeElementAt(float x, float y, float z, float s) {
     unsigned char* octalCode = pointToOctalCode(x,y,z,s);
+    unfoldPathTo(octalCode);
     OctreeElement* node = nodeForOctalCode(_rootNode, octalCode, NULL);
     if (*node->getOctalCode() != *octalCode) {
         node = NULL;
@@ -540,6 +611,7 @@ public:
     float& distance;
     BoxFace& face;
     bool found;
+    const Octree* tree;
 };
 
 bool findRayIntersectionOp(OctreeElement* node, void* extraData) {
@@ -553,6 +625,19 @@ bool findRayIntersectionOp(OctreeElement* node, void* extraData) {
     if (!node->isLeaf()) {
         return true; // recurse on children
     }
+    // a folded element is hit where the voxels folded below it are
+    bool hit = false;
+    if (node->hasUnloadedChildren() &&
+            args->tree->findRayIntersectionInFolded(node, args->origin, args->direction, hit, distance, face)) {
+        distance *= TREE_SCALE;
+        if (hit && (!args->found || distance < args->distance)) {
+            args->node = node;
+            args->distance = distance;
+            args->face = face;
+            args->found = true;
+        }
+        return false;
+    }
     distance *= TREE_SCALE;
     if (node->hasContent() && (!args->found || distance < args->distance)) {
         args->node = node;
@@ -565,7 +650,7 @@ bool findRayIntersectionOp(OctreeElement* node, void* extraData) {
 
 bool Octree::findRayIntersection(const glm::vec3& origin, const glm::vec3& direction,
                                     OctreeElement*& node, float& distance, BoxFace& face) {
-    RayArgs args = { origin / (float)(TREE_SCALE), direction, node, distance, face };
+    RayArgs args = { origin / (float)(TREE_SCALE), direction, node, distance, face, false, this };
     recurseTreeWithOperation(findRayIntersectionOp, &args);
     return args.found;
 }
@@ -673,13 +758,54 @@ int Octree::encodeTreeBitstream(OctreeElement* node,
         return bytesWritten;
     }
 
+    // the client may already have all of this subtree
+    if (params.knownState) {
+        params.knownState->startEncode();
+        if (params.knownState->isKnown(node)) {
+            params.stopReason = EncodeBitstreamParams::WAS_KNOWN;
+            return bytesWritten;
+        }
+    }
+
+    // subtrees that many clients can see entirely are encoded once and shared
+    if (params.encodeCache) {
+        bytesWritten = params.encodeCache->encodeFromCache(this, node, packetData, params);
+        if (bytesWritten > 0) {
+            // cached encodings are always of the whole subtree
+            if (params.knownState) {
+                params.knownState->subtreeSent(node);
+                params.knownState->commitPending();
+            }
+            return bytesWritten;
+        }
+    }
+
     startEncoding(node);
 
-    // If we're at a node that is out of view, then we can return, because no nodes below us will be in view!
-    if (params.viewFrustum && !node->isInView(*params.viewFrustum)) {
-        doneEncoding(node);
-        params.stopReason = EncodeBitstreamParams::OUT_OF_VIEW;
-        return bytesWritten;
+    // this is the one node whose parent didn't look it up for the recursion, so it starts with all the frustum tests
+    // and finds its jurisdiction position from its octal code
+    EncodeElementState elementState;
+    elementState.location = ViewFrustum::INSIDE;
+    elementState.testMask = ALL_FRUSTUM_TESTS;
+    elementState.lastLocation = ViewFrustum::OUTSIDE;
+    elementState.lastTestMask = ALL_FRUSTUM_TESTS;
+    if (params.jurisdictionMap) {
+        elementState.jurisdiction = params.jurisdictionMap->getPosition(node->getOctalCode());
+    }
+    if (params.viewFrustum) {
+        AABox box = node->getAABox();
+        box.scale(TREE_SCALE);
+        elementState.location = params.viewFrustum->boxInFrustum(box, elementState.testMask);
+
+        // If we're at a node that is out of view, then we can return, because no nodes below us will be in view!
+        if (elementState.location == ViewFrustum::OUTSIDE) {
+            doneEncoding(node);
+            params.stopReason = EncodeBitstreamParams::OUT_OF_VIEW;
+            return bytesWritten;
+        }
+        if (params.deltaViewFrustum && params.lastViewFrustum) {
+            elementState.lastLocation = params.lastViewFrustum->boxInFrustum(box, elementState.lastTestMask);
+        }
     }
 
     // write the octal code
@@ -702,7 +828,8 @@ int Octree::encodeTreeBitstream(OctreeElement* node,
     // If the octalcode couldn't fit, then we can return, because no nodes below us will fit...
     if (!roomForOctalCode) {
         doneEncoding(node);
-        bag.insert(node); // add the node back to the bag so it will eventually get included
+        // add the node back to the bag so it will eventually get included
+        bag.insert(node, node->getEncodePriority(params.viewFrustum));
         params.stopReason = EncodeBitstreamParams::DIDNT_FIT;
         return bytesWritten;
     }
@@ -717,7 +844,8 @@ int Octree::encodeTreeBitstream(OctreeElement* node,
         params.stats->traversed(node);
     }
 
-    int childBytesWritten = encodeTreeBitstreamRecursion(node, packetData, bag, params, currentEncodeLevel);
+    int childBytesWritten = encodeTreeBitstreamRecursion(node, packetData, bag, params, currentEncodeLevel,
+                                                         elementState);
 
     // if childBytesWritten == 1 then something went wrong... that's not possible
     assert(childBytesWritten != 1);
@@ -740,8 +868,14 @@ int Octree::encodeTreeBitstream(OctreeElement* node,
 
     if (bytesWritten == 0) {
         packetData->discardSubTree();
+        if (params.knownState) {
+            params.knownState->discardPending(0);
+        }
     } else {
         packetData->endSubTree();
+        if (params.knownState) {
+            params.knownState->commitPending();
+        }
     }
 
     doneEncoding(node);
@@ -749,12 +883,71 @@ int Octree::encodeTreeBitstream(OctreeElement* node,
     return bytesWritten;
 }
 
+// Tests all of a node's children against the view frustums at once, doing only the tests the node didn't settle for
+// them, and puts the results at the children's indexes in childStates.
+static void findChildFrustumStates(OctreeElement* const* children, const EncodeElementState& elementState,
+                                   const EncodeBitstreamParams& params, EncodeElementState* childStates) {
+    glm::vec3 corners[NUMBER_OF_CHILDREN];
+    int childIndexes[NUMBER_OF_CHILDREN];
+    int numChildren = 0;
+    float scale = 0.0f;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        const OctreeElement* childNode = children[i];
+        if (childNode) {
+            // scaled the same way as OctreeElement::inFrustum() does, so the results are the same
+            corners[numChildren] = childNode->getCorner() * (float)TREE_SCALE;
+            scale = childNode->getScale() * (float)TREE_SCALE;
+            childIndexes[numChildren++] = i;
+        }
+    }
+    if (numChildren == 0) {
+        return;
+    }
+
+    ViewFrustum::location locations[NUMBER_OF_CHILDREN];
+    unsigned char testMasks[NUMBER_OF_CHILDREN];
+    params.viewFrustum->boxesInFrustum(corners, scale, numChildren, elementState.testMask, locations, testMasks);
+    for (int i = 0; i < numChildren; i++) {
+        childStates[childIndexes[i]].location = locations[i];
+        childStates[childIndexes[i]].testMask = testMasks[i];
+    }
+
+    if (params.deltaViewFrustum && params.lastViewFrustum) {
+        params.lastViewFrustum->boxesInFrustum(corners, scale, numChildren, elementState.lastTestMask,
+                                               locations, testMasks);
+        for (int i = 0; i < numChildren; i++) {
+            childStates[childIndexes[i]].lastLocation = locations[i];
+            childStates[childIndexes[i]].lastTestMask = testMasks[i];
+        }
+    }
+}
+
+// Whether the children of a non-leaf element are close enough to render at the params' level of detail, the same way
+// OctreeElement::calculateShouldRender() decides it, so that encoding its subtree will send something.
+static bool childrenAreWithinLOD(const OctreeElement* node, const EncodeBitstreamParams& params) {
+    if (!params.viewFrustum) {
+        return true;
+    }
+    float childBoundary = boundaryDistanceForRenderLevel(node->getLevel() + 1 + params.boundaryLevelAdjust,
+                                                         params.octreeElementSizeScale);
+    return node->furthestDistanceToCamera(*params.viewFrustum) <= childBoundary;
+}
+
+// Folded elements have no children in the tree, but they're encoded with the children folded below them.
+static bool isEncodedAsLeaf(const OctreeElement* node) {
+    return node->isLeaf() && !node->hasUnloadedChildren();
+}
+
 int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
                                             OctreePacketData* packetData, OctreeElementBag& bag,
-                                            EncodeBitstreamParams& params, int& currentEncodeLevel) const {
+                                            EncodeBitstreamParams& params, int& currentEncodeLevel,
+                                            const EncodeElementState& elementState) const {
     // How many bytes have we written so far at this level;
     int bytesAtThisLevel = 0;
 
+    // assume the worst, returning early always means we left something out
+    params.subtreeComplete = false;
+
     // you can't call this without a valid node
     if (!node) {
         qDebug("WARNING! encodeTreeBitstreamRecursion() called with node=NULL");
@@ -762,6 +955,12 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
         return bytesAtThisLevel;
     }
 
+    // this part of the tree may still be in the indexed file, ask for it to be loaded soon, until then we send what we
+    // have (otherwise it's folded, and sent from the folded voxels below)
+    if (node->hasUnloadedChildren() && _indexedFile) {
+        _indexedFile->requestLoad(node);
+    }
+
     // Keep track of how deep we've encoded.
     currentEncodeLevel++;
 
@@ -777,7 +976,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
     if (params.jurisdictionMap) {
         // here's how it works... if we're currently above our root jurisdiction, then we proceed normally.
         // but once we're in our own jurisdiction, then we need to make sure we're not below it.
-        if (JurisdictionMap::BELOW == params.jurisdictionMap->isMyJurisdiction(node->getOctalCode(), CHECK_NODE_ONLY)) {
+        if (JurisdictionMap::BELOW == params.jurisdictionMap->getArea(elementState.jurisdiction)) {
             params.stopReason = EncodeBitstreamParams::OUT_OF_JURISDICTION;
             return bytesAtThisLevel;
         }
@@ -801,7 +1000,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
         // If we're at a node that is out of view, then we can return, because no nodes below us will be in view!
         // although technically, we really shouldn't ever be here, because our callers shouldn't be calling us if
         // we're out of view
-        if (!node->isInView(*params.viewFrustum)) {
+        if (elementState.location == ViewFrustum::OUTSIDE) {
             if (params.stats) {
                 params.stats->skippedOutOfView(node);
             }
@@ -809,15 +1008,25 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
             return bytesAtThisLevel;
         }
 
+        // If the client already has everything below us, and none of it has changed, then there's nothing to send
+        if (params.knownState && params.knownState->isKnown(node)) {
+            if (params.stats) {
+                params.stats->skippedWasInView(node);
+            }
+            params.subtreeComplete = true;
+            params.stopReason = EncodeBitstreamParams::WAS_KNOWN;
+            return bytesAtThisLevel;
+        }
+
         // Ok, we are in view, but if we're in delta mode, then we also want to make sure we weren't already in view
         // because we don't send nodes from the previously know in view frustum.
         bool wasInView = false;
 
         if (params.deltaViewFrustum && params.lastViewFrustum) {
-            ViewFrustum::location location = node->inFrustum(*params.lastViewFrustum);
+            ViewFrustum::location location = elementState.lastLocation;
 
             // If we're a leaf, then either intersect or inside is considered "formerly in view"
-            if (node->isLeaf()) {
+            if (isEncodedAsLeaf(node)) {
                 wasInView = location != ViewFrustum::OUTSIDE;
             } else {
                 wasInView = location == ViewFrustum::INSIDE;
@@ -862,7 +1071,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
 
         // If the user also asked for occlusion culling, check if this node is occluded, but only if it's not a leaf.
         // leaf occlusion is handled down below when we check child nodes
-        if (params.wantOcclusionCulling && !node->isLeaf()) {
+        if (params.wantOcclusionCulling && !isEncodedAsLeaf(node)) {
             AABox voxelBox = node->getAABox();
             voxelBox.scale(TREE_SCALE);
             OctreeProjectedPolygon* voxelPolygon = new OctreeProjectedPolygon(params.viewFrustum->getProjectedPolygon(voxelBox));
@@ -887,6 +1096,26 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
         }
     }
 
+    // a folded element's children are written by its tree, and it can only go in the bag as a whole
+    int foldedBytesWritten = 0;
+    bool foldedDidntFit = false;
+    if (node->hasUnloadedChildren() && encodeFoldedChildren(node, packetData, params, currentEncodeLevel, elementState,
+                                                            foldedBytesWritten, foldedDidntFit)) {
+        bool foldedComplete = params.subtreeComplete;
+        if (foldedDidntFit) {
+            bag.insert(node, node->getEncodePriority(params.viewFrustum));
+            if (params.stats) {
+                params.stats->didntFit(node);
+            }
+            params.stopReason = EncodeBitstreamParams::DIDNT_FIT;
+            foldedComplete = false;
+        } else if (params.knownState && foldedComplete) {
+            params.knownState->subtreeSent(node);
+        }
+        params.subtreeComplete = params.knownState && foldedComplete;
+        return foldedBytesWritten;
+    }
+
     bool keepDiggingDeeper = true; // Assuming we're in view we have a great work ethic, we're always ready for more!
 
     // At any given point in writing the bitstream, the largest minimum we might need to flesh out the current level
@@ -900,6 +1129,11 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
 
     // Make our local buffer large enough to handle writing at this level in case we need to.
     LevelDetails thisLevelKey = packetData->startLevel();
+    int knownStatePendingAtStart = params.knownState ? params.knownState->getPendingCount() : 0;
+
+    // for the known state, which children we've sent (or the client had) all of, and those we colored beyond the usual
+    bool childComplete[NUMBER_OF_CHILDREN] = { false, false, false, false, false, false, false, false };
+    unsigned char childrenColoredForKnownStateBits = 0;
 
     int inViewCount = 0;
     int inViewNotLeafCount = 0;
@@ -910,15 +1144,30 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
     int indexOfChildren[NUMBER_OF_CHILDREN] = { 0, 0, 0, 0, 0, 0, 0, 0 };
     int currentCount = 0;
 
+    // read each child only once, with snapshot reads a writer can add or remove children while we're encoding, and the
+    // frustum states below must be for the same children we encode
+    OctreeElement* children[NUMBER_OF_CHILDREN];
     for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
-        OctreeElement* childNode = node->getChildAtIndex(i);
+        children[i] = node->getChildAtIndex(i);
+    }
+
+    // where our parent found us settles some of the frustum tests for all of our children, which are tested together
+    EncodeElementState childStates[NUMBER_OF_CHILDREN];
+    if (params.viewFrustum) {
+        findChildFrustumStates(children, elementState, params, childStates);
+    }
+
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* childNode = children[i];
 
         // if the caller wants to include childExistsBits, then include them even if not in view, if however,
         // we're in a portion of the tree that's not our responsibility, then we assume the child nodes exist
         // even if they don't in our local tree
         bool notMyJurisdiction = false;
         if (params.jurisdictionMap) {
-            notMyJurisdiction = (JurisdictionMap::WITHIN != params.jurisdictionMap->isMyJurisdiction(node->getOctalCode(), i));
+            JurisdictionPosition& childPosition = childStates[i].jurisdiction;
+            childPosition = params.jurisdictionMap->getChildPosition(elementState.jurisdiction, i);
+            notMyJurisdiction = (JurisdictionMap::WITHIN != params.jurisdictionMap->getArea(childPosition));
         }
         if (params.includeExistsBits) {
             // If the child is known to exist, OR, it's not my jurisdiction, then we mark the bit as existing
@@ -955,7 +1204,8 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
         OctreeElement* childNode = sortedChildren[i];
         int originalIndex = indexOfChildren[i];
 
-        bool childIsInView  = (childNode && (!params.viewFrustum || childNode->isInView(*params.viewFrustum)));
+        bool childIsInView  = (childNode && (!params.viewFrustum ||
+                                             childStates[originalIndex].location != ViewFrustum::OUTSIDE));
 
         if (!childIsInView) {
             // must check childNode here, because it could be we got here because there was no childNode
@@ -980,7 +1230,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
                 // track children in view as existing and not a leaf, if they're a leaf,
                 // we don't care about recursing deeper on them, and we don't consider their
                 // subtree to exist
-                if (!(childNode && childNode->isLeaf())) {
+                if (!(childNode && isEncodedAsLeaf(childNode))) {
                     childrenExistInPacketBits += (1 << (7 - originalIndex));
                     inViewNotLeafCount++;
                 }
@@ -988,7 +1238,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
                 bool childIsOccluded = false; // assume it's not occluded
 
                 // If the user also asked for occlusion culling, check if this node is occluded
-                if (params.wantOcclusionCulling && childNode->isLeaf()) {
+                if (params.wantOcclusionCulling && isEncodedAsLeaf(childNode)) {
                     // Don't check occlusion here, just add them to our distance ordered array...
 
                     AABox voxelBox = childNode->getAABox();
@@ -1026,7 +1276,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
                 // track some stats
                 if (params.stats) {
                     // don't need to check childNode here, because we can't get here with no childNode
-                    if (!shouldRender && childNode->isLeaf()) {
+                    if (!shouldRender && isEncodedAsLeaf(childNode)) {
                         params.stats->skippedDistance(childNode);
                     }
                     // don't need to check childNode here, because we can't get here with no childNode
@@ -1035,15 +1285,25 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
                     }
                 }
 
+                bool childIsKnown = params.knownState && params.knownState->isKnown(childNode);
+                if (childIsKnown) {
+                    childComplete[originalIndex] = true;
+                }
+
                 // track children with actual color, only if the child wasn't previously in view!
-                if (shouldRender && !childIsOccluded) {
+                if (childIsKnown && isEncodedAsLeaf(childNode)) {
+                    // the client already has this leaf's color
+                    if (params.stats) {
+                        params.stats->skippedWasInView(childNode);
+                    }
+                } else if (shouldRender && !childIsOccluded) {
                     bool childWasInView = false;
 
                     if (childNode && params.deltaViewFrustum && params.lastViewFrustum) {
-                        ViewFrustum::location location = childNode->inFrustum(*params.lastViewFrustum);
+                        ViewFrustum::location location = childStates[originalIndex].lastLocation;
 
                         // If we're a leaf, then either intersect or inside is considered "formerly in view"
-                        if (childNode->isLeaf()) {
+                        if (isEncodedAsLeaf(childNode)) {
                             childWasInView = location != ViewFrustum::OUTSIDE;
                         } else {
                             childWasInView = location == ViewFrustum::INSIDE;
@@ -1059,6 +1319,9 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
 
                         childrenColoredBits += (1 << (7 - originalIndex));
                         inViewWithColorCount++;
+                        if (isEncodedAsLeaf(childNode)) {
+                            childComplete[originalIndex] = true;
+                        }
                     } else {
                         // otherwise just track stats of the items we discarded
                         // don't need to check childNode here, because we can't get here with no childNode
@@ -1070,6 +1333,14 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
                             }
                         }
                     }
+                } else if (params.knownState && !isEncodedAsLeaf(childNode) && !childIsKnown && !childIsOccluded &&
+                           childrenAreWithinLOD(childNode, params)) {
+                    // we're about to send what's below this child, when we keep a known state we also send its color,
+                    // so that once the client has the subtree it can render it from afar without us sending it again.
+                    // Children that are occluded, known or too far for their own children to render send nothing below.
+                    childrenColoredBits += (1 << (7 - originalIndex));
+                    childrenColoredForKnownStateBits += (1 << (7 - originalIndex));
+                    inViewWithColorCount++;
                 }
             }
         }
@@ -1089,7 +1360,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
     if (continueThisLevel && params.includeColor) {
         for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
             if (oneAtBit(childrenColoredBits, i)) {
-                OctreeElement* childNode = node->getChildAtIndex(i);
+                OctreeElement* childNode = children[i];
                 if (childNode) {
                     int bytesBeforeChild = packetData->getUncompressedSize();
                     continueThisLevel = childNode->appendElementData(packetData);
@@ -1181,8 +1452,13 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
                 //
                 // This only applies in the view frustum case, in other cases, like file save and copy/past where
                 // no viewFrustum was requested, we still want to recurse the child tree.
-                if (!params.viewFrustum || !oneAtBit(childrenColoredBits, originalIndex)) {
-                    childTreeBytesOut = encodeTreeBitstreamRecursion(childNode, packetData, bag, params, thisLevel);
+                if (!params.viewFrustum ||
+                        !oneAtBit(childrenColoredBits & ~childrenColoredForKnownStateBits, originalIndex)) {
+                    childTreeBytesOut = encodeTreeBitstreamRecursion(childNode, packetData, bag, params, thisLevel,
+                                                                     childStates[originalIndex]);
+                    if (params.subtreeComplete) {
+                        childComplete[originalIndex] = true;
+                    }
                 }
 
                 // remember this for reshuffling
@@ -1285,7 +1561,7 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
     }
 
     if (!continueThisLevel) {
-        bag.insert(node);
+        bag.insert(node, node->getEncodePriority(params.viewFrustum));
 
         // don't need to check node here, because we can't get here with no node
         if (params.stats) {
@@ -1296,6 +1572,30 @@ int Octree::encodeTreeBitstreamRecursion(OctreeElement* node,
         bytesAtThisLevel = 0; // didn't fit
     }
 
+    // record what the client will now have, if we sent all of our children we're known as a whole, otherwise the leaves
+    // we colored are known on their own
+    bool subtreeComplete = continueThisLevel;
+    if (params.knownState) {
+        for (int i = 0; i < NUMBER_OF_CHILDREN && subtreeComplete; i++) {
+            if (node->getChildAtIndex(i) && !childComplete[i]) {
+                subtreeComplete = false;
+            }
+        }
+        if (!continueThisLevel) {
+            params.knownState->discardPending(knownStatePendingAtStart);
+        } else if (subtreeComplete) {
+            params.knownState->subtreeSent(node);
+        } else {
+            for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+                OctreeElement* childNode = node->getChildAtIndex(i);
+                if (childNode && isEncodedAsLeaf(childNode) && oneAtBit(childrenColoredBits, i)) {
+                    params.knownState->subtreeSent(childNode);
+                }
+            }
+        }
+    }
+    params.subtreeComplete = params.knownState && subtreeComplete;
+
     return bytesAtThisLevel;
 }
 
@@ -1333,7 +1633,7 @@ bool Octree::readFromSVOFile(const char* fileName) {
                 dataLength -= sizeof(expectedType);
                 PacketVersion expectedVersion = versionForPacketType(expectedType);
                 PacketVersion gotVersion = *dataAt;
-                if (gotVersion == expectedVersion) {
+                if (canReadSVOfileVersion(gotVersion)) {
                     dataAt += sizeof(expectedVersion);
                     dataLength -= sizeof(expectedVersion);
                     fileOk = true;
@@ -1359,8 +1659,8 @@ bool Octree::readFromSVOFile(const char* fileName) {
     return fileOk;
 }
 
-void Octree::writeToSVOFile(const char* fileName, OctreeElement* node) {
-
+bool Octree::writeToSVOFile(const char* fileName, OctreeElement* node) {
+    bool fileOk = false;
     std::ofstream file(fileName, std::ios::out|std::ios::binary);
 
     if(file.is_open()) {
@@ -1412,8 +1712,35 @@ void Octree::writeToSVOFile(const char* fileName, OctreeElement* node) {
             file.write((const char*)packetData.getFinalizedData(), packetData.getFinalizedSize());
         }
 
+        fileOk = file.good();
     }
     file.close();
+    return fileOk && !file.fail();
+}
+
+bool Octree::readFromIndexedSVOFile(const char* fileName) {
+    OctreeIndexedFile* indexedFile = new OctreeIndexedFile();
+    if (!indexedFile->open(this, fileName)) {
+        delete indexedFile;
+        return false;
+    }
+    delete _indexedFile;
+    _indexedFile = indexedFile;
+
+    if (!supportsLazyLoading()) {
+        while (hasUnloadedSubtrees()) {
+            loadUnloadedSubtrees(USECS_PER_SECOND);
+        }
+    }
+    return true;
+}
+
+bool Octree::writeToIndexedSVOFile(const char* fileName, int indexLevel) {
+    return OctreeIndexedFile::write(this, fileName, indexLevel);
+}
+
+int Octree::loadUnloadedSubtrees(quint64 timeBudgetUsecs) {
+    return hasUnloadedSubtrees() ? _indexedFile->loadSubtrees(this, timeBudgetUsecs) : 0;
 }
 
 unsigned long Octree::getOctreeElementsCount() {
@@ -1500,12 +1827,19 @@ void dumpSetContents(const char* name, std::set<unsigned char*> set) {
 }
 
 void Octree::startEncoding(OctreeElement* node) {
+    // with snapshot reads, deletes never need to wait for encoders, the epoch manager keeps retired elements around
+    if (_wantSnapshotReads) {
+        return;
+    }
     _encodeSetLock.lock();
     _codesBeingEncoded.insert(node->getOctalCode());
     _encodeSetLock.unlock();
 }
 
 void Octree::doneEncoding(OctreeElement* node) {
+    if (_wantSnapshotReads) {
+        return;
+    }
     _encodeSetLock.lock();
     _codesBeingEncoded.erase(node->getOctalCode());
     _encodeSetLock.unlock();
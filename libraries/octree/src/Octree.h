@@ -16,8 +16,11 @@
 class CoverageMap;
 class ReadBitstreamToTreeParams;
 class Octree;
+class OctreeEditBatch;
 class OctreeElement;
 class OctreeElementBag;
+class OctreeEncodeCache;
+class OctreeKnownState;
 class OctreePacketData;
 
 
@@ -25,6 +28,7 @@ class OctreePacketData;
 #include "ViewFrustum.h"
 #include "OctreeElement.h"
 #include "OctreeElementBag.h"
+#include "OctreeIndexedFile.h"
 #include "OctreePacketData.h"
 #include "OctreeSceneStats.h"
 
@@ -54,6 +58,18 @@ const quint64 IGNORE_LAST_SENT  = 0;
 #define IGNORE_COVERAGE_MAP      NULL
 #define IGNORE_JURISDICTION_MAP  NULL
 
+/// Where the encode found an element to be when it looked at the element's parent, so that the element doesn't look
+/// itself up again: its place in the view frustums along with the tests its children still need, and its position in
+/// the jurisdiction.
+class EncodeElementState {
+public:
+    ViewFrustum::location location;
+    unsigned char testMask;
+    ViewFrustum::location lastLocation; // against the last view frustum, only found in delta view frustum mode
+    unsigned char lastTestMask;
+    JurisdictionPosition jurisdiction; // only found when there's a jurisdiction map
+};
+
 class EncodeBitstreamParams {
 public:
     int maxEncodeLevel;
@@ -72,6 +88,8 @@ public:
     OctreeSceneStats* stats;
     CoverageMap* map;
     JurisdictionMap* jurisdictionMap;
+    OctreeEncodeCache* encodeCache; // optional, shared encodings of subtrees that are entirely in view
+    OctreeKnownState* knownState; // optional, subtrees the client already has, needs includeColor
 
     // output hints from the encode process
     typedef enum {
@@ -84,9 +102,11 @@ public:
         OUT_OF_VIEW,
         WAS_IN_VIEW,
         NO_CHANGE,
-        OCCLUDED
+        OCCLUDED,
+        WAS_KNOWN
     } reason;
     reason stopReason;
+    bool subtreeComplete; // set by each level of the recursion, true if everything below it was sent or known
 
     EncodeBitstreamParams(
         int maxEncodeLevel = INT_MAX,
@@ -120,7 +140,10 @@ public:
             stats(stats),
             map(map),
             jurisdictionMap(jurisdictionMap),
-            stopReason(UNKNOWN)
+            encodeCache(NULL),
+            knownState(NULL),
+            stopReason(UNKNOWN),
+            subtreeComplete(false)
     {}
 
     void displayStopReason() {
@@ -138,6 +161,7 @@ public:
             case WAS_IN_VIEW: printf("WAS_IN_VIEW\n"); break;
             case NO_CHANGE: printf("NO_CHANGE\n"); break;
             case OCCLUDED: printf("OCCLUDED\n"); break;
+            case WAS_KNOWN: printf("WAS_KNOWN\n"); break;
         }
     }
 };
@@ -188,10 +212,25 @@ public:
     // own definition. Implement these to allow your octree based server to support editing
     virtual bool getWantSVOfileVersions() const { return false; }
     virtual PacketType expectedDataPacketType() const { return PacketTypeUnknown; }
+    virtual bool canReadSVOfileVersion(PacketVersion version) const {
+        return version == versionForPacketType(expectedDataPacketType());
+    }
     virtual bool handlesEditPacketType(PacketType packetType) const { return false; }
     virtual int processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
                     const unsigned char* editData, int maxLength, const SharedNodePointer& sourceNode) { return 0; }
 
+    // Trees can also let the OctreeServer gather the edit records of several packets into an OctreeEditBatch and apply
+    // them all under one write lock. Implement these for the edit packet types whose records don't need the packet
+    // they came in or the node that sent them, and that can be applied in the order of their octal codes.
+    virtual bool handlesEditBatchPacketType(PacketType packetType) const { return false; }
+
+    /// \return the size of the edit record at editData, or 0 if it's malformed and the rest of the packet is skipped
+    virtual int getEditRecordSize(PacketType packetType, const unsigned char* editData, int maxLength) { return 0; }
+
+    /// Applies a sorted batch, with the same result as processEditPacketData() for each record in the order they
+    /// arrived. Caller must hold the write lock.
+    virtual void processEditBatch(const OctreeEditBatch& batch) { }
+
 
     virtual void update() { }; // nothing to do by default
 
@@ -205,7 +244,9 @@ public:
     void reaverageOctreeElements(OctreeElement* startNode = NULL);
 
     void deleteOctreeElementAt(float x, float y, float z, float s);
-    OctreeElement* getOctreeElementAt(float x, float y, float z, float s) const;
+
+    /// In trees that fold subtrees this unfolds the path to the element, so the caller must hold the write lock.
+    OctreeElement* getOctreeElementAt(float x, float y, float z, float s);
     OctreeElement* getOrCreateChildElementAt(float x, float y, float z, float s);
 
     void recurseTreeWithOperation(RecurseOctreeOperation operation, void* extraData=NULL);
@@ -220,6 +261,7 @@ public:
     void clearDirtyBit() { _isDirty = false; }
     void setDirtyBit() { _isDirty = true; }
 
+    /// A ray that hits a voxel folded below an element (see supportsFolding()) reports that element.
     bool findRayIntersection(const glm::vec3& origin, const glm::vec3& direction,
                              OctreeElement*& node, float& distance, BoxFace& face);
 
@@ -232,17 +274,73 @@ public:
     void loadOctreeFile(const char* fileName, bool wantColorRandomizer);
 
     // these will read/write files that match the wireformat, excluding the 'V' leading
-    void writeToSVOFile(const char* filename, OctreeElement* node = NULL);
+    /// \return true if the whole file was written
+    bool writeToSVOFile(const char* filename, OctreeElement* node = NULL);
     bool readFromSVOFile(const char* filename);
+
+    /// Indexed SVO files, see OctreeIndexedFile. Reading one only decodes the top levels of the tree, the rest is decoded
+    /// by loadUnloadedSubtrees(), sooner for the parts encoders reach, and right away for the parts edits touch. Trees
+    /// that don't support lazy loading decode the whole file at once. Caller must hold the write lock while reading.
+    bool readFromIndexedSVOFile(const char* filename);
+    bool writeToIndexedSVOFile(const char* filename, int indexLevel = OctreeIndexedFile::DEFAULT_INDEX_LEVEL);
+    virtual bool supportsLazyLoading() const { return false; }
+    bool hasUnloadedSubtrees() const { return _indexedFile && _indexedFile->getUnloadedCount() > 0; }
+    int getUnloadedSubtreeCount() const { return _indexedFile ? _indexedFile->getUnloadedCount() : 0; }
+
+    /// Loads subtrees from the indexed file until the time budget is spent. Caller must hold the write lock.
+    /// \return number of subtrees loaded
+    int loadUnloadedSubtrees(quint64 timeBudgetUsecs);
+
+    /// Edits must call this before changing the tree at an octal code, so that the data still in the indexed file for
+    /// that part of the tree doesn't later overwrite the edit, and so that nothing on its path is folded. Caller must
+    /// hold the write lock.
+    void loadSubtreesForEdit(const unsigned char* octalCode) {
+        if (hasUnloadedSubtrees()) {
+            _indexedFile->loadSubtreesFor(this, octalCode);
+        }
+        unfoldPathTo(octalCode);
+    }
     // reads voxels from square image with alpha as a Y-axis
     bool readFromSquareARGB32Pixels(const char *filename);
     bool readFromSchematicFile(const char* filename);
 
+    /// Snapshot reads let encoders traverse the tree without the read lock, so they neither block nor are blocked by
+    /// writers. Writers still serialize on lockForWrite(), but child arrays become copy-on-write and elements they unlink
+    /// are retired to the OctreeEpochManager rather than deleted. Only trees whose element data can safely be read while
+    /// it is being written should support this, and it has to be enabled before the tree is populated.
+    virtual bool supportsSnapshotReads() const { return false; }
+
+    /// Can the state of this tree be rebuilt by replaying its edit packets in order on top of an older copy of it. This
+    /// requires edits to overwrite whatever they touch, and that nothing else (like simulation) changes the tree.
+    virtual bool canReplayEdits() const { return false; }
+    void setWantSnapshotReads(bool wantSnapshotReads);
+    bool getWantSnapshotReads() const { return _wantSnapshotReads; }
+
+    /// Folding lets the tree pack the elements below subtrees that haven't changed in a while into a compact store of
+    /// its own, the folded element keeps its color and is marked as having unloaded children. getOctreeElementAt() and
+    /// loadSubtreesForEdit() unfold the path they reach, encodeTreeBitstream() and findRayIntersection() read the
+    /// folded voxels in place, everything else sees a folded element as a leaf.
+    virtual bool supportsFolding() const { return false; }
+    void setWantFolding(bool wantFolding);
+    bool getWantFolding() const { return _wantFolding; }
+
+    /// Trees that fold find where a ray (in tree units) first hits the voxels folded below an element.
+    /// \return false if the element isn't folded, otherwise hit is set, and distance and face if it's true
+    virtual bool findRayIntersectionInFolded(const OctreeElement* element, const glm::vec3& origin,
+                                             const glm::vec3& direction, bool& hit, float& distance,
+                                             BoxFace& face) const { return false; }
+
+    /// Begins a read of the tree that may run concurrently with writers when snapshot reads are enabled, otherwise
+    /// this simply takes the read lock.
+    /// \return token that must be passed to endSnapshotRead()
+    quint64 beginSnapshotRead();
+    void endSnapshotRead(quint64 snapshotToken);
+
     // Octree does not currently handle its own locking, caller must use these to lock/unlock
     void lockForRead() { lock.lockForRead(); }
     bool tryLockForRead() { return lock.tryLockForRead(); }
-    void lockForWrite() { lock.lockForWrite(); }
-    bool tryLockForWrite() { return lock.tryLockForWrite(); }
+    void lockForWrite();
+    bool tryLockForWrite();
     void unlock() { lock.unlock(); }
 
     unsigned long getOctreeElementsCount();
@@ -274,10 +372,22 @@ protected:
 
     int encodeTreeBitstreamRecursion(OctreeElement* node,
                                      OctreePacketData* packetData, OctreeElementBag& bag,
-                                     EncodeBitstreamParams& params, int& currentEncodeLevel) const;
+                                     EncodeBitstreamParams& params, int& currentEncodeLevel,
+                                     const EncodeElementState& elementState) const;
 
     static bool countOctreeElementsOperation(OctreeElement* node, void* extraData);
 
+    /// Trees that fold encode the children of a folded element here, as encodeTreeBitstreamRecursion() would have
+    /// written them, once the element itself passed its checks.
+    /// \return false if the element isn't folded, otherwise bytesWritten is set, or didntFit if nothing fit
+    virtual bool encodeFoldedChildren(const OctreeElement* element, OctreePacketData* packetData,
+                                      EncodeBitstreamParams& params, int currentEncodeLevel,
+                                      const EncodeElementState& elementState, int& bytesWritten,
+                                      bool& didntFit) const { return false; }
+
+    /// Trees that fold unfold each folded element on the path to the octal code, down to and including its element.
+    virtual void unfoldPathTo(const unsigned char* octalCode) { }
+
     OctreeElement* nodeForOctalCode(OctreeElement* ancestorNode, const unsigned char* needleCode, OctreeElement** parentOfFoundNode) const;
     OctreeElement* createMissingNode(OctreeElement* lastParentNode, const unsigned char* codeToReach);
     int readNodeData(OctreeElement *destinationNode, const unsigned char* nodeData,
@@ -324,6 +434,12 @@ protected:
     void emptyDeleteQueue();
 
     QReadWriteLock lock;
+    bool _wantSnapshotReads;
+    bool _wantFolding;
+    void reclaimRetiredElements();
+
+    friend class OctreeIndexedFile;
+    OctreeIndexedFile* _indexedFile; // the indexed file we're still loading subtrees from, if any
     
     /// This tree is receiving inbound viewer datagrams.
     bool _isViewing;
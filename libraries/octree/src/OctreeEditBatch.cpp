@@ -0,0 +1,78 @@
+//
+//  OctreeEditBatch.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Edit records from many edit packets, gathered up to be applied to a tree in one pass
+//
+
+#include <algorithm>
+
+#include <OctalCode.h>
+
+#include "OctreeEditBatch.h"
+
+class DepthFirstRecordOrder {
+public:
+    DepthFirstRecordOrder(const std::vector<OctreeEditRecord>& records) : _records(records) { }
+
+    bool operator()(int indexA, int indexB) const {
+        return compareOctalCodesDepthFirst(_records[indexA].editData, _records[indexB].editData) == LESS_THAN;
+    }
+
+private:
+    const std::vector<OctreeEditRecord>& _records;
+};
+
+OctreeEditBatch::OctreeEditBatch() :
+    _packets(),
+    _records(),
+    _sortedIndices(),
+    _canApplySorted(true)
+{
+}
+
+void OctreeEditBatch::addRecord(PacketType packetType, const unsigned char* editData, int size) {
+    OctreeEditRecord record = { packetType, editData, size };
+    _records.push_back(record);
+}
+
+void OctreeEditBatch::sort() {
+    int numRecords = _records.size();
+    _sortedIndices.resize(numRecords);
+    for (int i = 0; i < numRecords; i++) {
+        _sortedIndices[i] = i;
+    }
+    std::stable_sort(_sortedIndices.begin(), _sortedIndices.end(), DepthFirstRecordOrder(_records));
+
+    // walk the sorted records keeping the chain of ancestors of the current one, along with the latest any of them
+    // arrived, if a record arrived before one of its ancestors then the sort put them the wrong way around
+    _canApplySorted = true;
+    std::vector<int> ancestors;
+    std::vector<int> latestArrivals;
+    for (int i = 0; i < numRecords && _canApplySorted; i++) {
+        int index = _sortedIndices[i];
+        const unsigned char* octalCode = _records[index].editData;
+        while (!ancestors.empty()) {
+            const unsigned char* ancestorCode = _records[ancestors.back()].editData;
+            if (numberOfCommonThreeBitSections(ancestorCode, octalCode) == numberOfThreeBitSectionsInCode(ancestorCode)) {
+                break;
+            }
+            ancestors.pop_back();
+            latestArrivals.pop_back();
+        }
+        if (!latestArrivals.empty() && latestArrivals.back() > index) {
+            _canApplySorted = false;
+        }
+        ancestors.push_back(index);
+        latestArrivals.push_back(latestArrivals.empty() ? index : std::max(latestArrivals.back(), index));
+    }
+}
+
+void OctreeEditBatch::clear() {
+    _packets.clear();
+    _records.clear();
+    _sortedIndices.clear();
+    _canApplySorted = true;
+}
@@ -0,0 +1,66 @@
+//
+//  OctreeEditBatch.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Edit records from many edit packets, gathered up to be applied to a tree in one pass
+//
+
+#ifndef __hifi__OctreeEditBatch__
+#define __hifi__OctreeEditBatch__
+
+#include <vector>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+
+#include <PacketHeaders.h>
+
+/// One edit record, which starts with the octal code of the element it edits.
+class OctreeEditRecord {
+public:
+    PacketType packetType;
+    const unsigned char* editData; // points into one of the batch's packets
+    int size;
+};
+
+/// Collects edit records from edit packets in the order they arrived, and sorts them into the order a depth first
+/// traversal of the tree reaches their elements, so that a tree can apply them all in one pass that only descends from
+/// the root once and reaverages each changed ancestor once.
+class OctreeEditBatch {
+public:
+    OctreeEditBatch();
+
+    /// Keeps a packet whose records are about to be added, so that the records stay valid for as long as the batch. A
+    /// packet made with QByteArray::fromRawData() only refers to its data, which the caller has to keep until clear().
+    void addPacket(const QByteArray& packet) { _packets.append(packet); }
+
+    void addRecord(PacketType packetType, const unsigned char* editData, int size);
+
+    /// Sorts the records by their octal codes, records with the same code stay in the order they arrived.
+    void sort();
+
+    /// \return false if sorting moved an edit of an element ahead of an edit of one of its descendants that arrived
+    /// before it, in which case the records only have the same result when they're applied in the order they arrived
+    bool canApplySorted() const { return _canApplySorted; }
+
+    void clear();
+
+    bool isEmpty() const { return _records.empty(); }
+    int size() const { return _records.size(); }
+
+    /// \return the records in the order they arrived
+    const std::vector<OctreeEditRecord>& getRecords() const { return _records; }
+
+    /// \return the records in the order sort() put them in
+    const OctreeEditRecord& getSortedRecord(int index) const { return _records[_sortedIndices[index]]; }
+
+private:
+    QVector<QByteArray> _packets;
+    std::vector<OctreeEditRecord> _records;
+    std::vector<int> _sortedIndices;
+    bool _canApplySorted;
+};
+
+#endif /* defined(__hifi__OctreeEditBatch__) */
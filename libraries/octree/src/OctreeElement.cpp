@@ -6,10 +6,12 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <stdio.h>
 
+#include <QtCore/QAtomicPointer>
 #include <QtCore/QDebug>
 
 #include <NodeList.h>
@@ -21,14 +23,51 @@
 #include "SharedUtil.h"
 #include "OctreeConstants.h"
 #include "OctreeElement.h"
+#include "OctreeElementBag.h"
+#include "OctreeEpochManager.h"
+#include "OctreeMemoryPool.h"
 #include "Octree.h"
 
 quint64 OctreeElement::_voxelMemoryUsage = 0;
 quint64 OctreeElement::_octcodeMemoryUsage = 0;
 quint64 OctreeElement::_externalChildrenMemoryUsage = 0;
+quint64 OctreeElement::_unpooledOctcodeMemoryUsage = 0;
 quint64 OctreeElement::_voxelNodeCount = 0;
 quint64 OctreeElement::_voxelNodeLeafCount = 0;
 
+// octal codes too long for the inline buffer, but short enough for a pool block (codes up to 40 levels deep)
+const int POOLED_OCTCODE_BYTES = 16;
+
+static OctreeMemoryPool* octcodePool() {
+    static OctreeMemoryPool* pool = new OctreeMemoryPool("Octal Codes", POOLED_OCTCODE_BYTES);
+    return pool;
+}
+
+static OctreeMemoryPool* childArrayPool() {
+    static OctreeMemoryPool* pool = new OctreeMemoryPool("Child Arrays", sizeof(OctreeElement*) * NUMBER_OF_CHILDREN);
+    return pool;
+}
+
+OctreeElement** OctreeElement::allocateChildArray() {
+    return static_cast<OctreeElement**>(childArrayPool()->allocate());
+}
+
+void OctreeElement::releaseChildArray(OctreeElement** children) {
+    childArrayPool()->release(children);
+}
+
+#ifdef SIMPLE_EXTERNAL_CHILDREN
+// Stores a fully built child array with release semantics, so that snapshot readers never see it partially initialized
+static inline void publishChildArray(OctreeElement**& slot, OctreeElement** children) {
+    reinterpret_cast<QBasicAtomicPointer<OctreeElement*>*>(&slot)->storeRelease(children);
+}
+
+// Pairs with publishChildArray(), a snapshot reader sees the array's contents as they were when it was published
+static inline OctreeElement** loadPublishedChildArray(OctreeElement** const& slot) {
+    return reinterpret_cast<const QBasicAtomicPointer<OctreeElement*>*>(&slot)->loadAcquire();
+}
+#endif
+
 OctreeElement::OctreeElement() {
     // Note: you must call init() from your subclass, otherwise the OctreeElement will not be properly
     // initialized. You will see DEADBEEF in your memory debugger if you have not properly called init()
@@ -45,10 +84,18 @@ void OctreeElement::init(unsigned char * octalCode) {
 
 
     int octalCodeLength = bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(octalCode));
-    if (octalCodeLength > sizeof(_octalCode)) {
+    if (octalCodeLength > POOLED_OCTCODE_BYTES) {
         _octalCode.pointer = octalCode;
         _octcodePointer = true;
         _octcodeMemoryUsage += octalCodeLength;
+        _unpooledOctcodeMemoryUsage += octalCodeLength;
+    } else if (octalCodeLength > sizeof(_octalCode)) {
+        // we own the caller's code either way, move it into a pool block
+        _octalCode.pointer = static_cast<unsigned char*>(octcodePool()->allocate());
+        memcpy(_octalCode.pointer, octalCode, octalCodeLength);
+        delete[] octalCode;
+        _octcodePointer = true;
+        _octcodeMemoryUsage += octalCodeLength;
     } else {
         _octcodePointer = false;
         memcpy(_octalCode.buffer, octalCode, octalCodeLength);
@@ -58,6 +105,9 @@ void OctreeElement::init(unsigned char * octalCode) {
     // set up the _children union
     _childBitmask = 0;
     _childrenExternal = false;
+    _isSnapshotSafe = false;
+    _isRetired = false;
+    _hasUnloadedChildren = false;
 
 #ifdef BLENDED_UNION_CHILDREN
     _children.external = NULL;
@@ -79,7 +129,7 @@ void OctreeElement::init(unsigned char * octalCode) {
 #endif
 
 #ifdef SIMPLE_EXTERNAL_CHILDREN
-    _children.single = NULL;
+    _children.single = NULL; // also sets _children.external to NULL
 #endif
 
     _isDirty = true;
@@ -97,8 +147,14 @@ OctreeElement::~OctreeElement() {
     }
 
     if (_octcodePointer) {
-        _octcodeMemoryUsage -= bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(getOctalCode()));
-        delete[] _octalCode.pointer;
+        int octalCodeLength = bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(getOctalCode()));
+        _octcodeMemoryUsage -= octalCodeLength;
+        if (octalCodeLength > POOLED_OCTCODE_BYTES) {
+            _unpooledOctcodeMemoryUsage -= octalCodeLength;
+            delete[] _octalCode.pointer;
+        } else {
+            octcodePool()->release(_octalCode.pointer);
+        }
     }
 
     // delete all of this node's children, this also takes care of all population tracking data
@@ -196,9 +252,9 @@ void OctreeElement::calculateAABox() {
 void OctreeElement::deleteChildAtIndex(int childIndex) {
     OctreeElement* childAt = getChildAtIndex(childIndex);
     if (childAt) {
-        //printf("deleteChildAtIndex()... about to call delete childAt=%p\n",childAt);
-        delete childAt;
+        // unlink the child before disposing of it, snapshot readers may still be able to reach it until then
         setChildAtIndex(childIndex, NULL);
+        disposeElement(childAt);
         _isDirty = true;
         markWithChangedTime();
 
@@ -232,6 +288,39 @@ OctreeElement* OctreeElement::removeChildAtIndex(int childIndex) {
     return returnedChild;
 }
 
+void OctreeElement::disposeElement(OctreeElement* element) {
+    if (!element) {
+        return;
+    }
+    if (element->_isSnapshotSafe) {
+        element->markSubtreeRetired();
+        OctreeEpochManager::getInstance()->retireElement(element);
+    } else {
+        delete element;
+    }
+}
+
+void OctreeElement::makeSnapshotSafe() {
+    _isSnapshotSafe = true;
+#ifdef SIMPLE_EXTERNAL_CHILDREN
+    // snapshot safe elements always keep their children in an external array, see setChildAtIndex()
+    _childrenExternal = true;
+#endif
+}
+
+// Let our delete hooks (like the encoders' bags) forget about the subtree now. They will be called again when the
+// elements are actually deleted, which is harmless.
+void OctreeElement::markSubtreeRetired() {
+    _isRetired = true;
+    notifyDeleteHooks();
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* childAt = getChildAtIndex(i);
+        if (childAt) {
+            childAt->markSubtreeRetired();
+        }
+    }
+}
+
 #ifdef HAS_AUDIT_CHILDREN
 void OctreeElement::auditChildren(const char* label) const {
     bool auditFailed = false;
@@ -294,6 +383,12 @@ OctreeElement* OctreeElement::getChildAtIndex(int childIndex) const {
 #endif // SIMPLE_CHILD_ARRAY
 
 #ifdef SIMPLE_EXTERNAL_CHILDREN
+    if (_childrenExternal) {
+        // snapshot safe children, don't consult _childBitmask since a writer may be between updating it and the array
+        OctreeElement** children = loadPublishedChildArray(_children.external);
+        return children ? children[childIndex] : NULL;
+    }
+
     int childCount = getChildCount();
 
     switch (childCount) {
@@ -639,6 +734,15 @@ void OctreeElement::deleteAllChildren() {
         }
     }
 
+#ifdef SIMPLE_EXTERNAL_CHILDREN
+    // snapshot safe children own their array even with a single child, we're being deleted so no one can be reading it
+    if (_childrenExternal && _children.external) {
+        releaseChildArray(_children.external);
+        _externalChildrenMemoryUsage -= NUMBER_OF_CHILDREN * sizeof(OctreeElement*);
+        _children.external = NULL;
+    }
+#endif
+
 #ifdef BLENDED_UNION_CHILDREN
     // now, reset our internal state and ANY and all population data
     int childCount = getChildCount();
@@ -725,13 +829,37 @@ void OctreeElement::setChildAtIndex(int childIndex, OctreeElement* child) {
         _childrenCount[newChildCount]++;
     }
 
-    if ((previousChildCount == 0 || previousChildCount == 1) && newChildCount == 0) {
+    if (_childrenExternal) {
+        // snapshot safe children: never modify a published child array in place, snapshot readers may be traversing it.
+        // Instead publish a modified copy, and retire the previous array until those readers are done.
+        OctreeElement** previousChildren = _children.external;
+        OctreeElement* previousChild = previousChildren ? previousChildren[childIndex] : NULL;
+        if (previousChild == child) {
+            return; // nothing to change, don't bother copying
+        }
+        OctreeElement** newChildren = NULL;
+        if (newChildCount > 0) {
+            newChildren = allocateChildArray();
+            if (previousChildren) {
+                memcpy(newChildren, previousChildren, sizeof(OctreeElement*) * NUMBER_OF_CHILDREN);
+            } else {
+                memset(newChildren, 0, sizeof(OctreeElement*) * NUMBER_OF_CHILDREN);
+            }
+            newChildren[childIndex] = child;
+            _externalChildrenMemoryUsage += NUMBER_OF_CHILDREN * sizeof(OctreeElement*);
+        }
+        publishChildArray(_children.external, newChildren);
+        if (previousChildren) {
+            _externalChildrenMemoryUsage -= NUMBER_OF_CHILDREN * sizeof(OctreeElement*);
+            OctreeEpochManager::getInstance()->retireChildArray(previousChildren);
+        }
+    } else if ((previousChildCount == 0 || previousChildCount == 1) && newChildCount == 0) {
         _children.single = NULL;
     } else if (previousChildCount == 0 && newChildCount == 1) {
         _children.single = child;
     } else if (previousChildCount == 1 && newChildCount == 2) {
         OctreeElement* previousChild = _children.single;
-        _children.external = new OctreeElement*[NUMBER_OF_CHILDREN];
+        _children.external = allocateChildArray();
         memset(_children.external, 0, sizeof(OctreeElement*) * NUMBER_OF_CHILDREN);
         _children.external[firstIndex] = previousChild;
         _children.external[childIndex] = child;
@@ -742,7 +870,7 @@ void OctreeElement::setChildAtIndex(int childIndex, OctreeElement* child) {
         assert(child == NULL); // we are removing a child, so this must be true!
         OctreeElement* previousFirstChild = _children.external[firstIndex];
         OctreeElement* previousSecondChild = _children.external[secondIndex];
-        delete[] _children.external;
+        releaseChildArray(_children.external);
         _externalChildrenMemoryUsage -= NUMBER_OF_CHILDREN * sizeof(OctreeElement*);
         if (childIndex == firstIndex) {
             _children.single = previousSecondChild;
@@ -1114,6 +1242,9 @@ OctreeElement* OctreeElement::addChildAtIndex(int childIndex) {
 
         unsigned char* newChildCode = childOctalCode(getOctalCode(), childIndex);
         childAt = createNewElement(newChildCode);
+        if (_isSnapshotSafe) {
+            childAt->makeSnapshotSafe(); // before setChildAtIndex() publishes it to the snapshot readers
+        }
         setChildAtIndex(childIndex, childAt);
 
         _isDirty = true;
@@ -1213,7 +1344,9 @@ bool OctreeElement::calculateShouldRender(const ViewFrustum* viewFrustum, float
         float childBoundary    = boundaryDistanceForRenderLevel(getLevel() + 1 + boundaryLevelAdjust, voxelScaleSize);
         bool  inBoundary       = (furthestDistance <= boundary);
         bool  inChildBoundary  = (furthestDistance <= childBoundary);
-        shouldRender = (isLeaf() && inChildBoundary) || (inBoundary && !inChildBoundary);
+        // elements with unloaded children are rendered as the parents they are, so that their subtrees get sent
+        bool rendersAsLeaf = isLeaf() && !hasUnloadedChildren();
+        shouldRender = (rendersAsLeaf && inChildBoundary) || (inBoundary && !inChildBoundary);
     }
     return shouldRender;
 }
@@ -1235,6 +1368,15 @@ float OctreeElement::distanceToCamera(const ViewFrustum& viewFrustum) const {
     return distanceToVoxelCenter;
 }
 
+float OctreeElement::getEncodePriority(const ViewFrustum* viewFrustum) const {
+    if (!viewFrustum) {
+        return DEFAULT_BAG_PRIORITY;
+    }
+    const float MIN_PRIORITY_DISTANCE = 0.001f; // meters, we may be inside the element
+    float size = _box.getScale() * (float)TREE_SCALE;
+    return size / std::max(distanceToCamera(*viewFrustum), MIN_PRIORITY_DISTANCE);
+}
+
 float OctreeElement::distanceSquareToPoint(const glm::vec3& point) const {
     glm::vec3 temp = point - _box.calcCenter();
     float distanceSquare = glm::dot(temp, temp);
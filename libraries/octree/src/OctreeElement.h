@@ -119,6 +119,11 @@ public:
     float distanceToCamera(const ViewFrustum& viewFrustum) const; 
     float furthestDistanceToCamera(const ViewFrustum& viewFrustum) const;
 
+    /// How soon this element should be encoded when it's queued in an OctreeElementBag: its size relative to its
+    /// distance from the camera, so that the nearest and biggest subtrees are drained first.
+    /// \return DEFAULT_BAG_PRIORITY if there is no view frustum
+    float getEncodePriority(const ViewFrustum* viewFrustum) const;
+
     bool calculateShouldRender(const ViewFrustum* viewFrustum, 
                 float voxelSizeScale = DEFAULT_OCTREE_SIZE_SCALE, int boundaryLevelAdjust = 0) const;
     
@@ -136,6 +141,29 @@ public:
     void markWithChangedTime();
     quint64 getLastChanged() const { return _lastChanged; }
     void handleSubtreeChanged(Octree* myTree);
+
+    /// Has this element been unlinked from its tree and is only waiting for snapshot readers to finish with it
+    bool isRetired() const { return _isRetired; }
+
+    /// Are this element's children still waiting to be loaded from the indexed file its tree was read from, or folded
+    /// by its tree (see Octree::supportsFolding())
+    bool hasUnloadedChildren() const { return _hasUnloadedChildren; }
+    void setHasUnloadedChildren(bool hasUnloadedChildren) { _hasUnloadedChildren = hasUnloadedChildren; }
+
+    /// Deletes an element that has already been unlinked from its parent. When the element is snapshot safe it is
+    /// retired instead, and deleted once no snapshot reader can still be traversing it.
+    static void disposeElement(OctreeElement* element);
+
+    /// Makes this element's child array copy-on-write and has it retire deleted elements to the OctreeEpochManager, so
+    /// that snapshot readers can traverse it while it is being written. Children added later inherit the setting, so
+    /// the tree only needs to call this on a freshly created root, before readers can reach it.
+    void makeSnapshotSafe();
+    bool isSnapshotSafe() const { return _isSnapshotSafe; }
+
+    /// External child arrays (NUMBER_OF_CHILDREN pointers) come from a shared pool, these are also used by the
+    /// OctreeEpochManager to free retired arrays. The array returned by allocateChildArray() is not cleared.
+    static OctreeElement** allocateChildArray();
+    static void releaseChildArray(OctreeElement** children);
     
     // Used by VoxelSystem for rendering in/out of view and LOD
     void setShouldRender(bool shouldRender);
@@ -163,6 +191,9 @@ public:
     static quint64 getExternalChildrenMemoryUsage() { return _externalChildrenMemoryUsage; }
     static quint64 getTotalMemoryUsage() { return _voxelMemoryUsage + _octcodeMemoryUsage + _externalChildrenMemoryUsage; }
 
+    /// Octal codes that are too long for the octal code pool and are still individually allocated
+    static quint64 getUnpooledOctcodeMemoryUsage() { return _unpooledOctcodeMemoryUsage; }
+
     static quint64 getGetChildAtIndexTime() { return _getChildAtIndexTime; }
     static quint64 getGetChildAtIndexCalls() { return _getChildAtIndexCalls; }
     static quint64 getSetChildAtIndexTime() { return _setChildAtIndexTime; }
@@ -216,6 +247,7 @@ protected:
     void checkStoreFourChildren(OctreeElement* childOne, OctreeElement* childTwo, OctreeElement* childThree, OctreeElement* childFour);
 #endif
     void calculateAABox();
+    void markSubtreeRetired();
     void notifyDeleteHooks();
     void notifyUpdateHooks();
 
@@ -270,7 +302,12 @@ protected:
          _shouldRender : 1, /// Client only, should this voxel render at this time, 1 bit
          _octcodePointer : 1, /// Client and Server only, is this voxel's octal code a pointer or buffer, 1 bit
          _unknownBufferIndex : 1,
-         _childrenExternal : 1; /// Client only, is this voxel's VBO buffer the unknown buffer index, 1 bit
+         _childrenExternal : 1, /// Client only, is this voxel's VBO buffer the unknown buffer index, 1 bit
+                                /// (with SIMPLE_EXTERNAL_CHILDREN: are the children snapshot safe, always external)
+         _hasUnloadedChildren : 1, /// Server only, are the children still in the indexed file or folded, 1 bit
+         _isSnapshotSafe : 1; /// Server only, does this element's tree allow snapshot reads, 1 bit
+
+    bool _isRetired; /// Server only, unlinked from the tree and waiting to be reclaimed
 
     static QReadWriteLock _deleteHooksLock;
     static std::vector<OctreeElementDeleteHook*> _deleteHooks;
@@ -284,6 +321,7 @@ protected:
     static quint64 _voxelMemoryUsage;
     static quint64 _octcodeMemoryUsage;
     static quint64 _externalChildrenMemoryUsage;
+    static quint64 _unpooledOctcodeMemoryUsage;
 
     static quint64 _getChildAtIndexTime;
     static quint64 _getChildAtIndexCalls;
@@ -6,13 +6,17 @@
 //  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
+
 #include "OctreeElementBag.h"
 #include <OctalCode.h>
 
-OctreeElementBag::OctreeElementBag() : 
-    _bagElements(NULL),
-    _elementsInUse(0),
-    _sizeOfElementsArray(0) {
+// let stale heap entries pile up to this multiple of the live elements before dropping them
+const size_t MAX_STALE_HEAP_RATIO = 2;
+const size_t MIN_HEAP_SIZE_TO_COMPACT = 1000;
+
+OctreeElementBag::OctreeElementBag() :
+    _nextSequence(0) {
     OctreeElement::addDeleteHook(this);
 };
 
@@ -22,107 +26,98 @@ OctreeElementBag::~OctreeElementBag() {
 }
 
 void OctreeElementBag::deleteAll() {
-    if (_bagElements) {
-        delete[] _bagElements;
-    }
-    _bagElements = NULL;
-    _elementsInUse = 0;
-    _sizeOfElementsArray = 0;
+    QMutexLocker locker(&_mutex);
+    _elements.clear();
+    _heap.clear();
+    _nextSequence = 0;
 }
 
+// put a node into the bag
+void OctreeElementBag::insert(OctreeElement* element, float priority) {
+    QMutexLocker locker(&_mutex);
+
+    // don't hold on to elements that have been unlinked from their tree, we'd never hear about them being deleted
+    if (element->isRetired()) {
+        return;
+    }
 
-const int GROW_BAG_BY = 100;
+    Entry entry;
+    entry.priority = priority;
+    entry.sequence = _nextSequence++;
+    entry.element = element;
 
-// put a node into the bag
-void OctreeElementBag::insert(OctreeElement* element) {
-
-    // Search for where we should live in the bag (sorted)
-    // Note: change this to binary search... instead of linear!
-    int insertAt = _elementsInUse;
-    for (int i = 0; i < _elementsInUse; i++) {
-        // just compare the pointers... that's good enough
-        if (_bagElements[i] == element) {
-            return; // exit early!!
-        }
-        
-        if (_bagElements[i] > element) {
-            insertAt = i;
-            break;
+    QHash<OctreeElement*, Entry>::iterator existing = _elements.find(element);
+    if (existing != _elements.end()) {
+        // de-dupe, only requeue the element if it got more important
+        if (priority <= existing.value().priority) {
+            return;
         }
+        existing.value() = entry;
+    } else {
+        _elements.insert(element, entry);
+    }
+
+    _heap.push_back(entry);
+    std::push_heap(_heap.begin(), _heap.end());
+
+    if (_heap.size() > MIN_HEAP_SIZE_TO_COMPACT && _heap.size() > MAX_STALE_HEAP_RATIO * _elements.size()) {
+        compact();
     }
-    // at this point, inserAt will be the location we want to insert at.
-    
-    // If we don't have room in our bag, then grow the bag
-    if (_sizeOfElementsArray < _elementsInUse + 1) {
-        OctreeElement** oldBag = _bagElements;
-        _bagElements = new OctreeElement*[_sizeOfElementsArray + GROW_BAG_BY];
-        _sizeOfElementsArray += GROW_BAG_BY;
-        
-        // If we had an old bag...
-        if (oldBag) {
-            // copy old elements into the new bag, but leave a space where we need to
-            // insert the new node
-            memcpy(_bagElements, oldBag, insertAt * sizeof(OctreeElement*));
-            memcpy(&_bagElements[insertAt + 1], &oldBag[insertAt], (_elementsInUse - insertAt) * sizeof(OctreeElement*));
-            delete[] oldBag;
+}
+
+// NOTE: must be called with _mutex locked
+void OctreeElementBag::compact() {
+    std::vector<Entry> liveEntries;
+    liveEntries.reserve(_elements.size());
+    for (size_t i = 0; i < _heap.size(); i++) {
+        QHash<OctreeElement*, Entry>::const_iterator live = _elements.constFind(_heap[i].element);
+        if (live != _elements.constEnd() && live.value().sequence == _heap[i].sequence) {
+            liveEntries.push_back(_heap[i]);
         }
-    } else {
-        // move existing elements further back in the bag array, leave a space where we need to
-        // insert the new node
-        memmove(&_bagElements[insertAt + 1], &_bagElements[insertAt], (_elementsInUse - insertAt) * sizeof(OctreeElement*));
     }
-    _bagElements[insertAt] = element;
-    _elementsInUse++;
+    _heap.swap(liveEntries);
+    std::make_heap(_heap.begin(), _heap.end());
 }
- 
-// pull a node out of the bag (could come in any order)
+
+// pull the highest priority node out of the bag
 OctreeElement* OctreeElementBag::extract() {
-    // pull the last node out, and shrink our list...
-    if (_elementsInUse) {
-        
-        // get the last element
-        OctreeElement* element = _bagElements[_elementsInUse - 1];
-        
-        // reduce the count
-        _elementsInUse--;
-
-        return element;
+    QMutexLocker locker(&_mutex);
+    while (!_heap.empty()) {
+        Entry top = _heap.front();
+        std::pop_heap(_heap.begin(), _heap.end());
+        _heap.pop_back();
+
+        // skip entries for elements that have since been removed, or requeued with a higher priority
+        QHash<OctreeElement*, Entry>::iterator live = _elements.find(top.element);
+        if (live != _elements.end() && live.value().sequence == top.sequence) {
+            _elements.erase(live);
+            return top.element;
+        }
     }
     return NULL;
 }
 
+bool OctreeElementBag::isEmpty() const {
+    QMutexLocker locker(&_mutex);
+    return _elements.isEmpty();
+}
+
+int OctreeElementBag::count() const {
+    QMutexLocker locker(&_mutex);
+    return _elements.size();
+}
+
 bool OctreeElementBag::contains(OctreeElement* element) {
-    for (int i = 0; i < _elementsInUse; i++) {
-        // just compare the pointers... that's good enough
-        if (_bagElements[i] == element) {
-            return true; // exit early!!
-        }
-        // if we're past where it should be, then it's not here!
-        if (_bagElements[i] > element) {
-            return false;
-        }
-    }
-    // if we made it through the entire bag, it's not here!
-    return false;
+    QMutexLocker locker(&_mutex);
+    return _elements.contains(element);
 }
 
 void OctreeElementBag::remove(OctreeElement* element) {
-    int foundAt = -1;
-    for (int i = 0; i < _elementsInUse; i++) {
-        // just compare the pointers... that's good enough
-        if (_bagElements[i] == element) {
-            foundAt = i;
-            break;
-        }
-        // if we're past where it should be, then it's not here!
-        if (_bagElements[i] > element) {
-            break;
-        }
-    }
-    // if we found it, then we need to remove it....
-    if (foundAt != -1) {
-        memmove(&_bagElements[foundAt], &_bagElements[foundAt + 1], (_elementsInUse - foundAt) * sizeof(OctreeElement*));
-        _elementsInUse--;
+    QMutexLocker locker(&_mutex);
+    _elements.remove(element);
+    if (_elements.isEmpty()) {
+        // nothing live is left, don't bother skipping over the stale entries later
+        _heap.clear();
     }
 }
 
@@ -131,4 +126,3 @@ void OctreeElementBag::elementDeleted(OctreeElement* element) {
     remove(element); // note: remove can safely handle nodes that aren't in it, so we don't need to check contains()
 }
 
-
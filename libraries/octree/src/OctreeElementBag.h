@@ -14,31 +14,54 @@
 #ifndef __hifi__OctreeElementBag__
 #define __hifi__OctreeElementBag__
 
+#include <vector>
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+
 #include "OctreeElement.h"
 
+const float DEFAULT_BAG_PRIORITY = 0.0f;
+
 class OctreeElementBag : public OctreeElementDeleteHook {
 
 public:
     OctreeElementBag();
     ~OctreeElementBag();
     
-    void insert(OctreeElement* element); // put a element into the bag
-    OctreeElement* extract(); // pull a element out of the bag (could come in any order)
+    /// put an element into the bag, if it's already in the bag it keeps the higher of its two priorities
+    void insert(OctreeElement* element, float priority = DEFAULT_BAG_PRIORITY);
+    OctreeElement* extract(); // pull the highest priority element out of the bag, ties come out most recent first
     bool contains(OctreeElement* element); // is this element in the bag?
     void remove(OctreeElement* element); // remove a specific element from the bag
     
-    bool isEmpty() const { return (_elementsInUse == 0); }
-    int count() const { return _elementsInUse; }
+    bool isEmpty() const;
+    int count() const;
 
     void deleteAll();
     virtual void elementDeleted(OctreeElement* element);
 
 private:
-    
-    OctreeElement** _bagElements;
-    int _elementsInUse;
-    int _sizeOfElementsArray;
-    //int _hookID;
-};
+    class Entry {
+    public:
+        float priority;
+        quint32 sequence;
+        OctreeElement* element;
 
+        bool operator<(const Entry& other) const {
+            return priority < other.priority || (priority == other.priority && sequence < other.sequence);
+        }
+    };
+
+    void compact();
+
+    // delete hooks can arrive from the writing threads while our encoder is using us, see Octree::setWantSnapshotReads()
+    mutable QMutex _mutex;
+
+    // membership, maps each element in the bag to its live heap entry. Removing an element only drops it from here,
+    // its heap entry goes stale and is skipped when it reaches the top, or dropped by compact()
+    QHash<OctreeElement*, Entry> _elements;
+    std::vector<Entry> _heap; // max heap on priority then sequence
+    quint32 _nextSequence;
+};
 #endif /* defined(__hifi__OctreeElementBag__) */
@@ -0,0 +1,187 @@
+//
+//  OctreeEncodeCache.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Server wide cache of encoded subtrees, shared by all of the clients' encoders
+//
+
+#include <cstring>
+
+#include <OctalCode.h>
+
+#include "Octree.h"
+#include "OctreeElementBag.h"
+#include "OctreeEncodeCache.h"
+#include "OctreePacketData.h"
+#include "ViewFrustum.h"
+
+OctreeEncodeCache::OctreeEncodeCache(quint64 maxBytes) :
+    _maxBytes(maxBytes),
+    _bytesHeld(0),
+    _generation(0),
+    _lookups(0),
+    _hits(0),
+    _bytesSaved(0),
+    _encodes(0),
+    _invalidations(0)
+{
+    OctreeElement::addDeleteHook(this);
+    OctreeElement::addUpdateHook(this);
+}
+
+OctreeEncodeCache::~OctreeEncodeCache() {
+    OctreeElement::removeDeleteHook(this);
+    OctreeElement::removeUpdateHook(this);
+}
+
+void OctreeEncodeCache::resetStats() {
+    QMutexLocker locker(&_mutex);
+    _lookups = 0;
+    _hits = 0;
+    _bytesSaved = 0;
+    _encodes = 0;
+    _invalidations = 0;
+}
+
+QByteArray OctreeEncodeCache::makeKey(const unsigned char* octalCode, int sections,
+                                      bool includeColor, bool includeExistsBits) {
+    // the first sections of an octal code, which is the code of that ancestor, followed by our flags
+    int codeBytes = bytesRequiredForCodeLength(sections);
+    QByteArray key(codeBytes + 1, 0);
+    key[0] = (char)sections;
+    memcpy(key.data() + 1, octalCode + 1, codeBytes - 1);
+    int unusedBits = (codeBytes - 1) * BITS_IN_BYTE - sections * BITS_IN_OCTAL;
+    if (unusedBits > 0) {
+        key[codeBytes - 1] = key[codeBytes - 1] & (char)(0xFF << unusedBits);
+    }
+    key[codeBytes] = (char)((includeColor ? 1 : 0) | (includeExistsBits ? 2 : 0));
+    return key;
+}
+
+// NOTE: must be called with _mutex locked
+void OctreeEncodeCache::insert(const QByteArray& key, const Entry& entry) {
+    QHash<QByteArray, Entry>::iterator existing = _entries.find(key);
+    if (existing != _entries.end()) {
+        _bytesHeld -= existing.value().encoded.size();
+        _entries.erase(existing);
+    }
+    _entries.insert(key, entry);
+    _insertionOrder.enqueue(key);
+    _bytesHeld += entry.encoded.size();
+
+    while (_bytesHeld > _maxBytes && !_insertionOrder.isEmpty()) {
+        QHash<QByteArray, Entry>::iterator oldest = _entries.find(_insertionOrder.dequeue());
+        if (oldest != _entries.end()) {
+            _bytesHeld -= oldest.value().encoded.size();
+            _entries.erase(oldest);
+        }
+    }
+}
+
+int OctreeEncodeCache::encodeFromCache(Octree* tree, OctreeElement* element, OctreePacketData* packetData,
+                                       const EncodeBitstreamParams& params) {
+
+    // only full scene, unchopped, view frustum sends can use the cache, see the class comment
+    if (!params.viewFrustum || !params.forceSendScene || params.chopLevels != DONT_CHOP ||
+            params.maxEncodeLevel != INT_MAX || params.wantOcclusionCulling ||
+            (params.deltaViewFrustum && params.lastViewFrustum)) {
+        return 0;
+    }
+    if (element->inFrustum(*params.viewFrustum) != ViewFrustum::INSIDE) {
+        return 0;
+    }
+
+    const unsigned char* octalCode = element->getOctalCode();
+    QByteArray key = makeKey(octalCode, numberOfThreeBitSectionsInCode(octalCode),
+                             params.includeColor, params.includeExistsBits);
+
+    _mutex.lock();
+    _lookups++;
+    QHash<QByteArray, Entry>::const_iterator cached = _entries.constFind(key);
+    bool found = (cached != _entries.constEnd());
+    Entry entry;
+    if (found) {
+        entry = cached.value();
+    }
+    quint64 generation = _generation;
+    _mutex.unlock();
+
+    if (!found) {
+        // encode the whole subtree without a view frustum, the same way a file save would
+        OctreePacketData encodeData(false, MAX_OCTREE_PACKET_DATA_SIZE);
+        OctreeElementBag leftOvers;
+        EncodeBitstreamParams encodeParams(INT_MAX, IGNORE_VIEW_FRUSTUM, params.includeColor, params.includeExistsBits);
+        encodeParams.jurisdictionMap = params.jurisdictionMap;
+        int bytesWritten = tree->encodeTreeBitstream(element, &encodeData, leftOvers, encodeParams);
+
+        entry.uncacheable = (bytesWritten == 0 || !leftOvers.isEmpty());
+        entry.deepestLevel = element->getLevel() + encodeParams.maxLevelReached;
+        if (!entry.uncacheable) {
+            entry.encoded = QByteArray(reinterpret_cast<const char*>(encodeData.getUncompressedData()),
+                                       encodeData.getUncompressedSize());
+        }
+
+        QMutexLocker locker(&_mutex);
+        _encodes++;
+        if (_generation == generation) {
+            insert(key, entry);
+        }
+    }
+
+    if (entry.uncacheable) {
+        return 0;
+    }
+
+    // every element in the subtree is no further than the subtree's furthest corner, so if that is close enough for the
+    // deepest level to be at full detail, the client's encode would have included everything, just like ours
+    float furthestDistance = element->furthestDistanceToCamera(*params.viewFrustum);
+    float fullDetailDistance = boundaryDistanceForRenderLevel(entry.deepestLevel + 1 + params.boundaryLevelAdjust,
+                                                              params.octreeElementSizeScale);
+    if (furthestDistance > fullDetailDistance) {
+        return 0;
+    }
+
+    if (!packetData->appendEncodedSubTree(reinterpret_cast<const unsigned char*>(entry.encoded.constData()),
+                                          entry.encoded.size())) {
+        return 0; // didn't fit, the caller's own encode will split it up
+    }
+
+    QMutexLocker locker(&_mutex);
+    if (found) {
+        _hits++;
+        _bytesSaved += entry.encoded.size();
+    }
+    return entry.encoded.size();
+}
+
+// NOTE: elements call their hooks from their destructor and from markWithChangedTime(), their octal code is valid in both
+void OctreeEncodeCache::invalidate(OctreeElement* element) {
+    QMutexLocker locker(&_mutex);
+    _generation++;
+    if (_entries.isEmpty()) {
+        return;
+    }
+
+    // our encoding and every one of our ancestors' encodings include us
+    const unsigned char* octalCode = element->getOctalCode();
+    for (int sections = numberOfThreeBitSectionsInCode(octalCode); sections >= 0; sections--) {
+        for (int flags = 0; flags < 4; flags++) {
+            QHash<QByteArray, Entry>::iterator stale = _entries.find(makeKey(octalCode, sections, flags & 1, flags & 2));
+            if (stale != _entries.end()) {
+                _bytesHeld -= stale.value().encoded.size();
+                _entries.erase(stale);
+                _invalidations++;
+            }
+        }
+    }
+}
+
+void OctreeEncodeCache::elementDeleted(OctreeElement* element) {
+    invalidate(element);
+}
+
+void OctreeEncodeCache::elementUpdated(OctreeElement* element) {
+    invalidate(element);
+}
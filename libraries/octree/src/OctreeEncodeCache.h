@@ -0,0 +1,88 @@
+//
+//  OctreeEncodeCache.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Server wide cache of encoded subtrees, shared by all of the clients' encoders
+//
+
+#ifndef __hifi__OctreeEncodeCache__
+#define __hifi__OctreeEncodeCache__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QQueue>
+
+#include "OctreeElement.h"
+
+class EncodeBitstreamParams;
+class Octree;
+class OctreePacketData;
+
+const quint64 DEFAULT_ENCODE_CACHE_BYTES = 64 * 1024 * 1024;
+
+/// Caches the encoded bytes of subtrees so that a region many clients are looking at is encoded once and then copied
+/// into each of their packets. An encoding only depends on the client's view when part of the subtree is out of view or
+/// beyond the client's LOD, so entries are encoded without a view frustum and used for any client that has the whole
+/// subtree inside its frustum and within full detail range of its LOD. Only full scene sends are served from the cache,
+/// delta and "changed since" sends, as well as occlusion culled ones, still encode per client.
+///
+/// Entries are keyed by octal code and the color/exists bits flags. Any change or delete of an element invalidates the
+/// entries of all of its ancestors through the element update and delete hooks. Packet compression covers the whole
+/// packet, so it still runs for every packet, the cache saves the tree traversal and bitmask/color encoding.
+class OctreeEncodeCache : public OctreeElementDeleteHook, public OctreeElementUpdateHook {
+public:
+    OctreeEncodeCache(quint64 maxBytes = DEFAULT_ENCODE_CACHE_BYTES);
+    ~OctreeEncodeCache();
+
+    /// Called by Octree::encodeTreeBitstream(). Appends the cached encoding of element to the packet if it can be used
+    /// for this client, encoding and caching the subtree first if needed.
+    /// \return the number of bytes appended, 0 if the caller must encode the subtree itself
+    int encodeFromCache(Octree* tree, OctreeElement* element, OctreePacketData* packetData,
+                        const EncodeBitstreamParams& params);
+
+    virtual void elementDeleted(OctreeElement* element);
+    virtual void elementUpdated(OctreeElement* element);
+
+    quint64 getMaxBytes() const { return _maxBytes; }
+    quint64 getBytesHeld() const { return _bytesHeld; }
+    int getEntryCount() const { return _entries.size(); }
+    quint64 getLookups() const { return _lookups; }
+    quint64 getHits() const { return _hits; }
+    float getHitRate() const { return _lookups == 0 ? 0.0f : (float)_hits / _lookups; }
+    quint64 getBytesSaved() const { return _bytesSaved; }
+    quint64 getEncodes() const { return _encodes; }
+    quint64 getInvalidations() const { return _invalidations; }
+
+    void resetStats();
+
+private:
+    class Entry {
+    public:
+        QByteArray encoded;
+        int deepestLevel; // getLevel() of the deepest element in the encoding
+        bool uncacheable; // too big for one packet, or empty
+    };
+
+    static QByteArray makeKey(const unsigned char* octalCode, int sections, bool includeColor, bool includeExistsBits);
+    void invalidate(OctreeElement* element);
+    void insert(const QByteArray& key, const Entry& entry);
+
+    quint64 _maxBytes;
+
+    QMutex _mutex;
+    QHash<QByteArray, Entry> _entries;
+    QQueue<QByteArray> _insertionOrder; // oldest first, may still hold keys that have since been invalidated
+    quint64 _bytesHeld;
+    quint64 _generation; // bumped on every invalidation, so that racing encodes don't store stale results
+
+    quint64 _lookups;
+    quint64 _hits;
+    quint64 _bytesSaved;
+    quint64 _encodes;
+    quint64 _invalidations;
+};
+
+#endif /* defined(__hifi__OctreeEncodeCache__) */
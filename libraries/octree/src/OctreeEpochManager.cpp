@@ -0,0 +1,103 @@
+//
+//  OctreeEpochManager.cpp
+//  hifi
+//
+//  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
+//
+//  Epoch based reclamation of octree elements for trees running with snapshot reads
+//
+
+#include <vector>
+
+#include "OctreeElement.h"
+#include "OctreeEpochManager.h"
+
+OctreeEpochManager* OctreeEpochManager::getInstance() {
+    static OctreeEpochManager sharedInstance;
+    return &sharedInstance;
+}
+
+OctreeEpochManager::OctreeEpochManager() :
+    _currentEpoch(1),
+    _totalRetired(0),
+    _totalReclaimed(0)
+{
+}
+
+quint64 OctreeEpochManager::enterReader() {
+    QMutexLocker locker(&_mutex);
+    quint64 epoch = _currentEpoch;
+    _activeReaders[epoch]++;
+    return epoch;
+}
+
+void OctreeEpochManager::exitReader(quint64 epoch) {
+    QMutexLocker locker(&_mutex);
+    std::map<quint64, int>::iterator reader = _activeReaders.find(epoch);
+    if (reader != _activeReaders.end()) {
+        if (--reader->second == 0) {
+            _activeReaders.erase(reader);
+        }
+    }
+}
+
+void OctreeEpochManager::retireElement(OctreeElement* element) {
+    if (element) {
+        retire(element, NULL);
+    }
+}
+
+void OctreeEpochManager::retireChildArray(OctreeElement** children) {
+    if (children) {
+        retire(NULL, children);
+    }
+}
+
+void OctreeEpochManager::retire(OctreeElement* element, OctreeElement** children) {
+    _mutex.lock();
+    RetiredItem item;
+    item.epoch = _currentEpoch++;
+    item.element = element;
+    item.children = children;
+    _retired.push_back(item);
+    _totalRetired++;
+    _mutex.unlock();
+
+    // opportunistically free anything older readers have let go of
+    reclaim();
+}
+
+void OctreeEpochManager::reclaim() {
+    std::vector<RetiredItem> reclaimable;
+
+    _mutex.lock();
+    // any reader that entered after an item's epoch can't have seen it
+    bool haveReaders = !_activeReaders.empty();
+    quint64 oldestReader = haveReaders ? _activeReaders.begin()->first : 0;
+    while (!_retired.empty() && (!haveReaders || _retired.front().epoch < oldestReader)) {
+        reclaimable.push_back(_retired.front());
+        _retired.pop_front();
+    }
+    _totalReclaimed += reclaimable.size();
+    _mutex.unlock();
+
+    // delete outside of our lock, element destructors call the delete hooks
+    for (size_t i = 0; i < reclaimable.size(); i++) {
+        delete reclaimable[i].element;
+        OctreeElement::releaseChildArray(reclaimable[i].children);
+    }
+}
+
+int OctreeEpochManager::getActiveReaders() {
+    QMutexLocker locker(&_mutex);
+    int readers = 0;
+    for (std::map<quint64, int>::const_iterator i = _activeReaders.begin(); i != _activeReaders.end(); ++i) {
+        readers += i->second;
+    }
+    return readers;
+}
+
+quint64 OctreeEpochManager::getPendingCount() {
+    QMutexLocker locker(&_mutex);
+    return _retired.size();
+}
@@ -0,0 +1,69 @@
+//
+//  OctreeEpochManager.h
+//  hifi
+//
+//  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
+//
+//  Epoch based reclamation of octree elements for trees running with snapshot reads
+//
+
+#ifndef __hifi__OctreeEpochManager__
+#define __hifi__OctreeEpochManager__
+
+#include <deque>
+#include <map>
+
+#include <QtCore/QMutex>
+
+class OctreeElement;
+
+/// Tracks the snapshot readers that are traversing an octree without holding its lock, and defers freeing elements and
+/// child arrays that writers have unlinked until every reader that could still see them has finished. Each retire
+/// advances the epoch, an item retired at epoch E is reclaimed once the oldest active reader entered after E. Only
+/// writers reclaim, on every retire and whenever they take the tree's write lock, so that element destructors and
+/// delete hooks never run alongside a writer.
+class OctreeEpochManager {
+public:
+    static OctreeEpochManager* getInstance();
+
+    /// Called by a snapshot reader before it starts traversing the tree.
+    /// \return the epoch the reader entered at, must be passed to exitReader()
+    quint64 enterReader();
+    void exitReader(quint64 epoch);
+
+    /// Retires an element (and its subtree) that has already been unlinked from its parent
+    void retireElement(OctreeElement* element);
+
+    /// Retires a child array that has already been replaced by a copy
+    void retireChildArray(OctreeElement** children);
+
+    /// Frees everything that no active reader can still reach. Must only be called by a writer holding the write lock.
+    void reclaim();
+
+    int getActiveReaders();
+    quint64 getPendingCount();
+    quint64 getTotalRetired() const { return _totalRetired; }
+    quint64 getTotalReclaimed() const { return _totalReclaimed; }
+
+private:
+    OctreeEpochManager();
+
+    class RetiredItem {
+    public:
+        quint64 epoch;
+        OctreeElement* element;
+        OctreeElement** children;
+    };
+
+    void retire(OctreeElement* element, OctreeElement** children);
+
+    QMutex _mutex;
+    quint64 _currentEpoch;
+    std::map<quint64, int> _activeReaders; // epoch -> number of readers that entered at that epoch
+    std::deque<RetiredItem> _retired; // in epoch order
+
+    quint64 _totalRetired;
+    quint64 _totalReclaimed;
+};
+
+#endif /* defined(__hifi__OctreeEpochManager__) */
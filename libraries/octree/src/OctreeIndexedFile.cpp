@@ -0,0 +1,394 @@
+//
+//  OctreeIndexedFile.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Indexed, memory mapped SVO files whose subtrees are loaded on demand
+//
+
+#include <algorithm>
+#include <cstring>
+
+#include <QtCore/QDebug>
+
+#include <OctalCode.h>
+#include <PacketHeaders.h>
+#include <SharedUtil.h>
+
+#include "Octree.h"
+#include "OctreeElementBag.h"
+#include "OctreePacketData.h"
+#include "OctreeIndexedFile.h"
+
+const char INDEXED_SVO_SIGNATURE[] = { 'S', 'V', 'O', '2' };
+
+class IndexedFileHeader {
+public:
+    char signature[sizeof(INDEXED_SVO_SIGNATURE)];
+    quint32 subtreeCount;
+    quint64 topOffset;
+    quint64 topLength;
+    quint64 indexOffset;
+    quint8 dataType; // the tree's data PacketType and version, if it wants SVO file versions
+    quint8 dataVersion;
+    quint8 indexLevel;
+    quint8 reserved[5];
+};
+
+// encodes everything below element, but no deeper than maxLevel, the same way Octree::writeToSVOFile() does
+static void encodeSubtree(Octree* tree, OctreeElement* element, int maxLevel, QByteArray& output) {
+    OctreeElementBag bag;
+    OctreePacketData packetData;
+    bool lastPacketWritten = false;
+
+    bag.insert(element);
+    while (!bag.isEmpty()) {
+        OctreeElement* subTree = bag.extract();
+
+        // encode levels are relative to the element we start at, elements in the bag can be at any level
+        int maxEncodeLevel = INT_MAX;
+        if (maxLevel != INT_MAX) {
+            maxEncodeLevel = maxLevel + 1 - numberOfThreeBitSectionsInCode(subTree->getOctalCode());
+        }
+        EncodeBitstreamParams params(maxEncodeLevel, IGNORE_VIEW_FRUSTUM, WANT_COLOR, NO_EXISTS_BITS);
+        int bytesWritten = tree->encodeTreeBitstream(subTree, &packetData, bag, params);
+
+        if (bytesWritten == 0 && (params.stopReason == EncodeBitstreamParams::DIDNT_FIT)) {
+            if (packetData.hasContent()) {
+                output.append(reinterpret_cast<const char*>(packetData.getFinalizedData()), packetData.getFinalizedSize());
+                lastPacketWritten = true;
+            }
+            packetData.reset();
+            bag.insert(subTree);
+        } else {
+            lastPacketWritten = false;
+        }
+    }
+    if (!lastPacketWritten) {
+        output.append(reinterpret_cast<const char*>(packetData.getFinalizedData()), packetData.getFinalizedSize());
+    }
+}
+
+// the octal code of the ancestor of octalCode at level (or octalCode itself) as a hash key, with the bits past its last
+// section cleared the way childOctalCode() leaves them, whatever the code they came from had there
+static QByteArray ancestorCodeKey(const unsigned char* octalCode, int level) {
+    int keyBytes = bytesRequiredForCodeLength(level);
+    QByteArray key(reinterpret_cast<const char*>(octalCode), keyBytes);
+    key[0] = level;
+    int usedBits = (level * BITS_IN_OCTAL) % BITS_IN_BYTE;
+    if (usedBits != 0) {
+        key[keyBytes - 1] = key[keyBytes - 1] & (0xFF << (BITS_IN_BYTE - usedBits));
+    }
+    return key;
+}
+
+// collects the octal codes of the elements at the index level that have children, and of the folded elements above it,
+// whose children the tree only encodes
+static void collectSubtreeCodes(OctreeElement* element, int indexLevel, QVector<QByteArray>& codes) {
+    const unsigned char* octalCode = element->getOctalCode();
+    int level = numberOfThreeBitSectionsInCode(octalCode);
+    if (level == indexLevel || element->hasUnloadedChildren()) {
+        if (!element->isLeaf() || element->hasUnloadedChildren()) {
+            codes.append(QByteArray(reinterpret_cast<const char*>(octalCode), bytesRequiredForCodeLength(level)));
+        }
+        return;
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        OctreeElement* childAt = element->getChildAtIndex(i);
+        if (childAt) {
+            collectSubtreeCodes(childAt, indexLevel, codes);
+        }
+    }
+}
+
+bool OctreeIndexedFile::isIndexedFile(const QString& filename) {
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray signature = file.read(sizeof(INDEXED_SVO_SIGNATURE));
+    return signature == QByteArray(INDEXED_SVO_SIGNATURE, sizeof(INDEXED_SVO_SIGNATURE));
+}
+
+bool OctreeIndexedFile::write(Octree* tree, const QString& filename, int indexLevel) {
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    qDebug() << "Saving indexed file" << filename << "...";
+
+    IndexedFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.signature, INDEXED_SVO_SIGNATURE, sizeof(INDEXED_SVO_SIGNATURE));
+    header.indexLevel = indexLevel;
+    if (tree->getWantSVOfileVersions()) {
+        header.dataType = tree->expectedDataPacketType();
+        header.dataVersion = versionForPacketType(tree->expectedDataPacketType());
+    }
+
+    // we'll come back and fill in the header once we know where everything went
+    bool fileOk = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+
+    QVector<QByteArray> subtreeCodes;
+    QByteArray section;
+
+    tree->lockForRead();
+    collectSubtreeCodes(tree->getRoot(), indexLevel, subtreeCodes);
+    encodeSubtree(tree, tree->getRoot(), indexLevel, section);
+    tree->unlock();
+
+    header.topOffset = file.pos();
+    header.topLength = section.size();
+    fileOk = fileOk && file.write(section) == section.size();
+
+    QByteArray index;
+    foreach (const QByteArray& octalCode, subtreeCodes) {
+        section.clear();
+
+        // do tree locking per subtree so that we have shorter slices and less thread contention
+        tree->lockForRead();
+        OctreeElement* element = tree->nodeForOctalCode(tree->getRoot(),
+                                                         reinterpret_cast<const unsigned char*>(octalCode.constData()), NULL);
+        if (compareOctalCodes(element->getOctalCode(),
+                reinterpret_cast<const unsigned char*>(octalCode.constData())) == EXACT_MATCH) {
+            encodeSubtree(tree, element, INT_MAX, section);
+        }
+        tree->unlock();
+
+        if (section.isEmpty()) {
+            continue; // the subtree went away while we were writing the others
+        }
+
+        quint64 offset = file.pos();
+        quint32 length = section.size();
+        quint8 codeBytes = octalCode.size();
+        index.append(reinterpret_cast<const char*>(&codeBytes), sizeof(codeBytes));
+        index.append(octalCode);
+        index.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+        index.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        header.subtreeCount++;
+
+        fileOk = fileOk && file.write(section) == section.size();
+    }
+
+    header.indexOffset = file.pos();
+    fileOk = fileOk && file.write(index) == index.size();
+
+    fileOk = fileOk && file.seek(0) && file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+    file.close();
+
+    qDebug() << "DONE saving indexed file, subtrees=" << header.subtreeCount << "ok=" << fileOk;
+    return fileOk;
+}
+
+OctreeIndexedFile::OctreeIndexedFile() :
+    _mappedData(NULL),
+    _mappedSize(0),
+    _unloadedCount(0),
+    _nextInFileOrder(0),
+    _deepestSubtreeLevel(0)
+{
+}
+
+OctreeIndexedFile::~OctreeIndexedFile() {
+    close();
+}
+
+bool OctreeIndexedFile::open(Octree* tree, const QString& filename) {
+    _file.setFileName(filename);
+    if (!_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    _mappedSize = _file.size();
+    if (_mappedSize < (qint64)sizeof(IndexedFileHeader) || !(_mappedData = _file.map(0, _mappedSize))) {
+        qDebug() << "Unable to map indexed file" << filename;
+        close();
+        return false;
+    }
+
+    IndexedFileHeader header;
+    memcpy(&header, _mappedData, sizeof(header));
+    if (memcmp(header.signature, INDEXED_SVO_SIGNATURE, sizeof(INDEXED_SVO_SIGNATURE)) != 0 ||
+            header.topOffset + header.topLength > (quint64)_mappedSize || header.indexOffset > (quint64)_mappedSize) {
+        qDebug() << "Indexed file" << filename << "is damaged";
+        close();
+        return false;
+    }
+    if (tree->getWantSVOfileVersions()) {
+        PacketType expectedType = tree->expectedDataPacketType();
+        if (header.dataType != expectedType || !tree->canReadSVOfileVersion(header.dataVersion)) {
+            qDebug("Indexed file version mismatch. Expected: %d/%d Got: %d/%d", expectedType,
+                   versionForPacketType(expectedType), header.dataType, header.dataVersion);
+            close();
+            return false;
+        }
+    }
+
+    // read the index
+    const uchar* indexAt = _mappedData + header.indexOffset;
+    const uchar* indexEnd = _mappedData + _mappedSize;
+    _subtrees.reserve(header.subtreeCount);
+    for (quint32 i = 0; i < header.subtreeCount; i++) {
+        if (indexAt + sizeof(quint8) > indexEnd) {
+            break;
+        }
+        quint8 codeBytes = *indexAt;
+        indexAt += sizeof(codeBytes);
+        if (indexAt + codeBytes + sizeof(quint64) + sizeof(quint32) > indexEnd) {
+            break;
+        }
+        Subtree subtree;
+        subtree.octalCode = QByteArray(reinterpret_cast<const char*>(indexAt), codeBytes);
+        indexAt += codeBytes;
+        memcpy(&subtree.offset, indexAt, sizeof(subtree.offset));
+        indexAt += sizeof(subtree.offset);
+        memcpy(&subtree.length, indexAt, sizeof(subtree.length));
+        indexAt += sizeof(subtree.length);
+        subtree.loaded = false;
+
+        if (subtree.offset + subtree.length > (quint64)_mappedSize) {
+            break;
+        }
+        const unsigned char* subtreeCode = reinterpret_cast<const unsigned char*>(subtree.octalCode.constData());
+        int subtreeLevel = numberOfThreeBitSectionsInCode(subtreeCode, codeBytes);
+        if (subtreeLevel < 0 || bytesRequiredForCodeLength(subtreeLevel) != codeBytes) {
+            break;
+        }
+        _subtreesByCode.insert(subtree.octalCode, _subtrees.size());
+        for (int level = 0; level <= subtreeLevel; level++) {
+            _subtreesByAncestorCode[ancestorCodeKey(subtreeCode, level)].append(_subtrees.size());
+        }
+        _deepestSubtreeLevel = std::max(_deepestSubtreeLevel, subtreeLevel);
+        _subtrees.append(subtree);
+    }
+    if ((quint32)_subtrees.size() != header.subtreeCount) {
+        qDebug() << "Indexed file" << filename << "has a damaged index";
+        close();
+        return false;
+    }
+
+    // decode the top of the tree
+    ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS);
+    tree->readBitstreamToTree(_mappedData + header.topOffset, header.topLength, args);
+
+    // and mark where the rest of it goes, the subtree roots won't have been in the top if they weren't colored
+    for (int i = 0; i < _subtrees.size(); i++) {
+        const unsigned char* octalCode = reinterpret_cast<const unsigned char*>(_subtrees[i].octalCode.constData());
+        OctreeElement* element = tree->nodeForOctalCode(tree->getRoot(), octalCode, NULL);
+        if (compareOctalCodes(element->getOctalCode(), octalCode) != EXACT_MATCH) {
+            element = tree->createMissingNode(element, octalCode);
+        }
+        element->setHasUnloadedChildren(true);
+    }
+    _unloadedCount = _subtrees.size();
+
+    qDebug() << "Opened indexed file" << filename << "subtrees=" << _unloadedCount;
+    if (_unloadedCount == 0) {
+        close();
+    }
+    return true;
+}
+
+void OctreeIndexedFile::close() {
+    QMutexLocker locker(&_requestsMutex);
+    if (_mappedData) {
+        _file.unmap(const_cast<uchar*>(_mappedData));
+        _mappedData = NULL;
+    }
+    _file.close();
+    _subtreesByCode.clear();
+    _subtreesByAncestorCode.clear();
+    _requests.clear();
+}
+
+void OctreeIndexedFile::requestLoad(const OctreeElement* element) {
+    const unsigned char* octalCode = element->getOctalCode();
+    QByteArray key(reinterpret_cast<const char*>(octalCode), bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(octalCode)));
+
+    QMutexLocker locker(&_requestsMutex);
+    QHash<QByteArray, int>::const_iterator subtree = _subtreesByCode.constFind(key);
+    if (subtree != _subtreesByCode.constEnd() && !_requests.contains(subtree.value())) {
+        _requests.append(subtree.value());
+    }
+}
+
+int OctreeIndexedFile::loadSubtrees(Octree* tree, quint64 timeBudgetUsecs) {
+    quint64 start = usecTimestampNow();
+    int loaded = 0;
+
+    while (_unloadedCount > 0 && usecTimestampNow() - start < timeBudgetUsecs) {
+        int subtreeIndex = -1;
+        _requestsMutex.lock();
+        if (!_requests.isEmpty()) {
+            subtreeIndex = _requests.first();
+            _requests.remove(0);
+        }
+        _requestsMutex.unlock();
+
+        if (subtreeIndex < 0) {
+            while (_nextInFileOrder < _subtrees.size() && _subtrees[_nextInFileOrder].loaded) {
+                _nextInFileOrder++;
+            }
+            subtreeIndex = _nextInFileOrder;
+        }
+        if (loadSubtree(tree, subtreeIndex)) {
+            loaded++;
+        }
+    }
+    return loaded;
+}
+
+void OctreeIndexedFile::loadSubtreesFor(Octree* tree, const unsigned char* octalCode) {
+    int codeLevel = numberOfThreeBitSectionsInCode(octalCode);
+
+    // the subtree the code is inside of, if any
+    for (int level = 0; level < codeLevel && level <= _deepestSubtreeLevel && _unloadedCount > 0; level++) {
+        QHash<QByteArray, int>::const_iterator subtree = _subtreesByCode.constFind(ancestorCodeKey(octalCode, level));
+        if (subtree != _subtreesByCode.constEnd()) {
+            loadSubtree(tree, subtree.value());
+        }
+    }
+
+    // and the subtrees at or inside of the code, copied since loading the last one closes the file and clears the index
+    if (_unloadedCount > 0 && codeLevel <= _deepestSubtreeLevel) {
+        QVector<int> subtrees = _subtreesByAncestorCode.value(ancestorCodeKey(octalCode, codeLevel));
+        foreach (int subtreeIndex, subtrees) {
+            loadSubtree(tree, subtreeIndex);
+        }
+    }
+}
+
+bool OctreeIndexedFile::loadSubtree(Octree* tree, int subtreeIndex) {
+    if (subtreeIndex < 0 || subtreeIndex >= _subtrees.size() || _subtrees[subtreeIndex].loaded) {
+        return false;
+    }
+    Subtree& subtree = _subtrees[subtreeIndex];
+    subtree.loaded = true;
+    _unloadedCount--;
+
+    // edits load the subtrees they touch first, so if the element is gone it was removed on purpose, leave it that way
+    const unsigned char* octalCode = reinterpret_cast<const unsigned char*>(subtree.octalCode.constData());
+    OctreeElement* element = tree->nodeForOctalCode(tree->getRoot(), octalCode, NULL);
+    if (compareOctalCodes(element->getOctalCode(), octalCode) == EXACT_MATCH) {
+        element->setHasUnloadedChildren(false);
+
+        ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS);
+        tree->readBitstreamToTree(_mappedData + subtree.offset, subtree.length, args);
+
+        // the subtree is new to anyone who was sent this part of the tree already, like the viewers' known state and
+        // the encode cache, so mark the whole path down to it as changed
+        OctreeElement* ancestor = tree->getRoot();
+        while (ancestor && ancestor != element) {
+            ancestor->markWithChangedTime();
+            ancestor = ancestor->getChildAtIndex(branchIndexWithDescendant(ancestor->getOctalCode(), octalCode));
+        }
+        element->markWithChangedTime();
+    }
+
+    // everything is in memory now, we don't need the file any more
+    if (_unloadedCount == 0) {
+        close();
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+//
+//  OctreeIndexedFile.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Indexed, memory mapped SVO files whose subtrees are loaded on demand
+//
+
+#ifndef __hifi__OctreeIndexedFile__
+#define __hifi__OctreeIndexedFile__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+class Octree;
+class OctreeElement;
+
+/// Version 2 SVO files. The levels of the tree down to the index level are stored as a single bitstream, and every
+/// subtree below an element at the index level is stored as its own bitstream, found through an index keyed by the
+/// octal code of that element. Opening a file maps it and decodes only the top levels, the elements at the index level
+/// are marked as having unloaded children, and their subtrees are decoded into the tree as they are asked for.
+///
+/// Layout: header, top bitstream, subtree bitstreams, index. All values are in host byte order, like SVO files.
+class OctreeIndexedFile {
+public:
+    static const int DEFAULT_INDEX_LEVEL = 3; // up to 512 subtrees
+
+    /// Does the file start with the indexed SVO signature
+    static bool isIndexedFile(const QString& filename);
+
+    /// Writes the tree in the indexed format. Takes the tree's read lock one subtree at a time.
+    static bool write(Octree* tree, const QString& filename, int indexLevel = DEFAULT_INDEX_LEVEL);
+
+    OctreeIndexedFile();
+    ~OctreeIndexedFile();
+
+    /// Maps the file and decodes its top levels into the tree. Caller must hold the tree's write lock.
+    bool open(Octree* tree, const QString& filename);
+
+    int getSubtreeCount() const { return _subtrees.size(); }
+    int getUnloadedCount() const { return _unloadedCount; }
+
+    /// Asks for the subtree below an element with unloaded children to be loaded ahead of the others. Safe to call while
+    /// only holding the tree's read lock, like the encoders do.
+    void requestLoad(const OctreeElement* element);
+
+    /// Loads the requested subtrees and then the others in file order, until the time budget is spent or everything is
+    /// loaded. Caller must hold the tree's write lock.
+    /// \return number of subtrees loaded
+    int loadSubtrees(Octree* tree, quint64 timeBudgetUsecs);
+
+    /// Loads any subtrees that contain, or are contained by, the octal code. Looks them up by the code's ancestors and
+    /// the code itself, so an edit costs a few hash lookups however many subtrees the file has. Caller must hold the
+    /// tree's write lock.
+    void loadSubtreesFor(Octree* tree, const unsigned char* octalCode);
+
+private:
+    class Subtree {
+    public:
+        QByteArray octalCode;
+        quint64 offset;
+        quint32 length;
+        bool loaded;
+    };
+
+    bool loadSubtree(Octree* tree, int subtreeIndex);
+    void close();
+
+    QFile _file;
+    const uchar* _mappedData;
+    qint64 _mappedSize;
+
+    QVector<Subtree> _subtrees;
+    QHash<QByteArray, int> _subtreesByCode;
+    QHash<QByteArray, QVector<int> > _subtreesByAncestorCode; // includes each subtree under its own code
+    int _deepestSubtreeLevel;
+    int _unloadedCount;
+    int _nextInFileOrder;
+
+    QMutex _requestsMutex;
+    QVector<int> _requests; // guarded by _requestsMutex
+};
+
+#endif /* defined(__hifi__OctreeIndexedFile__) */
@@ -0,0 +1,89 @@
+//
+//  OctreeKnownState.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  The subtrees one client has already been sent, so that moving around doesn't mean resending the scene
+//
+
+#include "OctreeConstants.h"
+#include "OctreeElement.h"
+#include "OctreeKnownState.h"
+
+OctreeKnownState::OctreeKnownState() :
+    _encodeStarted(0),
+    _resets(0)
+{
+    OctreeElement::addDeleteHook(this);
+}
+
+OctreeKnownState::~OctreeKnownState() {
+    OctreeElement::removeDeleteHook(this);
+}
+
+void OctreeKnownState::clear() {
+    QMutexLocker locker(&_mutex);
+    _known.clear();
+    _pending.clear();
+}
+
+int OctreeKnownState::getKnownSubtreeCount() const {
+    QMutexLocker locker(&_mutex);
+    return _known.size();
+}
+
+void OctreeKnownState::elementDeleted(OctreeElement* element) {
+    QMutexLocker locker(&_mutex);
+    _known.remove(element);
+}
+
+void OctreeKnownState::startEncode() {
+    _pending.clear();
+    _encodeStarted = usecTimestampNow();
+}
+
+bool OctreeKnownState::isKnown(const OctreeElement* element) const {
+    QMutexLocker locker(&_mutex);
+    QHash<const OctreeElement*, quint64>::const_iterator known = _known.constFind(element);
+    if (known == _known.constEnd()) {
+        return false;
+    }
+    quint64 version = known.value();
+    return !element->hasChangedSince(version) && version + MAX_KNOWN_SUBTREE_AGE > _encodeStarted;
+}
+
+void OctreeKnownState::discardPending(int keepCount) {
+    if (keepCount < (int)_pending.size()) {
+        _pending.resize(keepCount);
+    }
+}
+
+void OctreeKnownState::commitPending() {
+    // same fudge the "changed since" sends use, anything changed around the time we encoded will be resent
+    quint64 version = _encodeStarted - CHANGE_FUDGE;
+
+    QMutexLocker locker(&_mutex);
+
+    // subtrees were recorded bottom up, so a parent comes after its children
+    for (size_t i = 0; i < _pending.size(); i++) {
+        OctreeElement* element = _pending[i];
+        if (element->isRetired()) {
+            continue; // deleted by a writer while we were encoding it, our delete hook has already been called for it
+        }
+        for (int childIndex = 0; childIndex < NUMBER_OF_CHILDREN; childIndex++) {
+            OctreeElement* child = element->getChildAtIndex(childIndex);
+            if (child && child->isLeaf()) {
+                _known.remove(child); // covered by their parent now
+            }
+        }
+        _known.insert(element, version);
+    }
+    _pending.clear();
+
+    // deleted elements are dropped as they go, this only bounds a client that has been sent an enormous scene
+    if (_known.size() > MAX_KNOWN_SUBTREES) {
+        _known.clear();
+        _resets++;
+    }
+}
@@ -0,0 +1,72 @@
+//
+//  OctreeKnownState.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  The subtrees one client has already been sent, so that moving around doesn't mean resending the scene
+//
+
+#ifndef __hifi__OctreeKnownState__
+#define __hifi__OctreeKnownState__
+
+#include <vector>
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+
+#include <SharedUtil.h>
+
+#include "OctreeElement.h"
+
+const int MAX_KNOWN_SUBTREES = 250000;
+const quint64 MAX_KNOWN_SUBTREE_AGE = 30 * USECS_PER_SECOND;
+
+/// The set of subtrees a client has been sent in full, each with the version (time) it was sent at. An element is known
+/// once the client has every element below it, or its color if it's a leaf, and stays known until something in its
+/// subtree changes, which marks the element with a newer change time. The encoder skips known subtrees, so a client
+/// moving through a large static world is only sent what's newly in view or changed since it last received it.
+///
+/// Leaves are only recorded until their parent is known, so the set is about the size of the non-leaf elements sent.
+/// The octree protocol has no acknowledgements, so a sent subtree is assumed to be received. Entries expire after
+/// MAX_KNOWN_SUBTREE_AGE, which repairs lost packets and clients that dropped their local voxels.
+///
+/// A client's known state is only used by the one send job encoding for it. The writers drop deleted elements from it
+/// through the delete hook though, since elements are pooled and a new element at a freed address mustn't inherit the
+/// entry of the one that was there before.
+class OctreeKnownState : public OctreeElementDeleteHook {
+public:
+    OctreeKnownState();
+    ~OctreeKnownState();
+
+    void clear();
+
+    /// Called by Octree::encodeTreeBitstream() before each encode
+    void startEncode();
+
+    /// true if the client has everything in element's subtree as it is now
+    bool isKnown(const OctreeElement* element) const;
+
+    /// The encoder records subtrees as it finishes them, they stay pending until their bytes are committed to the packet
+    void subtreeSent(OctreeElement* element) { _pending.push_back(element); }
+    int getPendingCount() const { return _pending.size(); }
+    void discardPending(int keepCount);
+    void commitPending();
+
+    int getKnownSubtreeCount() const;
+    quint64 getResets() const { return _resets; }
+
+    virtual void elementDeleted(OctreeElement* element);
+
+private:
+    OctreeKnownState(const OctreeKnownState&); // not copyable, it's registered as a delete hook
+    OctreeKnownState& operator=(const OctreeKnownState&);
+
+    mutable QMutex _mutex; // guards _known against the delete hook
+    QHash<const OctreeElement*, quint64> _known;
+    std::vector<OctreeElement*> _pending;
+    quint64 _encodeStarted;
+    quint64 _resets;
+};
+
+#endif /* defined(__hifi__OctreeKnownState__) */
@@ -0,0 +1,100 @@
+//
+//  OctreeMemoryPool.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Fixed size block pool used for octree elements, octal codes and child arrays
+//
+
+#include <new>
+
+#include "OctreeMemoryPool.h"
+
+const size_t POOL_BLOCK_ALIGNMENT = 8;
+
+// the registry is intentionally leaked along with the pools, elements can still be deleted during static destruction
+static QMutex* poolsMutex() {
+    static QMutex* mutex = new QMutex();
+    return mutex;
+}
+
+static QVector<OctreeMemoryPool*>* allPools() {
+    static QVector<OctreeMemoryPool*>* pools = new QVector<OctreeMemoryPool*>();
+    return pools;
+}
+
+OctreeMemoryPool::OctreeMemoryPool(const char* name, size_t blockSize, int blocksPerSlab) :
+    _name(name),
+    _blockSize(blockSize),
+    _blocksPerSlab(blocksPerSlab),
+    _freeList(NULL),
+    _slabCount(0),
+    _blocksInUse(0)
+{
+    // every block must be able to hold the free list link, and stay aligned when packed back to back in a slab
+    if (_blockSize < sizeof(FreeBlock)) {
+        _blockSize = sizeof(FreeBlock);
+    }
+    _blockSize = (_blockSize + POOL_BLOCK_ALIGNMENT - 1) & ~(POOL_BLOCK_ALIGNMENT - 1);
+
+    QMutexLocker locker(poolsMutex());
+    allPools()->append(this);
+}
+
+// NOTE: must be called with _mutex locked
+void OctreeMemoryPool::addSlab() {
+    // ::operator new throws std::bad_alloc like any other new would if we're out of memory
+    char* slab = static_cast<char*>(::operator new(_blockSize * _blocksPerSlab));
+
+    // thread the blocks in address order, so that a fresh slab hands out contiguous memory
+    for (int i = _blocksPerSlab - 1; i >= 0; i--) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + i * _blockSize);
+        block->next = _freeList;
+        _freeList = block;
+    }
+    _slabCount++;
+}
+
+void* OctreeMemoryPool::allocate() {
+    QMutexLocker locker(&_mutex);
+    if (!_freeList) {
+        addSlab();
+    }
+    FreeBlock* block = _freeList;
+    _freeList = block->next;
+    _blocksInUse++;
+    return block;
+}
+
+void OctreeMemoryPool::release(void* block) {
+    if (!block) {
+        return;
+    }
+    QMutexLocker locker(&_mutex);
+    FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+    freeBlock->next = _freeList;
+    _freeList = freeBlock;
+    _blocksInUse--;
+}
+
+QVector<OctreeMemoryPool*> OctreeMemoryPool::getPools() {
+    QMutexLocker locker(poolsMutex());
+    return *allPools();
+}
+
+quint64 OctreeMemoryPool::getTotalReservedBytes() {
+    quint64 total = 0;
+    foreach (OctreeMemoryPool* pool, getPools()) {
+        total += pool->getReservedBytes();
+    }
+    return total;
+}
+
+quint64 OctreeMemoryPool::getTotalBlocksInUse() {
+    quint64 total = 0;
+    foreach (OctreeMemoryPool* pool, getPools()) {
+        total += pool->getBlocksInUse();
+    }
+    return total;
+}
@@ -0,0 +1,63 @@
+//
+//  OctreeMemoryPool.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Fixed size block pool used for octree elements, octal codes and child arrays
+//
+
+#ifndef __hifi__OctreeMemoryPool__
+#define __hifi__OctreeMemoryPool__
+
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
+const int DEFAULT_BLOCKS_PER_SLAB = 4096;
+
+/// Hands out fixed size blocks carved from large slabs. Freed blocks go on a free list and are recycled in O(1), which
+/// keeps the many small octree allocations contiguous and avoids the per allocation malloc overhead. Slabs are never
+/// given back to the system, memory freed by erasing a tree is kept for the next elements. Pools are created once and
+/// live for the life of the process, all live pools can be enumerated with getPools() for reporting.
+class OctreeMemoryPool {
+public:
+    /// \param const char* name used when reporting the pool's stats, not copied
+    /// \param size_t blockSize size in bytes of the blocks handed out by allocate()
+    /// \param int blocksPerSlab number of blocks reserved each time the pool grows
+    OctreeMemoryPool(const char* name, size_t blockSize, int blocksPerSlab = DEFAULT_BLOCKS_PER_SLAB);
+
+    void* allocate();
+    void release(void* block);
+
+    const char* getName() const { return _name; }
+    size_t getBlockSize() const { return _blockSize; }
+    int getSlabCount() const { return _slabCount; }
+    quint64 getBlocksInUse() const { return _blocksInUse; }
+    quint64 getReservedBytes() const { return (quint64)_slabCount * _blocksPerSlab * _blockSize; }
+
+    static QVector<OctreeMemoryPool*> getPools();
+    static quint64 getTotalReservedBytes();
+    static quint64 getTotalBlocksInUse();
+
+private:
+    // never deleted, see class comment
+    ~OctreeMemoryPool() { }
+
+    class FreeBlock {
+    public:
+        FreeBlock* next;
+    };
+
+    void addSlab();
+
+    const char* _name;
+    size_t _blockSize;
+    int _blocksPerSlab;
+
+    QMutex _mutex;
+    FreeBlock* _freeList;
+    int _slabCount;
+    quint64 _blocksInUse;
+};
+
+#endif /* defined(__hifi__OctreeMemoryPool__) */
@@ -347,6 +347,16 @@ bool OctreePacketData::appendRawData(const unsigned char* data, int length) {
     return success;
 }
 
+bool OctreePacketData::appendEncodedSubTree(const unsigned char* data, int length) {
+    bool success = append(data, length);
+    if (success) {
+        _subTreeAt = _bytesInUse; // the subtree is already complete
+        _bytesOfRawData += length;
+        _totalBytesOfRawData += length;
+    }
+    return success;
+}
+
 quint64 OctreePacketData::_compressContentTime = 0;
 quint64 OctreePacketData::_compressContentCalls = 0;
 
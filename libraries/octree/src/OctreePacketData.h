@@ -144,6 +144,10 @@ public:
     /// appends raw bytes, might fail if byte would cause packet to be too large
     bool appendRawData(const unsigned char* data, int length);
 
+    /// appends a complete subtree, octal code and all, that was previously encoded into another packet's uncompressed
+    /// stream. May fail if the subtree is too long, in which case the stream remains in its previous state.
+    bool appendEncodedSubTree(const unsigned char* data, int length);
+
     /// returns a byte offset from beginning of the uncompressed stream based on offset from end. 
     /// Positive offsetFromEnd returns that many bytes before the end of uncompressed stream
     int getUncompressedByteOffset(int offsetFromEnd = 0) const { return _bytesInUse - offsetFromEnd; }
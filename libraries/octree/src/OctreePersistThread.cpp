@@ -8,18 +8,206 @@
 //  Threaded or non-threaded Octree persistence
 //
 
+#include <cstdio>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 #include <QDebug>
+#include <PacketHeaders.h>
 #include <PerfStat.h>
 #include <SharedUtil.h>
 
 #include "OctreePersistThread.h"
 
-OctreePersistThread::OctreePersistThread(Octree* tree, const QString& filename, int persistInterval) :
+// each journal record is the length of the packet, a checksum of the packet, and then the packet itself
+typedef quint32 JournalRecordLength;
+typedef quint16 JournalRecordChecksum;
+const int JOURNAL_RECORD_HEADER_SIZE = sizeof(JournalRecordLength) + sizeof(JournalRecordChecksum);
+
+// makes sure a file's contents are on disk, not just in the OS's cache, before we rename it into place
+static bool syncFile(const QString& filename) {
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+// replaces one file with another, atomically where the platform allows it
+static bool replaceFile(const QString& fromFilename, const QString& toFilename) {
+#ifdef _WIN32
+    // rename() won't replace an existing file on windows
+    QFile::remove(toFilename);
+#endif
+    return rename(fromFilename.toLocal8Bit().constData(), toFilename.toLocal8Bit().constData()) == 0;
+}
+
+OctreePersistThread::OctreePersistThread(Octree* tree, const QString& filename, int persistInterval,
+                                         bool wantJournal, int checkpointInterval, bool wantIndexedFile) :
     _tree(tree),
     _filename(filename),
     _persistInterval(persistInterval),
     _initialLoadComplete(false),
-    _loadTimeUSecs(0) {
+    _loadTimeUSecs(0),
+    _wantJournal(wantJournal && tree->canReplayEdits()),
+    _checkpointInterval(checkpointInterval),
+    _lastCheckpoint(0),
+    _journalSize(0),
+    _totalJournaledPackets(0),
+    _replayedPackets(0),
+    _totalCheckpoints(0),
+    _lastCheckpointUSecs(0),
+    _wantIndexedFile(wantIndexedFile),
+    _lazyLoadComplete(false),
+    _lazyLoadStarted(0),
+    _lazyLoadTimeUSecs(0) {
+}
+
+void OctreePersistThread::journalEditPacket(const QByteArray& packet) {
+    if (!_wantJournal) {
+        return;
+    }
+    JournalRecordLength length = packet.size();
+    JournalRecordChecksum checksum = qChecksum(packet.constData(), length);
+
+    QMutexLocker locker(&_journalMutex);
+    _pendingJournal.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    _pendingJournal.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    _pendingJournal.append(packet);
+    _totalJournaledPackets++;
+}
+
+int OctreePersistThread::replayJournal(const QString& journalFilename) {
+    QFile journal(journalFilename);
+    if (!journal.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    QByteArray contents = journal.readAll();
+    journal.close();
+
+    int packetsReplayed = 0;
+    int atByte = 0;
+    while (atByte + JOURNAL_RECORD_HEADER_SIZE <= contents.size()) {
+        JournalRecordLength length;
+        JournalRecordChecksum checksum;
+        memcpy(&length, contents.constData() + atByte, sizeof(length));
+        memcpy(&checksum, contents.constData() + atByte + sizeof(length), sizeof(checksum));
+
+        // a crash while appending can leave a partial record at the end of the journal, everything before it is good
+        if (atByte + JOURNAL_RECORD_HEADER_SIZE + (int)length > contents.size() ||
+                qChecksum(contents.constData() + atByte + JOURNAL_RECORD_HEADER_SIZE, length) != checksum) {
+            qDebug() << "journal" << journalFilename << "has a partial record at byte" << atByte << ", ignoring the rest";
+            break;
+        }
+
+        QByteArray packet = QByteArray::fromRawData(contents.constData() + atByte + JOURNAL_RECORD_HEADER_SIZE, length);
+        atByte += JOURNAL_RECORD_HEADER_SIZE + length;
+
+        // apply the edits the same way OctreeInboundPacketProcessor did when the packet first arrived
+        PacketType packetType = packetTypeForPacket(packet);
+        const unsigned char* packetData = reinterpret_cast<const unsigned char*>(packet.constData());
+        int editAtByte = numBytesForPacketHeader(packet) + sizeof(unsigned short) + sizeof(quint64); // sequence, sentAt
+        while (editAtByte < packet.size()) {
+            int editDataBytesRead = _tree->processEditPacketData(packetType, packetData, packet.size(),
+                                                                 packetData + editAtByte, packet.size() - editAtByte,
+                                                                 SharedNodePointer());
+            if (editDataBytesRead <= 0) {
+                break;
+            }
+            editAtByte += editDataBytesRead;
+        }
+        packetsReplayed++;
+    }
+    qDebug() << "replayed" << packetsReplayed << "edit packets from journal" << journalFilename;
+    return packetsReplayed;
+}
+
+void OctreePersistThread::openJournal() {
+    _journalFile.setFileName(getJournalFilename());
+    if (!_journalFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "unable to open journal" << getJournalFilename() << ", edits will only be saved by checkpoints";
+    }
+    _journalSize = _journalFile.size();
+}
+
+void OctreePersistThread::flushJournal() {
+    QByteArray pending;
+    _journalMutex.lock();
+    pending.swap(_pendingJournal);
+    _journalMutex.unlock();
+
+    if (!pending.isEmpty() && _journalFile.isOpen()) {
+        _journalFile.write(pending);
+        _journalFile.flush();
+        _journalSize += pending.size();
+    }
+}
+
+// Starts a new journal for the edits that follow the checkpoint we're about to write. The old journal is kept as the
+// previous journal until that checkpoint has safely replaced the persist file.
+void OctreePersistThread::rotateJournal() {
+    flushJournal();
+    _journalFile.close();
+
+    QString journalFilename = getJournalFilename();
+    QString previousJournalFilename = getPreviousJournalFilename();
+    if (QFile::exists(previousJournalFilename)) {
+        // an earlier checkpoint never made it to disk, so those edits are still needed, keep them all together
+        QFile journal(journalFilename);
+        QFile previousJournal(previousJournalFilename);
+        if (journal.open(QIODevice::ReadOnly) && previousJournal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            previousJournal.write(journal.readAll());
+            journal.close();
+            previousJournal.close();
+            QFile::remove(journalFilename);
+        }
+    } else {
+        replaceFile(journalFilename, previousJournalFilename);
+    }
+
+    openJournal();
+}
+
+bool OctreePersistThread::writeCheckpoint() {
+    quint64 checkpointStarted = usecTimestampNow();
+    qDebug() << "saving Octrees to file " << _filename << "...";
+
+    if (_wantJournal) {
+        rotateJournal();
+    }
+
+    // anything edited while we're writing will mark the tree dirty again
+    _tree->clearDirtyBit();
+
+    QString tempFilename = getTempFilename();
+    bool saved = (_wantIndexedFile ? _tree->writeToIndexedSVOFile(tempFilename.toLocal8Bit().constData())
+                                   : _tree->writeToSVOFile(tempFilename.toLocal8Bit().constData()))
+        && syncFile(tempFilename) && replaceFile(tempFilename, _filename);
+
+    if (saved) {
+        // the checkpoint has everything the previous journal did
+        if (_wantJournal) {
+            QFile::remove(getPreviousJournalFilename());
+        }
+        _totalCheckpoints++;
+        _lastCheckpointUSecs = usecTimestampNow() - checkpointStarted;
+        qDebug("DONE saving Octrees to file...");
+    } else {
+        // leave the persist file, and the journal that goes with it, as they were. We'll try again next interval.
+        QFile::remove(tempFilename);
+        _tree->setDirtyBit();
+        qDebug() << "FAILED saving Octrees to file " << _filename;
+    }
+    _lastCheckpoint = usecTimestampNow();
+    return saved;
 }
 
 bool OctreePersistThread::process() {
@@ -33,12 +221,27 @@ bool OctreePersistThread::process() {
         _tree->lockForWrite();
         {
             PerformanceWarning warn(true, "Loading Octree File", true);
-            persistantFileRead = _tree->readFromSVOFile(_filename.toLocal8Bit().constData());
+            if (OctreeIndexedFile::isIndexedFile(_filename)) {
+                // keep saving in the format we loaded
+                _wantIndexedFile = true;
+                persistantFileRead = _tree->readFromIndexedSVOFile(_filename.toLocal8Bit().constData());
+            } else {
+                persistantFileRead = _tree->readFromSVOFile(_filename.toLocal8Bit().constData());
+            }
+        }
+        if (_wantJournal) {
+            PerformanceWarning warn(true, "Replaying Octree Journal", true);
+            _replayedPackets = replayJournal(getPreviousJournalFilename()) + replayJournal(getJournalFilename());
         }
         _tree->unlock();
 
+        // a temp file is only ever a checkpoint that didn't finish
+        QFile::remove(getTempFilename());
+
         quint64 loadDone = usecTimestampNow();
         _loadTimeUSecs = loadDone - loadStarted;
+        _lazyLoadComplete = !_tree->hasUnloadedSubtrees();
+        _lazyLoadStarted = loadDone;
 
         _tree->clearDirtyBit(); // the tree is clean since we just loaded it
         qDebug("DONE loading Octrees from file... fileRead=%s", debug::valueOf(persistantFileRead));
@@ -58,6 +261,16 @@ bool OctreePersistThread::process() {
 
         _initialLoadComplete = true;
         _lastCheck = usecTimestampNow(); // we just loaded, no need to save again
+        _lastCheckpoint = _lastCheck;
+
+        if (_wantJournal) {
+            openJournal();
+
+            // fold whatever we replayed into a fresh checkpoint, so the journals don't keep growing across restarts
+            if (_replayedPackets > 0 && _lazyLoadComplete) {
+                writeCheckpoint();
+            }
+        }
 
         emit loadCompleted();
     }
@@ -72,20 +285,46 @@ bool OctreePersistThread::process() {
         _tree->update();
         _tree->unlock();
 
+        // the journal is what keeps recent edits safe, so get them to disk promptly
+        flushJournal();
+
+        // keep loading the rest of an indexed file in short slices, so that edits and encoders aren't held up
+        if (!_lazyLoadComplete) {
+            _tree->lockForWrite();
+            _tree->loadUnloadedSubtrees(LAZY_LOAD_SLICE_USECS);
+            _lazyLoadComplete = !_tree->hasUnloadedSubtrees();
+            _tree->unlock();
+            if (_lazyLoadComplete) {
+                _lazyLoadTimeUSecs = usecTimestampNow() - _lazyLoadStarted;
+                qDebug("DONE loading subtrees from indexed file...");
+            }
+        }
+
         quint64 now = usecTimestampNow();
         quint64 sinceLastSave = now - _lastCheck;
         quint64 intervalToCheck = _persistInterval * MSECS_TO_USECS;
 
-        if (sinceLastSave > intervalToCheck) {
+        // a checkpoint would leave out the subtrees that aren't loaded yet, and until then the journal keeps edits safe
+        if (sinceLastSave > intervalToCheck && _lazyLoadComplete) {
             // check the dirty bit and persist here...
             _lastCheck = usecTimestampNow();
-            if (_tree->isDirty()) {
-                qDebug() << "saving Octrees to file " << _filename << "...";
-                _tree->writeToSVOFile(_filename.toLocal8Bit().constData());
-                _tree->clearDirtyBit(); // tree is clean after saving
-                qDebug("DONE saving Octrees to file...");
+            if (_wantJournal) {
+                // the edits are already in the journal, only pay for writing the whole tree once the journal is big or old
+                quint64 sinceLastCheckpoint = now - _lastCheckpoint;
+                quint64 checkpointInterval = _checkpointInterval * MSECS_TO_USECS;
+                if (_journalSize > 0 &&
+                        (_journalSize >= DEFAULT_CHECKPOINT_JOURNAL_SIZE || sinceLastCheckpoint > checkpointInterval)) {
+                    writeCheckpoint();
+                }
+            } else if (_tree->isDirty()) {
+                writeCheckpoint();
             }
         }
     }
+
+    if (!isStillRunning()) {
+        // we're being shut down, don't lose the last few edits
+        flushJournal();
+    }
     return isStillRunning();  // keep running till they terminate us
 }
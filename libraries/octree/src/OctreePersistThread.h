@@ -11,21 +11,52 @@
 #ifndef __Octree_server__OctreePersistThread__
 #define __Octree_server__OctreePersistThread__
 
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
 #include <QString>
 #include <GenericThread.h>
 #include "Octree.h"
 
 /// Generalized threaded processor for handling received inbound packets.
+///
+/// For trees that can replay their edits, every applied edit packet is appended to a journal next to the persist file,
+/// and the tree itself is only checkpointed once the journal has grown large or old. Checkpoints are written to a temp
+/// file and renamed over the persist file, so a crash never leaves a partially written file behind. On startup the
+/// checkpoint is loaded and the journal(s) replayed on top of it.
+///
+/// Persist files can also be indexed SVO files (see OctreeIndexedFile). For trees that support lazy loading, the initial
+/// load then only reads the top of the tree, and the rest is loaded in the background while the server is already up.
 class OctreePersistThread : public GenericThread {
     Q_OBJECT
 public:
     static const int DEFAULT_PERSIST_INTERVAL = 1000 * 30; // every 30 seconds
+    static const int DEFAULT_CHECKPOINT_INTERVAL = 1000 * 60 * 10; // every 10 minutes
+    static const qint64 DEFAULT_CHECKPOINT_JOURNAL_SIZE = 16 * 1024 * 1024; // or once the journal reaches 16MB
 
-    OctreePersistThread(Octree* tree, const QString& filename, int persistInterval = DEFAULT_PERSIST_INTERVAL);
+    static const quint64 LAZY_LOAD_SLICE_USECS = 5 * 1000; // how long we hold the write lock while loading subtrees
+
+    OctreePersistThread(Octree* tree, const QString& filename, int persistInterval = DEFAULT_PERSIST_INTERVAL,
+                        bool wantJournal = true, int checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL,
+                        bool wantIndexedFile = false);
 
     bool isInitialLoadComplete() const { return _initialLoadComplete; }
     quint64 getLoadElapsedTime() const { return _loadTimeUSecs; }
 
+    /// Appends an edit packet to the journal, call after all of the edits in the packet have been applied to the tree.
+    void journalEditPacket(const QByteArray& packet);
+
+    bool isJournalEnabled() const { return _wantJournal; }
+    qint64 getJournalSize() const { return _journalSize; }
+    quint64 getTotalJournaledPackets() const { return _totalJournaledPackets; }
+    quint64 getReplayedPackets() const { return _replayedPackets; }
+    quint64 getTotalCheckpoints() const { return _totalCheckpoints; }
+    quint64 getLastCheckpointElapsedTime() const { return _lastCheckpointUSecs; }
+
+    bool isIndexedFile() const { return _wantIndexedFile; }
+    bool isLazyLoadComplete() const { return _lazyLoadComplete; }
+    quint64 getLazyLoadElapsedTime() const { return _lazyLoadTimeUSecs; }
+
 signals:
     void loadCompleted();
 
@@ -33,6 +64,16 @@ protected:
     /// Implements generic processing behavior for this thread.
     virtual bool process();
 private:
+    QString getJournalFilename() const { return _filename + ".journal"; }
+    QString getPreviousJournalFilename() const { return _filename + ".journal.previous"; }
+    QString getTempFilename() const { return _filename + ".temp"; }
+
+    int replayJournal(const QString& journalFilename);
+    void openJournal();
+    void flushJournal();
+    void rotateJournal();
+    bool writeCheckpoint();
+
     Octree* _tree;
     QString _filename;
     int _persistInterval;
@@ -40,6 +81,25 @@ private:
 
     quint64 _loadTimeUSecs;
     quint64 _lastCheck;
+
+    bool _wantJournal;
+    int _checkpointInterval;
+    quint64 _lastCheckpoint;
+
+    QMutex _journalMutex;
+    QByteArray _pendingJournal; // edit packets waiting to be written, guarded by _journalMutex
+    QFile _journalFile;
+    qint64 _journalSize;
+
+    quint64 _totalJournaledPackets;
+    quint64 _replayedPackets;
+    quint64 _totalCheckpoints;
+    quint64 _lastCheckpointUSecs;
+
+    bool _wantIndexedFile;
+    bool _lazyLoadComplete;
+    quint64 _lazyLoadStarted;
+    quint64 _lazyLoadTimeUSecs;
 };
 
 #endif // __Octree_server__OctreePersistThread__
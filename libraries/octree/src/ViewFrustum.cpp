@@ -9,6 +9,7 @@
 //
 
 #include <algorithm>
+#include <cassert>
 
 #include <glm/glm.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -24,6 +25,14 @@
 
 using namespace std;
 
+// the plane tests are vectorized when the build targets SSE
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define VIEW_FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+const int NUMBER_OF_PLANES = 6;
+
 ViewFrustum::ViewFrustum() :
     _position(0,0,0),
     _orientation(),
@@ -298,6 +307,111 @@ ViewFrustum::location ViewFrustum::boxInFrustum(const AABox& box) const {
     return regularResult;
 }
 
+ViewFrustum::location ViewFrustum::boxInFrustum(const AABox& box, unsigned char& testMask) const {
+    ViewFrustum::location result;
+    boxesInFrustum(&box.getCorner(), box.getScale(), 1, testMask, &result, &testMask);
+    return result;
+}
+
+// \return a bit for each box whose vertex at corner + offset is behind the plane, the vertices are worked out with the
+// same operations in the same order as Plane::distance() of AABox::getVertexP() and getVertexN(), so that the results
+// match boxInFrustum()
+static unsigned char verticesBehindPlane(const ::Plane& plane, const float* cornersX, const float* cornersY,
+                                         const float* cornersZ, const glm::vec3& offset) {
+    const glm::vec3& normal = plane.getNormal();
+    unsigned char behind = 0;
+#ifdef VIEW_FRUSTUM_SSE
+    __m128 normalX = _mm_set1_ps(normal.x);
+    __m128 normalY = _mm_set1_ps(normal.y);
+    __m128 normalZ = _mm_set1_ps(normal.z);
+    __m128 offsetX = _mm_set1_ps(offset.x);
+    __m128 offsetY = _mm_set1_ps(offset.y);
+    __m128 offsetZ = _mm_set1_ps(offset.z);
+    __m128 dCoefficient = _mm_set1_ps(plane.getDCoefficient());
+    __m128 zero = _mm_setzero_ps();
+    for (int i = 0; i < MAX_BOXES_PER_FRUSTUM_TEST; i += 4) {
+        __m128 x = _mm_mul_ps(normalX, _mm_add_ps(_mm_loadu_ps(cornersX + i), offsetX));
+        __m128 y = _mm_mul_ps(normalY, _mm_add_ps(_mm_loadu_ps(cornersY + i), offsetY));
+        __m128 z = _mm_mul_ps(normalZ, _mm_add_ps(_mm_loadu_ps(cornersZ + i), offsetZ));
+        __m128 distance = _mm_add_ps(dCoefficient, _mm_add_ps(_mm_add_ps(x, y), z));
+        behind |= _mm_movemask_ps(_mm_cmplt_ps(distance, zero)) << i;
+    }
+#else
+    for (int i = 0; i < MAX_BOXES_PER_FRUSTUM_TEST; i++) {
+        glm::vec3 vertex(cornersX[i] + offset.x, cornersY[i] + offset.y, cornersZ[i] + offset.z);
+        if (plane.distance(vertex) < 0) {
+            behind |= (1 << i);
+        }
+    }
+#endif
+    return behind;
+}
+
+void ViewFrustum::boxesInFrustum(const glm::vec3* corners, float scale, int numBoxes, unsigned char testMask,
+                                 ViewFrustum::location* locations, unsigned char* childTestMasks) const {
+    assert(numBoxes <= MAX_BOXES_PER_FRUSTUM_TEST);
+
+    // boxes inside every plane are inside the frustum, whatever the keyhole says
+    if (!testMask) {
+        for (int i = 0; i < numBoxes; i++) {
+            locations[i] = INSIDE;
+            childTestMasks[i] = 0;
+        }
+        return;
+    }
+
+    ViewFrustum::location keyholeResults[MAX_BOXES_PER_FRUSTUM_TEST];
+    float cornersX[MAX_BOXES_PER_FRUSTUM_TEST] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    float cornersY[MAX_BOXES_PER_FRUSTUM_TEST] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    float cornersZ[MAX_BOXES_PER_FRUSTUM_TEST] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < numBoxes; i++) {
+        cornersX[i] = corners[i].x;
+        cornersY[i] = corners[i].y;
+        cornersZ[i] = corners[i].z;
+        childTestMasks[i] = testMask;
+
+        // the keyhole is tested every time, since a box that sticks out of its bounding box counts as outside it
+        // even when the box's children don't
+        keyholeResults[i] = (_keyholeRadius >= 0.0f) ? boxInKeyhole(AABox(corners[i], scale)) : OUTSIDE;
+    }
+
+    unsigned char outsideBoxes = 0;
+    unsigned char intersectingBoxes = 0;
+    for (int plane = 0; plane < NUMBER_OF_PLANES; plane++) {
+        unsigned char planeTest = (1 << plane);
+        if (!(testMask & planeTest)) {
+            continue;
+        }
+        const glm::vec3& normal = _planes[plane].getNormal();
+        glm::vec3 offsetP(normal.x > 0 ? scale : 0.0f, normal.y > 0 ? scale : 0.0f, normal.z > 0 ? scale : 0.0f);
+        glm::vec3 offsetN(normal.x < 0 ? scale : 0.0f, normal.y < 0 ? scale : 0.0f, normal.z < 0 ? scale : 0.0f);
+        unsigned char behindP = verticesBehindPlane(_planes[plane], cornersX, cornersY, cornersZ, offsetP);
+        unsigned char behindN = verticesBehindPlane(_planes[plane], cornersX, cornersY, cornersZ, offsetN);
+        outsideBoxes |= behindP;
+        intersectingBoxes |= behindN;
+        for (int i = 0; i < numBoxes; i++) {
+            if (!(behindN & (1 << i))) {
+                childTestMasks[i] &= ~planeTest;
+            }
+        }
+    }
+
+    // same precedence as boxInFrustum(), the keyhole first, then the planes
+    for (int i = 0; i < numBoxes; i++) {
+        if (keyholeResults[i] == INSIDE) {
+            locations[i] = INSIDE;
+            childTestMasks[i] = 0;
+        } else if (outsideBoxes & (1 << i)) {
+            locations[i] = keyholeResults[i];
+        } else if (intersectingBoxes & (1 << i)) {
+            locations[i] = INTERSECT;
+        } else {
+            locations[i] = INSIDE;
+            childTestMasks[i] = 0;
+        }
+    }
+}
+
 bool testMatches(glm::quat lhs, glm::quat rhs, float epsilon = EPSILON) {
     return (fabs(lhs.x - rhs.x) <= epsilon && fabs(lhs.y - rhs.y) <= epsilon && fabs(lhs.z - rhs.z) <= epsilon
             && fabs(lhs.w - rhs.w) <= epsilon);
@@ -21,6 +21,11 @@
 
 const float DEFAULT_KEYHOLE_RADIUS = 3.0f;
 
+// the frustum tests a box still needs, one bit for each plane, a box that's entirely inside a plane has children that
+// are too, so its children can skip testing that plane
+const unsigned char ALL_FRUSTUM_TESTS = 0x3f;
+const int MAX_BOXES_PER_FRUSTUM_TEST = 8;
+
 class ViewFrustum {
 public:
     // setters for camera attributes
@@ -81,6 +86,17 @@ public:
     ViewFrustum::location sphereInFrustum(const glm::vec3& center, float radius) const;
     ViewFrustum::location boxInFrustum(const AABox& box) const;
 
+    /// Same result as boxInFrustum(box), but only does the tests in testMask, which it then changes to the tests the
+    /// box's children will need. Start from ALL_FRUSTUM_TESTS for a box whose parent wasn't tested.
+    ViewFrustum::location boxInFrustum(const AABox& box, unsigned char& testMask) const;
+
+    /// Tests up to MAX_BOXES_PER_FRUSTUM_TEST boxes of the same size, like the children of one box, that all need the
+    /// tests in testMask, with each plane tested against all of the boxes at once.
+    /// \param locations gets the location of each box
+    /// \param childTestMasks gets the tests the children of each box will need
+    void boxesInFrustum(const glm::vec3* corners, float scale, int numBoxes, unsigned char testMask,
+                        ViewFrustum::location* locations, unsigned char* childTestMasks) const;
+
     // some frustum comparisons
     bool matches(const ViewFrustum& compareTo, bool debug = false) const;
     bool matches(const ViewFrustum* compareTo, bool debug = false) const { return matches(*compareTo, debug); }
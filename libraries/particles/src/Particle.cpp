@@ -15,15 +15,9 @@
 #include <VoxelsScriptingInterface.h>
 #include <VoxelDetail.h>
 
-
-// This is not ideal, but adding script-engine as a linked library, will cause a circular reference
-// I'm open to other potential solutions. Could we change cmake to allow libraries to reference each others
-// headers, but not link to each other, this is essentially what this construct is doing, but would be
-// better to add includes to the include path, but not link
-#include "../../script-engine/src/ScriptEngine.h"
-
 #include "ParticlesScriptingInterface.h"
 #include "Particle.h"
+#include "ParticleScriptContext.h"
 #include "ParticleTree.h"
 
 uint32_t Particle::_nextID = 0;
@@ -92,6 +86,7 @@ Particle::Particle(const ParticleID& particleID, const ParticleProperties& prope
     _script = DEFAULT_SCRIPT;
     _inHand = NOT_IN_HAND;
     _shouldDie = false;
+    _isSleeping = false;
     _modelURL = DEFAULT_MODEL_URL;
     _modelTranslation = DEFAULT_MODEL_TRANSLATION;
     _modelRotation = DEFAULT_MODEL_ROTATION;
@@ -128,6 +123,7 @@ void Particle::init(glm::vec3 position, float radius, rgbColor color, glm::vec3
     _script = updateScript;
     _inHand = inHand;
     _shouldDie = false;
+    _isSleeping = false;
     _modelURL = DEFAULT_MODEL_URL;
     _modelTranslation = DEFAULT_MODEL_TRANSLATION;
     _modelRotation = DEFAULT_MODEL_ROTATION;
@@ -851,59 +847,42 @@ void Particle::update(const quint64& now) {
     }
 }
 
-void Particle::startParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable) {
-    if (_voxelEditSender) {
-        engine.getVoxelsScriptingInterface()->setPacketSender(_voxelEditSender);
-    }
-    if (_particleEditSender) {
-        engine.getParticlesScriptingInterface()->setPacketSender(_particleEditSender);
-    }
+// slower than this and a particle with nothing else moving it is considered to be at rest
+const float SLEEPING_PARTICLE_SPEED = 0.001f / (float)(TREE_SCALE); // a millimeter per second
 
-    // Add the "this" Particle object
-    engine.registerGlobalObject("Particle", &particleScriptable);
-    engine.evaluate();
+bool Particle::canSleep() const {
+    return _script.isEmpty() && !_inHand && !_shouldDie && _gravity == glm::vec3(0.0f) &&
+        glm::length(_velocity) < SLEEPING_PARTICLE_SPEED;
 }
 
-void Particle::endParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable) {
-    if (_voxelEditSender) {
-        _voxelEditSender->releaseQueuedMessages();
-    }
-    if (_particleEditSender) {
-        _particleEditSender->releaseQueuedMessages();
+void Particle::setSleeping(bool isSleeping) {
+    _isSleeping = isSleeping;
+    if (isSleeping) {
+        _velocity = glm::vec3(0.0f);
+    } else {
+        // don't simulate all the time we were asleep in one step
+        _lastUpdated = usecTimestampNow();
     }
 }
 
 void Particle::executeUpdateScripts() {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
-        particleScriptable.emitUpdate();
-        endParticleScriptContext(engine, particleScriptable);
+        ParticleScriptContext::getInstance()->runUpdate(this);
     }
 }
 
 void Particle::collisionWithParticle(Particle* other) {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
-        ParticleScriptObject otherParticleScriptable(other);
-        particleScriptable.emitCollisionWithParticle(&otherParticleScriptable);
-        endParticleScriptContext(engine, particleScriptable);
+        ParticleScriptContext::getInstance()->runCollisionWithParticle(this, other);
     }
 }
 
 void Particle::collisionWithVoxel(VoxelDetail* voxelDetails) {
     // Only run this particle script if there's a script attached directly to the particle.
     if (!_script.isEmpty()) {
-        ScriptEngine engine(_script);
-        ParticleScriptObject particleScriptable(this);
-        startParticleScriptContext(engine, particleScriptable);
-        particleScriptable.emitCollisionWithVoxel(*voxelDetails);
-        endParticleScriptContext(engine, particleScriptable);
+        ParticleScriptContext::getInstance()->runCollisionWithVoxel(this, *voxelDetails);
     }
 }
 
@@ -26,7 +26,6 @@ class ParticleProperties;
 class ParticlesScriptingInterface;
 class ParticleScriptObject;
 class ParticleTree;
-class ScriptEngine;
 class VoxelEditPacketSender;
 class VoxelsScriptingInterface;
 struct VoxelDetail;
@@ -296,6 +295,16 @@ public:
 
     void update(const quint64& now);
     void collisionWithParticle(Particle* other);
+
+    /// Is the particle at rest with no gravity or script to move it, so it can sleep until something hits or edits it.
+    bool canSleep() const;
+    bool isSleeping() const { return _isSleeping; }
+
+    /// Puts the particle to sleep where it is, or wakes it up to be simulated again from now on.
+    void setSleeping(bool isSleeping);
+
+    /// \return the time when the particle's lifetime runs out
+    quint64 getLifetimeEnd() const { return _created + (quint64)(_lifetime * USECS_PER_SECOND); }
     void collisionWithVoxel(VoxelDetail* voxel);
 
     void debugDump() const;
@@ -322,8 +331,6 @@ protected:
     static VoxelEditPacketSender* _voxelEditSender;
     static ParticleEditPacketSender* _particleEditSender;
 
-    void startParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable);
-    void endParticleScriptContext(ScriptEngine& engine, ParticleScriptObject& particleScriptable);
     void executeUpdateScripts();
 
     void setAge(float age);
@@ -336,6 +343,7 @@ protected:
     uint32_t _id;
     static uint32_t _nextID;
     bool _shouldDie;
+    bool _isSleeping; // this doesn't go on the wire, every simulation decides for itself
     glm::vec3 _gravity;
     float _damping;
     float _lifetime;
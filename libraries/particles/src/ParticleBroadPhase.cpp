@@ -0,0 +1,66 @@
+//
+//  ParticleBroadPhase.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Finds every pair of overlapping particles in one sort and sweep
+//
+
+#include <algorithm>
+
+#include <GeometryUtil.h>
+#include <OctreeConstants.h>
+
+#include "Particle.h"
+#include "ParticleBroadPhase.h"
+
+ParticleBroadPhase::ParticleBroadPhase() :
+    _entries(),
+    _numCandidatePairs(0) {
+}
+
+void ParticleBroadPhase::clear() {
+    _entries.clear();
+}
+
+void ParticleBroadPhase::addParticle(Particle* particle) {
+    Entry entry;
+    glm::vec3 extent(particle->getRadius());
+    entry.minimum = particle->getPosition() - extent;
+    entry.maximum = particle->getPosition() + extent;
+    entry.particle = particle;
+    entry.order = _entries.size();
+    _entries.push_back(entry);
+}
+
+void ParticleBroadPhase::findCollisionPairs(std::vector<ParticleCollisionPair>& pairs) {
+    _numCandidatePairs = 0;
+    std::sort(_entries.begin(), _entries.end());
+
+    int numEntries = _entries.size();
+    for (int i = 0; i < numEntries; i++) {
+        const Entry& first = _entries[i];
+
+        // everything after this in the sort starts further along x, so stop at the first one that starts past our end
+        for (int j = i + 1; j < numEntries && _entries[j].minimum.x <= first.maximum.x; j++) {
+            const Entry& second = _entries[j];
+            if (first.particle->isSleeping() && second.particle->isSleeping()) {
+                continue; // two sleeping particles that overlap have already settled it between them
+            }
+            if (second.minimum.y > first.maximum.y || second.maximum.y < first.minimum.y ||
+                    second.minimum.z > first.maximum.z || second.maximum.z < first.minimum.z) {
+                continue;
+            }
+            _numCandidatePairs++;
+
+            const Entry& a = (first.order < second.order) ? first : second;
+            const Entry& b = (first.order < second.order) ? second : first;
+            glm::vec3 penetration;
+            if (findSphereSpherePenetration(a.particle->getPosition(), a.particle->getRadius(),
+                                            b.particle->getPosition(), b.particle->getRadius(), penetration)) {
+                pairs.push_back(ParticleCollisionPair(a.particle, b.particle, penetration * (float)(TREE_SCALE)));
+            }
+        }
+    }
+}
@@ -0,0 +1,65 @@
+//
+//  ParticleBroadPhase.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Finds every pair of overlapping particles in one sort and sweep
+//
+
+#ifndef __hifi__ParticleBroadPhase__
+#define __hifi__ParticleBroadPhase__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class Particle;
+
+/// Two particles whose spheres overlap.
+class ParticleCollisionPair {
+public:
+    ParticleCollisionPair(Particle* particleA, Particle* particleB, const glm::vec3& penetration) :
+        particleA(particleA), particleB(particleB), penetration(penetration) { }
+
+    Particle* particleA;
+    Particle* particleB;
+    glm::vec3 penetration; // how deep A overlaps B in meters, pointing from A into B
+};
+
+/// Collects the particles for one collision update, then sorts their bounding boxes along x and sweeps them, so that
+/// every overlapping pair is found once without searching the particle tree for each particle.
+class ParticleBroadPhase {
+public:
+    ParticleBroadPhase();
+
+    void clear();
+
+    void addParticle(Particle* particle);
+
+    /// Appends each pair of the added particles that overlap to pairs, the particle added first is particleA. Pairs of
+    /// sleeping particles are left out.
+    void findCollisionPairs(std::vector<ParticleCollisionPair>& pairs);
+
+    int getNumParticles() const { return _entries.size(); }
+
+    /// \return the number of pairs with overlapping bounding boxes in the last findCollisionPairs(), which got the
+    /// exact sphere test
+    int getNumCandidatePairs() const { return _numCandidatePairs; }
+
+private:
+    class Entry {
+    public:
+        bool operator<(const Entry& other) const { return minimum.x < other.minimum.x; }
+
+        glm::vec3 minimum;
+        glm::vec3 maximum;
+        Particle* particle;
+        int order; // when the particle was added, so pairs come out the same way around whatever the sort does
+    };
+
+    std::vector<Entry> _entries;
+    int _numCandidatePairs;
+};
+
+#endif /* defined(__hifi__ParticleBroadPhase__) */
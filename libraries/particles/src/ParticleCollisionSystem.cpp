@@ -17,6 +17,7 @@
 #include "Particle.h"
 #include "ParticleCollisionSystem.h"
 #include "ParticleEditPacketSender.h"
+#include "ParticleScriptContext.h"
 #include "ParticleTree.h"
 
 const int MAX_COLLISIONS_PER_PARTICLE = 16;
@@ -50,6 +51,7 @@ bool ParticleCollisionSystem::updateOperation(OctreeElement* element, void* extr
     for (uint16_t i = 0; i < numberOfParticles; i++) {
         Particle* particle = &particles[i];
         system->checkParticle(particle);
+        system->_broadPhase.addParticle(particle);
     }
 
     return true;
@@ -59,18 +61,41 @@ bool ParticleCollisionSystem::updateOperation(OctreeElement* element, void* extr
 void ParticleCollisionSystem::update() {
     // update all particles
     if (_particles->tryLockForWrite()) {
+        updateAvatarBounds();
+        _broadPhase.clear();
+        ParticleScriptContext* scriptContext = ParticleScriptContext::getInstance();
+        scriptContext->beginTick();
         _particles->recurseTreeWithOperation(updateOperation, this);
+        updateCollisionsBetweenParticles();
+        scriptContext->endTick();
         _particles->unlock();
     }
 }
 
 
 void ParticleCollisionSystem::checkParticle(Particle* particle) {
-    updateCollisionWithVoxels(particle);
-    updateCollisionWithParticles(particle);
+    // a sleeping particle has already come to rest against the voxels, but avatars can still walk into it
+    if (!particle->isSleeping()) {
+        updateCollisionWithVoxels(particle);
+    }
     updateCollisionWithAvatars(particle);
 }
 
+void ParticleCollisionSystem::updateAvatarBounds() {
+    _avatarBounds.clear();
+    if (!_avatars) {
+        _avatarHash.clear();
+        return;
+    }
+    _avatarHash = _avatars->getAvatarHash();
+    foreach (const AvatarSharedPointer& avatarPointer, _avatarHash) {
+        // use a very generous bounding radius since the arms can stretch
+        AvatarBounds bounds = { avatarPointer.data(), avatarPointer->getPosition(),
+                                2.f * avatarPointer->getBoundingRadius() };
+        _avatarBounds.push_back(bounds);
+    }
+}
+
 void ParticleCollisionSystem::emitGlobalParticleCollisionWithVoxel(Particle* particle, VoxelDetail* voxelDetails) {
     ParticleID particleID = particle->getParticleID();
     emit particleCollisionWithVoxel(particleID, *voxelDetails);
@@ -109,60 +134,74 @@ void ParticleCollisionSystem::updateCollisionWithVoxels(Particle* particle) {
     }
 }
 
-void ParticleCollisionSystem::updateCollisionWithParticles(Particle* particleA) {
-    glm::vec3 center = particleA->getPosition() * (float)(TREE_SCALE);
-    float radius = particleA->getRadius() * (float)(TREE_SCALE);
+void ParticleCollisionSystem::updateCollisionsBetweenParticles() {
+    _collisionPairs.clear();
+    _broadPhase.findCollisionPairs(_collisionPairs);
+    
+    for (size_t i = 0; i < _collisionPairs.size(); i++) {
+        updateCollisionWithParticle(_collisionPairs[i]);
+    }
+    if (!_collisionPairs.empty()) {
+        _packetSender->releaseQueuedMessages();
+    }
+}
+
+void ParticleCollisionSystem::updateCollisionWithParticle(const ParticleCollisionPair& pair) {
+    Particle* particleA = pair.particleA;
+    Particle* particleB = pair.particleB;
     //const float ELASTICITY = 0.4f;
     //const float DAMPING = 0.0f;
     const float COLLISION_FREQUENCY = 0.5f;
-    glm::vec3 penetration;
-    Particle* particleB;
-    if (_particles->findSpherePenetration(center, radius, penetration, (void**)&particleB)) {
-        // NOTE: 'penetration' is the depth that 'particleA' overlaps 'particleB'.
-        // That is, it points from A into B.
-
-        // Even if the particles overlap... when the particles are already moving appart
-        // we don't want to count this as a collision.
-        glm::vec3 relativeVelocity = particleA->getVelocity() - particleB->getVelocity();
-        if (glm::dot(relativeVelocity, penetration) > 0.0f) {
-            particleA->collisionWithParticle(particleB);
-            particleB->collisionWithParticle(particleA);
-            emitGlobalParticleCollisionWithParticle(particleA, particleB);
-
-            glm::vec3 axis = glm::normalize(penetration);
-            glm::vec3 axialVelocity = glm::dot(relativeVelocity, axis) * axis;
-
-            // particles that are in hand are assigned an ureasonably large mass for collisions
-            // which effectively makes them immovable but allows the other ball to reflect correctly.
-            const float MAX_MASS = 1.0e6f;
-            float massA = (particleA->getInHand()) ? MAX_MASS : particleA->getMass();
-            float massB = (particleB->getInHand()) ? MAX_MASS : particleB->getMass();
-            float totalMass = massA + massB;
-
-            // handle A particle
-            particleA->setVelocity(particleA->getVelocity() - axialVelocity * (2.0f * massB / totalMass));
-            particleA->setPosition(particleA->getPosition() - 0.5f * penetration);
-            ParticleProperties propertiesA;
-            ParticleID particleAid(particleA->getID());
-            propertiesA.copyFromParticle(*particleA);
-            propertiesA.setVelocity(particleA->getVelocity() * (float)TREE_SCALE);
-            propertiesA.setPosition(particleA->getPosition() * (float)TREE_SCALE);
-            _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleAid, propertiesA);
-
-            // handle B particle
-            particleB->setVelocity(particleB->getVelocity() + axialVelocity * (2.0f * massA / totalMass));
-            particleA->setPosition(particleB->getPosition() + 0.5f * penetration);
-            ParticleProperties propertiesB;
-            ParticleID particleBid(particleB->getID());
-            propertiesB.copyFromParticle(*particleB);
-            propertiesB.setVelocity(particleB->getVelocity() * (float)TREE_SCALE);
-            propertiesB.setPosition(particleB->getPosition() * (float)TREE_SCALE);
-            _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleBid, propertiesB);
-
-            _packetSender->releaseQueuedMessages();
-
-            updateCollisionSound(particleA, penetration, COLLISION_FREQUENCY);
-        }
+
+    // NOTE: 'penetration' is the depth that 'particleA' overlaps 'particleB'.
+    // That is, it points from A into B.
+    const glm::vec3& penetration = pair.penetration;
+
+    // Even if the particles overlap... when the particles are already moving appart
+    // we don't want to count this as a collision.
+    glm::vec3 relativeVelocity = particleA->getVelocity() - particleB->getVelocity();
+    if (glm::dot(relativeVelocity, penetration) > 0.0f) {
+        particleA->collisionWithParticle(particleB);
+        particleB->collisionWithParticle(particleA);
+        emitGlobalParticleCollisionWithParticle(particleA, particleB);
+
+        glm::vec3 axis = glm::normalize(penetration);
+        glm::vec3 axialVelocity = glm::dot(relativeVelocity, axis) * axis;
+
+        // particles that are in hand are assigned an ureasonably large mass for collisions
+        // which effectively makes them immovable but allows the other ball to reflect correctly.
+        const float MAX_MASS = 1.0e6f;
+        float massA = (particleA->getInHand()) ? MAX_MASS : particleA->getMass();
+        float massB = (particleB->getInHand()) ? MAX_MASS : particleB->getMass();
+        float totalMass = massA + massB;
+
+        // the penetration is in meters, the particles are in domain units
+        glm::vec3 halfPenetration = 0.5f * penetration / (float)(TREE_SCALE);
+
+        _particles->wakeParticle(particleA);
+        _particles->wakeParticle(particleB);
+
+        // handle A particle
+        particleA->setVelocity(particleA->getVelocity() - axialVelocity * (2.0f * massB / totalMass));
+        particleA->setPosition(particleA->getPosition() - halfPenetration);
+        ParticleProperties propertiesA;
+        ParticleID particleAid(particleA->getID());
+        propertiesA.copyFromParticle(*particleA);
+        propertiesA.setVelocity(particleA->getVelocity() * (float)TREE_SCALE);
+        propertiesA.setPosition(particleA->getPosition() * (float)TREE_SCALE);
+        _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleAid, propertiesA);
+
+        // handle B particle
+        particleB->setVelocity(particleB->getVelocity() + axialVelocity * (2.0f * massA / totalMass));
+        particleB->setPosition(particleB->getPosition() + halfPenetration);
+        ParticleProperties propertiesB;
+        ParticleID particleBid(particleB->getID());
+        propertiesB.copyFromParticle(*particleB);
+        propertiesB.setVelocity(particleB->getVelocity() * (float)TREE_SCALE);
+        propertiesB.setPosition(particleB->getPosition() * (float)TREE_SCALE);
+        _packetSender->queueParticleEditMessage(PacketTypeParticleAddOrEdit, particleBid, propertiesB);
+
+        updateCollisionSound(particleA, penetration, COLLISION_FREQUENCY);
     }
 }
 
@@ -184,12 +223,12 @@ void ParticleCollisionSystem::updateCollisionWithAvatars(Particle* particle) {
     glm::vec3 penetration;
 
     _collisions.clear();
-    foreach (const AvatarSharedPointer& avatarPointer, _avatars->getAvatarHash()) {
-        AvatarData* avatar = avatarPointer.data();
+    for (size_t avatarIndex = 0; avatarIndex < _avatarBounds.size(); avatarIndex++) {
+        const AvatarBounds& bounds = _avatarBounds[avatarIndex];
+        AvatarData* avatar = bounds.avatar;
 
-        // use a very generous bounding radius since the arms can stretch
-        float totalRadius = 2.f * avatar->getBoundingRadius() + radius;
-        glm::vec3 relativePosition = center - avatar->getPosition();
+        float totalRadius = bounds.radius + radius;
+        glm::vec3 relativePosition = center - bounds.position;
         if (glm::dot(relativePosition, relativePosition) > (totalRadius * totalRadius)) {
             continue;
         }
@@ -227,6 +266,7 @@ void ParticleCollisionSystem::updateCollisionWithAvatars(Particle* particle) {
     
                     updateCollisionSound(particle, collision->_penetration, COLLISION_FREQUENCY);
                     collision->_penetration /= (float)(TREE_SCALE);
+                    _particles->wakeParticle(particle);
                     particle->applyHardCollision(*collision);
                     queueParticlePropertiesUpdate(particle);
                 }
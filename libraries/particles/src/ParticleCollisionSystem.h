@@ -12,6 +12,7 @@
 
 #include <glm/glm.hpp>
 #include <stdint.h>
+#include <vector>
 
 #include <QtScript/QScriptEngine>
 #include <QtCore/QObject>
@@ -22,6 +23,7 @@
 #include <OctreePacketData.h>
 
 #include "Particle.h"
+#include "ParticleBroadPhase.h"
 
 class AbstractAudioInterface;
 class AvatarData;
@@ -47,7 +49,8 @@ public:
 
     void checkParticle(Particle* particle);
     void updateCollisionWithVoxels(Particle* particle);
-    void updateCollisionWithParticles(Particle* particle);
+    void updateCollisionsBetweenParticles();
+    void updateCollisionWithParticle(const ParticleCollisionPair& pair);
     void updateCollisionWithAvatars(Particle* particle);
     void queueParticlePropertiesUpdate(Particle* particle);
     void updateCollisionSound(Particle* particle, const glm::vec3 &penetration, float frequency);
@@ -57,7 +60,16 @@ signals:
     void particleCollisionWithParticle(const ParticleID& idA, const ParticleID& idB);
 
 private:
+    /// Where an avatar is for this update, and how close a particle has to be to possibly touch it.
+    class AvatarBounds {
+    public:
+        AvatarData* avatar;
+        glm::vec3 position;
+        float radius;
+    };
+
     static bool updateOperation(OctreeElement* element, void* extraData);
+    void updateAvatarBounds();
     void emitGlobalParticleCollisionWithVoxel(Particle* particle, VoxelDetail* voxelDetails);
     void emitGlobalParticleCollisionWithParticle(Particle* particleA, Particle* particleB);
 
@@ -67,6 +79,12 @@ private:
     AbstractAudioInterface* _audio;
     AvatarHashMap* _avatars;
     CollisionList _collisions;
+
+    // built once per update, rather than searched for each particle
+    ParticleBroadPhase _broadPhase;
+    std::vector<ParticleCollisionPair> _collisionPairs;
+    std::vector<AvatarBounds> _avatarBounds;
+    AvatarHash _avatarHash; // keeps the avatars in _avatarBounds alive for the update
 };
 
 #endif /* defined(__hifi__ParticleCollisionSystem__) */
@@ -0,0 +1,140 @@
+//
+//  ParticleScriptContext.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Shared script engine that runs the particle script callbacks for a thread
+//
+
+#include <QtCore/QThreadStorage>
+
+#include <SharedUtil.h> // usecTimestampNow()
+#include <VoxelDetail.h>
+#include <VoxelsScriptingInterface.h>
+
+// This is not ideal, but adding script-engine as a linked library, will cause a circular reference
+// I'm open to other potential solutions. Could we change cmake to allow libraries to reference each others
+// headers, but not link to each other, this is essentially what this construct is doing, but would be
+// better to add includes to the include path, but not link
+#include "../../script-engine/src/ScriptEngine.h"
+
+#include "ParticleEditPacketSender.h"
+#include "ParticlesScriptingInterface.h"
+#include "Particle.h"
+#include "ParticleScriptContext.h"
+
+// past this many different scripts the cache starts over, rather than growing with every script ever seen
+const int MAX_CACHED_PARTICLE_SCRIPTS = 1000;
+
+static QThreadStorage<ParticleScriptContext*> threadContexts;
+
+ParticleScriptContext* ParticleScriptContext::getInstance() {
+    if (!threadContexts.hasLocalData()) {
+        threadContexts.setLocalData(new ParticleScriptContext());
+    }
+    return threadContexts.localData();
+}
+
+ParticleScriptContext::ParticleScriptContext() :
+    _engine(new ScriptEngine()),
+    _programs(),
+    _tickDepth(0),
+    _tickCallbacks(0),
+    _tickScriptUsecs(0),
+    _lastTickCallbacks(0),
+    _lastTickScriptUsecs(0),
+    _totalCallbacks(0),
+    _totalScriptUsecs(0),
+    _numCompiles(0)
+{
+}
+
+ParticleScriptContext::~ParticleScriptContext() {
+    delete _engine;
+}
+
+void ParticleScriptContext::beginTick() {
+    if (_tickDepth++ > 0) {
+        return;
+    }
+    _tickCallbacks = 0;
+    _tickScriptUsecs = 0;
+
+    // the senders can change between ticks, but not during one
+    if (Particle::getVoxelEditPacketSender()) {
+        ScriptEngine::getVoxelsScriptingInterface()->setPacketSender(Particle::getVoxelEditPacketSender());
+    }
+    if (Particle::getParticleEditPacketSender()) {
+        ScriptEngine::getParticlesScriptingInterface()->setPacketSender(Particle::getParticleEditPacketSender());
+    }
+}
+
+void ParticleScriptContext::endTick() {
+    if (--_tickDepth > 0) {
+        return;
+    }
+    if (_tickCallbacks > 0) {
+        if (Particle::getVoxelEditPacketSender()) {
+            Particle::getVoxelEditPacketSender()->releaseQueuedMessages();
+        }
+        if (Particle::getParticleEditPacketSender()) {
+            Particle::getParticleEditPacketSender()->releaseQueuedMessages();
+        }
+    }
+    _lastTickCallbacks = _tickCallbacks;
+    _lastTickScriptUsecs = _tickScriptUsecs;
+}
+
+void ParticleScriptContext::runUpdate(Particle* particle) {
+    ParticleScriptObject particleScriptable(particle);
+    quint64 startedAt = startCallback(particle, particleScriptable);
+    particleScriptable.emitUpdate();
+    endCallback(startedAt);
+}
+
+void ParticleScriptContext::runCollisionWithParticle(Particle* particle, Particle* other) {
+    ParticleScriptObject particleScriptable(particle);
+    quint64 startedAt = startCallback(particle, particleScriptable);
+    ParticleScriptObject otherParticleScriptable(other);
+    particleScriptable.emitCollisionWithParticle(&otherParticleScriptable);
+    endCallback(startedAt);
+}
+
+void ParticleScriptContext::runCollisionWithVoxel(Particle* particle, const VoxelDetail& voxelDetails) {
+    ParticleScriptObject particleScriptable(particle);
+    quint64 startedAt = startCallback(particle, particleScriptable);
+    particleScriptable.emitCollisionWithVoxel(voxelDetails);
+    endCallback(startedAt);
+}
+
+quint64 ParticleScriptContext::startCallback(Particle* particle, ParticleScriptObject& particleScriptable) {
+    beginTick();
+    quint64 startedAt = usecTimestampNow();
+
+    // the script connects its handlers to this "Particle" object, which goes away with them after the callback
+    _engine->registerGlobalObject("Particle", &particleScriptable);
+    _engine->evaluate(getProgram(particle->getScript()));
+    return startedAt;
+}
+
+void ParticleScriptContext::endCallback(quint64 startedAt) {
+    quint64 elapsed = usecTimestampNow() - startedAt;
+    _tickCallbacks++;
+    _tickScriptUsecs += elapsed;
+    _totalCallbacks++;
+    _totalScriptUsecs += elapsed;
+    endTick();
+}
+
+const QScriptProgram& ParticleScriptContext::getProgram(const QString& script) {
+    QHash<QString, QScriptProgram>::iterator program = _programs.find(script);
+    if (program != _programs.end()) {
+        return program.value();
+    }
+    if (_programs.size() >= MAX_CACHED_PARTICLE_SCRIPTS) {
+        _programs.clear();
+    }
+    _numCompiles++;
+    return _programs.insert(script, QScriptProgram(script)).value();
+}
@@ -0,0 +1,81 @@
+//
+//  ParticleScriptContext.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Shared script engine that runs the particle script callbacks for a thread
+//
+
+#ifndef __hifi__ParticleScriptContext__
+#define __hifi__ParticleScriptContext__
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtScript/QScriptProgram>
+
+class Particle;
+class ParticleScriptObject;
+class ScriptEngine;
+struct VoxelDetail;
+
+/// Runs the script callbacks of particles in one script engine per thread, instead of setting up a new engine for
+/// every callback. Each script text is compiled the first time it is seen and the program is kept for the next
+/// particle with the same script, and each callback evaluates it in a scope of its own, so the variables one
+/// particle's script declares aren't seen by the next. Callbacks made between beginTick() and endTick() share one
+/// setup of the edit packet senders and have their edit messages released together at the end of the tick, callbacks
+/// made outside of a tick are each a tick of their own.
+class ParticleScriptContext {
+public:
+    /// \return the context for the calling thread, which is made the first time the thread asks
+    static ParticleScriptContext* getInstance();
+
+    ~ParticleScriptContext();
+
+    /// Starts batching callbacks, ticks can nest and only the outermost one counts.
+    void beginTick();
+
+    /// Releases the edit messages the tick's callbacks queued and keeps the tick's script time.
+    void endTick();
+
+    void runUpdate(Particle* particle);
+    void runCollisionWithParticle(Particle* particle, Particle* other);
+    void runCollisionWithVoxel(Particle* particle, const VoxelDetail& voxelDetails);
+
+    /// \return the number of callbacks in the last tick that ended
+    int getLastTickCallbacks() const { return _lastTickCallbacks; }
+
+    /// \return the time spent in scripts in the last tick that ended
+    quint64 getLastTickScriptUsecs() const { return _lastTickScriptUsecs; }
+
+    quint64 getTotalCallbacks() const { return _totalCallbacks; }
+    quint64 getTotalScriptUsecs() const { return _totalScriptUsecs; }
+
+    /// \return the number of times a script had to be compiled, rather than coming from the cache
+    quint64 getNumCompiles() const { return _numCompiles; }
+
+    int getNumCachedScripts() const { return _programs.size(); }
+
+private:
+    ParticleScriptContext();
+    ParticleScriptContext(const ParticleScriptContext&); // not copyable, it owns its engine
+    ParticleScriptContext& operator=(const ParticleScriptContext&);
+
+    quint64 startCallback(Particle* particle, ParticleScriptObject& particleScriptable);
+    void endCallback(quint64 startedAt);
+    const QScriptProgram& getProgram(const QString& script);
+
+    ScriptEngine* _engine;
+    QHash<QString, QScriptProgram> _programs;
+    int _tickDepth;
+
+    int _tickCallbacks;
+    quint64 _tickScriptUsecs;
+    int _lastTickCallbacks;
+    quint64 _lastTickScriptUsecs;
+    quint64 _totalCallbacks;
+    quint64 _totalScriptUsecs;
+    quint64 _numCompiles;
+};
+
+#endif /* defined(__hifi__ParticleScriptContext__) */
@@ -6,13 +6,31 @@
 //  Copyright (c) 2013 High Fidelity, Inc. All rights reserved.
 //
 
+#include <algorithm>
+#include <vector>
+
+#include <OctalCode.h>
+#include <WorkerPool.h>
+
+#include "ParticleScriptContext.h"
 #include "ParticleTree.h"
 
-ParticleTree::ParticleTree(bool shouldReaverage) : Octree(shouldReaverage) {
+ParticleTree::ParticleTree(bool shouldReaverage) : Octree(shouldReaverage),
+    _hasRemovedParticles(false),
+    _updateWorkerPool(NULL),
+    _lastTickCallbacks(0),
+    _lastTickScriptUsecs(0),
+    _totalScriptUsecs(0) {
     ParticleTreeElement* rootNode = createNewElement();
     _rootNode = rootNode;
 }
 
+ParticleTree::~ParticleTree() {
+    // our elements take their particles out of our index as they're deleted, so delete them while we still have it
+    delete _rootNode;
+    _rootNode = NULL;
+}
+
 ParticleTreeElement* ParticleTree::createNewElement(unsigned char * octalCode) {
     ParticleTreeElement* newElement = new ParticleTreeElement(octalCode);
     newElement->setTree(this);
@@ -30,73 +48,13 @@ bool ParticleTree::handlesEditPacketType(PacketType packetType) const {
     }
 }
 
-class FindAndDeleteParticlesArgs {
-public:
-    QList<uint32_t> _idsToDelete;
-};
-
-bool ParticleTree::findAndDeleteOperation(OctreeElement* element, void* extraData) {
-    //qDebug() << "findAndDeleteOperation()";
-
-    FindAndDeleteParticlesArgs* args = static_cast< FindAndDeleteParticlesArgs*>(extraData);
-
-    // if we've found and deleted all our target particles, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-
-    //qDebug() << "findAndDeleteOperation() args->_idsToDelete.size():" << args->_idsToDelete.size();
-
-    for (QList<uint32_t>::iterator it = args->_idsToDelete.begin(); it != args->_idsToDelete.end(); it++) {
-        uint32_t particleID = *it;
-        //qDebug() << "findAndDeleteOperation() particleID:" << particleID;
-
-        if (particleTreeElement->removeParticleWithID(particleID)) {
-            // if the particle was in this element, then remove it from our search list.
-            //qDebug() << "findAndDeleteOperation() it = args->_idsToDelete.erase(it)";
-            it = args->_idsToDelete.erase(it);
-        }
-
-        if (it == args->_idsToDelete.end()) {
-            //qDebug() << "findAndDeleteOperation() breaking";
-            break;
-        }
-    }
-
-    // if we've found and deleted all our target particles, then we can stop looking
-    if (args->_idsToDelete.size() <= 0) {
-        return false;
-    }
-    return true;
-}
-
-
-class FindAndUpdateParticleArgs {
-public:
-    const Particle& searchParticle;
-    bool found;
-};
-
-bool ParticleTree::findAndUpdateOperation(OctreeElement* element, void* extraData) {
-    FindAndUpdateParticleArgs* args = static_cast<FindAndUpdateParticleArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-    // Note: updateParticle() will only operate on correctly found particles
-    if (particleTreeElement->updateParticle(args->searchParticle)) {
-        args->found = true;
-        return false; // stop searching
-    }
-    return true;
-}
-
 void ParticleTree::storeParticle(const Particle& particle, const SharedNodePointer& senderNode) {
     // First, look for the existing particle in the tree..
-    FindAndUpdateParticleArgs args = { particle, false };
-    recurseTreeWithOperation(findAndUpdateOperation, &args);
+    ParticleTreeElement* containingElement = getContainingElement(particle.getID());
+    bool found = containingElement && containingElement->updateParticle(particle);
 
     // if we didn't find it in the tree, then store it...
-    if (!args.found) {
+    if (!found) {
         glm::vec3 position = particle.getPosition();
         float size = std::max(MINIMUM_PARTICLE_ELEMENT_SIZE, particle.getRadius());
         ParticleTreeElement* element = (ParticleTreeElement*)getOrCreateChildElementAt(position.x, position.y, position.z, size);
@@ -107,36 +65,13 @@ void ParticleTree::storeParticle(const Particle& particle, const SharedNodePoint
     _isDirty = true;
 }
 
-class FindAndUpdateParticleWithIDandPropertiesArgs {
-public:
-    const ParticleID& particleID;
-    const ParticleProperties& properties;
-    bool found;
-};
-
-bool ParticleTree::findAndUpdateWithIDandPropertiesOperation(OctreeElement* element, void* extraData) {
-    FindAndUpdateParticleWithIDandPropertiesArgs* args = static_cast<FindAndUpdateParticleWithIDandPropertiesArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-    // Note: updateParticle() will only operate on correctly found particles
-    if (particleTreeElement->updateParticle(args->particleID, args->properties)) {
-        args->found = true;
-        return false; // stop searching
-    }
-
-    // if we've found our particle stop searching
-    if (args->found) {
-        return false;
-    }
-
-    return true;
-}
-
 void ParticleTree::updateParticle(const ParticleID& particleID, const ParticleProperties& properties) {
-    // First, look for the existing particle in the tree..
-    FindAndUpdateParticleWithIDandPropertiesArgs args = { particleID, properties, false };
-    recurseTreeWithOperation(findAndUpdateWithIDandPropertiesOperation, &args);
+    // First, look for the existing particle in the tree, locally created particles may not know their ID yet
+    ParticleTreeElement* containingElement = particleID.isKnownID ? getContainingElement(particleID.id)
+        : _particleElementsByCreatorToken.value(particleID.creatorTokenID);
+
     // if we found it in the tree, then mark the tree as dirty
-    if (args.found) {
+    if (containingElement && containingElement->updateParticle(particleID, properties)) {
         _isDirty = true;
     }
 }
@@ -158,32 +93,15 @@ void ParticleTree::addParticle(const ParticleID& particleID, const ParticlePrope
 
 void ParticleTree::deleteParticle(const ParticleID& particleID) {
     if (particleID.isKnownID) {
-        FindAndDeleteParticlesArgs args;
-        args._idsToDelete.push_back(particleID.id);
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
+        deleteParticleWithID(particleID.id);
     }
 }
 
-// scans the tree and handles mapping locally created particles to know IDs.
-// in the event that this tree is also viewing the scene, then we need to also
-// search the tree to make sure we don't have a duplicate particle from the viewing
-// operation.
-bool ParticleTree::findAndUpdateParticleIDOperation(OctreeElement* element, void* extraData) {
-    bool keepSearching = true;
-
-    FindAndUpdateParticleIDArgs* args = static_cast<FindAndUpdateParticleIDArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-
-    // Note: updateParticleID() will only operate on correctly found particles
-    particleTreeElement->updateParticleID(args);
-
-    // if we've found and replaced both the creatorTokenID and the viewedParticle, then we
-    // can stop looking, otherwise we will keep looking    
-    if (args->creatorTokenFound && args->viewedParticleFound) {
-        keepSearching = false;
+void ParticleTree::deleteParticleWithID(uint32_t particleID) {
+    ParticleTreeElement* containingElement = getContainingElement(particleID);
+    if (containingElement && containingElement->removeParticleWithID(particleID)) {
+        _hasRemovedParticles = true;
     }
-    
-    return keepSearching;
 }
 
 void ParticleTree::handleAddParticleResponse(const QByteArray& packet) {
@@ -215,7 +133,21 @@ void ParticleTree::handleAddParticleResponse(const QByteArray& packet) {
                 << " getIsViewing()=" << getIsViewing();
     }
     lockForWrite();
-    recurseTreeWithOperation(findAndUpdateParticleIDOperation, &args);
+
+    // in the event that this tree is also viewing the scene, then the particle the server sent us under this ID is a
+    // duplicate of our locally created one and is removed, look for it first as ours doesn't have the ID yet
+    if (!args.viewedParticleFound) {
+        ParticleTreeElement* viewedElement = getContainingElement(particleID);
+        if (viewedElement) {
+            viewedElement->updateParticleID(&args);
+        }
+    }
+    if (!args.creatorTokenFound) {
+        ParticleTreeElement* creatorElement = _particleElementsByCreatorToken.value(creatorTokenID);
+        if (creatorElement) {
+            creatorElement->updateParticleID(&args);
+        }
+    }
     unlock();
 }
 
@@ -338,50 +270,44 @@ void ParticleTree::findParticlesForUpdate(const AABox& box, QVector<Particle*> f
     foundParticles.swap(args._foundParticles);
 }
 
-class FindByIDArgs {
-public:
-    uint32_t id;
-    bool found;
-    const Particle* foundParticle;
-};
-
-
-bool ParticleTree::findByIDOperation(OctreeElement* element, void* extraData) {
-//qDebug() << "ParticleTree::findByIDOperation()....";
-
-    FindByIDArgs* args = static_cast<FindByIDArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-
-    // if already found, stop looking
-    if (args->found) {
-        return false;
-    }
-
-    // as the tree element if it has this particle
-    const Particle* foundParticle = particleTreeElement->getParticleWithID(args->id);
-    if (foundParticle) {
-        args->foundParticle = foundParticle;
-        args->found = true;
-        return false;
-    }
-
-    // keep looking
-    return true;
-}
-
-
 const Particle* ParticleTree::findParticleByID(uint32_t id, bool alreadyLocked) {
-    FindByIDArgs args = { id, false, NULL };
+    const Particle* foundParticle = NULL;
     if (!alreadyLocked) {
-        //qDebug() << "ParticleTree::findParticleByID().... about to call lockForRead()....";
         lockForRead();
-        //qDebug() << "ParticleTree::findParticleByID().... after call lockForRead()....";
     }
-    recurseTreeWithOperation(findByIDOperation, &args);
+    ParticleTreeElement* containingElement = getContainingElement(id);
+    if (containingElement) {
+        foundParticle = containingElement->getParticleWithID(id);
+    }
     if (!alreadyLocked) {
         unlock();
     }
-    return args.foundParticle;
+    return foundParticle;
+}
+
+void ParticleTree::wakeParticle(Particle* particle) {
+    if (particle->isSleeping()) {
+        ParticleTreeElement* containingElement = getContainingElement(particle->getID());
+        if (containingElement) {
+            containingElement->wakeParticle(*particle);
+        }
+    }
+}
+
+void ParticleTree::wakeExpiredParticles() {
+    // the particles may have been woken, deleted or gone back to sleep since, in which case this is harmless
+    quint64 now = usecTimestampNow();
+    QMultiMap<quint64, uint32_t>::iterator lifetimeEnd = _sleepingParticleLifetimeEnds.begin();
+    while (lifetimeEnd != _sleepingParticleLifetimeEnds.end() && lifetimeEnd.key() <= now) {
+        ParticleTreeElement* containingElement = getContainingElement(lifetimeEnd.value());
+        if (containingElement) {
+            Particle* particle = containingElement->getParticleWithID(lifetimeEnd.value());
+            if (particle && particle->isSleeping()) {
+                containingElement->wakeParticle(*particle);
+            }
+        }
+        lifetimeEnd = _sleepingParticleLifetimeEnds.erase(lifetimeEnd);
+    }
 }
 
 
@@ -441,13 +367,6 @@ void ParticleTree::removeNewlyCreatedHook(NewlyCreatedParticleHook* hook) {
 }
 
 
-bool ParticleTree::updateOperation(OctreeElement* element, void* extraData) {
-    ParticleTreeUpdateArgs* args = static_cast<ParticleTreeUpdateArgs*>(extraData);
-    ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
-    particleTreeElement->update(*args);
-    return true;
-}
-
 bool ParticleTree::pruneOperation(OctreeElement* element, void* extraData) {
     ParticleTreeElement* particleTreeElement = static_cast<ParticleTreeElement*>(element);
     for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
@@ -459,15 +378,136 @@ bool ParticleTree::pruneOperation(OctreeElement* element, void* extraData) {
     return true;
 }
 
+void ParticleTree::indexParticle(const Particle& particle, ParticleTreeElement* element) {
+    if (particle.getID() != UNKNOWN_PARTICLE_ID) {
+        _particleElementsByID.insert(particle.getID(), element);
+    }
+    if (particle.getCreatorTokenID() != UNKNOWN_TOKEN) {
+        _particleElementsByCreatorToken.insert(particle.getCreatorTokenID(), element);
+    }
+}
+
+void ParticleTree::unindexParticle(const Particle& particle, ParticleTreeElement* element) {
+    // only forget the particle if the index still has it here, it may already have been stored somewhere else
+    QHash<uint32_t, ParticleTreeElement*>::iterator byID = _particleElementsByID.find(particle.getID());
+    if (byID != _particleElementsByID.end() && byID.value() == element) {
+        _particleElementsByID.erase(byID);
+    }
+    QHash<uint32_t, ParticleTreeElement*>::iterator byCreatorToken =
+        _particleElementsByCreatorToken.find(particle.getCreatorTokenID());
+    if (byCreatorToken != _particleElementsByCreatorToken.end() && byCreatorToken.value() == element) {
+        _particleElementsByCreatorToken.erase(byCreatorToken);
+    }
+}
+
+// fewer awake elements than this aren't worth handing to another thread
+const int MIN_ELEMENTS_PER_UPDATE_PARTITION = 16;
+const int UPDATE_PARTITIONS_PER_THREAD = 4; // so that the threads all finish at about the same time
+
+static bool hasLowerOctalCode(ParticleTreeElement* elementA, ParticleTreeElement* elementB) {
+    return compareOctalCodes(elementA->getOctalCode(), elementB->getOctalCode()) == LESS_THAN;
+}
+
+/// Updates runs of elements each into their own args, and merges the args back in the order of the runs, whichever
+/// threads got to them first.
+class ParticleTreePartitionUpdater : public WorkerPoolJobs {
+public:
+    ParticleTreePartitionUpdater(const QVector<ParticleTreeElement*>& elements, int numberOfPartitions) :
+        _elements(elements),
+        _partitions(numberOfPartitions) {
+    }
+
+    virtual void runJob(int partitionIndex) {
+        ParticleTreeUpdateArgs& args = _partitions[partitionIndex];
+        int end = getPartitionStart(partitionIndex + 1);
+        for (int i = getPartitionStart(partitionIndex); i < end; i++) {
+            _elements[i]->update(args);
+        }
+    }
+
+    void mergeInto(ParticleTreeUpdateArgs& args) const {
+        for (size_t i = 0; i < _partitions.size(); i++) {
+            const ParticleTreeUpdateArgs& partition = _partitions[i];
+            args._movingParticles += partition._movingParticles;
+            args._movingParticleElements += partition._movingParticleElements;
+            args._awakeElements += partition._awakeElements;
+            args._sleepingParticleLifetimeEnds.unite(partition._sleepingParticleLifetimeEnds);
+        }
+    }
+
+private:
+    int getPartitionStart(int partitionIndex) const {
+        return (qint64)_elements.size() * partitionIndex / (qint64)_partitions.size();
+    }
+
+    const QVector<ParticleTreeElement*>& _elements;
+    std::vector<ParticleTreeUpdateArgs> _partitions;
+};
+
+void ParticleTree::updateInParallel(const QSet<ParticleTreeElement*>& awakeElements, ParticleTreeUpdateArgs& args) {
+    // particle scripts can reach anything, so their elements are updated on this thread once the workers are done.
+    // the rest are split in octal code order, so that the split and the merged results don't depend on hashing.
+    QVector<ParticleTreeElement*> elements;
+    QVector<ParticleTreeElement*> scriptedElements;
+    foreach (ParticleTreeElement* element, awakeElements) {
+        if (element->hasScriptedParticles()) {
+            scriptedElements.append(element);
+        } else {
+            elements.append(element);
+        }
+    }
+    std::sort(elements.begin(), elements.end(), hasLowerOctalCode);
+    std::sort(scriptedElements.begin(), scriptedElements.end(), hasLowerOctalCode);
+
+    int numberOfPartitions = std::min(elements.size() / MIN_ELEMENTS_PER_UPDATE_PARTITION,
+                                      (_updateWorkerPool->getWorkerCount() + 1) * UPDATE_PARTITIONS_PER_THREAD);
+    numberOfPartitions = std::max(numberOfPartitions, 1);
+    ParticleTreePartitionUpdater updater(elements, numberOfPartitions);
+    _updateWorkerPool->runJobs(&updater, numberOfPartitions);
+    updater.mergeInto(args);
+
+    foreach (ParticleTreeElement* element, scriptedElements) {
+        element->update(args);
+    }
+}
+
 void ParticleTree::update() {
-    _isDirty = true;
+    wakeExpiredParticles();
 
+    // only the elements with awake particles change, the ones that stay awake go back in the set
+    QSet<ParticleTreeElement*> awakeElements;
+    awakeElements.swap(_awakeElements);
+    if (!awakeElements.isEmpty()) {
+        _isDirty = true;
+    }
+
+    // the update scripts all run on this thread, their edits go out together once every element is updated
+    // the context's counts span its outermost tick, which could be wider than this update, so take the difference
+    ParticleScriptContext* scriptContext = ParticleScriptContext::getInstance();
+    quint64 callbacksBefore = scriptContext->getTotalCallbacks();
+    quint64 scriptUsecsBefore = scriptContext->getTotalScriptUsecs();
+    scriptContext->beginTick();
     ParticleTreeUpdateArgs args = { };
-    recurseTreeWithOperation(updateOperation, &args);
+    if (_updateWorkerPool && awakeElements.size() >= 2 * MIN_ELEMENTS_PER_UPDATE_PARTITION) {
+        updateInParallel(awakeElements, args);
+    } else {
+        foreach (ParticleTreeElement* element, awakeElements) {
+            element->update(args);
+        }
+    }
+    scriptContext->endTick();
+    _lastTickCallbacks = (int) (scriptContext->getTotalCallbacks() - callbacksBefore);
+    _lastTickScriptUsecs = scriptContext->getTotalScriptUsecs() - scriptUsecsBefore;
+    _totalScriptUsecs += _lastTickScriptUsecs;
+    foreach (ParticleTreeElement* element, args._awakeElements) {
+        _awakeElements.insert(element);
+    }
+    _sleepingParticleLifetimeEnds.unite(args._sleepingParticleLifetimeEnds);
 
     // now add back any of the particles that moved elements....
     int movingParticles = args._movingParticles.size();
     for (int i = 0; i < movingParticles; i++) {
+        unindexParticle(args._movingParticles[i], args._movingParticleElements[i]);
         bool shouldDie = args._movingParticles[i].getShouldDie();
 
         // if the particle is still inside our total bounds, then re-add it
@@ -484,8 +524,11 @@ void ParticleTree::update() {
         }
     }
 
-    // prune the tree...
-    recurseTreeWithOperation(pruneOperation, NULL);
+    // prune the tree, if any elements could have been emptied...
+    if (movingParticles > 0 || _hasRemovedParticles) {
+        recurseTreeWithOperation(pruneOperation, NULL);
+        _hasRemovedParticles = false;
+    }
 }
 
 
@@ -611,23 +654,16 @@ void ParticleTree::processEraseMessage(const QByteArray& dataByteArray, const Sh
     dataAt += sizeof(numberOfIds);
     processedBytes += sizeof(numberOfIds);
 
-    if (numberOfIds > 0) {
-        FindAndDeleteParticlesArgs args;
-
-        for (size_t i = 0; i < numberOfIds; i++) {
-            if (processedBytes + sizeof(uint32_t) > packetLength) {
-                break; // bail to prevent buffer overflow
-            }
-
-            uint32_t particleID = 0; // placeholder for now
-            memcpy(&particleID, dataAt, sizeof(particleID));
-            dataAt += sizeof(particleID);
-            processedBytes += sizeof(particleID);
-
-            args._idsToDelete.push_back(particleID);
+    for (size_t i = 0; i < numberOfIds; i++) {
+        if (processedBytes + sizeof(uint32_t) > packetLength) {
+            break; // bail to prevent buffer overflow
         }
 
-        // calling recurse to actually delete the particles
-        recurseTreeWithOperation(findAndDeleteOperation, &args);
+        uint32_t particleID = 0; // placeholder for now
+        memcpy(&particleID, dataAt, sizeof(particleID));
+        dataAt += sizeof(particleID);
+        processedBytes += sizeof(particleID);
+
+        deleteParticleWithID(particleID);
     }
 }
@@ -9,9 +9,14 @@
 #ifndef __hifi__ParticleTree__
 #define __hifi__ParticleTree__
 
+#include <QHash>
+#include <QSet>
+
 #include <Octree.h>
 #include "ParticleTreeElement.h"
 
+class WorkerPool;
+
 class NewlyCreatedParticleHook {
 public:
     virtual void particleCreated(const Particle& newParticle, const SharedNodePointer& senderNode) = 0;
@@ -21,6 +26,7 @@ class ParticleTree : public Octree {
     Q_OBJECT
 public:
     ParticleTree(bool shouldReaverage = false);
+    virtual ~ParticleTree();
 
     /// Implements our type specific root element factory
     virtual ParticleTreeElement* createNewElement(unsigned char * octalCode = NULL);
@@ -33,12 +39,28 @@ public:
     // own definition. Implement these to allow your octree based server to support editing
     virtual bool getWantSVOfileVersions() const { return true; }
     virtual PacketType expectedDataPacketType() const { return PacketTypeParticleData; }
+
+    /// the particle data went from version 1 to 2 for the SipHash packet MAC, the files it's saved in didn't change
+    virtual bool canReadSVOfileVersion(PacketVersion version) const { return version == 1 || version == 2; }
     virtual bool handlesEditPacketType(PacketType packetType) const;
     virtual int processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
                     const unsigned char* editData, int maxLength, const SharedNodePointer& senderNode);
 
     virtual void update();
 
+    /// Spreads update() across the threads of a pool once enough elements have awake particles. Set it back to NULL
+    /// with the tree locked for writing before stopping the pool.
+    void setUpdateWorkerPool(WorkerPool* updateWorkerPool) { _updateWorkerPool = updateWorkerPool; }
+
+    /// \return the number of script callbacks the last update() ran
+    int getLastTickCallbacks() const { return _lastTickCallbacks; }
+
+    /// \return the time the last update() spent in scripts
+    quint64 getLastTickScriptUsecs() const { return _lastTickScriptUsecs; }
+
+    /// \return the time every update() so far has spent in scripts
+    quint64 getTotalScriptUsecs() const { return _totalScriptUsecs; }
+
     void storeParticle(const Particle& particle, const SharedNodePointer& senderNode = SharedNodePointer());
     void updateParticle(const ParticleID& particleID, const ParticleProperties& properties);
     void addParticle(const ParticleID& particleID, const ParticleProperties& properties);
@@ -46,6 +68,9 @@ public:
     const Particle* findClosestParticle(glm::vec3 position, float targetRadius);
     const Particle* findParticleByID(uint32_t id, bool alreadyLocked = false);
 
+    /// Wakes a sleeping particle up, for when something other than an edit to the tree changes it.
+    void wakeParticle(Particle* particle);
+
     /// finds all particles that touch a sphere
     /// \param center the center of the sphere
     /// \param radius the radius of the sphere
@@ -71,19 +96,42 @@ public:
     void handleAddParticleResponse(const QByteArray& packet);
 
 private:
+    friend class ParticleTreeElement; // to keep our particle index up to date as its particles come and go
 
-    static bool updateOperation(OctreeElement* element, void* extraData);
-    static bool findAndUpdateOperation(OctreeElement* element, void* extraData);
-    static bool findAndUpdateWithIDandPropertiesOperation(OctreeElement* element, void* extraData);
     static bool findNearPointOperation(OctreeElement* element, void* extraData);
     static bool findInSphereOperation(OctreeElement* element, void* extraData);
     static bool pruneOperation(OctreeElement* element, void* extraData);
-    static bool findByIDOperation(OctreeElement* element, void* extraData);
-    static bool findAndDeleteOperation(OctreeElement* element, void* extraData);
-    static bool findAndUpdateParticleIDOperation(OctreeElement* element, void* extraData);
 
     void notifyNewlyCreatedParticle(const Particle& newParticle, const SharedNodePointer& senderNode);
 
+    ParticleTreeElement* getContainingElement(uint32_t particleID) const {
+        return _particleElementsByID.value(particleID);
+    }
+    void indexParticle(const Particle& particle, ParticleTreeElement* element);
+    void unindexParticle(const Particle& particle, ParticleTreeElement* element);
+
+    void deleteParticleWithID(uint32_t particleID);
+
+    void wakeElement(ParticleTreeElement* element) { _awakeElements.insert(element); }
+    void wakeExpiredParticles();
+    void updateInParallel(const QSet<ParticleTreeElement*>& awakeElements, ParticleTreeUpdateArgs& args);
+
+    // the element holding each particle with a known ID, and each locally created particle by its creator token, so
+    // that particles are found without searching the tree. The elements change these along with their particle lists.
+    QHash<uint32_t, ParticleTreeElement*> _particleElementsByID;
+    QHash<uint32_t, ParticleTreeElement*> _particleElementsByCreatorToken;
+
+    // update() only visits the elements with awake particles, sleeping particles are woken when they're edited or hit,
+    // or when their lifetime runs out so that they can die
+    QSet<ParticleTreeElement*> _awakeElements;
+    QMultiMap<quint64, uint32_t> _sleepingParticleLifetimeEnds;
+    bool _hasRemovedParticles;
+    WorkerPool* _updateWorkerPool;
+
+    int _lastTickCallbacks;
+    quint64 _lastTickScriptUsecs;
+    quint64 _totalScriptUsecs;
+
     QReadWriteLock _newlyCreatedHooksLock;
     std::vector<NewlyCreatedParticleHook*> _newlyCreatedHooks;
 
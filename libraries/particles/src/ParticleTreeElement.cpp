@@ -7,20 +7,48 @@
 //
 
 #include <GeometryUtil.h>
+#include <OctreeMemoryPool.h>
 
 #include "ParticleTree.h"
 #include "ParticleTreeElement.h"
 
-ParticleTreeElement::ParticleTreeElement(unsigned char* octalCode) : OctreeElement(), _particles(NULL) {
+ParticleTreeElement::ParticleTreeElement(unsigned char* octalCode) : OctreeElement(), _myTree(NULL), _particles(NULL) {
     init(octalCode);
 };
 
 ParticleTreeElement::~ParticleTreeElement() {
     _voxelMemoryUsage -= sizeof(ParticleTreeElement);
+    if (_myTree) {
+        for (int i = 0; i < _particles->size(); i++) {
+            _myTree->unindexParticle((*_particles)[i], this);
+        }
+        _myTree->_awakeElements.remove(this);
+    }
     delete _particles;
     _particles = NULL;
 }
 
+static OctreeMemoryPool* elementPool() {
+    static OctreeMemoryPool* pool = new OctreeMemoryPool("Particle Elements", sizeof(ParticleTreeElement));
+    return pool;
+}
+
+void* ParticleTreeElement::operator new(size_t size) {
+    // blocks are exactly our size, let the global allocator handle anything else
+    if (size != sizeof(ParticleTreeElement)) {
+        return ::operator new(size);
+    }
+    return elementPool()->allocate();
+}
+
+void ParticleTreeElement::operator delete(void* element, size_t size) {
+    if (size != sizeof(ParticleTreeElement)) {
+        ::operator delete(element);
+        return;
+    }
+    elementPool()->release(element);
+}
+
 // This will be called primarily on addChildAt(), which means we're adding a child of our
 // own type to our own tree. This means we should initialize that child with any tree and type
 // specific settings that our children must have. One example is out VoxelSystem, which
@@ -64,23 +92,41 @@ bool ParticleTreeElement::appendElementData(OctreePacketData* packetData) const
 }
 
 void ParticleTreeElement::update(ParticleTreeUpdateArgs& args) {
-    markWithChangedTime();
-    // TODO: early exit when _particles is empty
+    bool hasChanged = false;
+    bool hasAwakeParticles = false;
 
     // update our contained particles
     QList<Particle>::iterator particleItr = _particles->begin();
     while(particleItr != _particles->end()) {
         Particle& particle = (*particleItr);
+        if (particle.isSleeping()) {
+            ++particleItr;
+            continue;
+        }
+
+        // only elements with particles that actually move get timestamped, so that only they are resent
+        if (!hasChanged) {
+            markWithChangedTime();
+            hasChanged = true;
+        }
         particle.update(_lastChanged);
 
         // If the particle wants to die, or if it's left our bounding box, then move it
         // into the arguments moving particles. These will be added back or deleted completely
         if (particle.getShouldDie() || !_box.contains(particle.getPosition())) {
             args._movingParticles.push_back(particle);
+            args._movingParticleElements.push_back(this);
 
             // erase this particle
             particleItr = _particles->erase(particleItr);
         } else {
+            // particles that came to rest sleep until something wakes them, they need an ID to be woken by
+            if (particle.canSleep() && particle.getID() != UNKNOWN_PARTICLE_ID) {
+                particle.setSleeping(true);
+                args._sleepingParticleLifetimeEnds.insert(particle.getLifetimeEnd(), particle.getID());
+            } else {
+                hasAwakeParticles = true;
+            }
             ++particleItr;
         }
     }
@@ -88,6 +134,20 @@ void ParticleTreeElement::update(ParticleTreeUpdateArgs& args) {
     // internal array is too big (QList internal array does not decrease size except in dtor and
     // assignment operator).  Otherwise _particles could become a "resource leak" for large
     // roaming piles of particles.
+
+    if (hasAwakeParticles) {
+        args._awakeElements.push_back(this);
+    }
+}
+
+bool ParticleTreeElement::hasScriptedParticles() const {
+    uint16_t numberOfParticles = _particles->size();
+    for (uint16_t i = 0; i < numberOfParticles; i++) {
+        if (!(*_particles)[i].getScript().isEmpty()) {
+            return true;
+        }
+    }
+    return false;
 }
 
 bool ParticleTreeElement::findSpherePenetration(const glm::vec3& center, float radius,
@@ -138,6 +198,7 @@ bool ParticleTreeElement::updateParticle(const Particle& particle) {
             bool changedOnServer = thisParticle.getLastEdited() < particle.getLastEdited();
             bool localOlder = thisParticle.getLastUpdated() < particle.getLastUpdated();
             if (changedOnServer || localOlder) {
+                wakeParticle(thisParticle);
                 if (wantDebug) {
                     printf("local particle [id:%d] %s and %s than server particle by %d, particle.isNewlyCreated()=%s\n",
                             particle.getID(), (changedOnServer ? "CHANGED" : "same"),
@@ -174,6 +235,7 @@ bool ParticleTreeElement::updateParticle(const ParticleID& particleID, const Par
             found = thisParticle.getCreatorTokenID() == particleID.creatorTokenID;
         }
         if (found) {
+            wakeParticle(thisParticle);
             thisParticle.setProperties(properties);
 
             const bool wantDebug = false;
@@ -191,6 +253,7 @@ bool ParticleTreeElement::updateParticle(const ParticleID& particleID, const Par
 }
 
 void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
+    bool foundCreatorTokenHere = false;
     uint16_t numberOfParticles = _particles->size();
     for (uint16_t i = 0; i < numberOfParticles; i++) {
         Particle& thisParticle = (*_particles)[i];
@@ -200,12 +263,14 @@ void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
             if (thisParticle.getCreatorTokenID() == args->creatorTokenID) {
                 thisParticle.setID(args->particleID);
                 args->creatorTokenFound = true;
+                foundCreatorTokenHere = true;
             }
         }
         
         // if we're in an isViewing tree, we also need to look for an kill any viewed particles
         if (!args->viewedParticleFound && args->isViewing) {
             if (thisParticle.getCreatorTokenID() == UNKNOWN_TOKEN && thisParticle.getID() == args->particleID) {
+                _myTree->unindexParticle(thisParticle, this);
                 _particles->removeAt(i); // remove the particle at this index
                 numberOfParticles--; // this means we have 1 fewer particle in this list
                 i--; // and we actually want to back up i as well.
@@ -213,6 +278,11 @@ void ParticleTreeElement::updateParticleID(FindAndUpdateParticleIDArgs* args) {
             }
         }
     }
+
+    // now that any viewed duplicate is gone, our particle can be found by its new ID
+    if (foundCreatorTokenHere) {
+        _myTree->indexParticle(*getParticleWithID(args->particleID), this);
+    }
 }
 
 
@@ -273,12 +343,24 @@ const Particle* ParticleTreeElement::getParticleWithID(uint32_t id) const {
     return foundParticle;
 }
 
+Particle* ParticleTreeElement::getParticleWithID(uint32_t id) {
+    return const_cast<Particle*>(static_cast<const ParticleTreeElement*>(this)->getParticleWithID(id));
+}
+
+void ParticleTreeElement::wakeParticle(Particle& particle) {
+    if (particle.isSleeping()) {
+        particle.setSleeping(false);
+    }
+    _myTree->wakeElement(this);
+}
+
 bool ParticleTreeElement::removeParticleWithID(uint32_t id) {
     bool foundParticle = false;
     uint16_t numberOfParticles = _particles->size();
     for (uint16_t i = 0; i < numberOfParticles; i++) {
         if ((*_particles)[i].getID() == id) {
             foundParticle = true;
+            _myTree->unindexParticle((*_particles)[i], this);
             _particles->removeAt(i);
             break;
         }
@@ -334,6 +416,8 @@ bool ParticleTreeElement::collapseChildren() {
 
 void ParticleTreeElement::storeParticle(const Particle& particle) {
     _particles->push_back(particle);
+    _myTree->indexParticle(particle, this);
+    wakeParticle(_particles->last());
     markWithChangedTime();
 }
 
@@ -14,6 +14,7 @@
 
 #include <OctreeElement.h>
 #include <QList>
+#include <QMap>
 
 #include "Particle.h"
 #include "ParticleTree.h"
@@ -21,9 +22,13 @@
 class ParticleTree;
 class ParticleTreeElement;
 
+/// What updating the elements leaves for the tree to do, so that elements can be updated on different threads at once.
 class ParticleTreeUpdateArgs {
 public:
     QList<Particle> _movingParticles;
+    QList<ParticleTreeElement*> _movingParticleElements; // the element each of the moving particles left
+    QList<ParticleTreeElement*> _awakeElements; // the updated elements that still have awake particles
+    QMultiMap<quint64, uint32_t> _sleepingParticleLifetimeEnds; // the particles that fell asleep, by ID
 };
 
 class FindAndUpdateParticleIDArgs {
@@ -47,6 +52,11 @@ class ParticleTreeElement : public OctreeElement {
 public:
     virtual ~ParticleTreeElement();
 
+    /// Elements are carved from a shared slab pool rather than individually allocated, see OctreeMemoryPool
+    static void* operator new(size_t size);
+    static void operator delete(void* element, size_t size);
+
+
     // type safe versions of OctreeElement methods
     ParticleTreeElement* getChildAtIndex(int index) { return (ParticleTreeElement*)OctreeElement::getChildAtIndex(index); }
 
@@ -94,7 +104,10 @@ public:
     QList<Particle>& getParticles() { return *_particles; }
     bool hasParticles() const { return _particles->size() > 0; }
 
+    /// Simulates the awake particles, leaving the sleeping ones where they are. Only changes this element, anything
+    /// else goes in args.
     void update(ParticleTreeUpdateArgs& args);
+    bool hasScriptedParticles() const;
     void setTree(ParticleTree* tree) { _myTree = tree; }
 
     bool updateParticle(const Particle& particle);
@@ -115,6 +128,10 @@ public:
     void getParticlesForUpdate(const AABox& box, QVector<Particle*>& foundParticles);
 
     const Particle* getParticleWithID(uint32_t id) const;
+    Particle* getParticleWithID(uint32_t id);
+
+    /// Wakes one of our particles up, so that it's simulated on the next update.
+    void wakeParticle(Particle& particle);
 
     bool removeParticleWithID(uint32_t id);
 
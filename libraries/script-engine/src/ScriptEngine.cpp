@@ -13,6 +13,7 @@
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkRequest>
 #include <QtNetwork/QNetworkReply>
+#include <QtScript/QScriptContext>
 
 #include <AvatarData.h>
 #include <NodeList.h>
@@ -173,6 +174,29 @@ void ScriptEngine::evaluate() {
     }
 }
 
+void ScriptEngine::evaluate(const QScriptProgram& program) {
+    if (!_isInitialized) {
+        init();
+    }
+
+    // the engine outlives this program, don't let an exception from an earlier one get reported against it
+    _engine.clearExceptions();
+
+    // evaluate it as the body of a function of its own, so that the variables and functions it declares go in a fresh
+    // activation object and aren't seen by the next program, while the handlers it connects keep theirs
+    QScriptContext* context = _engine.pushContext();
+    QScriptValue activationObject = _engine.newObject();
+    context->setActivationObject(activationObject);
+    context->setThisObject(activationObject);
+    QScriptValue result = _engine.evaluate(program);
+    _engine.popContext();
+
+    if (_engine.hasUncaughtException()) {
+        int line = _engine.uncaughtExceptionLineNumber();
+        qDebug() << "Uncaught exception at line" << line << ":" << result.toString();
+    }
+}
+
 void ScriptEngine::run() {
     if (!_isInitialized) {
         init();
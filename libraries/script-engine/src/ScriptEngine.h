@@ -12,6 +12,7 @@
 #include <vector>
 
 #include <QtScript/QScriptEngine>
+#include <QtScript/QScriptProgram>
 #include <QtCore/QObject>
 #include <QtCore/QUrl>
 
@@ -60,6 +61,10 @@ public:
     void init();
     void run(); /// runs continuously until Agent.stop() is called
     void evaluate(); /// initializes the engine, and evaluates the script, but then returns control to caller
+
+    /// initializes the engine, and evaluates a program compiled ahead of time instead of the script contents, so that a
+    /// script evaluated over and over is only parsed once. The program gets a scope of its own for what it declares.
+    void evaluate(const QScriptProgram& program);
     
     void timerFired();
 
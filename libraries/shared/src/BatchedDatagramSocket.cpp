@@ -0,0 +1,267 @@
+//
+//  BatchedDatagramSocket.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Reads and writes many datagrams per system call on the NodeList socket
+//
+
+#include <cstring>
+
+#include <QtCore/QDebug>
+
+#include "SharedUtil.h"
+
+#include "BatchedDatagramSocket.h"
+
+// recvmmsg() and sendmmsg() are Linux only, everything else goes through the QUdpSocket one datagram at a time
+#if defined(__linux__)
+#define HIFI_BATCHED_DATAGRAMS
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+BatchedDatagramSocket::BatchedDatagramSocket(QUdpSocket& socket) :
+    _socket(socket),
+#ifdef HIFI_BATCHED_DATAGRAMS
+    _isBatching(true),
+#else
+    _isBatching(false),
+#endif
+    _receiveBuffers(new char[DATAGRAM_BATCH_SIZE * MAX_PACKET_SIZE]),
+    _numReceived(0),
+    _nextReceived(0),
+    _sendBuffers(new char[DATAGRAM_BATCH_SIZE * MAX_PACKET_SIZE]),
+    _numQueued(0),
+    _numReceiveCalls(0),
+    _numReceivedDatagrams(0),
+    _numSendCalls(0),
+    _numSentDatagrams(0)
+{
+}
+
+BatchedDatagramSocket::~BatchedDatagramSocket() {
+    delete[] _receiveBuffers;
+    delete[] _sendBuffers;
+}
+
+bool BatchedDatagramSocket::nextDatagram(const char*& data, int& size, HifiSockAddr& senderSockAddr) {
+    if (_nextReceived == _numReceived && receiveBatch() == 0) {
+        return false;
+    }
+
+    data = _receiveBuffers + _nextReceived * MAX_PACKET_SIZE;
+    size = _receivedSizes[_nextReceived];
+    senderSockAddr = _senderSockAddrs[_nextReceived];
+    _nextReceived++;
+    return true;
+}
+
+char* BatchedDatagramSocket::queueDatagram(const char* data, int size, const HifiSockAddr& destinationSockAddr) {
+    if (size > MAX_PACKET_SIZE) {
+        // too big for a slot in the batch, which only happens for packets that would be fragmented anyway
+        _numSendCalls++;
+        if (_socket.writeDatagram(data, size, destinationSockAddr.getAddress(), destinationSockAddr.getPort()) >= 0) {
+            _numSentDatagrams++;
+        }
+        return NULL;
+    }
+
+    if (_numQueued == DATAGRAM_BATCH_SIZE) {
+        flush();
+    }
+
+    char* queuedData = _sendBuffers + _numQueued * MAX_PACKET_SIZE;
+    memcpy(queuedData, data, size);
+    _queuedSizes[_numQueued] = size;
+    _destinationSockAddrs[_numQueued] = destinationSockAddr;
+    _numQueued++;
+    return queuedData;
+}
+
+int BatchedDatagramSocket::flush() {
+    int numSent = 0;
+    if (_isBatching) {
+        numSent = sendBatchWithSyscall();
+    }
+
+    // sendBatchWithSyscall() moves whatever it didn't get to right after what it sent, those go one at a time
+    for (int i = numSent; i < _numQueued; i++) {
+        _numSendCalls++;
+        if (_socket.writeDatagram(_sendBuffers + i * MAX_PACKET_SIZE, _queuedSizes[i],
+                                  _destinationSockAddrs[i].getAddress(), _destinationSockAddrs[i].getPort()) >= 0) {
+            numSent++;
+        }
+    }
+
+    _numQueued = 0;
+    _numSentDatagrams += numSent;
+    return numSent;
+}
+
+int BatchedDatagramSocket::receiveBatch() {
+    _numReceived = 0;
+    _nextReceived = 0;
+
+    if (_isBatching) {
+        _numReceived = receiveBatchWithSyscall();
+    }
+
+    // QUdpSocket stops emitting readyRead() after it has emitted it once, until readDatagram() is called on it. So once
+    // the socket has been drained the last read always goes through the QUdpSocket, which re-arms it. If another
+    // datagram arrived since the drain it simply gets read here, nothing is lost.
+    if (_numReceived < DATAGRAM_BATCH_SIZE && readDatagramIntoRing(_numReceived)) {
+        _numReceived++;
+    }
+
+    _numReceivedDatagrams += _numReceived;
+    return _numReceived;
+}
+
+bool BatchedDatagramSocket::readDatagramIntoRing(int index) {
+    _numReceiveCalls++;
+    qint64 size = _socket.readDatagram(_receiveBuffers + index * MAX_PACKET_SIZE, MAX_PACKET_SIZE,
+                                       _senderSockAddrs[index].getAddressPointer(),
+                                       _senderSockAddrs[index].getPortPointer());
+    if (size < 0) {
+        return false;
+    }
+    _receivedSizes[index] = size;
+    return true;
+}
+
+#ifdef HIFI_BATCHED_DATAGRAMS
+
+int BatchedDatagramSocket::receiveBatchWithSyscall() {
+    int socketDescriptor = _socket.socketDescriptor();
+    if (socketDescriptor == -1) {
+        return 0;
+    }
+
+    mmsghdr messages[DATAGRAM_BATCH_SIZE];
+    iovec buffers[DATAGRAM_BATCH_SIZE];
+    sockaddr_storage senders[DATAGRAM_BATCH_SIZE];
+    memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < DATAGRAM_BATCH_SIZE; i++) {
+        buffers[i].iov_base = _receiveBuffers + i * MAX_PACKET_SIZE;
+        buffers[i].iov_len = MAX_PACKET_SIZE;
+        messages[i].msg_hdr.msg_iov = &buffers[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = &senders[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+    }
+
+    _numReceiveCalls++;
+    int numMessages = recvmmsg(socketDescriptor, messages, DATAGRAM_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (numMessages < 0) {
+        if (errno == ENOSYS) {
+            qDebug() << "recvmmsg() isn't supported by this kernel, reading one datagram at a time.";
+            _isBatching = false;
+        }
+        return 0;
+    }
+
+    // pack the datagrams we keep to the front of the ring, dropping any that didn't fit in a buffer
+    int numKept = 0;
+    for (int i = 0; i < numMessages; i++) {
+        if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            qDebug() << "Dropping a datagram bigger than" << MAX_PACKET_SIZE << "bytes.";
+            continue;
+        }
+        if (numKept != i) {
+            memcpy(_receiveBuffers + numKept * MAX_PACKET_SIZE, _receiveBuffers + i * MAX_PACKET_SIZE,
+                   messages[i].msg_len);
+        }
+        _receivedSizes[numKept] = messages[i].msg_len;
+
+        HifiSockAddr& senderSockAddr = _senderSockAddrs[numKept];
+        if (senders[i].ss_family == AF_INET) {
+            const sockaddr_in* sender = reinterpret_cast<const sockaddr_in*>(&senders[i]);
+            senderSockAddr.getAddressPointer()->setAddress(ntohl(sender->sin_addr.s_addr));
+            senderSockAddr.setPort(ntohs(sender->sin_port));
+        } else {
+            const sockaddr_in6* sender = reinterpret_cast<const sockaddr_in6*>(&senders[i]);
+            senderSockAddr.setAddress(QHostAddress(reinterpret_cast<const sockaddr*>(sender)));
+            senderSockAddr.setPort(ntohs(sender->sin6_port));
+        }
+        numKept++;
+    }
+    return numKept;
+}
+
+int BatchedDatagramSocket::sendBatchWithSyscall() {
+    int socketDescriptor = _socket.socketDescriptor();
+    if (socketDescriptor == -1) {
+        return 0;
+    }
+
+    // the node socket is bound to IPv4, an IPv6 destination and everything after it goes through the QUdpSocket
+    mmsghdr messages[DATAGRAM_BATCH_SIZE];
+    iovec buffers[DATAGRAM_BATCH_SIZE];
+    sockaddr_in destinations[DATAGRAM_BATCH_SIZE];
+    memset(messages, 0, sizeof(messages));
+    memset(destinations, 0, sizeof(destinations));
+    int numMessages = 0;
+    for (; numMessages < _numQueued; numMessages++) {
+        const HifiSockAddr& destinationSockAddr = _destinationSockAddrs[numMessages];
+        if (destinationSockAddr.getAddress().protocol() != QAbstractSocket::IPv4Protocol) {
+            break;
+        }
+        destinations[numMessages].sin_family = AF_INET;
+        destinations[numMessages].sin_addr.s_addr = htonl(destinationSockAddr.getAddress().toIPv4Address());
+        destinations[numMessages].sin_port = htons(destinationSockAddr.getPort());
+
+        buffers[numMessages].iov_base = _sendBuffers + numMessages * MAX_PACKET_SIZE;
+        buffers[numMessages].iov_len = _queuedSizes[numMessages];
+        messages[numMessages].msg_hdr.msg_iov = &buffers[numMessages];
+        messages[numMessages].msg_hdr.msg_iovlen = 1;
+        messages[numMessages].msg_hdr.msg_name = &destinations[numMessages];
+        messages[numMessages].msg_hdr.msg_namelen = sizeof(destinations[numMessages]);
+    }
+
+    int numAttempted = 0;
+    int numSent = 0;
+    while (numAttempted < numMessages) {
+        _numSendCalls++;
+        int numSentThisCall = sendmmsg(socketDescriptor, messages + numAttempted, numMessages - numAttempted, 0);
+        if (numSentThisCall < 0) {
+            if (errno == ENOSYS) {
+                qDebug() << "sendmmsg() isn't supported by this kernel, sending one datagram at a time.";
+                _isBatching = false;
+                break;
+            }
+            // sendmmsg() only fails if the first datagram does, drop that one like a failed writeDatagram()
+            numAttempted++;
+        } else {
+            numAttempted += numSentThisCall;
+            numSent += numSentThisCall;
+        }
+    }
+
+    // datagrams that failed outright are dropped, the ones we never got to are left to the QUdpSocket
+    int numLeftForQt = _numQueued - numAttempted;
+    if (numLeftForQt > 0 && numAttempted > 0) {
+        memmove(_sendBuffers + numSent * MAX_PACKET_SIZE, _sendBuffers + numAttempted * MAX_PACKET_SIZE,
+                numLeftForQt * MAX_PACKET_SIZE);
+        for (int i = 0; i < numLeftForQt; i++) {
+            _queuedSizes[numSent + i] = _queuedSizes[numAttempted + i];
+            _destinationSockAddrs[numSent + i] = _destinationSockAddrs[numAttempted + i];
+        }
+    }
+    _numQueued = numSent + numLeftForQt;
+    return numSent;
+}
+
+#else
+
+int BatchedDatagramSocket::receiveBatchWithSyscall() {
+    return 0;
+}
+
+int BatchedDatagramSocket::sendBatchWithSyscall() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,83 @@
+//
+//  BatchedDatagramSocket.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Reads and writes many datagrams per system call on the NodeList socket
+//
+
+#ifndef __hifi__BatchedDatagramSocket__
+#define __hifi__BatchedDatagramSocket__
+
+#include <QtNetwork/QUdpSocket>
+
+#include "HifiSockAddr.h"
+
+// the most datagrams read or written by one system call
+const int DATAGRAM_BATCH_SIZE = 64;
+
+/// Batches the datagrams going through a bound QUdpSocket. On Linux a batch is read with recvmmsg() into a preallocated
+/// ring of packet buffers and written with sendmmsg(). Everywhere else, or if the kernel doesn't have those calls, it
+/// falls back to reading and writing one datagram at a time through the QUdpSocket.
+class BatchedDatagramSocket {
+public:
+    BatchedDatagramSocket(QUdpSocket& socket);
+    ~BatchedDatagramSocket();
+
+    /// \return true if this build and kernel can read and write batches with a single system call
+    bool isBatching() const { return _isBatching; }
+
+    /// Goes back to one datagram per system call, for comparison.
+    void disableBatching() { _isBatching = false; }
+
+    /// Hands out the next datagram that has been received, reading another batch once the current one is used up.
+    /// The data stays valid until the next call.
+    /// \return false if there was nothing left to read
+    bool nextDatagram(const char*& data, int& size, HifiSockAddr& senderSockAddr);
+
+    /// Copies a datagram into the outgoing batch, sending the batch first if it is already full. Datagrams bigger than
+    /// MAX_PACKET_SIZE are sent right away instead.
+    /// \return the queued copy, which can be changed until the next call to queueDatagram() or flush(), or NULL if the
+    /// datagram was too big to queue
+    char* queueDatagram(const char* data, int size, const HifiSockAddr& destinationSockAddr);
+
+    /// Sends every queued datagram.
+    /// \return the number of datagrams sent
+    int flush();
+
+    quint64 getNumReceiveCalls() const { return _numReceiveCalls; }
+    quint64 getNumReceivedDatagrams() const { return _numReceivedDatagrams; }
+    quint64 getNumSendCalls() const { return _numSendCalls; }
+    quint64 getNumSentDatagrams() const { return _numSentDatagrams; }
+
+private:
+    BatchedDatagramSocket(const BatchedDatagramSocket&); // not copyable, it owns its buffers
+    BatchedDatagramSocket& operator=(const BatchedDatagramSocket&);
+
+    int receiveBatch();
+    int receiveBatchWithSyscall();
+    int sendBatchWithSyscall();
+    bool readDatagramIntoRing(int index);
+
+    QUdpSocket& _socket;
+    bool _isBatching;
+
+    char* _receiveBuffers; // DATAGRAM_BATCH_SIZE buffers of MAX_PACKET_SIZE bytes
+    int _receivedSizes[DATAGRAM_BATCH_SIZE];
+    HifiSockAddr _senderSockAddrs[DATAGRAM_BATCH_SIZE];
+    int _numReceived;
+    int _nextReceived;
+
+    char* _sendBuffers; // DATAGRAM_BATCH_SIZE buffers of MAX_PACKET_SIZE bytes
+    int _queuedSizes[DATAGRAM_BATCH_SIZE];
+    HifiSockAddr _destinationSockAddrs[DATAGRAM_BATCH_SIZE];
+    int _numQueued;
+
+    quint64 _numReceiveCalls;
+    quint64 _numReceivedDatagrams;
+    quint64 _numSendCalls;
+    quint64 _numSentDatagrams;
+};
+
+#endif /* defined(__hifi__BatchedDatagramSocket__) */
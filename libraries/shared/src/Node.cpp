@@ -53,6 +53,7 @@ Node::Node(const QUuid& uuid, char type, const HifiSockAddr& publicSocket, const
     _localSocket(localSocket),
     _activeSocket(NULL),
     _connectionSecret(),
+    _authenticationKey(),
     _bytesReceivedMovingAverage(NULL),
     _linkedData(NULL),
     _isAlive(true),
@@ -87,6 +88,11 @@ void Node::setLocalSocket(const HifiSockAddr& localSocket) {
     _localSocket = localSocket;
 }
 
+void Node::setConnectionSecret(const QUuid& connectionSecret) {
+    _connectionSecret = connectionSecret;
+    _authenticationKey = PacketAuthenticationKey(connectionSecret);
+}
+
 void Node::activateLocalSocket() {
     qDebug() << "Activating local socket for node" << *this;
     _activeSocket = &_localSocket;
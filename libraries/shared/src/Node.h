@@ -25,6 +25,7 @@
 
 #include "HifiSockAddr.h"
 #include "NodeData.h"
+#include "PacketAuthentication.h"
 #include "SimpleMovingAverage.h"
 
 typedef quint8 NodeType_t;
@@ -77,7 +78,10 @@ public:
     void activateLocalSocket();
     
     const QUuid& getConnectionSecret() const { return _connectionSecret; }
-    void setConnectionSecret(const QUuid& connectionSecret) { _connectionSecret = connectionSecret; }
+    void setConnectionSecret(const QUuid& connectionSecret);
+    
+    /// the MAC key state for our connection secret, kept so that packets don't have to set it up again
+    const PacketAuthenticationKey& getAuthenticationKey() const { return _authenticationKey; }
 
     NodeData* getLinkedData() const { return _linkedData; }
     void setLinkedData(NodeData* linkedData) { _linkedData = linkedData; }
@@ -112,6 +116,7 @@ private:
     HifiSockAddr _localSocket;
     HifiSockAddr* _activeSocket;
     QUuid _connectionSecret;
+    PacketAuthenticationKey _authenticationKey;
     SimpleMovingAverage* _bytesReceivedMovingAverage;
     NodeData* _linkedData;
     bool _isAlive;
@@ -59,9 +59,12 @@ NodeList* NodeList::getInstance() {
 NodeList::NodeList(char newOwnerType, unsigned short int newSocketListenPort) :
     _nodeHash(),
     _nodeHashMutex(QMutex::Recursive),
+    _nodeHashVersion(0),
+    _nodeHashSnapshots(),
     _domainHostname(),
     _domainSockAddr(HifiSockAddr(QHostAddress::Null, DEFAULT_DOMAIN_SERVER_PORT)),
     _nodeSocket(this),
+    _batchedSocket(_nodeSocket),
     _ownerType(newOwnerType),
     _nodeTypesOfInterest(),
     _sessionUUID(),
@@ -81,34 +84,30 @@ NodeList::~NodeList() {
 }
 
 bool NodeList::packetVersionAndHashMatch(const QByteArray& packet) {
-    if (packet[1] != versionForPacketType(packetTypeForPacket(packet))
-        && packetTypeForPacket(packet) != PacketTypeStunResponse) {
-        PacketType mismatchType = packetTypeForPacket(packet);
+    PacketType packetType = packetTypeForPacket(packet);
+    
+    if (packet[1] != versionForPacketType(packetType)
+        && packetType != PacketTypeStunResponse) {
         int numPacketTypeBytes = numBytesArithmeticCodingFromBuffer(packet.data());
         
-        qDebug() << "Packet version mismatch on" << packetTypeForPacket(packet) << "- Sender"
+        qDebug() << "Packet version mismatch on" << packetType << "- Sender"
             << uuidFromPacketHeader(packet) << "sent" << qPrintable(QString::number(packet[numPacketTypeBytes])) << "but"
-            << qPrintable(QString::number(versionForPacketType(mismatchType))) << "expected.";
+            << qPrintable(QString::number(versionForPacketType(packetType))) << "expected.";
     }
     
-    const QSet<PacketType> NON_VERIFIED_PACKETS = QSet<PacketType>() << PacketTypeDomainList
-        << PacketTypeDomainListRequest << PacketTypeStunResponse << PacketTypeDataServerConfirm
-        << PacketTypeDataServerGet << PacketTypeDataServerPut << PacketTypeDataServerSend
-        << PacketTypeCreateAssignment << PacketTypeRequestAssignment;
-    
-    if (!NON_VERIFIED_PACKETS.contains(packetTypeForPacket(packet))) {
+    if (isVerifiedPacketType(packetType)) {
         // figure out which node this is from
         SharedNodePointer sendingNode = sendingNodeForPacket(packet);
         if (sendingNode) {
-            // check if the md5 hash in the header matches the hash we would expect
-            if (hashFromPacketHeader(packet) == hashForPacketAndConnectionUUID(packet, sendingNode->getConnectionSecret())) {
+            // check if the MAC in the header matches the MAC we would expect
+            if (packetHashMatches(packet.constData(), packet.size(), sendingNode->getAuthenticationKey())) {
                 return true;
             } else {
-                qDebug() << "Packet hash mismatch on" << packetTypeForPacket(packet) << "- Sender"
+                qDebug() << "Packet hash mismatch on" << packetType << "- Sender"
                     << uuidFromPacketHeader(packet);
             }
         } else {
-            qDebug() << "Packet of type" << packetTypeForPacket(packet) << "received from unknown node with UUID"
+            qDebug() << "Packet of type" << packetType << "received from unknown node with UUID"
                 << uuidFromPacketHeader(packet);
         }
     } else {
@@ -120,6 +119,11 @@ bool NodeList::packetVersionAndHashMatch(const QByteArray& packet) {
 
 qint64 NodeList::writeDatagram(const QByteArray& datagram, const SharedNodePointer& destinationNode,
                                const HifiSockAddr& overridenSockAddr) {
+    return writeDatagram(datagram.constData(), datagram.size(), destinationNode, overridenSockAddr);
+}
+
+qint64 NodeList::writeDatagram(const char* data, qint64 size, const SharedNodePointer& destinationNode,
+                               const HifiSockAddr& overridenSockAddr) {
     if (destinationNode) {
         // if we don't have an ovveriden address, assume they want to send to the node's active socket
         const HifiSockAddr* destinationSockAddr = &overridenSockAddr;
@@ -133,20 +137,42 @@ qint64 NodeList::writeDatagram(const QByteArray& datagram, const SharedNodePoint
             }
         }
         
-        QByteArray datagramCopy = datagram;
-        // setup the MD5 hash for source verification in the header
-        replaceHashInPacketGivenConnectionUUID(datagramCopy, destinationNode->getConnectionSecret());
+        // the caller's datagram is const, so the MAC goes into a copy, on the stack unless it's oversized
+        char stackCopy[MAX_PACKET_SIZE];
+        QByteArray heapCopy;
+        char* datagramCopy = stackCopy;
+        if (size > MAX_PACKET_SIZE) {
+            heapCopy.resize(size);
+            datagramCopy = heapCopy.data();
+        }
+        memcpy(datagramCopy, data, size);
+        
+        // setup the MAC for source verification in the header
+        replaceHashInPacket(datagramCopy, size, destinationNode->getAuthenticationKey());
         
-        return _nodeSocket.writeDatagram(datagramCopy, destinationSockAddr->getAddress(), destinationSockAddr->getPort());
+        return _nodeSocket.writeDatagram(datagramCopy, size, destinationSockAddr->getAddress(),
+                                         destinationSockAddr->getPort());
     }
     
     // didn't have a destinationNode to send to, return 0
     return 0;
 }
 
-qint64 NodeList::writeDatagram(const char* data, qint64 size, const SharedNodePointer& destinationNode,
-                               const HifiSockAddr& overridenSockAddr) {
-    return writeDatagram(QByteArray(data, size), destinationNode, overridenSockAddr);
+qint64 NodeList::queueDatagram(const char* data, qint64 size, const SharedNodePointer& destinationNode) {
+    if (size > MAX_PACKET_SIZE) {
+        // too big to batch, this sends it now
+        return writeDatagram(data, size, destinationNode);
+    }
+    
+    if (destinationNode && destinationNode->getActiveSocket()) {
+        // the queued copy is ours to change, so the MAC goes straight into it
+        char* queuedDatagram = _batchedSocket.queueDatagram(data, size, *destinationNode->getActiveSocket());
+        replaceHashInPacket(queuedDatagram, size, destinationNode->getAuthenticationKey());
+        return size;
+    }
+    
+    // no node, or no socket to send to, return 0
+    return 0;
 }
 
 void NodeList::setDomainHostname(const QString& domainHostname) {
@@ -284,8 +310,7 @@ int NodeList::findNodeAndUpdateWithDataFromPacket(const QByteArray& packet) {
 }
 
 SharedNodePointer NodeList::nodeWithUUID(const QUuid& nodeUUID) {
-    QMutexLocker locker(&_nodeHashMutex);
-    return _nodeHash.value(nodeUUID);
+    return currentNodeHash().value(nodeUUID);
 }
 
 SharedNodePointer NodeList::sendingNodeForPacket(const QByteArray& packet) {
@@ -296,8 +321,20 @@ SharedNodePointer NodeList::sendingNodeForPacket(const QByteArray& packet) {
 }
 
 NodeHash NodeList::getNodeHash() {
-    QMutexLocker locker(&_nodeHashMutex);
-    return NodeHash(_nodeHash);
+    return currentNodeHash();
+}
+
+const NodeHash& NodeList::currentNodeHash() {
+    NodeHashSnapshot& snapshot = _nodeHashSnapshots.localData();
+    
+    if (snapshot.version != _nodeHashVersion.loadAcquire()) {
+        // the hash has changed since this thread last looked, take a new snapshot of it
+        QMutexLocker locker(&_nodeHashMutex);
+        snapshot.hash = _nodeHash;
+        snapshot.version = _nodeHashVersion.load();
+    }
+    
+    return snapshot.hash;
 }
 
 void NodeList::clear() {
@@ -480,7 +517,9 @@ void NodeList::killNodeWithUUID(const QUuid& nodeUUID) {
 NodeHash::iterator NodeList::killNodeAtHashIterator(NodeHash::iterator& nodeItemToKill) {
     qDebug() << "Killed" << *nodeItemToKill.value();
     emit nodeKilled(nodeItemToKill.value());
-    return _nodeHash.erase(nodeItemToKill);
+    NodeHash::iterator nextNodeItem = _nodeHash.erase(nodeItemToKill);
+    publishNodeHash();
+    return nextNodeItem;
 }
 
 void NodeList::processKillNode(const QByteArray& dataByteArray) {
@@ -681,6 +720,7 @@ SharedNodePointer NodeList::addOrUpdateNode(const QUuid& uuid, char nodeType,
         SharedNodePointer newNodeSharedPointer(newNode, &QObject::deleteLater);
         
         _nodeHash.insert(newNode->getUUID(), newNodeSharedPointer);
+        publishNodeHash();
         
         _nodeHashMutex.unlock();
         
@@ -21,13 +21,16 @@
 #include <unistd.h> // not on windows, not needed for mac or windows
 #endif
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QMutex>
 #include <QtCore/QSet>
 #include <QtCore/QSettings>
 #include <QtCore/QSharedPointer>
+#include <QtCore/QThreadStorage>
 #include <QtNetwork/QHostAddress>
 #include <QtNetwork/QUdpSocket>
 
+#include "BatchedDatagramSocket.h"
 #include "Node.h"
 
 const quint64 NODE_SILENCE_THRESHOLD_USECS = 2 * 1000 * 1000;
@@ -52,6 +55,15 @@ typedef QSharedPointer<Node> SharedNodePointer;
 typedef QHash<QUuid, SharedNodePointer> NodeHash;
 Q_DECLARE_METATYPE(SharedNodePointer)
 
+/// One thread's copy of the node hash, and the version of the hash it was copied from.
+class NodeHashSnapshot {
+public:
+    NodeHashSnapshot() : version(-1) { }
+    
+    NodeHash hash;
+    int version;
+};
+
 typedef quint8 PingType_t;
 namespace PingType {
     const PingType_t Agnostic = 0;
@@ -81,6 +93,7 @@ public:
     void setSessionUUID(const QUuid& sessionUUID);
 
     QUdpSocket& getNodeSocket() { return _nodeSocket; }
+    BatchedDatagramSocket& getBatchedSocket() { return _batchedSocket; }
     
     bool packetVersionAndHashMatch(const QByteArray& packet);
     
@@ -89,8 +102,15 @@ public:
     qint64 writeDatagram(const char* data, qint64 size, const SharedNodePointer& destinationNode,
                          const HifiSockAddr& overridenSockAddr = HifiSockAddr());
 
+    /// Like writeDatagram(), but the datagram goes out with the rest of the batch on the next flushQueuedDatagrams().
+    /// Only for the thread that owns the NodeList.
+    qint64 queueDatagram(const char* data, qint64 size, const SharedNodePointer& destinationNode);
+    int flushQueuedDatagrams() { return _batchedSocket.flush(); }
+
     void(*linkedDataCreateCallback)(Node *);
 
+    /// \return a snapshot of the nodes, which doesn't lock anything unless a node was added or killed since this thread
+    /// last asked for one
     NodeHash getNodeHash();
     int size() const { return _nodeHash.size(); }
 
@@ -150,12 +170,20 @@ private:
     void processSTUNResponse(const QByteArray& packet);
 
     NodeHash::iterator killNodeAtHashIterator(NodeHash::iterator& nodeItemToKill);
+    
+    const NodeHash& currentNodeHash();
+    void publishNodeHash() { _nodeHashVersion.fetchAndAddRelease(1); }
 
+    // writers change _nodeHash under the mutex and then publish it by bumping the version, readers copy it only when
+    // the version has moved on from their snapshot, and a copy is cheap as QHash shares its data until the next write
     NodeHash _nodeHash;
     QMutex _nodeHashMutex;
+    QAtomicInt _nodeHashVersion;
+    QThreadStorage<NodeHashSnapshot> _nodeHashSnapshots;
     QString _domainHostname;
     HifiSockAddr _domainSockAddr;
     QUdpSocket _nodeSocket;
+    BatchedDatagramSocket _batchedSocket;
     NodeType_t _ownerType;
     NodeSet _nodeTypesOfInterest;
     QUuid _sessionUUID;
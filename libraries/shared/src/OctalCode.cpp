@@ -204,6 +204,35 @@ OctalCodeComparison compareOctalCodes(const unsigned char* codeA, const unsigned
 }
 
 
+int numberOfCommonThreeBitSections(const unsigned char* codeA, const unsigned char* codeB) {
+    int sections = std::min(numberOfThreeBitSectionsInCode(codeA), numberOfThreeBitSectionsInCode(codeB));
+    for (int section = 0; section < sections; section++) {
+        if (getOctalCodeSectionValue(codeA, section) != getOctalCodeSectionValue(codeB, section)) {
+            return section;
+        }
+    }
+    return sections;
+}
+
+OctalCodeComparison compareOctalCodesDepthFirst(const unsigned char* codeA, const unsigned char* codeB) {
+    if (!codeA || !codeB) {
+        return ILLEGAL_CODE;
+    }
+    int codeLengthA = numberOfThreeBitSectionsInCode(codeA);
+    int codeLengthB = numberOfThreeBitSectionsInCode(codeB);
+    int commonSections = numberOfCommonThreeBitSections(codeA, codeB);
+
+    // if one code is the start of the other, it's the ancestor and comes first
+    if (commonSections == codeLengthA) {
+        return (codeLengthA == codeLengthB) ? EXACT_MATCH : LESS_THAN;
+    }
+    if (commonSections == codeLengthB) {
+        return GREATER_THAN;
+    }
+    return (getOctalCodeSectionValue(codeA, commonSections) < getOctalCodeSectionValue(codeB, commonSections)) ?
+        LESS_THAN : GREATER_THAN;
+}
+
 char getOctalCodeSectionValue(const unsigned char* octalCode, int section) {
     int startAtByte = 1 + (BITS_IN_OCTAL * section / BITS_IN_BYTE);
     char startIndexInByte = (BITS_IN_OCTAL * section) % BITS_IN_BYTE;
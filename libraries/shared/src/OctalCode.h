@@ -23,6 +23,8 @@ void printOctalCode(const unsigned char* octalCode);
 int bytesRequiredForCodeLength(unsigned char threeBitCodes);
 int branchIndexWithDescendant(const unsigned char* ancestorOctalCode, const unsigned char* descendantOctalCode);
 unsigned char* childOctalCode(const unsigned char* parentOctalCode, char childNumber);
+/// \return the child index (0 to 7) the code takes at the section's depth, sections counting from the root's children
+char getOctalCodeSectionValue(const unsigned char* octalCode, int section);
 
 const int OVERFLOWED_OCTCODE_BUFFER = -1;
 const int UNKNOWN_OCTCODE_LENGTH = -2;
@@ -59,6 +61,13 @@ typedef enum {
 
 OctalCodeComparison compareOctalCodes(const unsigned char* code1, const unsigned char* code2);
 
+/// \return the number of leading sections the two codes share, which is the depth of their deepest common ancestor
+int numberOfCommonThreeBitSections(const unsigned char* codeA, const unsigned char* codeB);
+
+/// Orders codes the way a depth first traversal reaches them, an ancestor before its descendants and all of a code's
+/// descendants before the next code that isn't one of them.
+OctalCodeComparison compareOctalCodesDepthFirst(const unsigned char* codeA, const unsigned char* codeB);
+
 QString octalCodeToHexString(const unsigned char* octalCode);
 unsigned char* hexStringToOctalCode(const QString& input);
 
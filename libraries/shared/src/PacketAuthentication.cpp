@@ -0,0 +1,97 @@
+//
+//  PacketAuthentication.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Keyed MAC that authenticates packets between nodes that share a connection secret
+//
+
+#include <QtCore/QByteArray>
+#include <QtCore/QtEndian>
+
+#include "PacketAuthentication.h"
+
+static inline quint64 rotateLeft(quint64 value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline void sipRound(quint64& v0, quint64& v1, quint64& v2, quint64& v3) {
+    v0 += v1;
+    v1 = rotateLeft(v1, 13);
+    v1 ^= v0;
+    v0 = rotateLeft(v0, 32);
+    v2 += v3;
+    v3 = rotateLeft(v3, 16);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotateLeft(v3, 21);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotateLeft(v1, 17);
+    v1 ^= v2;
+    v2 = rotateLeft(v2, 32);
+}
+
+PacketAuthenticationKey::PacketAuthenticationKey(const QUuid& connectionSecret) {
+    QByteArray keyBytes = connectionSecret.toRfc4122();
+    const uchar* key = reinterpret_cast<const uchar*>(keyBytes.constData());
+    quint64 k0 = qFromLittleEndian<quint64>(key);
+    quint64 k1 = qFromLittleEndian<quint64>(key + sizeof(quint64));
+
+    _v0 = k0 ^ Q_UINT64_C(0x736f6d6570736575);
+    _v1 = k1 ^ Q_UINT64_C(0x646f72616e646f6d) ^ 0xee; // 0xee selects the 128 bit output
+    _v2 = k0 ^ Q_UINT64_C(0x6c7967656e657261);
+    _v3 = k1 ^ Q_UINT64_C(0x7465646279746573);
+}
+
+void PacketAuthenticationKey::computeMAC(const char* data, int size, char* mac) const {
+    quint64 v0 = _v0;
+    quint64 v1 = _v1;
+    quint64 v2 = _v2;
+    quint64 v3 = _v3;
+
+    const uchar* position = reinterpret_cast<const uchar*>(data);
+    const uchar* wholeWordsEnd = position + (size - size % sizeof(quint64));
+    for (; position != wholeWordsEnd; position += sizeof(quint64)) {
+        quint64 word = qFromLittleEndian<quint64>(position);
+        v3 ^= word;
+        sipRound(v0, v1, v2, v3);
+        sipRound(v0, v1, v2, v3);
+        v0 ^= word;
+    }
+
+    // the last word holds whatever bytes are left, and the low byte of the size
+    quint64 lastWord = ((quint64) size) << 56;
+    for (int i = size % sizeof(quint64) - 1; i >= 0; i--) {
+        lastWord |= ((quint64) position[i]) << (8 * i);
+    }
+    v3 ^= lastWord;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= lastWord;
+
+    v2 ^= 0xee;
+    for (int i = 0; i < 4; i++) {
+        sipRound(v0, v1, v2, v3);
+    }
+    qToLittleEndian<quint64>(v0 ^ v1 ^ v2 ^ v3, reinterpret_cast<uchar*>(mac));
+
+    v1 ^= 0xdd;
+    for (int i = 0; i < 4; i++) {
+        sipRound(v0, v1, v2, v3);
+    }
+    qToLittleEndian<quint64>(v0 ^ v1 ^ v2 ^ v3, reinterpret_cast<uchar*>(mac + sizeof(quint64)));
+}
+
+bool PacketAuthenticationKey::macMatches(const char* data, int size, const char* mac) const {
+    char expectedMAC[NUM_BYTES_PACKET_MAC];
+    computeMAC(data, size, expectedMAC);
+
+    // look at every byte no matter where the first difference is, so the timing doesn't give the MAC away
+    char difference = 0;
+    for (int i = 0; i < NUM_BYTES_PACKET_MAC; i++) {
+        difference |= expectedMAC[i] ^ mac[i];
+    }
+    return difference == 0;
+}
@@ -0,0 +1,37 @@
+//
+//  PacketAuthentication.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Keyed MAC that authenticates packets between nodes that share a connection secret
+//
+
+#ifndef __hifi__PacketAuthentication__
+#define __hifi__PacketAuthentication__
+
+#include <QtCore/QUuid>
+
+const int NUM_BYTES_PACKET_MAC = 16;
+
+/// The SipHash-2-4 key state for one connection secret, the 128 bit output variant. Nodes keep one for their connection
+/// secret so that authenticating a packet is a single pass over its payload, in place, without allocating anything.
+class PacketAuthenticationKey {
+public:
+    PacketAuthenticationKey(const QUuid& connectionSecret = QUuid());
+
+    /// Writes the NUM_BYTES_PACKET_MAC byte MAC of the size bytes at data to mac.
+    void computeMAC(const char* data, int size, char* mac) const;
+
+    /// \return true if mac holds the MAC of the size bytes at data
+    bool macMatches(const char* data, int size, const char* mac) const;
+
+private:
+    // the state after the key has been mixed in, which is all a MAC needs from the key
+    quint64 _v0;
+    quint64 _v1;
+    quint64 _v2;
+    quint64 _v3;
+};
+
+#endif /* defined(__hifi__PacketAuthentication__) */
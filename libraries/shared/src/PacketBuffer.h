@@ -0,0 +1,61 @@
+//
+//  PacketBuffer.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Fixed size buffer a received packet is read into and handed over in
+//
+
+#ifndef __hifi__PacketBuffer__
+#define __hifi__PacketBuffer__
+
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QByteArray>
+
+#include "HifiSockAddr.h"
+#include "NodeList.h"
+#include "SharedUtil.h"
+
+/// Holds one packet of up to MAX_PACKET_SIZE bytes, along with the node it came from or is going to. Buffers are made
+/// once and passed between the threads that queue and the threads that process, so no packet needs memory of its own.
+class PacketBuffer {
+public:
+    PacketBuffer() : _size(0), _queuedAt(0), _nextInQueue(NULL), _isPooled(false) { }
+
+    char* getData() { return _data; }
+    const char* getData() const { return _data; }
+
+    int getSize() const { return _size; }
+    void setSize(int size) { _size = size; }
+
+    /// \return the packet without copying it, which is only valid until the buffer is given back, so it must not be
+    /// kept, or queued to another thread, past the handling of the packet
+    QByteArray getByteArray() const { return QByteArray::fromRawData(_data, _size); }
+
+    const SharedNodePointer& getSendingNode() const { return _sendingNode; }
+    void setSendingNode(const SharedNodePointer& sendingNode) { _sendingNode = sendingNode; }
+
+    const HifiSockAddr& getSenderSockAddr() const { return _senderSockAddr; }
+    HifiSockAddr& getSenderSockAddr() { return _senderSockAddr; }
+
+    /// \return the time the packet was pushed onto a PacketQueue
+    quint64 getQueuedAt() const { return _queuedAt; }
+
+private:
+    friend class PacketBufferPool;
+    friend class PacketQueue;
+
+    PacketBuffer(const PacketBuffer&); // not copyable, buffers are handed over by pointer
+    PacketBuffer& operator=(const PacketBuffer&);
+
+    char _data[MAX_PACKET_SIZE];
+    int _size;
+    SharedNodePointer _sendingNode;
+    HifiSockAddr _senderSockAddr;
+    quint64 _queuedAt;
+    QAtomicPointer<PacketBuffer> _nextInQueue;
+    bool _isPooled; // false for the buffers made when the pool had none to spare, which are deleted when released
+};
+
+#endif /* defined(__hifi__PacketBuffer__) */
@@ -0,0 +1,142 @@
+//
+//  PacketBufferPool.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Process wide pool of packet buffers that the packet queues take their buffers from
+//
+
+#include "PacketBufferPool.h"
+
+// the ring positions count up forever, so they're added and compared as unsigned values that are allowed to wrap
+static int wrappingAdd(int position, int amount) {
+    return (int)((unsigned int)position + (unsigned int)amount);
+}
+
+static int wrappingDifference(int first, int second) {
+    return (int)((unsigned int)first - (unsigned int)second);
+}
+
+PacketBufferPool& PacketBufferPool::getInstance() {
+    static PacketBufferPool* sharedInstance = new PacketBufferPool(MAX_POOLED_PACKET_BUFFERS);
+    return *sharedInstance;
+}
+
+PacketBufferPool::PacketBufferPool(int maxBuffers) :
+    _maxBuffers(maxBuffers),
+    _cellMask(0),
+    _freeCells(NULL),
+    _pushPosition(0),
+    _popPosition(0),
+    _numAllocated(0),
+    _numInUse(0),
+    _numFailedAcquires(0),
+    _numOverflowAllocations(0)
+{
+    int numCells = 1;
+    while (numCells < maxBuffers) {
+        numCells <<= 1;
+    }
+    _cellMask = numCells - 1;
+    _freeCells = new FreeCell[numCells];
+    for (int i = 0; i < numCells; i++) {
+        _freeCells[i].sequence.store(i);
+        _freeCells[i].buffer = NULL;
+    }
+}
+
+PacketBufferPool::~PacketBufferPool() {
+    // buffers still in use belong to whoever has them
+    PacketBuffer* buffer;
+    while ((buffer = popFree())) {
+        delete buffer;
+    }
+    delete[] _freeCells;
+}
+
+PacketBuffer* PacketBufferPool::acquire() {
+    PacketBuffer* buffer = popFree();
+    if (!buffer) {
+        if (_numAllocated.fetchAndAddOrdered(1) < _maxBuffers) {
+            buffer = new PacketBuffer();
+            buffer->_isPooled = true;
+        } else {
+            _numAllocated.fetchAndAddOrdered(-1);
+            _numFailedAcquires.ref();
+            return NULL;
+        }
+    }
+    _numInUse.ref();
+    return buffer;
+}
+
+PacketBuffer* PacketBufferPool::acquireOrAllocate() {
+    PacketBuffer* buffer = acquire();
+    if (!buffer) {
+        buffer = new PacketBuffer();
+        _numOverflowAllocations.ref();
+        _numInUse.ref();
+    }
+    return buffer;
+}
+
+void PacketBufferPool::release(PacketBuffer* buffer) {
+    _numInUse.deref();
+    if (!buffer->_isPooled) {
+        delete buffer;
+        return;
+    }
+    buffer->setSendingNode(SharedNodePointer());
+    buffer->setSize(0);
+    pushFree(buffer);
+}
+
+void PacketBufferPool::pushFree(PacketBuffer* buffer) {
+    FreeCell* cell;
+    int position = _pushPosition.load();
+    while (true) {
+        cell = &_freeCells[position & _cellMask];
+        int difference = wrappingDifference(cell->sequence.loadAcquire(), position);
+        if (difference == 0) {
+            // the cell is empty and it's our turn, claim it
+            if (_pushPosition.testAndSetRelaxed(position, wrappingAdd(position, 1))) {
+                break;
+            }
+            position = _pushPosition.load();
+        } else if (difference < 0) {
+            // there are at least as many cells as buffers, so the ring is never really full: the cell's last buffer
+            // has been claimed by a pop that hasn't freed the cell yet, so wait for it rather than lose this buffer
+            position = _pushPosition.load();
+        } else {
+            position = _pushPosition.load(); // another thread claimed it first
+        }
+    }
+    cell->buffer = buffer;
+    cell->sequence.storeRelease(wrappingAdd(position, 1));
+}
+
+PacketBuffer* PacketBufferPool::popFree() {
+    FreeCell* cell;
+    int position = _popPosition.load();
+    while (true) {
+        cell = &_freeCells[position & _cellMask];
+        int difference = wrappingDifference(cell->sequence.loadAcquire(), wrappingAdd(position, 1));
+        if (difference == 0) {
+            // the cell has been filled for this position, claim it
+            if (_popPosition.testAndSetRelaxed(position, wrappingAdd(position, 1))) {
+                break;
+            }
+            position = _popPosition.load();
+        } else if (difference < 0) {
+            return NULL; // the ring is empty
+        } else {
+            position = _popPosition.load(); // another thread claimed it first
+        }
+    }
+    PacketBuffer* buffer = cell->buffer;
+
+    // the cell is free for the push one lap later
+    cell->sequence.storeRelease(wrappingAdd(position, _cellMask + 1));
+    return buffer;
+}
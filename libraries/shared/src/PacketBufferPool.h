@@ -0,0 +1,79 @@
+//
+//  PacketBufferPool.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Process wide pool of packet buffers that the packet queues take their buffers from
+//
+
+#ifndef __hifi__PacketBufferPool__
+#define __hifi__PacketBufferPool__
+
+#include <QtCore/QAtomicInt>
+
+#include "PacketBuffer.h"
+
+// the most packet buffers the shared pool makes, past this queueing a packet drops it
+const int MAX_POOLED_PACKET_BUFFERS = 16384;
+
+/// Hands out packet buffers to any thread and takes them back from any thread without locking. Buffers are only made
+/// the first time there is no free one, up to a fixed number, and are never freed, so a process that doesn't queue
+/// many packets doesn't pay for the buffers a busy server needs. The free buffers are kept in a bounded
+/// multi-producer, multi-consumer ring, which unlike a linked free list can't be fooled by a buffer being taken and
+/// given back between another thread's read and swap.
+class PacketBufferPool {
+public:
+    /// \return the pool the packet queues share, which is never destroyed so threads that are still shutting down can
+    /// give their buffers back
+    static PacketBufferPool& getInstance();
+
+    PacketBufferPool(int maxBuffers);
+    ~PacketBufferPool();
+
+    /// \return an empty buffer, or NULL if the pool has made every buffer it may and all of them are in use
+    PacketBuffer* acquire();
+
+    /// \return an empty buffer, which is made on its own outside of the pool if the pool has none to spare, for
+    /// packets that mustn't be dropped
+    PacketBuffer* acquireOrAllocate();
+
+    /// Gives back a buffer from acquire() or acquireOrAllocate(), letting go of its node.
+    void release(PacketBuffer* buffer);
+
+    int getMaxBuffers() const { return _maxBuffers; }
+    int getNumAllocated() const { return _numAllocated.load(); }
+    int getNumInUse() const { return _numInUse.load(); }
+
+    /// \return the number of times acquire() had nothing to hand out
+    int getNumFailedAcquires() const { return _numFailedAcquires.load(); }
+
+    /// \return the number of buffers acquireOrAllocate() had to make outside of the pool
+    int getNumOverflowAllocations() const { return _numOverflowAllocations.load(); }
+
+private:
+    PacketBufferPool(const PacketBufferPool&); // not copyable, it owns its buffers
+    PacketBufferPool& operator=(const PacketBufferPool&);
+
+    class FreeCell {
+    public:
+        QAtomicInt sequence;
+        PacketBuffer* buffer;
+    };
+
+    void pushFree(PacketBuffer* buffer);
+    PacketBuffer* popFree();
+
+    int _maxBuffers;
+    int _cellMask; // the number of cells is a power of two at least as big as _maxBuffers
+    FreeCell* _freeCells;
+    QAtomicInt _pushPosition;
+    QAtomicInt _popPosition;
+
+    QAtomicInt _numAllocated;
+    QAtomicInt _numInUse;
+    QAtomicInt _numFailedAcquires;
+    QAtomicInt _numOverflowAllocations;
+};
+
+#endif /* defined(__hifi__PacketBufferPool__) */
@@ -9,6 +9,7 @@
 #include <math.h>
 
 #include <QtCore/QDebug>
+#include <QtCore/QtEndian>
 
 #include "NodeList.h"
 
@@ -45,7 +46,7 @@ int packArithmeticallyCodedValue(int value, char* destination) {
 PacketVersion versionForPacketType(PacketType type) {
     switch (type) {
         case PacketTypeParticleData:
-            return 1;
+            return 2;
         case PacketTypeDomainList:
         case PacketTypeDomainListRequest:
             return 1;
@@ -59,9 +60,30 @@ PacketVersion versionForPacketType(PacketType type) {
             return 1;
         case PacketTypeVoxelSet:
         case PacketTypeVoxelSetDestructive:
+            return 2;
+        case PacketTypeUnknown:
+        case PacketTypeStunResponse:
+            return 0;
+        default:
+            // the verified types, up one from 0 for the SipHash MAC
             return 1;
+    }
+}
+
+bool isVerifiedPacketType(PacketType type) {
+    switch (type) {
+        case PacketTypeDomainList:
+        case PacketTypeDomainListRequest:
+        case PacketTypeStunResponse:
+        case PacketTypeDataServerConfirm:
+        case PacketTypeDataServerGet:
+        case PacketTypeDataServerPut:
+        case PacketTypeDataServerSend:
+        case PacketTypeCreateAssignment:
+        case PacketTypeRequestAssignment:
+            return false;
         default:
-            return 0;
+            return true;
     }
 }
 
@@ -91,9 +113,9 @@ int populatePacketHeader(char* packet, PacketType type, const QUuid& connectionU
     memcpy(position, rfcUUID.constData(), NUM_BYTES_RFC4122_UUID);
     position += NUM_BYTES_RFC4122_UUID;
     
-    // pack 16 bytes of zeros where the md5 hash will be placed one data is packed
-    memset(position, 0, NUM_BYTES_MD5_HASH);
-    position += NUM_BYTES_MD5_HASH;
+    // pack 16 bytes of zeros where the MAC will be placed once data is packed
+    memset(position, 0, NUM_BYTES_PACKET_MAC);
+    position += NUM_BYTES_PACKET_MAC;
     
     // return the number of bytes written for pointer pushing
     return position - packet;
@@ -114,22 +136,47 @@ int numBytesForPacketHeaderGivenPacketType(PacketType type) {
 }
 
 QUuid uuidFromPacketHeader(const QByteArray& packet) {
-    return QUuid::fromRfc4122(packet.mid(numBytesArithmeticCodingFromBuffer(packet.data()) + sizeof(PacketVersion),
-                                         NUM_BYTES_RFC4122_UUID));
+    int uuidOffset = numBytesArithmeticCodingFromBuffer(packet.constData()) + sizeof(PacketVersion);
+    if (packet.size() < uuidOffset + NUM_BYTES_RFC4122_UUID) {
+        return QUuid();
+    }
+
+    // the same as QUuid::fromRfc4122(), straight from the packet instead of a copy of the UUID's bytes
+    const uchar* rfcUUID = reinterpret_cast<const uchar*>(packet.constData()) + uuidOffset;
+    return QUuid(qFromBigEndian<quint32>(rfcUUID), qFromBigEndian<quint16>(rfcUUID + 4),
+                 qFromBigEndian<quint16>(rfcUUID + 6), rfcUUID[8], rfcUUID[9], rfcUUID[10], rfcUUID[11],
+                 rfcUUID[12], rfcUUID[13], rfcUUID[14], rfcUUID[15]);
 }
 
 QByteArray hashFromPacketHeader(const QByteArray& packet) {
-    return packet.mid(numBytesForPacketHeader(packet) - NUM_BYTES_MD5_HASH, NUM_BYTES_MD5_HASH);
+    return packet.mid(numBytesForPacketHeader(packet) - NUM_BYTES_PACKET_MAC, NUM_BYTES_PACKET_MAC);
 }
 
 QByteArray hashForPacketAndConnectionUUID(const QByteArray& packet, const QUuid& connectionUUID) {
-    return QCryptographicHash::hash(packet.mid(numBytesForPacketHeader(packet)) + connectionUUID.toRfc4122(),
-                                    QCryptographicHash::Md5);
+    QByteArray hash(NUM_BYTES_PACKET_MAC, 0);
+    int numBytesPacketHeader = numBytesForPacketHeader(packet);
+    PacketAuthenticationKey(connectionUUID).computeMAC(packet.constData() + numBytesPacketHeader,
+                                                       packet.size() - numBytesPacketHeader, hash.data());
+    return hash;
 }
 
 void replaceHashInPacketGivenConnectionUUID(QByteArray& packet, const QUuid& connectionUUID) {
-    packet.replace(numBytesForPacketHeader(packet) - NUM_BYTES_MD5_HASH, NUM_BYTES_MD5_HASH,
-                   hashForPacketAndConnectionUUID(packet, connectionUUID));
+    replaceHashInPacket(packet.data(), packet.size(), PacketAuthenticationKey(connectionUUID));
+}
+
+void replaceHashInPacket(char* packet, int packetSize, const PacketAuthenticationKey& key) {
+    int numBytesPacketHeader = numBytesForPacketHeader(packet);
+    key.computeMAC(packet + numBytesPacketHeader, packetSize - numBytesPacketHeader,
+                   packet + numBytesPacketHeader - NUM_BYTES_PACKET_MAC);
+}
+
+bool packetHashMatches(const char* packet, int packetSize, const PacketAuthenticationKey& key) {
+    int numBytesPacketHeader = numBytesForPacketHeader(packet);
+    if (packetSize < numBytesPacketHeader) {
+        return false;
+    }
+    return key.macMatches(packet + numBytesPacketHeader, packetSize - numBytesPacketHeader,
+                          packet + numBytesPacketHeader - NUM_BYTES_PACKET_MAC);
 }
 
 PacketType packetTypeForPacket(const QByteArray& packet) {
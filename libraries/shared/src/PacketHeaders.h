@@ -12,9 +12,9 @@
 #ifndef hifi_PacketHeaders_h
 #define hifi_PacketHeaders_h
 
-#include <QtCore/QCryptographicHash>
 #include <QtCore/QUuid>
 
+#include "PacketAuthentication.h"
 #include "UUID.h"
 
 enum PacketType {
@@ -58,12 +58,14 @@ enum PacketType {
 
 typedef char PacketVersion;
 
-const int NUM_BYTES_MD5_HASH = 16;
-const int NUM_STATIC_HEADER_BYTES = sizeof(PacketVersion) + NUM_BYTES_RFC4122_UUID + NUM_BYTES_MD5_HASH;
+const int NUM_STATIC_HEADER_BYTES = sizeof(PacketVersion) + NUM_BYTES_RFC4122_UUID + NUM_BYTES_PACKET_MAC;
 const int MAX_PACKET_HEADER_BYTES = sizeof(PacketType) + NUM_STATIC_HEADER_BYTES;
 
 PacketVersion versionForPacketType(PacketType type);
 
+/// false for the packet types that are sent before the sender has a connection secret, and so carry no MAC
+bool isVerifiedPacketType(PacketType type);
+
 const QUuid nullUUID = QUuid();
 
 QByteArray byteArrayWithPopluatedHeader(PacketType type, const QUuid& connectionUUID = nullUUID);
@@ -80,6 +82,12 @@ QByteArray hashFromPacketHeader(const QByteArray& packet);
 QByteArray hashForPacketAndConnectionUUID(const QByteArray& packet, const QUuid& connectionUUID);
 void replaceHashInPacketGivenConnectionUUID(QByteArray& packet, const QUuid& connectionUUID);
 
+/// writes the MAC of the packet's payload into its header, in place
+void replaceHashInPacket(char* packet, int packetSize, const PacketAuthenticationKey& key);
+
+/// \return true if the MAC in the packet's header is the MAC of its payload
+bool packetHashMatches(const char* packet, int packetSize, const PacketAuthenticationKey& key);
+
 PacketType packetTypeForPacket(const QByteArray& packet);
 PacketType packetTypeForPacket(const char* packet);
 
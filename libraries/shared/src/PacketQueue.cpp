@@ -0,0 +1,127 @@
+//
+//  PacketQueue.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Lock-free multiple producer, single consumer queue of pooled packet buffers
+//
+
+#include <cstring>
+
+#include <QtCore/QDebug>
+
+#include "PacketBufferPool.h"
+#include "SharedUtil.h"
+
+#include "PacketQueue.h"
+
+PacketQueue::PacketQueue(bool dropsWhenPoolIsEmpty) :
+    _dropsWhenPoolIsEmpty(dropsWhenPoolIsEmpty),
+    _stub(),
+    _head(&_stub),
+    _tail(&_stub),
+    _size(0),
+    _droppedPackets(0),
+    _overflowPackets(0),
+    _waitStatsResetRequested(0),
+    _totalTakenPackets(0),
+    _totalWaitTime(0),
+    _maxWaitTime(0)
+{
+}
+
+PacketQueue::~PacketQueue() {
+    PacketBuffer* buffer;
+    while ((buffer = pop())) {
+        PacketBufferPool::getInstance().release(buffer);
+    }
+}
+
+bool PacketQueue::queuePacket(const SharedNodePointer& node, const char* data, int size) {
+    if (size > MAX_PACKET_SIZE) {
+        qDebug() << "Dropping a packet of" << size << "bytes, which doesn't fit in a packet buffer.";
+        _droppedPackets.ref();
+        return false;
+    }
+    PacketBufferPool& pool = PacketBufferPool::getInstance();
+    PacketBuffer* buffer = pool.acquire();
+    if (!buffer) {
+        if (_dropsWhenPoolIsEmpty) {
+            _droppedPackets.ref();
+            return false;
+        }
+        buffer = pool.acquireOrAllocate();
+        _overflowPackets.ref();
+    }
+    memcpy(buffer->getData(), data, size);
+    buffer->setSize(size);
+    buffer->setSendingNode(node);
+    buffer->_queuedAt = usecTimestampNow();
+
+    // counted before it can be taken, so the size never dips below zero
+    _size.ref();
+    push(buffer);
+    return true;
+}
+
+PacketBuffer* PacketQueue::takePacket() {
+    if (_waitStatsResetRequested.load() && _waitStatsResetRequested.testAndSetOrdered(1, 0)) {
+        _totalTakenPackets = 0;
+        _totalWaitTime = 0;
+        _maxWaitTime = 0;
+    }
+    PacketBuffer* buffer = pop();
+    if (buffer) {
+        _size.deref();
+        quint64 waitTime = usecTimestampNow() - buffer->_queuedAt;
+        _totalTakenPackets++;
+        _totalWaitTime += waitTime;
+        if (waitTime > _maxWaitTime) {
+            _maxWaitTime = waitTime;
+        }
+    }
+    return buffer;
+}
+
+void PacketQueue::releasePacket(PacketBuffer* buffer) {
+    PacketBufferPool::getInstance().release(buffer);
+}
+
+void PacketQueue::push(PacketBuffer* buffer) {
+    buffer->_nextInQueue.store(NULL);
+    PacketBuffer* previous = _head.fetchAndStoreOrdered(buffer);
+
+    // between the swap and this store the consumer can't get past previous, it sees the queue as empty until then
+    previous->_nextInQueue.storeRelease(buffer);
+}
+
+PacketBuffer* PacketQueue::pop() {
+    PacketBuffer* tail = _tail;
+    PacketBuffer* next = tail->_nextInQueue.loadAcquire();
+    if (tail == &_stub) {
+        if (!next) {
+            return NULL;
+        }
+        // step past the stub
+        _tail = next;
+        tail = next;
+        next = next->_nextInQueue.loadAcquire();
+    }
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    if (tail != _head.loadAcquire()) {
+        return NULL; // a producer has swapped itself onto the head but not linked itself in yet
+    }
+
+    // the tail is the last packet, put the stub back behind it so that taking it doesn't leave the list empty
+    push(&_stub);
+    next = tail->_nextInQueue.loadAcquire();
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    return NULL;
+}
@@ -0,0 +1,90 @@
+//
+//  PacketQueue.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Lock-free multiple producer, single consumer queue of pooled packet buffers
+//
+
+#ifndef __hifi__PacketQueue__
+#define __hifi__PacketQueue__
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+
+#include "PacketBuffer.h"
+
+/// Queues packets from any number of threads for one thread to process, without locking. Queueing copies the packet
+/// into a buffer from the shared PacketBufferPool, and the buffers are linked through themselves, so a packet is
+/// copied once and nothing is allocated or shifted however deep the queue gets. A packet that doesn't fit in a buffer
+/// is dropped and counted, as is one that arrives when the pool has no buffer to spare, unless the queue is one that
+/// mustn't drop packets.
+class PacketQueue {
+public:
+    /// \param dropsWhenPoolIsEmpty false to give packets a buffer of their own when the pool has none to spare, rather
+    /// than dropping them, for queues of packets that the network hasn't already been free to lose
+    PacketQueue(bool dropsWhenPoolIsEmpty = true);
+
+    /// Gives back the buffers of any packets that are still queued. Only destroy the queue once nothing can push to it.
+    ~PacketQueue();
+
+    /// Copies a packet onto the end of the queue. Any thread.
+    /// \return false if the packet was dropped
+    bool queuePacket(const SharedNodePointer& node, const char* data, int size);
+
+    /// Takes the oldest packet off the queue. Consumer thread only. The buffer has to be given back with
+    /// releasePacket() once the packet has been handled.
+    /// \return the oldest packet, or NULL if there is none, or the one that is next is still being pushed
+    PacketBuffer* takePacket();
+
+    /// Gives a buffer from takePacket() back to the pool.
+    void releasePacket(PacketBuffer* buffer);
+
+    /// \return the number of queued packets, which can be out of date by the time it returns
+    int size() const { return _size.load(); }
+
+    /// \return the number of packets that were dropped rather than queued
+    int getDroppedPackets() const { return _droppedPackets.load(); }
+
+    /// \return the number of packets that were queued in buffers of their own because the pool had none to spare
+    int getOverflowPackets() const { return _overflowPackets.load(); }
+
+    /// \return the number of packets taken off the queue
+    quint64 getTotalTakenPackets() const { return _totalTakenPackets; }
+
+    /// \return the average time the taken packets spent in the queue
+    quint64 getAverageWaitTime() const { return _totalTakenPackets == 0 ? 0 : _totalWaitTime / _totalTakenPackets; }
+
+    /// \return the longest time a taken packet spent in the queue
+    quint64 getMaxWaitTime() const { return _maxWaitTime; }
+
+    /// Asks for the wait time statistics to start over. Any thread, the statistics belong to the consumer, which resets
+    /// them the next time it takes a packet.
+    void resetWaitStats() { _waitStatsResetRequested.store(1); }
+
+private:
+    PacketQueue(const PacketQueue&); // not copyable, it holds buffers from the pool
+    PacketQueue& operator=(const PacketQueue&);
+
+    void push(PacketBuffer* buffer);
+    PacketBuffer* pop();
+
+    // the producers swap themselves onto the head, the consumer follows the links from the tail. The stub keeps the
+    // list from ever being empty, so a push never has to touch the tail.
+    bool _dropsWhenPoolIsEmpty;
+    PacketBuffer _stub;
+    QAtomicPointer<PacketBuffer> _head;
+    PacketBuffer* _tail;
+    QAtomicInt _size;
+    QAtomicInt _droppedPackets;
+    QAtomicInt _overflowPackets;
+    QAtomicInt _waitStatsResetRequested;
+
+    // only written by the consumer
+    quint64 _totalTakenPackets;
+    quint64 _totalWaitTime;
+    quint64 _maxWaitTime;
+};
+
+#endif /* defined(__hifi__PacketQueue__) */
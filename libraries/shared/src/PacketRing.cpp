@@ -0,0 +1,66 @@
+//
+//  PacketRing.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Lock-free single producer, single consumer queue of received packet buffers
+//
+
+#include "PacketRing.h"
+
+PacketRing::PacketRing(int capacity) :
+    _numSlots(capacity + 1),
+    _slots(new PacketBuffer*[capacity + 1]),
+    _head(0),
+    _tail(0),
+    _wakePending(0),
+    _droppedPackets(0)
+{
+    for (int i = 0; i < _numSlots; i++) {
+        _slots[i] = new PacketBuffer();
+    }
+}
+
+PacketRing::~PacketRing() {
+    for (int i = 0; i < _numSlots; i++) {
+        delete _slots[i];
+    }
+    delete[] _slots;
+}
+
+PacketBuffer* PacketRing::push(PacketBuffer* filled) {
+    int head = _head.load();
+    int nextHead = nextSlot(head);
+    if (nextHead == _tail.loadAcquire()) {
+        _droppedPackets++;
+        return NULL;
+    }
+
+    // the slot at the head is outside of what the consumer can see, so its buffer is one the consumer is done with
+    PacketBuffer* empty = _slots[head];
+    _slots[head] = filled;
+    _head.storeRelease(nextHead);
+    return empty;
+}
+
+PacketBuffer* PacketRing::front() {
+    int tail = _tail.load();
+    return (tail == _head.loadAcquire()) ? NULL : _slots[tail];
+}
+
+void PacketRing::pop() {
+    int tail = _tail.load();
+    if (tail == _head.loadAcquire()) {
+        return;
+    }
+
+    // let go of the sending node here, rather than whenever the producer gets around to reusing the buffer
+    _slots[tail]->setSendingNode(SharedNodePointer());
+    _tail.storeRelease(nextSlot(tail));
+}
+
+int PacketRing::size() const {
+    int size = _head.loadAcquire() - _tail.loadAcquire();
+    return (size < 0) ? size + _numSlots : size;
+}
@@ -0,0 +1,69 @@
+//
+//  PacketRing.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Lock-free single producer, single consumer queue of received packet buffers
+//
+
+#ifndef __hifi__PacketRing__
+#define __hifi__PacketRing__
+
+#include <QtCore/QAtomicInt>
+
+#include "PacketBuffer.h"
+
+/// Hands packet buffers from one thread to one other thread without locking. The ring owns a buffer for every slot, and
+/// the producer keeps a spare buffer of its own that it reads the next packet into. Pushing swaps the filled spare into
+/// the ring and gives the producer back the buffer that was in the slot, which the consumer has finished with, so the
+/// packets themselves are never copied and nothing is allocated once the ring is made.
+class PacketRing {
+public:
+    /// \param capacity the most packets that can be waiting at once
+    PacketRing(int capacity);
+    ~PacketRing();
+
+    /// Queues a filled buffer. Producer thread only.
+    /// \return the empty buffer to read the next packet into, or NULL if the ring was full and the packet was dropped,
+    /// in which case filled still belongs to the caller
+    PacketBuffer* push(PacketBuffer* filled);
+
+    /// \return true if the consumer needs to be woken up for what was just pushed, which is the case for the first push
+    /// since the consumer last called startDraining(). Producer thread only.
+    bool shouldWakeConsumer() { return _wakePending.fetchAndStoreOrdered(1) == 0; }
+
+    /// Lets the producer wake the consumer again, call this before draining the ring. Consumer thread only.
+    void startDraining() { _wakePending.fetchAndStoreOrdered(0); }
+
+    /// \return the oldest waiting packet, or NULL if there is none. It stays valid until pop(). Consumer thread only.
+    PacketBuffer* front();
+
+    /// Gives the oldest waiting packet back to the producer. Consumer thread only.
+    void pop();
+
+    /// \return the number of waiting packets, which can be out of date by the time it returns on any other thread
+    int size() const;
+
+    int getCapacity() const { return _numSlots - 1; }
+
+    /// \return the number of packets dropped because the ring was full
+    int getDroppedPackets() const { return _droppedPackets; }
+
+private:
+    PacketRing(const PacketRing&); // not copyable, it owns its buffers
+    PacketRing& operator=(const PacketRing&);
+
+    int nextSlot(int slot) const { return (slot + 1 == _numSlots) ? 0 : slot + 1; }
+
+    // one slot more than the capacity, so that a full ring can be told apart from an empty one
+    int _numSlots;
+    PacketBuffer** _slots;
+
+    QAtomicInt _head; // the next slot the producer fills, only written by the producer
+    QAtomicInt _tail; // the oldest waiting packet, only written by the consumer
+    QAtomicInt _wakePending;
+    int _droppedPackets;
+};
+
+#endif /* defined(__hifi__PacketRing__) */
@@ -32,6 +32,7 @@ PacketSender::PacketSender(int packetsPerSecond) :
     _usecsPerProcessCallHint(0),
     _lastProcessCallTime(0),
     _averageProcessCallTime(AVERAGE_CALL_TIME_SAMPLES),
+    _packets(false), // edits that the caller has handed off are never dropped, see PacketQueue
     _lastSendTime(0), // Note: we set this to 0 to indicate we haven't yet sent something
     _lastPPSCheck(0),
     _packetsOverCheckInterval(0),
@@ -48,12 +49,14 @@ PacketSender::~PacketSender() {
 
 
 void PacketSender::queuePacketForSending(const SharedNodePointer& destinationNode, const QByteArray& packet) {
-    NetworkPacket networkPacket(destinationNode, packet);
-    lock();
-    _packets.push_back(networkPacket);
-    unlock();
-    _totalPacketsQueued++;
-    _totalBytesQueued += packet.size();
+    queuePacketForSending(destinationNode, packet.constData(), packet.size());
+}
+
+void PacketSender::queuePacketForSending(const SharedNodePointer& destinationNode, const char* data, int size) {
+    if (_packets.queuePacket(destinationNode, data, size)) {
+        _totalPacketsQueued++;
+        _totalBytesQueued += size;
+    }
 }
 
 void PacketSender::setPacketsPerSecond(int packetsPerSecond) {
@@ -77,7 +80,7 @@ bool PacketSender::threadedProcess() {
     }
 
     // in threaded mode, we keep running and just empty our packet queue sleeping enough to keep our PPS on target
-    while (_packets.size() > 0) {
+    while (hasPacketsToSend()) {
         // Recalculate our SEND_INTERVAL_USECS each time, in case the caller has changed it on us..
         int packetsPerSecondTarget = (_packetsPerSecond > MINIMUM_PACKETS_PER_SECOND)
                                             ? _packetsPerSecond : MINIMUM_PACKETS_PER_SECOND;
@@ -155,7 +158,7 @@ bool PacketSender::nonThreadedProcess() {
         averageCallTime = _usecsPerProcessCallHint;
     }
 
-    if (_packets.size() == 0) {
+    if (!hasPacketsToSend()) {
         // in non-threaded mode, if there's nothing to do, just return, keep running till they terminate us
         return isStillRunning();
     }
@@ -251,25 +254,18 @@ bool PacketSender::nonThreadedProcess() {
         }
     }
 
-    int packetsLeft = _packets.size();
-
     // Now that we know how many packets to send this call to process, just send them.
-    while ((packetsSentThisCall < packetsToSendThisCall) && (packetsLeft > 0)) {
-        lock();
-        NetworkPacket& packet = _packets.front();
-        NetworkPacket temporary = packet; // make a copy
-        _packets.erase(_packets.begin());
-        packetsLeft = _packets.size();
-        unlock();
-
-        // send the packet through the NodeList...
-        NodeList::getInstance()->writeDatagram(temporary.getByteArray(), temporary.getDestinationNode());
+    PacketBuffer* packet;
+    while ((packetsSentThisCall < packetsToSendThisCall) && (packet = _packets.takePacket())) {
+        // send the packet through the NodeList, straight from its pooled buffer...
+        NodeList::getInstance()->writeDatagram(packet->getData(), packet->getSize(), packet->getSendingNode());
         packetsSentThisCall++;
         _packetsOverCheckInterval++;
         _totalPacketsSent++;
-        _totalBytesSent += temporary.getByteArray().size();
+        _totalBytesSent += packet->getSize();
         
-        emit packetSent(temporary.getByteArray().size());
+        emit packetSent(packet->getSize());
+        _packets.releasePacket(packet);
         
         _lastSendTime = now;
     }
@@ -12,11 +12,13 @@
 #define __shared__PacketSender__
 
 #include "GenericThread.h"
-#include "NetworkPacket.h"
 #include "NodeList.h"
+#include "PacketQueue.h"
 #include "SharedUtil.h"
 
-/// Generalized threaded processor for queueing and sending of outbound packets.
+/// Generalized threaded processor for queueing and sending of outbound packets. Queued packets wait in a lock-free
+/// queue of pooled packet buffers, so any number of threads can queue without blocking each other or the sender. The
+/// queue is unbounded like it always was, when the shared pool runs out the packets get buffers of their own.
 class PacketSender : public GenericThread {
     Q_OBJECT
 public:
@@ -40,6 +42,10 @@ public:
     /// \thread any thread, typically the application thread
     void queuePacketForSending(const SharedNodePointer& destinationNode, const QByteArray& packet);
 
+    /// Add packet to outbound queue, copying it straight from data into a pooled packet buffer.
+    /// \thread any thread, typically the application thread
+    void queuePacketForSending(const SharedNodePointer& destinationNode, const char* data, int size);
+
     void setPacketsPerSecond(int packetsPerSecond);
     int getPacketsPerSecond() const { return _packetsPerSecond; }
 
@@ -51,6 +57,18 @@ public:
     /// how many packets are there in the send queue waiting to be sent
     int packetsToSendCount() const { return _packets.size(); }
 
+    /// how long the sent packets waited in the send queue, on average, in usecs
+    quint64 getAverageQueueWaitTime() const { return _packets.getAverageWaitTime(); }
+
+    /// the longest a sent packet waited in the send queue, in usecs
+    quint64 getMaxQueueWaitTime() const { return _packets.getMaxWaitTime(); }
+
+    /// how many packets were dropped because they were too big for a packet buffer
+    int getDroppedPackets() const { return _packets.getDroppedPackets(); }
+
+    /// how many packets were queued in buffers of their own because the shared pool had none to spare
+    int getOverflowPackets() const { return _packets.getOverflowPackets(); }
+
     /// If you're running in non-threaded mode, call this to give us a hint as to how frequently you will call process.
     /// This has no effect in threaded mode. This is only considered a hint in non-threaded mode.
     /// \param int usecsPerProcessCall expected number of usecs between calls to process in non-threaded mode.
@@ -98,7 +116,7 @@ protected:
     SimpleMovingAverage _averageProcessCallTime;
 
 private:
-    std::vector<NetworkPacket> _packets;
+    PacketQueue _packets;
     quint64 _lastSendTime;
 
     bool threadedProcess();
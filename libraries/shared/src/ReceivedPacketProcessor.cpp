@@ -20,10 +20,14 @@ void ReceivedPacketProcessor::queueReceivedPacket(const SharedNodePointer& desti
     // Make sure our Node and NodeList knows we've heard from this node.
     destinationNode->setLastHeardMicrostamp(usecTimestampNow());
 
-    NetworkPacket networkPacket(destinationNode, packet);
-    lock();
-    _packets.push_back(networkPacket);
-    unlock();
+    _packets.queuePacket(destinationNode, packet.constData(), packet.size());
+}
+
+void ReceivedPacketProcessor::takeQueuedPackets(std::vector<PacketBuffer*>& packets) {
+    PacketBuffer* packet;
+    while ((packet = _packets.takePacket())) {
+        packets.push_back(packet);
+    }
 }
 
 bool ReceivedPacketProcessor::process() {
@@ -31,17 +35,13 @@ bool ReceivedPacketProcessor::process() {
     // If a derived class handles process sleeping, like the JurisdiciontListener, then it can set
     // this _dontSleep member and we will honor that request.
     if (_packets.size() == 0 && !_dontSleep) {
-        const quint64 RECEIVED_THREAD_SLEEP_INTERVAL = (1000 * 1000)/60; // check at 60fps
         usleep(RECEIVED_THREAD_SLEEP_INTERVAL);
     }
-    while (_packets.size() > 0) {
-
-        lock(); // lock to make sure nothing changes on us
-        NetworkPacket& packet = _packets.front(); // get the oldest packet
-        NetworkPacket temporary = packet; // make a copy of the packet in case the vector is resized on us
-        _packets.erase(_packets.begin()); // remove the oldest packet
-        unlock(); // let others add to the packets
-        processPacket(temporary.getDestinationNode(), temporary.getByteArray()); // process our temporary copy
+    PacketBuffer* packet;
+    while ((packet = _packets.takePacket())) {
+        // the byte array is a view of the pooled buffer, which goes back to the pool once the packet is processed
+        processPacket(packet->getSendingNode(), packet->getByteArray());
+        _packets.releasePacket(packet);
     }
     return isStillRunning();  // keep running till they terminate us
 }
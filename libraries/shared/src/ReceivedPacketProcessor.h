@@ -11,10 +11,16 @@
 #ifndef __shared__ReceivedPacketProcessor__
 #define __shared__ReceivedPacketProcessor__
 
+#include <vector>
+
 #include "GenericThread.h"
-#include "NetworkPacket.h"
+#include "PacketQueue.h"
+
+const quint64 RECEIVED_THREAD_SLEEP_INTERVAL = (1000 * 1000)/60; // check at 60fps
 
-/// Generalized threaded processor for handling received inbound packets. 
+/// Generalized threaded processor for handling received inbound packets. Received packets wait in a lock-free queue
+/// of pooled packet buffers, so queueing never blocks the network receive thread and taking a packet costs the same
+/// however far behind processing has fallen.
 class ReceivedPacketProcessor : public GenericThread {
 public:
     ReceivedPacketProcessor();
@@ -27,10 +33,19 @@ public:
     void queueReceivedPacket(const SharedNodePointer& destinationNode, const QByteArray& packet);
 
     /// Are there received packets waiting to be processed
-    bool hasPacketsToProcess() const { return _packets.size() > 0; }
+    virtual bool hasPacketsToProcess() const { return _packets.size() > 0; }
 
     /// How many received packets waiting are to be processed
-    int packetsToProcessCount() const { return _packets.size(); }
+    virtual int packetsToProcessCount() const { return _packets.size(); }
+
+    /// How long the processed packets waited in the queue, on average, in usecs
+    quint64 getAverageQueueWaitTime() const { return _packets.getAverageWaitTime(); }
+
+    /// The longest a processed packet waited in the queue, in usecs
+    quint64 getMaxQueueWaitTime() const { return _packets.getMaxWaitTime(); }
+
+    /// How many received packets were dropped because no packet buffer was free
+    int getDroppedPackets() const { return _packets.getDroppedPackets(); }
 
 protected:
     /// Callback for processing of recieved packets. Implement this to process the incoming packets.
@@ -43,11 +58,22 @@ protected:
     /// Implements generic processing behavior for this thread.
     virtual bool process();
 
+    /// Moves every packet waiting to be processed onto the end of packets, oldest first, for processors that handle
+    /// them together instead of one at a time. Each one has to be given back with releasePacket() once it's handled.
+    void takeQueuedPackets(std::vector<PacketBuffer*>& packets);
+
+    /// Gives back a packet from takeQueuedPackets().
+    void releasePacket(PacketBuffer* packet) { _packets.releasePacket(packet); }
+
+    /// Starts the queue wait time statistics over, from any thread. The processing thread does it before it takes its
+    /// next packet.
+    void resetQueueWaitStats() { _packets.resetWaitStats(); }
+
     bool _dontSleep;
 
 private:
 
-    std::vector<NetworkPacket> _packets;
+    PacketQueue _packets;
 };
 
 #endif // __shared__PacketReceiver__
@@ -6,6 +6,8 @@
 //  Copyright (c) 2013 HighFidelity, Inc. All rights reserved.
 //
 
+#include <cstring>
+
 #include <QtCore/QCoreApplication>
 #include <QtCore/QTimer>
 
@@ -62,12 +64,12 @@ void ThreadedAssignment::checkInWithDomainServerOrExit() {
 }
 
 bool ThreadedAssignment::readAvailableDatagram(QByteArray& destinationByteArray, HifiSockAddr& senderSockAddr) {
-    NodeList* nodeList = NodeList::getInstance();
-    
-    if (nodeList->getNodeSocket().hasPendingDatagrams()) {
-        destinationByteArray.resize(nodeList->getNodeSocket().pendingDatagramSize());
-        nodeList->getNodeSocket().readDatagram(destinationByteArray.data(), destinationByteArray.size(),
-                                               senderSockAddr.getAddressPointer(), senderSockAddr.getPortPointer());
+    // the batched socket drains as many datagrams as it can per system call, and hands them out one at a time
+    const char* datagram;
+    int datagramSize;
+    if (NodeList::getInstance()->getBatchedSocket().nextDatagram(datagram, datagramSize, senderSockAddr)) {
+        destinationByteArray.resize(datagramSize);
+        memcpy(destinationByteArray.data(), datagram, datagramSize);
         return true;
     } else {
         return false;
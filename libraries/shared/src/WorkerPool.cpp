@@ -0,0 +1,117 @@
+//
+//  WorkerPool.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Pool of worker threads that a batch of independent jobs is spread across
+//
+
+#include <algorithm>
+
+#include <QtCore/QDebug>
+#include <QtCore/QThread>
+
+#include "WorkerPool.h"
+
+const unsigned long MAX_IDLE_WAIT_MSECS = 100; // so that the workers notice when they are terminated
+
+WorkerPoolThread::WorkerPoolThread(WorkerPool* pool) :
+    _pool(pool)
+{
+}
+
+bool WorkerPoolThread::process() {
+    return _pool->processNextJob() && isStillRunning();
+}
+
+WorkerPool::WorkerPool(int numberOfWorkers) :
+    _numberOfWorkers(numberOfWorkers),
+    _stopping(false),
+    _jobs(NULL),
+    _numberOfJobs(0),
+    _nextJob(0),
+    _jobsFinished(0)
+{
+    if (_numberOfWorkers < 0) {
+        _numberOfWorkers = std::max(0, QThread::idealThreadCount() - 1);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+void WorkerPool::start() {
+    _stopping = false;
+    for (int i = 0; i < _numberOfWorkers; i++) {
+        WorkerPoolThread* worker = new WorkerPoolThread(this);
+        worker->initialize(true);
+        _workers.append(worker);
+    }
+    qDebug("WorkerPool started with %d workers", _numberOfWorkers);
+}
+
+void WorkerPool::stop() {
+    _mutex.lock();
+    _stopping = true;
+    _jobsAvailable.wakeAll();
+    _mutex.unlock();
+
+    foreach (WorkerPoolThread* worker, _workers) {
+        worker->terminate();
+        worker->deleteLater();
+    }
+    _workers.clear();
+}
+
+void WorkerPool::runJobs(WorkerPoolJobs* jobs, int numberOfJobs) {
+    QMutexLocker locker(&_mutex);
+    _jobs = jobs;
+    _numberOfJobs = numberOfJobs;
+    _nextJob = 0;
+    _jobsFinished = 0;
+    _jobsAvailable.wakeAll();
+
+    // pitch in until the jobs have all been handed out
+    while (_nextJob < _numberOfJobs) {
+        int jobIndex = _nextJob++;
+        _mutex.unlock();
+        jobs->runJob(jobIndex);
+        _mutex.lock();
+        _jobsFinished++;
+    }
+
+    // then wait for the workers to finish theirs
+    while (_jobsFinished < _numberOfJobs) {
+        _jobsDone.wait(&_mutex);
+    }
+    _jobs = NULL;
+}
+
+bool WorkerPool::processNextJob() {
+    _mutex.lock();
+
+    if (_stopping) {
+        _mutex.unlock();
+        return false;
+    }
+
+    if (_nextJob >= _numberOfJobs) {
+        _jobsAvailable.wait(&_mutex, MAX_IDLE_WAIT_MSECS);
+        _mutex.unlock();
+        return true;
+    }
+
+    int jobIndex = _nextJob++;
+    WorkerPoolJobs* jobs = _jobs;
+    _mutex.unlock();
+
+    jobs->runJob(jobIndex);
+
+    QMutexLocker locker(&_mutex);
+    if (++_jobsFinished == _numberOfJobs) {
+        _jobsDone.wakeAll();
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+//
+//  WorkerPool.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  Pool of worker threads that a batch of independent jobs is spread across
+//
+
+#ifndef __hifi__WorkerPool__
+#define __hifi__WorkerPool__
+
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+#include "GenericThread.h"
+
+class WorkerPool;
+
+/// Runs one job of a batch at a time, for jobs by index. Called from any of the pool's threads at once, so the jobs of a
+/// batch must not change anything another job of the batch uses.
+class WorkerPoolJobs {
+public:
+    virtual ~WorkerPoolJobs() { }
+    virtual void runJob(int jobIndex) = 0;
+};
+
+/// Worker thread for the WorkerPool, runs jobs of the current batch until there are none left.
+class WorkerPoolThread : public GenericThread {
+public:
+    WorkerPoolThread(WorkerPool* pool);
+
+protected:
+    /// Implements generic processing behavior for this thread.
+    virtual bool process();
+
+private:
+    WorkerPool* _pool;
+};
+
+/// Splits a batch of jobs across a fixed size pool of worker threads. The thread that asks for the batch runs jobs as
+/// well, and gets control back once every job has run, so it can use the results itself.
+class WorkerPool {
+public:
+    /// \param int numberOfWorkers number of worker threads besides the caller's, if < 0 then
+    /// QThread::idealThreadCount() - 1 is used, 0 runs everything on the calling thread
+    WorkerPool(int numberOfWorkers = -1);
+    ~WorkerPool();
+
+    /// Starts the worker threads
+    void start();
+
+    /// Stops and deletes the worker threads
+    void stop();
+
+    /// Calls jobs->runJob() for jobs 0 through numberOfJobs - 1, returns once they have all returned.
+    void runJobs(WorkerPoolJobs* jobs, int numberOfJobs);
+
+    /// Called by the workers, waits for a job to run and runs it. Returns false if the pool is stopping.
+    bool processNextJob();
+
+    int getWorkerCount() const { return _workers.size(); }
+
+private:
+    QMutex _mutex;
+    QWaitCondition _jobsAvailable;
+    QWaitCondition _jobsDone;
+    QVector<WorkerPoolThread*> _workers;
+    int _numberOfWorkers;
+    bool _stopping;
+
+    // the current batch
+    WorkerPoolJobs* _jobs;
+    int _numberOfJobs;
+    int _nextJob;
+    int _jobsFinished;
+};
+
+#endif /* defined(__hifi__WorkerPool__) */
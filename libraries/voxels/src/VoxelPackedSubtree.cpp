@@ -0,0 +1,423 @@
+//
+//  VoxelPackedSubtree.cpp
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  A pointerless copy of the elements below a folded voxel tree element
+//
+
+#include <algorithm>
+#include <cstring>
+
+#include <OctreeConstants.h>
+
+#include "VoxelPackedSubtree.h"
+
+void VoxelPackedSubtree::appendNode(unsigned char childBitmask, const nodeColor& color) {
+    _nodes.push_back(childBitmask);
+    _nodes.insert(_nodes.end(), color, color + sizeof(nodeColor));
+}
+
+void VoxelPackedSubtree::appendSubtree(const VoxelPackedSubtree& subtree, const nodeColor& rootColor) {
+    int rootOffset = _nodes.size();
+    _nodes.insert(_nodes.end(), subtree._nodes.begin(), subtree._nodes.end());
+    memcpy(&_nodes[rootOffset + 1], rootColor, sizeof(nodeColor));
+}
+
+VoxelPackedSubtree* VoxelPackedSubtree::copySubtree(int index) const {
+    VoxelPackedSubtree* subtree = new VoxelPackedSubtree();
+    subtree->_nodes.assign(_nodes.begin() + index * BYTES_PER_NODE,
+                           _nodes.begin() + skipSubtree(index) * BYTES_PER_NODE);
+    return subtree;
+}
+
+int VoxelPackedSubtree::skipSubtree(int index) const {
+    // every node we pass adds its children to the nodes we still have to pass
+    int nodesLeft = 1;
+    while (nodesLeft > 0) {
+        nodesLeft += numberOfOnes(getChildBitmask(index)) - 1;
+        index++;
+    }
+    return index;
+}
+
+void VoxelPackedSubtree::findChildren(int index, int* childIndexes) const {
+    unsigned char childBitmask = getChildBitmask(index);
+    int nextIndex = index + 1;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (oneAtBit(childBitmask, i)) {
+            childIndexes[i] = nextIndex;
+            nextIndex = skipSubtree(nextIndex);
+        } else {
+            childIndexes[i] = -1;
+        }
+    }
+}
+
+float VoxelPackedSubtree::calculateDensity(int index) const {
+    float density;
+    calculateDensity(index, density);
+    return density;
+}
+
+int VoxelPackedSubtree::calculateDensity(int index, float& density) const {
+    unsigned char childBitmask = getChildBitmask(index);
+    if (childBitmask == 0) {
+        density = isColored(index) ? 1.0f : 0.0f;
+        return index + 1;
+    }
+    density = 0.0f;
+    int nextIndex = index + 1;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (oneAtBit(childBitmask, i)) {
+            float childDensity;
+            nextIndex = calculateDensity(nextIndex, childDensity);
+            density += childDensity;
+        }
+    }
+    density /= NUMBER_OF_CHILDREN;
+    return nextIndex;
+}
+
+int VoxelPackedSubtree::getMaxEncodedSize() const {
+    int maxSize = 0;
+    for (int index = 0; index < getNodeCount(); index++) {
+        unsigned char childBitmask = getChildBitmask(index);
+        if (childBitmask) {
+            // colored bits, exists in tree bits and exists in packet bits, then the colors
+            maxSize += 3 * sizeof(unsigned char) + numberOfOnes(childBitmask) * BYTES_PER_COLOR;
+        }
+    }
+    return maxSize;
+}
+
+AABox VoxelPackedSubtree::childBox(const AABox& box, int childIndex) {
+    float halfScale = box.getScale() / 2.0f;
+    glm::vec3 corner = box.getCorner();
+    if (childIndex & 4) {
+        corner.x += halfScale;
+    }
+    if (childIndex & 2) {
+        corner.y += halfScale;
+    }
+    if (childIndex & 1) {
+        corner.z += halfScale;
+    }
+    return AABox(corner, halfScale);
+}
+
+bool VoxelPackedSubtree::findRayIntersection(const AABox& rootBox, const glm::vec3& origin,
+                                             const glm::vec3& direction, float& distance, BoxFace& face) const {
+    bool found = false;
+    int childIndexes[NUMBER_OF_CHILDREN];
+    findChildren(0, childIndexes);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (childIndexes[i] >= 0) {
+            findRayIntersection(childIndexes[i], childBox(rootBox, i), origin, direction, found, distance, face);
+        }
+    }
+    return found;
+}
+
+void VoxelPackedSubtree::findRayIntersection(int index, const AABox& box, const glm::vec3& origin,
+                                             const glm::vec3& direction, bool& found, float& distance,
+                                             BoxFace& face) const {
+    float boxDistance;
+    BoxFace boxFace;
+    if (!box.findRayIntersection(origin, direction, boxDistance, boxFace)) {
+        return;
+    }
+    // nothing inside a box can be hit before the box itself
+    if (found && boxDistance >= distance) {
+        return;
+    }
+    unsigned char childBitmask = getChildBitmask(index);
+    if (childBitmask == 0) {
+        if (isColored(index)) {
+            found = true;
+            distance = boxDistance;
+            face = boxFace;
+        }
+        return;
+    }
+    int childIndexes[NUMBER_OF_CHILDREN];
+    findChildren(index, childIndexes);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (childIndexes[i] >= 0) {
+            findRayIntersection(childIndexes[i], childBox(box, i), origin, direction, found, distance, face);
+        }
+    }
+}
+
+int VoxelPackedSubtree::encodeChildren(const AABox& rootBox, int rootLevel, quint64 lastChanged,
+                                       OctreePacketData* packetData, EncodeBitstreamParams& params,
+                                       int currentEncodeLevel, const EncodeElementState& rootState,
+                                       bool& didntFit) const {
+    EncodeNode root;
+    root.index = 0;
+    root.box = rootBox;
+    root.box.scale(TREE_SCALE);
+    root.level = rootLevel;
+    root.state = rootState;
+
+    didntFit = false;
+    bool complete = false;
+    int bytesWritten = encodeLevel(root, lastChanged, packetData, params, currentEncodeLevel, didntFit, complete);
+    params.subtreeComplete = params.knownState && complete;
+    return bytesWritten;
+}
+
+// The checks Octree::encodeTreeBitstreamRecursion() makes before it writes an element's level, for a node that isn't
+// the root. Nodes we get here for always have children.
+int VoxelPackedSubtree::encodeNode(const EncodeNode& node, quint64 lastChanged, OctreePacketData* packetData,
+                                   EncodeBitstreamParams& params, int currentEncodeLevel, bool& didntFit,
+                                   bool& complete) const {
+    complete = false;
+
+    currentEncodeLevel++;
+    params.maxLevelReached = std::max(currentEncodeLevel, params.maxLevelReached);
+    if (currentEncodeLevel >= params.maxEncodeLevel) {
+        params.stopReason = EncodeBitstreamParams::TOO_DEEP;
+        return 0;
+    }
+
+    if (params.jurisdictionMap && JurisdictionMap::BELOW == params.jurisdictionMap->getArea(node.state.jurisdiction)) {
+        params.stopReason = EncodeBitstreamParams::OUT_OF_JURISDICTION;
+        return 0;
+    }
+
+    if (params.viewFrustum) {
+        float boundaryDistance = boundaryDistanceForRenderLevel(node.level + params.boundaryLevelAdjust,
+                                                                params.octreeElementSizeScale);
+        if (glm::distance(node.box.calcCenter(), params.viewFrustum->getPosition()) >= boundaryDistance) {
+            params.stopReason = EncodeBitstreamParams::LOD_SKIP;
+            return 0;
+        }
+        if (node.state.location == ViewFrustum::OUTSIDE) {
+            params.stopReason = EncodeBitstreamParams::OUT_OF_VIEW;
+            return 0;
+        }
+
+        bool changed = lastChanged > params.lastViewFrustumSent - CHANGE_FUDGE;
+        bool wasInView = false;
+        if (params.deltaViewFrustum && params.lastViewFrustum) {
+            wasInView = node.state.lastLocation == ViewFrustum::INSIDE &&
+                glm::distance(node.box.calcCenter(), params.lastViewFrustum->getPosition()) < boundaryDistance;
+        }
+        if (wasInView && !(params.deltaViewFrustum && changed)) {
+            params.stopReason = EncodeBitstreamParams::WAS_IN_VIEW;
+            return 0;
+        }
+        if (!params.forceSendScene && !params.deltaViewFrustum && !changed) {
+            params.stopReason = EncodeBitstreamParams::NO_CHANGE;
+            return 0;
+        }
+    }
+
+    return encodeLevel(node, lastChanged, packetData, params, currentEncodeLevel, didntFit, complete);
+}
+
+// Writes the children of a node the way Octree::encodeTreeBitstreamRecursion() writes the children of an element, and
+// recurses into them. Without occlusion culling the children are visited in index order and their distances aren't
+// checked here, calculateShouldRender() and their own levels do that.
+int VoxelPackedSubtree::encodeLevel(const EncodeNode& node, quint64 lastChanged, OctreePacketData* packetData,
+                                    EncodeBitstreamParams& params, int currentEncodeLevel, bool& didntFit,
+                                    bool& complete) const {
+    int bytesAtThisLevel = 0;
+    complete = false;
+
+    bool changed = lastChanged > params.lastViewFrustumSent - CHANGE_FUDGE;
+    int childLevel = node.level + 1;
+
+    int childIndexes[NUMBER_OF_CHILDREN];
+    findChildren(node.index, childIndexes);
+
+    AABox childBoxes[NUMBER_OF_CHILDREN];
+    EncodeElementState childStates[NUMBER_OF_CHILDREN];
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (childIndexes[i] < 0) {
+            continue;
+        }
+        childBoxes[i] = childBox(node.box, i);
+        if (params.viewFrustum) {
+            childStates[i].testMask = node.state.testMask;
+            childStates[i].location = params.viewFrustum->boxInFrustum(childBoxes[i], childStates[i].testMask);
+            if (params.deltaViewFrustum && params.lastViewFrustum) {
+                childStates[i].lastTestMask = node.state.lastTestMask;
+                childStates[i].lastLocation = params.lastViewFrustum->boxInFrustum(childBoxes[i],
+                                                                                   childStates[i].lastTestMask);
+            }
+        }
+    }
+
+    unsigned char childrenExistInTreeBits = 0;
+    unsigned char childrenExistInPacketBits = 0;
+    unsigned char childrenColoredBits = 0;
+    unsigned char childrenColoredForKnownStateBits = 0;
+    bool childComplete[NUMBER_OF_CHILDREN] = { false, false, false, false, false, false, false, false };
+    int inViewNotLeafCount = 0;
+
+    LevelDetails thisLevelKey = packetData->startLevel();
+
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        bool childExists = childIndexes[i] >= 0;
+
+        bool notMyJurisdiction = false;
+        if (params.jurisdictionMap) {
+            childStates[i].jurisdiction = params.jurisdictionMap->getChildPosition(node.state.jurisdiction, i);
+            notMyJurisdiction =
+                (JurisdictionMap::WITHIN != params.jurisdictionMap->getArea(childStates[i].jurisdiction));
+        }
+        if (params.includeExistsBits && (childExists || notMyJurisdiction)) {
+            childrenExistInTreeBits += (1 << (7 - i));
+        }
+
+        if (!childExists || (params.viewFrustum && childStates[i].location == ViewFrustum::OUTSIDE)) {
+            continue;
+        }
+
+        bool childIsLeaf = getChildBitmask(childIndexes[i]) == 0;
+        if (!childIsLeaf) {
+            childrenExistInPacketBits += (1 << (7 - i));
+            inViewNotLeafCount++;
+        }
+
+        bool shouldRender = true;
+        if (params.viewFrustum) {
+            shouldRender = false;
+            if (isColored(childIndexes[i])) {
+                float furthestDistance = glm::distance(params.viewFrustum->getFurthestPointFromCamera(childBoxes[i]),
+                                                       params.viewFrustum->getPosition());
+                bool inBoundary = furthestDistance <= boundaryDistanceForRenderLevel(
+                    childLevel + params.boundaryLevelAdjust, params.octreeElementSizeScale);
+                bool inChildBoundary = furthestDistance <= boundaryDistanceForRenderLevel(
+                    childLevel + 1 + params.boundaryLevelAdjust, params.octreeElementSizeScale);
+                shouldRender = (childIsLeaf && inChildBoundary) || (inBoundary && !inChildBoundary);
+            }
+        }
+
+        if (shouldRender) {
+            bool childWasInView = false;
+            if (params.deltaViewFrustum && params.lastViewFrustum) {
+                ViewFrustum::location location = childStates[i].lastLocation;
+                childWasInView = childIsLeaf ? location != ViewFrustum::OUTSIDE : location == ViewFrustum::INSIDE;
+            }
+            if (!childWasInView || (params.deltaViewFrustum && changed)) {
+                childrenColoredBits += (1 << (7 - i));
+                if (childIsLeaf) {
+                    childComplete[i] = true;
+                }
+            }
+        } else if (params.knownState && !childIsLeaf &&
+                   glm::distance(params.viewFrustum->getFurthestPointFromCamera(childBoxes[i]),
+                                 params.viewFrustum->getPosition()) <=
+                   boundaryDistanceForRenderLevel(childLevel + 1 + params.boundaryLevelAdjust,
+                                                  params.octreeElementSizeScale)) {
+            // the same as the known state coloring of Octree::encodeTreeBitstreamRecursion()
+            childrenColoredBits += (1 << (7 - i));
+            childrenColoredForKnownStateBits += (1 << (7 - i));
+        }
+    }
+
+    bool continueThisLevel = packetData->appendBitMask(childrenColoredBits);
+    if (continueThisLevel) {
+        bytesAtThisLevel += sizeof(childrenColoredBits);
+        if (params.stats) {
+            params.stats->colorBitsWritten();
+        }
+    }
+
+    if (continueThisLevel && params.includeColor) {
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            if (oneAtBit(childrenColoredBits, i)) {
+                continueThisLevel = packetData->appendColor(getColor(childIndexes[i]));
+                if (!continueThisLevel) {
+                    break;
+                }
+                bytesAtThisLevel += BYTES_PER_COLOR;
+            }
+        }
+    }
+
+    if (continueThisLevel && params.includeExistsBits) {
+        continueThisLevel = packetData->appendBitMask(childrenExistInTreeBits);
+        if (continueThisLevel) {
+            bytesAtThisLevel += sizeof(childrenExistInTreeBits);
+            if (params.stats) {
+                params.stats->existsBitsWritten();
+            }
+        }
+    }
+
+    if (continueThisLevel) {
+        continueThisLevel = packetData->appendBitMask(childrenExistInPacketBits);
+        if (continueThisLevel) {
+            bytesAtThisLevel += sizeof(childrenExistInPacketBits);
+            if (params.stats) {
+                params.stats->existsInPacketBitsWritten();
+            }
+        }
+    }
+
+    if (continueThisLevel && inViewNotLeafCount > 0) {
+        int childExistsPlaceHolder = packetData->getUncompressedByteOffset(sizeof(childrenExistInPacketBits));
+
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            if (!oneAtBit(childrenExistInPacketBits, i)) {
+                continue;
+            }
+            int childTreeBytesOut = 0;
+            if (!params.viewFrustum || !oneAtBit(childrenColoredBits & ~childrenColoredForKnownStateBits, i)) {
+                EncodeNode child;
+                child.index = childIndexes[i];
+                child.box = childBoxes[i];
+                child.level = childLevel;
+                child.state = childStates[i];
+                childTreeBytesOut = encodeNode(child, lastChanged, packetData, params, currentEncodeLevel,
+                                               didntFit, childComplete[i]);
+                if (didntFit) {
+                    // the child already rolled back its own level
+                    continueThisLevel = false;
+                    break;
+                }
+            }
+
+            if (params.includeColor && !params.includeExistsBits && childTreeBytesOut == 2) {
+                childTreeBytesOut = 0; // no colors and no child trees
+            }
+            bytesAtThisLevel += childTreeBytesOut;
+
+            if (childTreeBytesOut == 0) {
+                childrenExistInPacketBits -= (1 << (7 - i));
+                continueThisLevel = packetData->updatePriorBitMask(childExistsPlaceHolder, childrenExistInPacketBits);
+                if (params.stats && childrenExistInPacketBits == 0) {
+                    params.stats->childBitsRemoved(params.includeExistsBits, params.includeColor);
+                }
+                if (!continueThisLevel) {
+                    break;
+                }
+            }
+        }
+    }
+
+    if (continueThisLevel) {
+        continueThisLevel = packetData->endLevel(thisLevelKey);
+    } else {
+        packetData->discardLevel(thisLevelKey);
+    }
+    if (!continueThisLevel) {
+        // the folded voxels can't go in the bag on their own, so nothing of the root's subtree is sent this time
+        didntFit = true;
+        params.stopReason = EncodeBitstreamParams::DIDNT_FIT;
+        return 0;
+    }
+
+    complete = true;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (childIndexes[i] >= 0 && !childComplete[i]) {
+            complete = false;
+        }
+    }
+    return bytesAtThisLevel;
+}
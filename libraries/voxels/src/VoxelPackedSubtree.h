@@ -0,0 +1,106 @@
+//
+//  VoxelPackedSubtree.h
+//  hifi
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+//  A pointerless copy of the elements below a folded voxel tree element
+//
+
+#ifndef __hifi__VoxelPackedSubtree__
+#define __hifi__VoxelPackedSubtree__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <AABox.h>
+#include <Octree.h>
+#include <SharedUtil.h>
+
+/// The elements of a voxel subtree packed in depth first order, each as its child bitmask and its color, 5 bytes per
+/// voxel instead of the 100+ bytes of a VoxelTreeElement. There are no pointers or boxes, the children of a node follow
+/// it in index order, and boxes are worked out from the root's on the way down. The first node is the subtree's root,
+/// which stays in the tree as the folded element (see VoxelTree::foldSubtrees()), so a packed subtree is never
+/// traversed past its root's children without its root's box.
+///
+/// Packed subtrees are immutable once they've been handed to the tree, so that snapshot readers can encode them while a
+/// writer folds and unfolds.
+class VoxelPackedSubtree {
+public:
+    static const int BYTES_PER_NODE = 1 + sizeof(nodeColor);
+
+    VoxelPackedSubtree() { }
+
+    /// Appends the next node in depth first order, its children have to follow it.
+    void appendNode(unsigned char childBitmask, const nodeColor& color);
+
+    /// Appends all of another packed subtree in place of the next node, which is its root, with the color given.
+    void appendSubtree(const VoxelPackedSubtree& subtree, const nodeColor& rootColor);
+
+    /// Copies the subtree below the node at index into a packed subtree of its own.
+    VoxelPackedSubtree* copySubtree(int index) const;
+
+    int getNodeCount() const { return _nodes.size() / BYTES_PER_NODE; }
+    quint64 getMemoryUsage() const { return sizeof(VoxelPackedSubtree) + _nodes.capacity(); }
+
+    /// Child bitmasks have a bit for each child, at the child's index counted from the most significant bit, the same
+    /// as the bitmasks of the bitstream, see oneAtBit().
+    unsigned char getChildBitmask(int index) const { return _nodes[index * BYTES_PER_NODE]; }
+    const nodeColor& getColor(int index) const {
+        return *reinterpret_cast<const nodeColor*>(&_nodes[index * BYTES_PER_NODE + 1]);
+    }
+    bool isColored(int index) const { return getColor(index)[3] == 1; }
+
+    /// \return the index of the first node after the subtree of the node at index
+    int skipSubtree(int index) const;
+
+    /// Finds the indexes of the children of the node at index, -1 for those it doesn't have.
+    void findChildren(int index, int* childIndexes) const;
+
+    /// The density VoxelTreeElement::calculateAverageFromChildren() would find for the node at index.
+    float calculateDensity(int index) const;
+
+    /// The most bytes encoding the subtree below the root could ever take: each node with children writes its child
+    /// bitmasks and at most a color for each child.
+    int getMaxEncodedSize() const;
+
+    /// Same as Octree::findRayIntersection() for the voxels below the root, whose box is given. Everything is in tree
+    /// units (0.0 to 1.0).
+    bool findRayIntersection(const AABox& rootBox, const glm::vec3& origin, const glm::vec3& direction,
+                             float& distance, BoxFace& face) const;
+
+    /// Encodes the level below the root, whose box, level and encode state the caller found, in the format
+    /// Octree::encodeTreeBitstreamRecursion() writes. The nodes don't have change times of their own, they are all
+    /// considered changed when the root was. The folded voxels aren't elements, so they aren't counted in the scene
+    /// stats, don't take part in occlusion culling and can't be put in the bag, if anything doesn't fit nothing is
+    /// written and didntFit is set, so that the root goes in the bag whole. Sets params.subtreeComplete.
+    /// \return the number of bytes written
+    int encodeChildren(const AABox& rootBox, int rootLevel, quint64 lastChanged, OctreePacketData* packetData,
+                       EncodeBitstreamParams& params, int currentEncodeLevel, const EncodeElementState& rootState,
+                       bool& didntFit) const;
+
+private:
+    class EncodeNode {
+    public:
+        int index;
+        AABox box; // scaled to meters
+        int level;
+        EncodeElementState state;
+    };
+
+    int encodeNode(const EncodeNode& node, quint64 lastChanged, OctreePacketData* packetData,
+                   EncodeBitstreamParams& params, int currentEncodeLevel, bool& didntFit, bool& complete) const;
+    int encodeLevel(const EncodeNode& node, quint64 lastChanged, OctreePacketData* packetData,
+                    EncodeBitstreamParams& params, int currentEncodeLevel, bool& didntFit, bool& complete) const;
+
+    int calculateDensity(int index, float& density) const;
+    void findRayIntersection(int index, const AABox& box, const glm::vec3& origin, const glm::vec3& direction,
+                             bool& found, float& distance, BoxFace& face) const;
+
+    static AABox childBox(const AABox& box, int childIndex);
+
+    std::vector<unsigned char> _nodes;
+};
+
+#endif /* defined(__hifi__VoxelPackedSubtree__) */
@@ -15,15 +15,39 @@
 #include <QRgb>
 
 
+#include <OctreeEditBatch.h>
+
 #include "VoxelTree.h"
 #include "Tags.h"
 
 // Voxel Specific operations....
 
-VoxelTree::VoxelTree(bool shouldReaverage) : Octree(shouldReaverage) {
+// subtrees are folded once nothing in them has changed for this long
+const quint64 FOLD_AFTER_UNCHANGED_USECS = 60 * 1000 * 1000;
+
+// how often update() starts going through the tree for subtrees to fold, one slice per call
+const quint64 FOLD_PASS_INTERVAL_USECS = 10 * 1000 * 1000;
+const int FOLD_SLICES = NUMBER_OF_CHILDREN * NUMBER_OF_CHILDREN; // the elements at the second level
+
+// a folded subtree is encoded whole, so it must fit in a packet with room to spare for the elements above it
+const int MAX_FOLDED_ENCODED_SIZE = MAX_OCTREE_PACKET_DATA_SIZE / 2;
+
+VoxelTree::VoxelTree(bool shouldReaverage) :
+    Octree(shouldReaverage),
+    _isDeleteHookAdded(false),
+    _nextFoldSlice(0),
+    _lastFoldPass(0),
+    _foldedThisPass(0) {
     _rootNode = createNewElement();
 }
 
+VoxelTree::~VoxelTree() {
+    // our elements are deleted by the Octree destructor, after we're gone
+    if (_isDeleteHookAdded) {
+        OctreeElement::removeDeleteHook(this);
+    }
+}
+
 VoxelTreeElement* VoxelTree::createNewElement(unsigned char * octalCode) {
     VoxelSystem* voxelSystem = NULL;
     if (_rootNode) {
@@ -39,7 +63,7 @@ void VoxelTree::deleteVoxelAt(float x, float y, float z, float s) {
     deleteOctreeElementAt(x, y, z, s);
 }
 
-VoxelTreeElement* VoxelTree::getVoxelAt(float x, float y, float z, float s) const {
+VoxelTreeElement* VoxelTree::getVoxelAt(float x, float y, float z, float s) {
     return (VoxelTreeElement*)getOctreeElementAt(x, y, z, s);
 }
 
@@ -449,39 +473,9 @@ void VoxelTree::readCodeColorBufferToTreeRecursion(VoxelTreeElement* node, ReadC
     // Since we traverse the tree in code order, we know that if our code
     // matches, then we've reached  our target node.
     if (lengthOfNodeCode == args.lengthOfCode) {
-        // we've reached our target -- we might have found our node, but that node might have children.
-        // in this case, we only allow you to set the color if you explicitly asked for a destructive
-        // write.
-        if (!node->isLeaf() && args.destructive) {
-            // if it does exist, make sure it has no children
-            for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
-                node->deleteChildAtIndex(i);
-            }
-        } else {
-            if (!node->isLeaf()) {
-                qDebug("WARNING! operation would require deleting children, add Voxel ignored!");
-            }
-        }
-
-        // If we get here, then it means, we either had a true leaf to begin with, or we were in
-        // destructive mode and we deleted all the child trees. So we can color.
-        if (node->isLeaf()) {
-            // give this node its color
-            int octalCodeBytes = bytesRequiredForCodeLength(args.lengthOfCode);
-
-            nodeColor newColor;
-            memcpy(newColor, args.codeColorBuffer + octalCodeBytes, SIZE_OF_COLOR_DATA);
-            newColor[SIZE_OF_COLOR_DATA] = 1;
-            node->setColor(newColor);
-
-            // It's possible we just reset the node to it's exact same color, in
-            // which case we don't consider this to be dirty...
-            if (node->isDirty()) {
-                // track our tree dirtiness
-                _isDirty = true;
-                // track that path has changed
-                args.pathChanged = true;
-            }
+        if (setVoxelColorFromCodeColorBuffer(node, args.codeColorBuffer, args.lengthOfCode, args.destructive)) {
+            // track that path has changed
+            args.pathChanged = true;
         }
         return;
     }
@@ -508,6 +502,44 @@ void VoxelTree::readCodeColorBufferToTreeRecursion(VoxelTreeElement* node, ReadC
     }
 }
 
+bool VoxelTree::setVoxelColorFromCodeColorBuffer(VoxelTreeElement* node, const unsigned char* codeColorBuffer,
+                                                  int lengthOfCode, bool destructive) {
+    // we've reached our target -- we might have found our node, but that node might have children.
+    // in this case, we only allow you to set the color if you explicitly asked for a destructive
+    // write.
+    if (!node->isLeaf() && destructive) {
+        // if it does exist, make sure it has no children
+        for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+            node->deleteChildAtIndex(i);
+        }
+    } else {
+        if (!node->isLeaf()) {
+            qDebug("WARNING! operation would require deleting children, add Voxel ignored!");
+        }
+    }
+
+    // If we get here, then it means, we either had a true leaf to begin with, or we were in
+    // destructive mode and we deleted all the child trees. So we can color.
+    if (node->isLeaf()) {
+        // give this node its color
+        int octalCodeBytes = bytesRequiredForCodeLength(lengthOfCode);
+
+        nodeColor newColor;
+        memcpy(newColor, codeColorBuffer + octalCodeBytes, SIZE_OF_COLOR_DATA);
+        newColor[SIZE_OF_COLOR_DATA] = 1;
+        node->setColor(newColor);
+
+        // It's possible we just reset the node to it's exact same color, in
+        // which case we don't consider this to be dirty...
+        if (node->isDirty()) {
+            // track our tree dirtiness
+            _isDirty = true;
+            return true;
+        }
+    }
+    return false;
+}
+
 bool VoxelTree::handlesEditPacketType(PacketType packetType) const {
     // we handle these types of "edit" packets
     switch (packetType) {
@@ -521,16 +553,17 @@ bool VoxelTree::handlesEditPacketType(PacketType packetType) const {
     }
 }
 
+bool VoxelTree::handlesEditBatchPacketType(PacketType packetType) const {
+    // erases are bitstreams that take up the rest of their packet, so only sets are batched
+    return packetType == PacketTypeVoxelSet || packetType == PacketTypeVoxelSetDestructive;
+}
+
 const unsigned int REPORT_OVERFLOW_WARNING_INTERVAL = 100;
 unsigned int overflowWarnings = 0;
-int VoxelTree::processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
-                    const unsigned char* editData, int maxLength, const SharedNodePointer& node) {
-    
-    // we handle these types of "edit" packets
+int VoxelTree::getEditRecordSize(PacketType packetType, const unsigned char* editData, int maxLength) {
     switch (packetType) {
         case PacketTypeVoxelSet:
         case PacketTypeVoxelSetDestructive: {
-            bool destructive = (packetType == PacketTypeVoxelSetDestructive);
             int octets = numberOfThreeBitSectionsInCode(editData, maxLength);
 
             if (octets == OVERFLOWED_OCTCODE_BUFFER) {
@@ -544,7 +577,7 @@ int VoxelTree::processEditPacketData(PacketType packetType, const unsigned char*
                     debug << "edit data contents:";
                     outputBufferBits(editData, maxLength, &debug);
                 }
-                return maxLength;
+                return 0;
             }
 
             const int COLOR_SIZE_IN_BYTES = 3;
@@ -562,9 +595,30 @@ int VoxelTree::processEditPacketData(PacketType packetType, const unsigned char*
                     debug << "edit data contents:";
                     outputBufferBits(editData, maxLength, &debug);
                 }
+                return 0;
+            }
+            return voxelDataSize;
+        } break;
+
+        default:
+            return 0;
+    }
+}
+
+int VoxelTree::processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
+                    const unsigned char* editData, int maxLength, const SharedNodePointer& node) {
+    
+    // we handle these types of "edit" packets
+    switch (packetType) {
+        case PacketTypeVoxelSet:
+        case PacketTypeVoxelSetDestructive: {
+            bool destructive = (packetType == PacketTypeVoxelSetDestructive);
+            int voxelDataSize = getEditRecordSize(packetType, editData, maxLength);
+            if (voxelDataSize == 0) {
                 return maxLength;
             }
 
+            loadSubtreesForEdit(editData);
             readCodeColorBufferToTree(editData, destructive);
 
             return voxelDataSize;
@@ -578,3 +632,280 @@ int VoxelTree::processEditPacketData(PacketType packetType, const unsigned char*
     }
 }
 
+void VoxelTree::processEditBatch(const OctreeEditBatch& batch) {
+    if (!batch.canApplySorted()) {
+        // something in the batch was edited after its descendants, which only comes out right in the arrival order
+        const std::vector<OctreeEditRecord>& records = batch.getRecords();
+        for (size_t i = 0; i < records.size(); i++) {
+            loadSubtreesForEdit(records[i].editData);
+            readCodeColorBufferToTree(records[i].editData, records[i].packetType == PacketTypeVoxelSetDestructive);
+        }
+        return;
+    }
+
+    // the path from the root to the element of the last record, and whether anything below each of its elements has
+    // changed. Consecutive sorted records share the start of their paths, so each one only descends from where they
+    // part, and once the records have moved past an element it gets reaveraged the one time.
+    std::vector<VoxelTreeElement*> path(1, getRoot());
+    std::vector<bool> changedBelow(1, false);
+    const unsigned char* lastOctalCode = NULL;
+    for (int i = 0; i < batch.size(); i++) {
+        const OctreeEditRecord& record = batch.getSortedRecord(i);
+        const unsigned char* octalCode = record.editData;
+        int lengthOfCode = numberOfThreeBitSectionsInCode(octalCode);
+
+        // loading and unfolding fill in the children of elements that are already in the tree, so the path stays valid
+        loadSubtreesForEdit(octalCode);
+
+        if (lastOctalCode) {
+            unwindEditPath(path, changedBelow, numberOfCommonThreeBitSections(lastOctalCode, octalCode) + 1);
+        }
+        while ((int)path.size() <= lengthOfCode) {
+            VoxelTreeElement* node = path.back();
+            int childIndex = branchIndexWithDescendant(node->getOctalCode(), octalCode);
+            VoxelTreeElement* childNode = node->getChildAtIndex(childIndex);
+
+            // If the branch we need to traverse does not exist, then create it on the way down...
+            if (!childNode) {
+                childNode = node->addChildAtIndex(childIndex);
+            }
+            path.push_back(childNode);
+            changedBelow.push_back(false);
+        }
+
+        bool destructive = (record.packetType == PacketTypeVoxelSetDestructive);
+        if (setVoxelColorFromCodeColorBuffer(path.back(), octalCode, lengthOfCode, destructive)) {
+            for (int level = path.size() - 2; level >= 0 && !changedBelow[level]; level--) {
+                changedBelow[level] = true;
+            }
+        }
+        lastOctalCode = octalCode;
+    }
+    unwindEditPath(path, changedBelow, 0);
+}
+
+void VoxelTree::unwindEditPath(std::vector<VoxelTreeElement*>& path, std::vector<bool>& changedBelow, int length) {
+    while ((int)path.size() > length) {
+        // let this node do its bookkeeping for everything that changed below it, like color re-averaging
+        if (changedBelow.back()) {
+            path.back()->handleSubtreeChanged(this);
+        }
+        path.pop_back();
+        changedBelow.pop_back();
+    }
+}
+
+
+void VoxelTree::update() {
+    if (!getWantFolding()) {
+        return;
+    }
+    quint64 now = usecTimestampNow();
+    if (_nextFoldSlice == 0) {
+        if (now - _lastFoldPass < FOLD_PASS_INTERVAL_USECS) {
+            return;
+        }
+        _lastFoldPass = now;
+        _foldedThisPass = 0;
+    }
+    _foldedThisPass += foldSlice(_nextFoldSlice, now - FOLD_AFTER_UNCHANGED_USECS);
+    _nextFoldSlice = (_nextFoldSlice + 1) % FOLD_SLICES;
+
+    if (_nextFoldSlice == 0 && _foldedThisPass > 0) {
+        int foldedVoxels = 0;
+        quint64 foldedBytes = 0;
+        foreach (const QSharedPointer<const VoxelPackedSubtree>& packed, _foldedSubtrees) {
+            foldedVoxels += packed->getNodeCount() - 1;
+            foldedBytes += packed->getMemoryUsage();
+        }
+        qDebug("VoxelTree::update()... folded %d subtrees, %d folded subtrees hold %d voxels in %llu bytes",
+               _foldedThisPass, _foldedSubtrees.size(), foldedVoxels, foldedBytes);
+    }
+}
+
+int VoxelTree::foldSubtrees(quint64 unchangedSince) {
+    int foldedCount = 0;
+    for (int slice = 0; slice < FOLD_SLICES; slice++) {
+        foldedCount += foldSlice(slice, unchangedSince);
+    }
+    return foldedCount;
+}
+
+int VoxelTree::foldSlice(int slice, quint64 unchangedSince) {
+    VoxelTreeElement* parent = getRoot()->getChildAtIndex(slice / NUMBER_OF_CHILDREN);
+    VoxelTreeElement* element = parent ? parent->getChildAtIndex(slice % NUMBER_OF_CHILDREN) : NULL;
+    int foldedCount = 0;
+    if (element) {
+        foldSubtreesRecursion(element, unchangedSince, foldedCount);
+    }
+    if (foldedCount > 0) {
+        // encoders put elements whose children didn't fit in their bags, and bags drop deleted elements, so anything
+        // that was still waiting to be sent below a fold has to be sent again from the top
+        parent->markWithChangedTime();
+        getRoot()->markWithChangedTime();
+    }
+    return foldedCount;
+}
+
+// Folds bottom up, so that each fold takes in the folds below it, as far up as the folds fit. Elements are cold if they
+// were before we started, folding below them marks them as changed.
+// \return true if the element is a leaf or folded, and can be part of its parent's fold
+bool VoxelTree::foldSubtreesRecursion(VoxelTreeElement* element, quint64 unchangedSince, int& foldedCount) {
+    if (element->isLeaf()) {
+        // unless its children are still in the indexed file
+        return !element->hasUnloadedChildren() || _foldedSubtrees.contains(element);
+    }
+    bool isCold = !element->hasChangedSince(unchangedSince);
+    bool childrenCanFold = true;
+    int foldedBefore = foldedCount;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        VoxelTreeElement* childAt = element->getChildAtIndex(i);
+        if (childAt && !foldSubtreesRecursion(childAt, unchangedSince, foldedCount)) {
+            childrenCanFold = false;
+        }
+    }
+    if (isCold && childrenCanFold && foldElement(element)) {
+        foldedCount++;
+        return true;
+    }
+    if (foldedCount > foldedBefore) {
+        element->markWithChangedTime();
+    }
+    return false;
+}
+
+bool VoxelTree::foldElement(VoxelTreeElement* element) {
+    VoxelPackedSubtree* packed = new VoxelPackedSubtree();
+    if (!packSubtree(element, *packed) || packed->getMaxEncodedSize() > MAX_FOLDED_ENCODED_SIZE) {
+        delete packed;
+        return false;
+    }
+    if (!_isDeleteHookAdded) {
+        OctreeElement::addDeleteHook(this);
+        _isDeleteHookAdded = true;
+    }
+
+    // encoders find the packed voxels before the children go away
+    _foldedLock.lockForWrite();
+    _foldedSubtrees.insert(element, QSharedPointer<const VoxelPackedSubtree>(packed));
+    _foldedLock.unlock();
+    element->setHasUnloadedChildren(true);
+
+    // folded children are taken in, elementDeleted() drops their packed voxels
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        element->deleteChildAtIndex(i);
+    }
+    return true;
+}
+
+bool VoxelTree::packSubtree(VoxelTreeElement* element, VoxelPackedSubtree& packed) const {
+    if (element->hasUnloadedChildren()) {
+        QSharedPointer<const VoxelPackedSubtree> folded = _foldedSubtrees.value(element);
+        if (!folded) {
+            return false; // still in the indexed file
+        }
+        packed.appendSubtree(*folded, element->getTrueColor());
+        return true;
+    }
+    unsigned char childBitmask = 0;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (element->getChildAtIndex(i)) {
+            childBitmask += (1 << (7 - i));
+        }
+    }
+    packed.appendNode(childBitmask, element->getTrueColor());
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        VoxelTreeElement* childAt = element->getChildAtIndex(i);
+        if (childAt && !packSubtree(childAt, packed)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Unfolds one level, the children that have children of their own are folded in turn.
+void VoxelTree::unfoldElement(VoxelTreeElement* element) {
+    QSharedPointer<const VoxelPackedSubtree> packed = findFoldedSubtree(element);
+    if (!packed) {
+        return;
+    }
+    int childIndexes[NUMBER_OF_CHILDREN];
+    packed->findChildren(0, childIndexes);
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        if (childIndexes[i] < 0) {
+            continue;
+        }
+        VoxelTreeElement* childAt = element->addChildAtIndex(i);
+
+        // the colors and densities are the ones the child had when it was folded, setColor() would change them
+        memcpy(&childAt->_trueColor, &packed->getColor(childIndexes[i]), sizeof(nodeColor));
+        memcpy(&childAt->_currentColor, &packed->getColor(childIndexes[i]), sizeof(nodeColor));
+        childAt->_density = packed->calculateDensity(childIndexes[i]);
+        if (packed->getChildBitmask(childIndexes[i])) {
+            _foldedLock.lockForWrite();
+            QSharedPointer<const VoxelPackedSubtree> childPacked(packed->copySubtree(childIndexes[i]));
+            _foldedSubtrees.insert(childAt, childPacked);
+            _foldedLock.unlock();
+            childAt->setHasUnloadedChildren(true);
+        }
+    }
+
+    // encoders that still find the packed voxels encode those, the others find the children ready
+    element->setHasUnloadedChildren(false);
+    _foldedLock.lockForWrite();
+    _foldedSubtrees.remove(element);
+    _foldedLock.unlock();
+}
+
+void VoxelTree::unfoldPathTo(const unsigned char* octalCode) {
+    if (_foldedSubtrees.isEmpty()) {
+        return;
+    }
+    // only the deepest element on the path can be folded, and what's below it becomes the path as it unfolds
+    VoxelTreeElement* element = static_cast<VoxelTreeElement*>(nodeForOctalCode(_rootNode, octalCode, NULL));
+    while (element && element->hasUnloadedChildren() && _foldedSubtrees.contains(element)) {
+        unfoldElement(element);
+        if (compareOctalCodes(element->getOctalCode(), octalCode) == EXACT_MATCH) {
+            break;
+        }
+        element = element->getChildAtIndex(branchIndexWithDescendant(element->getOctalCode(), octalCode));
+    }
+}
+
+QSharedPointer<const VoxelPackedSubtree> VoxelTree::findFoldedSubtree(const OctreeElement* element) const {
+    QReadLocker locker(&_foldedLock);
+    return _foldedSubtrees.value(element);
+}
+
+bool VoxelTree::encodeFoldedChildren(const OctreeElement* element, OctreePacketData* packetData,
+                                     EncodeBitstreamParams& params, int currentEncodeLevel,
+                                     const EncodeElementState& elementState, int& bytesWritten,
+                                     bool& didntFit) const {
+    QSharedPointer<const VoxelPackedSubtree> packed = findFoldedSubtree(element);
+    if (!packed) {
+        return false;
+    }
+    bytesWritten = packed->encodeChildren(element->getAABox(), element->getLevel(), element->getLastChanged(),
+                                          packetData, params, currentEncodeLevel, elementState, didntFit);
+    return true;
+}
+
+bool VoxelTree::findRayIntersectionInFolded(const OctreeElement* element, const glm::vec3& origin,
+                                            const glm::vec3& direction, bool& hit, float& distance,
+                                            BoxFace& face) const {
+    QSharedPointer<const VoxelPackedSubtree> packed = findFoldedSubtree(element);
+    if (!packed) {
+        return false;
+    }
+    hit = packed->findRayIntersection(element->getAABox(), origin, direction, distance, face);
+    return true;
+}
+
+void VoxelTree::elementDeleted(OctreeElement* element) {
+    // folded elements are the only ones with packed voxels, and with snapshot reads we hear about each one twice, when
+    // it's retired and when it's deleted, which is harmless since its address can't be reused before then
+    if (element->hasUnloadedChildren()) {
+        QWriteLocker locker(&_foldedLock);
+        _foldedSubtrees.remove(element);
+    }
+}
@@ -10,6 +10,12 @@
 #define __hifi__VoxelTree__
 
 #include <set>
+#include <vector>
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+
 #include <SimpleMovingAverage.h>
 #include <OctreeElementBag.h>
 #include <Octree.h>
@@ -21,20 +27,22 @@
 #include "VoxelPacketData.h"
 #include "VoxelSceneStats.h"
 #include "VoxelEditPacketSender.h"
+#include "VoxelPackedSubtree.h"
 
 class ReadCodeColorBufferToTreeArgs;
 
-class VoxelTree : public Octree {
+class VoxelTree : public Octree, public OctreeElementDeleteHook {
     Q_OBJECT
 public:
 
     VoxelTree(bool shouldReaverage = false);
+    ~VoxelTree();
 
     virtual VoxelTreeElement* createNewElement(unsigned char * octalCode = NULL);
     VoxelTreeElement* getRoot() { return (VoxelTreeElement*)_rootNode; }
 
     void deleteVoxelAt(float x, float y, float z, float s);
-    VoxelTreeElement* getVoxelAt(float x, float y, float z, float s) const;
+    VoxelTreeElement* getVoxelAt(float x, float y, float z, float s);
     void createVoxel(float x, float y, float z, float s,
                      unsigned char red, unsigned char green, unsigned char blue, bool destructive = false);
 
@@ -55,8 +63,37 @@ public:
     virtual bool handlesEditPacketType(PacketType packetType) const;
     virtual int processEditPacketData(PacketType packetType, const unsigned char* packetData, int packetLength,
                     const unsigned char* editData, int maxLength, const SharedNodePointer& node);
+    virtual bool handlesEditBatchPacketType(PacketType packetType) const;
+    virtual int getEditRecordSize(PacketType packetType, const unsigned char* editData, int maxLength);
+    virtual void processEditBatch(const OctreeEditBatch& batch);
     void processSetVoxelsBitstream(const unsigned char* bitstream, int bufferSizeBytes);
 
+    /// voxel data is plain color bytes, a reader racing a writer at worst sees a stale color which will be resent
+    virtual bool supportsSnapshotReads() const { return true; }
+
+    /// voxel edits set or erase whatever they cover, so replaying them over an older copy of the tree is safe
+    virtual bool canReplayEdits() const { return true; }
+
+    /// voxel edits make sure the subtrees they touch are loaded, see loadSubtreesForEdit()
+    virtual bool supportsLazyLoading() const { return true; }
+
+    /// subtrees that haven't changed in a while are folded into VoxelPackedSubtrees, a few bytes per voxel
+    virtual bool supportsFolding() const { return true; }
+    virtual bool findRayIntersectionInFolded(const OctreeElement* element, const glm::vec3& origin,
+                                             const glm::vec3& direction, bool& hit, float& distance,
+                                             BoxFace& face) const;
+
+    /// folds a slice of the tree's cold subtrees each call, when folding is wanted
+    virtual void update();
+
+    /// Folds every subtree below the root's children that hasn't changed since the time given, as far up as each fits
+    /// in half a packet once encoded. Caller must hold the write lock.
+    /// \return the number of subtrees folded
+    int foldSubtrees(quint64 unchangedSince);
+    int getFoldedSubtreeCount() const { return _foldedSubtrees.size(); }
+
+    virtual void elementDeleted(OctreeElement* element);
+
 /**
 signals:
     void importSize(float x, float y, float z);
@@ -73,6 +110,36 @@ private:
     void nudgeLeaf(VoxelTreeElement* element, void* extraData);
     void chunkifyLeaf(VoxelTreeElement* element);
     void readCodeColorBufferToTreeRecursion(VoxelTreeElement* node, ReadCodeColorBufferToTreeArgs& args);
+
+    /// Colors the element a set voxel record is for, clearing its children first if the set is destructive.
+    /// \return true if its color changed
+    bool setVoxelColorFromCodeColorBuffer(VoxelTreeElement* node, const unsigned char* codeColorBuffer,
+                                          int lengthOfCode, bool destructive);
+    void unwindEditPath(std::vector<VoxelTreeElement*>& path, std::vector<bool>& changedBelow, int length);
+
+protected:
+    virtual bool encodeFoldedChildren(const OctreeElement* element, OctreePacketData* packetData,
+                                      EncodeBitstreamParams& params, int currentEncodeLevel,
+                                      const EncodeElementState& elementState, int& bytesWritten,
+                                      bool& didntFit) const;
+    virtual void unfoldPathTo(const unsigned char* octalCode);
+
+private:
+    int foldSlice(int slice, quint64 unchangedSince);
+    bool foldSubtreesRecursion(VoxelTreeElement* element, quint64 unchangedSince, int& foldedCount);
+    bool foldElement(VoxelTreeElement* element);
+    bool packSubtree(VoxelTreeElement* element, VoxelPackedSubtree& packed) const;
+    void unfoldElement(VoxelTreeElement* element);
+    QSharedPointer<const VoxelPackedSubtree> findFoldedSubtree(const OctreeElement* element) const;
+
+    /// The packed voxels below each folded element. Only writers change it, and they take the lock to do it so that
+    /// encoders can look folded elements up while snapshot reads are on.
+    QHash<const OctreeElement*, QSharedPointer<const VoxelPackedSubtree> > _foldedSubtrees;
+    mutable QReadWriteLock _foldedLock;
+    bool _isDeleteHookAdded;
+    int _nextFoldSlice;
+    quint64 _lastFoldPass;
+    int _foldedThisPass;
 };
 
 #endif /* defined(__hifi__VoxelTree__) */
@@ -7,6 +7,7 @@
 //
 
 #include <NodeList.h>
+#include <OctreeMemoryPool.h>
 #include <PerfStat.h>
 
 #include "VoxelConstants.h"
@@ -21,6 +22,27 @@ VoxelTreeElement::~VoxelTreeElement() {
     _voxelMemoryUsage -= sizeof(VoxelTreeElement);
 }
 
+static OctreeMemoryPool* elementPool() {
+    static OctreeMemoryPool* pool = new OctreeMemoryPool("Voxel Elements", sizeof(VoxelTreeElement));
+    return pool;
+}
+
+void* VoxelTreeElement::operator new(size_t size) {
+    // anything bigger than us, like a subclass, can't use our blocks
+    if (size != sizeof(VoxelTreeElement)) {
+        return ::operator new(size);
+    }
+    return elementPool()->allocate();
+}
+
+void VoxelTreeElement::operator delete(void* element, size_t size) {
+    if (size != sizeof(VoxelTreeElement)) {
+        ::operator delete(element);
+        return;
+    }
+    elementPool()->release(element);
+}
+
 // This will be called primarily on addChildAt(), which means we're adding a child of our
 // own type to our own tree. This means we should initialize that child with any tree and type
 // specific settings that our children must have. One example is out VoxelSystem, which
@@ -208,8 +230,8 @@ bool VoxelTreeElement::collapseChildren() {
     int red,green,blue;
     for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
         VoxelTreeElement* childAt = getChildAtIndex(i);
-        // if no child, child isn't a leaf, or child doesn't have a color
-        if (!childAt || !childAt->isLeaf() || !childAt->isColored()) {
+        // if no child, child isn't a leaf (or only looks like one until it's loaded), or child doesn't have a color
+        if (!childAt || !childAt->isLeaf() || childAt->hasUnloadedChildren() || !childAt->isColored()) {
             allChildrenMatch=false;
             //qDebug("SADNESS child missing or not colored! i=%d\n",i);
             break;
@@ -231,8 +253,8 @@ bool VoxelTreeElement::collapseChildren() {
         //qDebug("allChildrenMatch: pruning tree\n");
         for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
             OctreeElement* childAt = getChildAtIndex(i);
-            delete childAt; // delete all the child nodes
             setChildAtIndex(i, NULL); // set it to NULL
+            disposeElement(childAt); // delete all the child nodes
         }
         nodeColor collapsedColor;
         collapsedColor[0]=red;
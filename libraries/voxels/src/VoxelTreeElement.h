@@ -35,6 +35,11 @@ class VoxelTreeElement : public OctreeElement {
     
 public:
     virtual ~VoxelTreeElement();
+
+    /// Elements are carved from a shared slab pool rather than individually allocated, see OctreeMemoryPool
+    static void* operator new(size_t size);
+    static void operator delete(void* element, size_t size);
+
     virtual void init(unsigned char * octalCode);
 
     virtual bool hasContent() const { return isColored(); }
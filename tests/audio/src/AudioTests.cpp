@@ -0,0 +1,243 @@
+//
+//  AudioTests.cpp
+//  audio-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <stdlib.h>
+#include <vector>
+
+#include <glm/gtx/quaternion.hpp>
+
+#include <QDebug>
+
+#include <AudioMixKernel.h>
+#include <PositionalAudioRingBuffer.h>
+#include <SharedUtil.h>
+#include <WorkerPool.h>
+
+#include "AudioTests.h"
+
+const int BENCHMARK_FRAMES = 100;
+const float ROOM_SIZE = 20.0f; // meters
+const int MAX_MIX_AMPLITUDE = 30000; // keeps the mixes from clipping, so that they can be compared
+
+static PositionalAudioRingBuffer* createSyntheticSource(int amplitude) {
+    PositionalAudioRingBuffer* source = new PositionalAudioRingBuffer(PositionalAudioRingBuffer::Microphone);
+
+    glm::vec3 position(randFloat() * ROOM_SIZE, 0.0f, randFloat() * ROOM_SIZE);
+    glm::quat orientation = glm::angleAxis(randFloat() * 360.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+    QByteArray positionalData;
+    positionalData.append(reinterpret_cast<const char*>(&position), sizeof(position));
+    positionalData.append(reinterpret_cast<const char*>(&orientation), sizeof(orientation));
+    source->parsePositionalData(positionalData);
+
+    // a frame of history for the phase delay, and the frame we'll mix
+    int16_t samples[2 * NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL];
+    for (int i = 0; i < 2 * NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL; i++) {
+        samples[i] = randIntInRange(-amplitude, amplitude);
+    }
+    source->writeSamples(samples, 2 * NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL);
+    source->shiftReadPosition(NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL);
+    return source;
+}
+
+// the mixer's per sample loop from before the mix kernels, clamping after every add
+static void mixLegacy(PositionalAudioRingBuffer* source, const AudioSourceMix& sourceMix, int16_t* mixedSamples) {
+    int delayedChannelOffset = sourceMix.isRightDelayed ? 1 : 0;
+    int goodChannelOffset = delayedChannelOffset == 0 ? 1 : 0;
+    int numSamplesDelay = sourceMix.numSamplesDelay;
+
+    for (int s = 0; s < NETWORK_BUFFER_LENGTH_SAMPLES_STEREO; s += 2) {
+        if ((s / 2) < numSamplesDelay) {
+            int earlierSample = (*source)[(s / 2) - numSamplesDelay] * sourceMix.delayedAttenuation;
+            mixedSamples[s + delayedChannelOffset] = glm::clamp(mixedSamples[s + delayedChannelOffset] + earlierSample,
+                                                                MIN_SAMPLE_VALUE, MAX_SAMPLE_VALUE);
+        }
+
+        int16_t currentSample = (*source)[s / 2] * sourceMix.attenuation;
+        mixedSamples[s + goodChannelOffset] = glm::clamp(mixedSamples[s + goodChannelOffset] + currentSample,
+                                                         MIN_SAMPLE_VALUE, MAX_SAMPLE_VALUE);
+
+        if ((s / 2) + numSamplesDelay < NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL) {
+            int16_t delayedSample = (*source)[s / 2] * sourceMix.delayedAttenuation;
+            mixedSamples[s + (numSamplesDelay * 2) + delayedChannelOffset] =
+                glm::clamp(mixedSamples[s + (numSamplesDelay * 2) + delayedChannelOffset] + delayedSample,
+                           MIN_SAMPLE_VALUE, MAX_SAMPLE_VALUE);
+        }
+    }
+}
+
+/// Every source is also a listener, the way every agent is in a domain, and doesn't hear itself.
+class BenchmarkMixer : public WorkerPoolJobs {
+public:
+    enum Kernel {
+        Legacy,
+        Scalar,
+        Vectorized
+    };
+
+    BenchmarkMixer(const std::vector<PositionalAudioRingBuffer*>& sources, int numberOfListeners) :
+        kernel(Legacy),
+        _sources(sources),
+        _accumulators(numberOfListeners),
+        _scalarChannels(numberOfListeners * NETWORK_BUFFER_LENGTH_SAMPLES_STEREO),
+        _mixedSamples(numberOfListeners * NETWORK_BUFFER_LENGTH_SAMPLES_STEREO) {
+    }
+
+    virtual void runJob(int listenerIndex) { mixListener(listenerIndex); }
+    void mixListener(int listenerIndex);
+
+    const int16_t* getMixedSamples(int listenerIndex) const {
+        return &_mixedSamples[listenerIndex * NETWORK_BUFFER_LENGTH_SAMPLES_STEREO];
+    }
+
+    Kernel kernel;
+
+private:
+    std::vector<PositionalAudioRingBuffer*> _sources;
+    std::vector<AudioMixAccumulator> _accumulators;
+    std::vector<float> _scalarChannels;
+    std::vector<int16_t> _mixedSamples;
+};
+
+void BenchmarkMixer::mixListener(int listenerIndex) {
+    PositionalAudioRingBuffer* listener = _sources[listenerIndex];
+    int16_t* mixedSamples = &_mixedSamples[listenerIndex * NETWORK_BUFFER_LENGTH_SAMPLES_STEREO];
+
+    if (kernel == Legacy) {
+        memset(mixedSamples, 0, NETWORK_BUFFER_LENGTH_BYTES_STEREO);
+        for (size_t i = 0; i < _sources.size(); i++) {
+            if (_sources[i] != listener) {
+                mixLegacy(_sources[i], AudioSourceMix(_sources[i], listener), mixedSamples);
+            }
+        }
+    } else if (kernel == Scalar) {
+        float* left = &_scalarChannels[listenerIndex * NETWORK_BUFFER_LENGTH_SAMPLES_STEREO];
+        float* right = left + NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL;
+        memset(left, 0, NETWORK_BUFFER_LENGTH_SAMPLES_STEREO * sizeof(float));
+        for (size_t i = 0; i < _sources.size(); i++) {
+            if (_sources[i] != listener) {
+                AudioSourceMix sourceMix(_sources[i], listener);
+                mixSamplesScalar(sourceMix.isRightDelayed ? left : right, _sources[i]->getLinearFrame(),
+                                 sourceMix.attenuation, NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL);
+                mixSamplesScalar(sourceMix.isRightDelayed ? right : left,
+                                 _sources[i]->getLinearFrame() - sourceMix.numSamplesDelay,
+                                 sourceMix.delayedAttenuation, NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL);
+            }
+        }
+        saturateAndInterleave(left, right, mixedSamples, NETWORK_BUFFER_LENGTH_SAMPLES_PER_CHANNEL);
+    } else {
+        AudioMixAccumulator& mix = _accumulators[listenerIndex];
+        mix.clear();
+        for (size_t i = 0; i < _sources.size(); i++) {
+            if (_sources[i] != listener) {
+                mix.addSource(_sources[i]->getLinearFrame(), AudioSourceMix(_sources[i], listener));
+            }
+        }
+        mix.writeSamples(mixedSamples);
+    }
+}
+
+AudioTests::AudioTests(int& argc, char** argv) :
+    QCoreApplication(argc, argv) {
+}
+
+bool AudioTests::run() {
+
+    qDebug() << "Running audio benchmarks...";
+
+    // seed the random number generator so that our benchmarks are reproducible
+    srand(0xBAAAAABE);
+
+    if (runMixBenchmark()) {
+        return true;
+    }
+
+    qDebug() << "All benchmarks passed!";
+
+    return false;
+}
+
+bool AudioTests::runMixBenchmark() {
+    const int SOURCE_COUNTS[] = { 25, 50, 100, 200 };
+    const int NUMBER_OF_SOURCE_COUNTS = sizeof(SOURCE_COUNTS) / sizeof(SOURCE_COUNTS[0]);
+    const char* PASS_NAMES[] = { "legacy", "scalar", getMixKernelName(), "pooled" };
+    const int NUMBER_OF_PASSES = sizeof(PASS_NAMES) / sizeof(PASS_NAMES[0]);
+
+    WorkerPool workerPool;
+    workerPool.start();
+
+    bool failed = false;
+    for (int countIndex = 0; countIndex < NUMBER_OF_SOURCE_COUNTS && !failed; countIndex++) {
+        int sourceCount = SOURCE_COUNTS[countIndex];
+
+        std::vector<PositionalAudioRingBuffer*> sources;
+        for (int i = 0; i < sourceCount; i++) {
+            sources.push_back(createSyntheticSource(MAX_MIX_AMPLITUDE / sourceCount));
+        }
+
+        BenchmarkMixer mixer(sources, sourceCount);
+        std::vector<int16_t> legacyMixes;
+        quint64 frameTimes[NUMBER_OF_PASSES];
+
+        for (int pass = 0; pass < NUMBER_OF_PASSES; pass++) {
+            mixer.kernel = (pass == 0) ? BenchmarkMixer::Legacy :
+                ((pass == 1) ? BenchmarkMixer::Scalar : BenchmarkMixer::Vectorized);
+            bool usePool = (pass == NUMBER_OF_PASSES - 1);
+
+            quint64 start = usecTimestampNow();
+            for (int frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+                if (mixer.kernel != BenchmarkMixer::Legacy) {
+                    for (int i = 0; i < sourceCount; i++) {
+                        sources[i]->linearizeFrame();
+                    }
+                }
+                if (usePool) {
+                    workerPool.runJobs(&mixer, sourceCount);
+                } else {
+                    for (int i = 0; i < sourceCount; i++) {
+                        mixer.mixListener(i);
+                    }
+                }
+            }
+            frameTimes[pass] = (usecTimestampNow() - start) / BENCHMARK_FRAMES;
+
+            // every pass must come up with the legacy mix, give or take the legacy truncation of every source's samples
+            int maxDifference = 0;
+            for (int i = 0; i < sourceCount; i++) {
+                const int16_t* mixedSamples = mixer.getMixedSamples(i);
+                if (pass == 0) {
+                    legacyMixes.insert(legacyMixes.end(), mixedSamples,
+                                       mixedSamples + NETWORK_BUFFER_LENGTH_SAMPLES_STEREO);
+                    continue;
+                }
+                const int16_t* legacySamples = &legacyMixes[i * NETWORK_BUFFER_LENGTH_SAMPLES_STEREO];
+                for (int s = 0; s < NETWORK_BUFFER_LENGTH_SAMPLES_STEREO; s++) {
+                    maxDifference = std::max(maxDifference, abs(mixedSamples[s] - legacySamples[s]));
+                }
+            }
+            if (maxDifference > 2 * sourceCount) {
+                qDebug() << "FAILED:" << PASS_NAMES[pass] << "mix of" << sourceCount
+                    << "sources differs from the legacy mix by" << maxDifference;
+                failed = true;
+            }
+        }
+
+        qDebug() << sourceCount << "sources and listeners, usecs per frame:"
+            << PASS_NAMES[0] << frameTimes[0] << PASS_NAMES[1] << frameTimes[1] << PASS_NAMES[2] << frameTimes[2]
+            << PASS_NAMES[3] << frameTimes[3] << "with" << workerPool.getWorkerCount() + 1 << "threads, frame budget"
+            << BUFFER_SEND_INTERVAL_USECS;
+
+        for (int i = 0; i < sourceCount; i++) {
+            delete sources[i];
+        }
+    }
+
+    workerPool.stop();
+
+    return failed;
+}
@@ -0,0 +1,33 @@
+//
+//  AudioTests.h
+//  audio-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __audio_tests__AudioTests__
+#define __audio_tests__AudioTests__
+
+#include <QCoreApplication>
+
+/// Benchmarks various aspects of the audio library.
+class AudioTests : public QCoreApplication {
+    Q_OBJECT
+
+public:
+
+    AudioTests(int& argc, char** argv);
+
+    /// Performs our various benchmarks.
+    /// \return true if any of the benchmarks failed.
+    bool run();
+
+private:
+
+    /// Mixes frames of synthetic sources for as many listeners, the way the audio mixer used to with a clamp per sample
+    /// through the ring buffers, then with the float kernels on one thread and across a WorkerPool, and
+    /// reports the microseconds per frame.
+    bool runMixBenchmark();
+};
+
+#endif // __audio_tests__AudioTests__
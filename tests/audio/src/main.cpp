@@ -0,0 +1,11 @@
+//
+//  main.cpp
+//  audio-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+
+#include "AudioTests.h"
+
+int main(int argc, char** argv) {
+    return AudioTests(argc, argv).run();
+}
@@ -0,0 +1,230 @@
+//
+//  AvatarTests.cpp
+//  avatar-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <stdlib.h>
+#include <vector>
+
+#include <QDebug>
+#include <QUdpSocket>
+#include <QUuid>
+
+#include <AvatarData.h>
+#include <AvatarInterestManager.h>
+#include <PacketHeaders.h>
+#include <SharedUtil.h>
+
+#include "AvatarTests.h"
+
+const int BENCHMARK_FRAMES = 120;
+const int BENCHMARK_FRAMES_PER_SECOND = 60;
+const float WORLD_SIZE = 2000.0f; // meters
+const float CROWD_SIZE = 40.0f; // meters, half of the agents stand around together
+const float WALK_PER_FRAME = 0.05f; // meters
+
+/// An agent connected to our fake mixer, listening on its own loopback socket
+class FakeAgent {
+public:
+    QUuid uuid;
+    QUuid connectionSecret;
+    AvatarData avatar;
+    QUdpSocket socket;
+    AvatarReceiverState receiverState;
+    glm::vec3 startPosition;
+};
+
+// the same work NodeList::writeDatagram() does for the mixer
+static qint64 sendToAgent(QUdpSocket& mixerSocket, const QByteArray& packet, FakeAgent* agent) {
+    QByteArray datagramCopy = packet;
+    replaceHashInPacketGivenConnectionUUID(datagramCopy, agent->connectionSecret);
+    return mixerSocket.writeDatagram(datagramCopy, QHostAddress::LocalHost, agent->socket.localPort());
+}
+
+static void drainAgentSockets(std::vector<FakeAgent*>& agents) {
+    static QByteArray buffer(MAX_PACKET_SIZE, 0);
+    for (size_t i = 0; i < agents.size(); i++) {
+        while (agents[i]->socket.hasPendingDatagrams()) {
+            agents[i]->socket.readDatagram(buffer.data(), buffer.size());
+        }
+    }
+}
+
+// how the avatar mixer used to do it, every agent gets every other avatar, serialized again for each pair
+static qint64 runFullMeshFrame(QUdpSocket& mixerSocket, const QUuid& mixerUUID, std::vector<FakeAgent*>& agents) {
+    static QByteArray mixedAvatarByteArray;
+    int numPacketHeaderBytes = populatePacketHeader(mixedAvatarByteArray, PacketTypeBulkAvatarData, mixerUUID);
+    qint64 bytesSent = 0;
+
+    for (size_t receiver = 0; receiver < agents.size(); receiver++) {
+        mixedAvatarByteArray.resize(numPacketHeaderBytes);
+        for (size_t other = 0; other < agents.size(); other++) {
+            if (other == receiver) {
+                continue;
+            }
+            QByteArray avatarByteArray;
+            avatarByteArray.append(agents[other]->uuid.toRfc4122());
+            avatarByteArray.append(agents[other]->avatar.toByteArray());
+
+            if (avatarByteArray.size() + mixedAvatarByteArray.size() > MAX_PACKET_SIZE) {
+                bytesSent += sendToAgent(mixerSocket, mixedAvatarByteArray, agents[receiver]);
+                mixedAvatarByteArray.resize(numPacketHeaderBytes);
+            }
+            mixedAvatarByteArray.append(avatarByteArray);
+        }
+        bytesSent += sendToAgent(mixerSocket, mixedAvatarByteArray, agents[receiver]);
+    }
+    return bytesSent;
+}
+
+// how the avatar mixer does it now, see broadcastAvatarData(), heard records which avatars each receiver was sent
+static qint64 runInterestFrame(QUdpSocket& mixerSocket, const QUuid& mixerUUID, std::vector<FakeAgent*>& agents,
+                               AvatarInterestManager& interestManager, std::vector<bool>& heard) {
+    static QByteArray mixedAvatarByteArray;
+    static std::vector<int> selectedAvatars;
+    int numPacketHeaderBytes = populatePacketHeader(mixedAvatarByteArray, PacketTypeBulkAvatarData, mixerUUID);
+    qint64 bytesSent = 0;
+
+    interestManager.beginFrame();
+    for (size_t i = 0; i < agents.size(); i++) {
+        QByteArray avatarByteArray = agents[i]->uuid.toRfc4122();
+        avatarByteArray.append(agents[i]->avatar.toByteArray());
+        interestManager.addAvatar(agents[i]->uuid, agents[i]->avatar.getPosition(), avatarByteArray);
+    }
+
+    for (size_t receiver = 0; receiver < agents.size(); receiver++) {
+        mixedAvatarByteArray.resize(numPacketHeaderBytes);
+        interestManager.selectForReceiver(agents[receiver]->uuid, agents[receiver]->avatar.getPosition(),
+                                          agents[receiver]->receiverState, selectedAvatars);
+        for (size_t i = 0; i < selectedAvatars.size(); i++) {
+            const QByteArray& avatarByteArray = interestManager.getPayload(selectedAvatars[i]);
+            if (avatarByteArray.size() + mixedAvatarByteArray.size() > MAX_PACKET_SIZE) {
+                bytesSent += sendToAgent(mixerSocket, mixedAvatarByteArray, agents[receiver]);
+                mixedAvatarByteArray.resize(numPacketHeaderBytes);
+            }
+            mixedAvatarByteArray.append(avatarByteArray);
+
+            // we added the avatars in agent order
+            heard[receiver * agents.size() + selectedAvatars[i]] = true;
+        }
+        bytesSent += sendToAgent(mixerSocket, mixedAvatarByteArray, agents[receiver]);
+    }
+    return bytesSent;
+}
+
+AvatarTests::AvatarTests(int& argc, char** argv) :
+    QCoreApplication(argc, argv) {
+}
+
+bool AvatarTests::run() {
+
+    qDebug() << "Running avatar benchmarks...";
+
+    // seed the random number generator so that our benchmarks are reproducible
+    srand(0xBAAAAABE);
+
+    if (runMixerBenchmark()) {
+        return true;
+    }
+
+    qDebug() << "All benchmarks passed!";
+
+    return false;
+}
+
+bool AvatarTests::runMixerBenchmark() {
+    const int AGENT_COUNTS[] = { 100, 250, 500 };
+    const int NUMBER_OF_AGENT_COUNTS = sizeof(AGENT_COUNTS) / sizeof(AGENT_COUNTS[0]);
+
+    QUdpSocket mixerSocket;
+    if (!mixerSocket.bind(QHostAddress::LocalHost, 0)) {
+        qDebug() << "FAILED: couldn't bind the mixer socket";
+        return true;
+    }
+    QUuid mixerUUID = QUuid::createUuid();
+
+    bool failed = false;
+    for (int countIndex = 0; countIndex < NUMBER_OF_AGENT_COUNTS && !failed; countIndex++) {
+        int agentCount = AGENT_COUNTS[countIndex];
+        int crowdCount = agentCount / 2;
+
+        std::vector<FakeAgent*> agents;
+        for (int i = 0; i < agentCount; i++) {
+            FakeAgent* agent = new FakeAgent();
+            agent->uuid = QUuid::createUuid();
+            agent->connectionSecret = QUuid::createUuid();
+            if (!agent->socket.bind(QHostAddress::LocalHost, 0)) {
+                qDebug() << "FAILED: couldn't bind the socket for agent" << i;
+                failed = true;
+            }
+            if (i < crowdCount) {
+                agent->startPosition = glm::vec3(WORLD_SIZE / 2.0f + (randFloat() - 0.5f) * CROWD_SIZE, 0.0f,
+                                                 WORLD_SIZE / 2.0f + (randFloat() - 0.5f) * CROWD_SIZE);
+            } else {
+                agent->startPosition = glm::vec3(randFloat() * WORLD_SIZE, 0.0f, randFloat() * WORLD_SIZE);
+            }
+            agents.push_back(agent);
+        }
+
+        quint64 frameTimes[2] = { 0, 0 };
+        qint64 bytesSent[2] = { 0, 0 };
+        std::vector<bool> heard(agentCount * agentCount, false);
+        for (int pass = 0; pass < 2 && !failed; pass++) {
+            bool useInterestManager = (pass == 1);
+            AvatarInterestManager interestManager(BENCHMARK_FRAMES_PER_SECOND);
+
+            // both passes walk the same way
+            srand(0xBAAAAABE + agentCount);
+            for (int i = 0; i < agentCount; i++) {
+                agents[i]->avatar.setPosition(agents[i]->startPosition);
+                agents[i]->receiverState = AvatarReceiverState();
+            }
+
+            for (int frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+                for (int i = 0; i < agentCount; i++) {
+                    glm::vec3 step((randFloat() - 0.5f) * WALK_PER_FRAME, 0.0f, (randFloat() - 0.5f) * WALK_PER_FRAME);
+                    agents[i]->avatar.setPosition(agents[i]->avatar.getPosition() + step);
+                }
+
+                quint64 start = usecTimestampNow();
+                if (useInterestManager) {
+                    bytesSent[pass] += runInterestFrame(mixerSocket, mixerUUID, agents, interestManager, heard);
+                } else {
+                    bytesSent[pass] += runFullMeshFrame(mixerSocket, mixerUUID, agents);
+                }
+                frameTimes[pass] += usecTimestampNow() - start;
+
+                // outside of the timing, the agents read what we sent them so that their socket buffers don't fill up
+                drainAgentSockets(agents);
+            }
+        }
+
+        if (!failed) {
+            qDebug() << "agents=" << agentCount
+                << "full mesh frame usecs=" << frameTimes[0] / BENCHMARK_FRAMES
+                << "bytes/agent/frame=" << bytesSent[0] / (agentCount * BENCHMARK_FRAMES)
+                << "interest managed frame usecs=" << frameTimes[1] / BENCHMARK_FRAMES
+                << "bytes/agent/frame=" << bytesSent[1] / (agentCount * BENCHMARK_FRAMES)
+                << "speedup=" << (float)frameTimes[0] / std::max(frameTimes[1], (quint64)1);
+
+            // the crowd is well within full rate distance, the budget may slow them down but mustn't starve anyone
+            for (int receiver = 0; receiver < crowdCount && !failed; receiver++) {
+                for (int other = 0; other < crowdCount; other++) {
+                    if (other != receiver && !heard[receiver * agentCount + other]) {
+                        qDebug() << "FAILED: agent" << receiver << "never heard from agent" << other << "in the crowd";
+                        failed = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < agents.size(); i++) {
+            delete agents[i];
+        }
+    }
+    return failed;
+}
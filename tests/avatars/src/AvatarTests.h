@@ -0,0 +1,32 @@
+//
+//  AvatarTests.h
+//  avatar-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __avatar_tests__AvatarTests__
+#define __avatar_tests__AvatarTests__
+
+#include <QCoreApplication>
+
+/// Benchmarks various aspects of the avatar library.
+class AvatarTests : public QCoreApplication {
+    Q_OBJECT
+
+public:
+
+    AvatarTests(int& argc, char** argv);
+
+    /// Performs our various benchmarks.
+    /// \return true if any of the benchmarks failed.
+    bool run();
+
+private:
+
+    /// Runs avatar mixer frames for hundreds of fake agents over loopback, sending every agent every other avatar the
+    /// way the mixer used to, and then through an AvatarInterestManager, and reports the frame times.
+    bool runMixerBenchmark();
+};
+
+#endif // __avatar_tests__AvatarTests__
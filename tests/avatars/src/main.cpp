@@ -0,0 +1,11 @@
+//
+//  main.cpp
+//  avatar-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+
+#include "AvatarTests.h"
+
+int main(int argc, char** argv) {
+    return AvatarTests(argc, argv).run();
+}
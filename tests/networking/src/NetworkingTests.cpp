@@ -0,0 +1,831 @@
+//
+//  NetworkingTests.cpp
+//  networking-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <stdlib.h>
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QUdpSocket>
+#include <QUuid>
+
+#include <BatchedDatagramSocket.h>
+#include <PacketHeaders.h>
+#include <SharedUtil.h>
+
+#include "NetworkingTests.h"
+
+const int BENCHMARK_PACKETS = 100000;
+const int PACKETS_PER_DRAIN = 100;
+const int BATCHED_BENCHMARK_BURSTS = 5000;
+const int BENCHMARK_NODES = 500;
+const int NODE_BENCHMARK_FRAMES = 2000;
+const int QUEUE_BENCHMARK_PRODUCERS = 4;
+const int QUEUE_BENCHMARK_PACKETS_PER_PRODUCER = 100000;
+const int POOL_BENCHMARK_USERS = 4;
+const int POOL_BENCHMARK_ROUNDS = 200000;
+const int POOL_BENCHMARK_BUFFERS = 12;
+const int BUFFERS_HELD_PER_POOL_USER = 4;
+const int RING_BENCHMARK_CAPACITY = 64;
+const int RING_BENCHMARK_PACKETS = 500000;
+const quint64 STRESS_TEST_TIMEOUT_USECS = 30 * USECS_PER_SECOND;
+const int TEST_PACKET_HEADER_SIZE = 2 * sizeof(int);
+
+// the SipHash-2-4-128 reference vectors: the MACs of the messages 00, 00 01, ... 00 01 .. 3e (and the empty one first)
+// under the key 00 01 .. 0f
+const int NUMBER_OF_SIPHASH_VECTORS = 64;
+const unsigned char SIPHASH_VECTORS[NUMBER_OF_SIPHASH_VECTORS][NUM_BYTES_PACKET_MAC] = {
+    { 0xa3, 0x81, 0x7f, 0x04, 0xba, 0x25, 0xa8, 0xe6, 0x6d, 0xf6, 0x72, 0x14, 0xc7, 0x55, 0x02, 0x93 },
+    { 0xda, 0x87, 0xc1, 0xd8, 0x6b, 0x99, 0xaf, 0x44, 0x34, 0x76, 0x59, 0x11, 0x9b, 0x22, 0xfc, 0x45 },
+    { 0x81, 0x77, 0x22, 0x8d, 0xa4, 0xa4, 0x5d, 0xc7, 0xfc, 0xa3, 0x8b, 0xde, 0xf6, 0x0a, 0xff, 0xe4 },
+    { 0x9c, 0x70, 0xb6, 0x0c, 0x52, 0x67, 0xa9, 0x4e, 0x5f, 0x33, 0xb6, 0xb0, 0x29, 0x85, 0xed, 0x51 },
+    { 0xf8, 0x81, 0x64, 0xc1, 0x2d, 0x9c, 0x8f, 0xaf, 0x7d, 0x0f, 0x6e, 0x7c, 0x7b, 0xcd, 0x55, 0x79 },
+    { 0x13, 0x68, 0x87, 0x59, 0x80, 0x77, 0x6f, 0x88, 0x54, 0x52, 0x7a, 0x07, 0x69, 0x0e, 0x96, 0x27 },
+    { 0x14, 0xee, 0xca, 0x33, 0x8b, 0x20, 0x86, 0x13, 0x48, 0x5e, 0xa0, 0x30, 0x8f, 0xd7, 0xa1, 0x5e },
+    { 0xa1, 0xf1, 0xeb, 0xbe, 0xd8, 0xdb, 0xc1, 0x53, 0xc0, 0xb8, 0x4a, 0xa6, 0x1f, 0xf0, 0x82, 0x39 },
+    { 0x3b, 0x62, 0xa9, 0xba, 0x62, 0x58, 0xf5, 0x61, 0x0f, 0x83, 0xe2, 0x64, 0xf3, 0x14, 0x97, 0xb4 },
+    { 0x26, 0x44, 0x99, 0x06, 0x0a, 0xd9, 0xba, 0xab, 0xc4, 0x7f, 0x8b, 0x02, 0xbb, 0x6d, 0x71, 0xed },
+    { 0x00, 0x11, 0x0d, 0xc3, 0x78, 0x14, 0x69, 0x56, 0xc9, 0x54, 0x47, 0xd3, 0xf3, 0xd0, 0xfb, 0xba },
+    { 0x01, 0x51, 0xc5, 0x68, 0x38, 0x6b, 0x66, 0x77, 0xa2, 0xb4, 0xdc, 0x6f, 0x81, 0xe5, 0xdc, 0x18 },
+    { 0xd6, 0x26, 0xb2, 0x66, 0x90, 0x5e, 0xf3, 0x58, 0x82, 0x63, 0x4d, 0xf6, 0x85, 0x32, 0xc1, 0x25 },
+    { 0x98, 0x69, 0xe2, 0x47, 0xe9, 0xc0, 0x8b, 0x10, 0xd0, 0x29, 0x93, 0x4f, 0xc4, 0xb9, 0x52, 0xf7 },
+    { 0x31, 0xfc, 0xef, 0xac, 0x66, 0xd7, 0xde, 0x9c, 0x7e, 0xc7, 0x48, 0x5f, 0xe4, 0x49, 0x49, 0x02 },
+    { 0x54, 0x93, 0xe9, 0x99, 0x33, 0xb0, 0xa8, 0x11, 0x7e, 0x08, 0xec, 0x0f, 0x97, 0xcf, 0xc3, 0xd9 },
+    { 0x6e, 0xe2, 0xa4, 0xca, 0x67, 0xb0, 0x54, 0xbb, 0xfd, 0x33, 0x15, 0xbf, 0x85, 0x23, 0x05, 0x77 },
+    { 0x47, 0x3d, 0x06, 0xe8, 0x73, 0x8d, 0xb8, 0x98, 0x54, 0xc0, 0x66, 0xc4, 0x7a, 0xe4, 0x77, 0x40 },
+    { 0xa4, 0x26, 0xe5, 0xe4, 0x23, 0xbf, 0x48, 0x85, 0x29, 0x4d, 0xa4, 0x81, 0xfe, 0xae, 0xf7, 0x23 },
+    { 0x78, 0x01, 0x77, 0x31, 0xcf, 0x65, 0xfa, 0xb0, 0x74, 0xd5, 0x20, 0x89, 0x52, 0x51, 0x2e, 0xb1 },
+    { 0x9e, 0x25, 0xfc, 0x83, 0x3f, 0x22, 0x90, 0x73, 0x3e, 0x93, 0x44, 0xa5, 0xe8, 0x38, 0x39, 0xeb },
+    { 0x56, 0x8e, 0x49, 0x5a, 0xbe, 0x52, 0x5a, 0x21, 0x8a, 0x22, 0x14, 0xcd, 0x3e, 0x07, 0x1d, 0x12 },
+    { 0x4a, 0x29, 0xb5, 0x45, 0x52, 0xd1, 0x6b, 0x9a, 0x46, 0x9c, 0x10, 0x52, 0x8e, 0xff, 0x0a, 0xae },
+    { 0xc9, 0xd1, 0x84, 0xdd, 0xd5, 0xa9, 0xf5, 0xe0, 0xcf, 0x8c, 0xe2, 0x9a, 0x9a, 0xbf, 0x69, 0x1c },
+    { 0x2d, 0xb4, 0x79, 0xae, 0x78, 0xbd, 0x50, 0xd8, 0x88, 0x2a, 0x8a, 0x17, 0x8a, 0x61, 0x32, 0xad },
+    { 0x8e, 0xce, 0x5f, 0x04, 0x2d, 0x5e, 0x44, 0x7b, 0x50, 0x51, 0xb9, 0xea, 0xcb, 0x8d, 0x8f, 0x6f },
+    { 0x9c, 0x0b, 0x53, 0xb4, 0xb3, 0xc3, 0x07, 0xe8, 0x7e, 0xae, 0xe0, 0x86, 0x78, 0x14, 0x1f, 0x66 },
+    { 0xab, 0xf2, 0x48, 0xaf, 0x69, 0xa6, 0xea, 0xe4, 0xbf, 0xd3, 0xeb, 0x2f, 0x12, 0x9e, 0xeb, 0x94 },
+    { 0x06, 0x64, 0xda, 0x16, 0x68, 0x57, 0x4b, 0x88, 0xb9, 0x35, 0xf3, 0x02, 0x73, 0x58, 0xae, 0xf4 },
+    { 0xaa, 0x4b, 0x9d, 0xc4, 0xbf, 0x33, 0x7d, 0xe9, 0x0c, 0xd4, 0xfd, 0x3c, 0x46, 0x7c, 0x6a, 0xb7 },
+    { 0xea, 0x5c, 0x7f, 0x47, 0x1f, 0xaf, 0x6b, 0xde, 0x2b, 0x1a, 0xd7, 0xd4, 0x68, 0x6d, 0x22, 0x87 },
+    { 0x29, 0x39, 0xb0, 0x18, 0x32, 0x23, 0xfa, 0xfc, 0x17, 0x23, 0xde, 0x4f, 0x52, 0xc4, 0x3d, 0x35 },
+    { 0x7c, 0x39, 0x56, 0xca, 0x5e, 0xea, 0xfc, 0x3e, 0x36, 0x3e, 0x9d, 0x55, 0x65, 0x46, 0xeb, 0x68 },
+    { 0x77, 0xc6, 0x07, 0x71, 0x46, 0xf0, 0x1c, 0x32, 0xb6, 0xb6, 0x9d, 0x5f, 0x4e, 0xa9, 0xff, 0xcf },
+    { 0x37, 0xa6, 0x98, 0x6c, 0xb8, 0x84, 0x7e, 0xdf, 0x09, 0x25, 0xf0, 0xf1, 0x30, 0x9b, 0x54, 0xde },
+    { 0xa7, 0x05, 0xf0, 0xe6, 0x9d, 0xa9, 0xa8, 0xf9, 0x07, 0x24, 0x1a, 0x2e, 0x92, 0x3c, 0x8c, 0xc8 },
+    { 0x3d, 0xc4, 0x7d, 0x1f, 0x29, 0xc4, 0x48, 0x46, 0x1e, 0x9e, 0x76, 0xed, 0x90, 0x4f, 0x67, 0x11 },
+    { 0x0d, 0x62, 0xbf, 0x01, 0xe6, 0xfc, 0x0e, 0x1a, 0x0d, 0x3c, 0x47, 0x51, 0xc5, 0xd3, 0x69, 0x2b },
+    { 0x8c, 0x03, 0x46, 0x8b, 0xca, 0x7c, 0x66, 0x9e, 0xe4, 0xfd, 0x5e, 0x08, 0x4b, 0xbe, 0xe7, 0xb5 },
+    { 0x52, 0x8a, 0x5b, 0xb9, 0x3b, 0xaf, 0x2c, 0x9c, 0x44, 0x73, 0xcc, 0xe5, 0xd0, 0xd2, 0x2b, 0xd9 },
+    { 0xdf, 0x6a, 0x30, 0x1e, 0x95, 0xc9, 0x5d, 0xad, 0x97, 0xae, 0x0c, 0xc8, 0xc6, 0x91, 0x3b, 0xd8 },
+    { 0x80, 0x11, 0x89, 0x90, 0x2c, 0x85, 0x7f, 0x39, 0xe7, 0x35, 0x91, 0x28, 0x5e, 0x70, 0xb6, 0xdb },
+    { 0xe6, 0x17, 0x34, 0x6a, 0xc9, 0xc2, 0x31, 0xbb, 0x36, 0x50, 0xae, 0x34, 0xcc, 0xca, 0x0c, 0x5b },
+    { 0x27, 0xd9, 0x34, 0x37, 0xef, 0xb7, 0x21, 0xaa, 0x40, 0x18, 0x21, 0xdc, 0xec, 0x5a, 0xdf, 0x89 },
+    { 0x89, 0x23, 0x7d, 0x9d, 0xed, 0x9c, 0x5e, 0x78, 0xd8, 0xb1, 0xc9, 0xb1, 0x66, 0xcc, 0x73, 0x42 },
+    { 0x4a, 0x6d, 0x80, 0x91, 0xbf, 0x5e, 0x7d, 0x65, 0x11, 0x89, 0xfa, 0x94, 0xa2, 0x50, 0xb1, 0x4c },
+    { 0x0e, 0x33, 0xf9, 0x60, 0x55, 0xe7, 0xae, 0x89, 0x3f, 0xfc, 0x0e, 0x3d, 0xcf, 0x49, 0x29, 0x02 },
+    { 0xe6, 0x1c, 0x43, 0x2b, 0x72, 0x0b, 0x19, 0xd1, 0x8e, 0xc8, 0xd8, 0x4b, 0xdc, 0x63, 0x15, 0x1b },
+    { 0xf7, 0xe5, 0xae, 0xf5, 0x49, 0xf7, 0x82, 0xcf, 0x37, 0x90, 0x55, 0xa6, 0x08, 0x26, 0x9b, 0x16 },
+    { 0x43, 0x8d, 0x03, 0x0f, 0xd0, 0xb7, 0xa5, 0x4f, 0xa8, 0x37, 0xf2, 0xad, 0x20, 0x1a, 0x64, 0x03 },
+    { 0xa5, 0x90, 0xd3, 0xee, 0x4f, 0xbf, 0x04, 0xe3, 0x24, 0x7e, 0x0d, 0x27, 0xf2, 0x86, 0x42, 0x3f },
+    { 0x5f, 0xe2, 0xc1, 0xa1, 0x72, 0xfe, 0x93, 0xc4, 0xb1, 0x5c, 0xd3, 0x7c, 0xae, 0xf9, 0xf5, 0x38 },
+    { 0x2c, 0x97, 0x32, 0x5c, 0xbd, 0x06, 0xb3, 0x6e, 0xb2, 0x13, 0x3d, 0xd0, 0x8b, 0x3a, 0x01, 0x7c },
+    { 0x92, 0xc8, 0x14, 0x22, 0x7a, 0x6b, 0xca, 0x94, 0x9f, 0xf0, 0x65, 0x9f, 0x00, 0x2a, 0xd3, 0x9e },
+    { 0xdc, 0xe8, 0x50, 0x11, 0x0b, 0xd8, 0x32, 0x8c, 0xfb, 0xd5, 0x08, 0x41, 0xd6, 0x91, 0x1d, 0x87 },
+    { 0x67, 0xf1, 0x49, 0x84, 0xc7, 0xda, 0x79, 0x12, 0x48, 0xe3, 0x2b, 0xb5, 0x92, 0x25, 0x83, 0xda },
+    { 0x19, 0x38, 0xf2, 0xcf, 0x72, 0xd5, 0x4e, 0xe9, 0x7e, 0x94, 0x16, 0x6f, 0xa9, 0x1d, 0x2a, 0x36 },
+    { 0x74, 0x48, 0x1e, 0x96, 0x46, 0xed, 0x49, 0xfe, 0x0f, 0x62, 0x24, 0x30, 0x16, 0x04, 0x69, 0x8e },
+    { 0x57, 0xfc, 0xa5, 0xde, 0x98, 0xa9, 0xd6, 0xd8, 0x00, 0x64, 0x38, 0xd0, 0x58, 0x3d, 0x8a, 0x1d },
+    { 0x9f, 0xec, 0xde, 0x1c, 0xef, 0xdc, 0x1c, 0xbe, 0xd4, 0x76, 0x36, 0x74, 0xd9, 0x57, 0x53, 0x59 },
+    { 0xe3, 0x04, 0x0c, 0x00, 0xeb, 0x28, 0xf1, 0x53, 0x66, 0xca, 0x73, 0xcb, 0xd8, 0x72, 0xe7, 0x40 },
+    { 0x76, 0x97, 0x00, 0x9a, 0x6a, 0x83, 0x1d, 0xfe, 0xcc, 0xa9, 0x1c, 0x59, 0x93, 0x67, 0x0f, 0x7a },
+    { 0x58, 0x53, 0x54, 0x23, 0x21, 0xf5, 0x67, 0xa0, 0x05, 0xd5, 0x47, 0xa4, 0xf0, 0x47, 0x59, 0xbd },
+    { 0x51, 0x50, 0xd1, 0x77, 0x2f, 0x50, 0x83, 0x4a, 0x50, 0x3e, 0x06, 0x9a, 0x97, 0x3f, 0xbd, 0x7c },
+};
+
+// how NodeList used to hash a packet, copying out the payload and appending the secret to MD5 it
+static QByteArray legacyHash(const QByteArray& packet, const QUuid& connectionSecret) {
+    return QCryptographicHash::hash(packet.mid(numBytesForPacketHeader(packet)) + connectionSecret.toRfc4122(),
+                                    QCryptographicHash::Md5);
+}
+
+static bool legacyHashMatches(const QByteArray& packet, const QUuid& connectionSecret) {
+    return hashFromPacketHeader(packet) == legacyHash(packet, connectionSecret);
+}
+
+// how NodeList used to send a packet, copying it into a QByteArray twice before hashing it
+static qint64 legacySend(QUdpSocket& socket, const char* data, int size, const QUuid& connectionSecret, quint16 port) {
+    QByteArray datagram(data, size);
+    QByteArray datagramCopy = datagram;
+    datagramCopy.replace(numBytesForPacketHeader(datagramCopy) - NUM_BYTES_PACKET_MAC, NUM_BYTES_PACKET_MAC,
+                         legacyHash(datagramCopy, connectionSecret));
+    return socket.writeDatagram(datagramCopy, QHostAddress::LocalHost, port);
+}
+
+// the way NodeList sends now, see NodeList::writeDatagram()
+static qint64 send(QUdpSocket& socket, const char* data, int size, const PacketAuthenticationKey& key, quint16 port) {
+    char datagramCopy[MAX_PACKET_SIZE];
+    memcpy(datagramCopy, data, size);
+    replaceHashInPacket(datagramCopy, size, key);
+    return socket.writeDatagram(datagramCopy, size, QHostAddress::LocalHost, port);
+}
+
+// how NodeList used to look up a node, under its recursive mutex
+static SharedNodePointer legacyNodeWithUUID(QMutex& mutex, const NodeHash& hash, const QUuid& nodeUUID) {
+    QMutexLocker locker(&mutex);
+    return hash.value(nodeUUID);
+}
+
+// how NodeList used to hand out its nodes, copied under its recursive mutex
+static NodeHash legacyGetNodeHash(QMutex& mutex, const NodeHash& hash) {
+    QMutexLocker locker(&mutex);
+    return NodeHash(hash);
+}
+
+static void ignoreMessage(QtMsgType, const QMessageLogContext&, const QString&) {
+}
+
+static void drainSocket(QUdpSocket& socket) {
+    static char buffer[MAX_PACKET_SIZE];
+    while (socket.hasPendingDatagrams()) {
+        socket.readDatagram(buffer, MAX_PACKET_SIZE);
+    }
+}
+
+// writes a test packet numbered by the thread that sends it and its place in that thread's packets, with a size and
+// contents that follow from the numbers so they can be checked when it comes out
+static int fillTestPacket(char* data, int producerIndex, int sequence) {
+    int size = TEST_PACKET_HEADER_SIZE + sequence % (MAX_PACKET_SIZE - TEST_PACKET_HEADER_SIZE);
+    memcpy(data, &producerIndex, sizeof(int));
+    memcpy(data + sizeof(int), &sequence, sizeof(int));
+    for (int i = TEST_PACKET_HEADER_SIZE; i < size; i++) {
+        data[i] = (char) (i + sequence);
+    }
+    return size;
+}
+
+// reads back the numbers of a packet from fillTestPacket(), returning false if its size or contents don't match them
+static bool readTestPacket(const char* data, int size, int& producerIndex, int& sequence) {
+    if (size < TEST_PACKET_HEADER_SIZE) {
+        return false;
+    }
+    memcpy(&producerIndex, data, sizeof(int));
+    memcpy(&sequence, data + sizeof(int), sizeof(int));
+    if (sequence < 0 || size != TEST_PACKET_HEADER_SIZE + sequence % (MAX_PACKET_SIZE - TEST_PACKET_HEADER_SIZE)) {
+        return false;
+    }
+    for (int i = TEST_PACKET_HEADER_SIZE; i < size; i++) {
+        if (data[i] != (char) (i + sequence)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+NetworkingTests::NetworkingTests(int& argc, char** argv) :
+    QCoreApplication(argc, argv) {
+}
+
+bool NetworkingTests::run() {
+
+    qDebug() << "Running networking benchmarks...";
+
+    // seed the random number generator so that our benchmarks are reproducible
+    srand(0xBAAAAABE);
+
+    if (runPacketAuthenticationBenchmark()) {
+        return true;
+    }
+    
+    if (runBatchedDatagramBenchmark()) {
+        return true;
+    }
+    
+    if (runNodeHashBenchmark()) {
+        return true;
+    }
+    
+    if (runPacketQueueBenchmark()) {
+        return true;
+    }
+    
+    if (runPacketBufferPoolBenchmark()) {
+        return true;
+    }
+    
+    if (runPacketRingBenchmark()) {
+        return true;
+    }
+
+    qDebug() << "All benchmarks passed!";
+
+    return false;
+}
+
+bool NetworkingTests::runPacketAuthenticationBenchmark() {
+    const int PAYLOAD_SIZES[] = { 64, 512, 1400 };
+    const int NUMBER_OF_PAYLOAD_SIZES = sizeof(PAYLOAD_SIZES) / sizeof(PAYLOAD_SIZES[0]);
+
+    QUdpSocket sendingSocket;
+    QUdpSocket receivingSocket;
+    if (!sendingSocket.bind(QHostAddress::LocalHost, 0) || !receivingSocket.bind(QHostAddress::LocalHost, 0)) {
+        qDebug() << "FAILED: couldn't bind the sockets";
+        return true;
+    }
+    quint16 port = receivingSocket.localPort();
+
+    // the MAC has to be SipHash-2-4-128 as published, or nodes built some other way couldn't talk to ours
+    char referenceKey[NUM_BYTES_RFC4122_UUID];
+    char referenceMessage[NUMBER_OF_SIPHASH_VECTORS];
+    for (int i = 0; i < NUMBER_OF_SIPHASH_VECTORS; i++) {
+        referenceMessage[i] = (char) i;
+        if (i < NUM_BYTES_RFC4122_UUID) {
+            referenceKey[i] = (char) i;
+        }
+    }
+    PacketAuthenticationKey referenceAuthenticationKey(QUuid::fromRfc4122(QByteArray(referenceKey,
+                                                                                     NUM_BYTES_RFC4122_UUID)));
+    for (int i = 0; i < NUMBER_OF_SIPHASH_VECTORS; i++) {
+        char mac[NUM_BYTES_PACKET_MAC];
+        referenceAuthenticationKey.computeMAC(referenceMessage, i, mac);
+        if (memcmp(mac, SIPHASH_VECTORS[i], NUM_BYTES_PACKET_MAC) != 0 ||
+                !referenceAuthenticationKey.macMatches(referenceMessage, i, (const char*) SIPHASH_VECTORS[i])) {
+            qDebug() << "FAILED: packet MAC of the" << i << "byte reference message isn't the SipHash-2-4-128 one";
+            return true;
+        }
+    }
+
+    QUuid senderUUID = QUuid::createUuid();
+    QUuid connectionSecret = QUuid::createUuid();
+    PacketAuthenticationKey key(connectionSecret);
+
+    for (int sizeIndex = 0; sizeIndex < NUMBER_OF_PAYLOAD_SIZES; sizeIndex++) {
+        QByteArray packet;
+        int numBytesPacketHeader = populatePacketHeader(packet, PacketTypeAvatarData, senderUUID);
+        for (int i = 0; i < PAYLOAD_SIZES[sizeIndex]; i++) {
+            packet.append((char) randIntInRange(0, 255));
+        }
+
+        // the MAC has to hold up before we bother timing it
+        replaceHashInPacket(packet.data(), packet.size(), key);
+        if (!packetHashMatches(packet.constData(), packet.size(), key)) {
+            qDebug() << "FAILED: packet MAC didn't verify";
+            return true;
+        }
+        QByteArray tamperedPacket = packet;
+        tamperedPacket[numBytesPacketHeader + PAYLOAD_SIZES[sizeIndex] / 2] =
+            tamperedPacket[numBytesPacketHeader + PAYLOAD_SIZES[sizeIndex] / 2] ^ 1;
+        if (packetHashMatches(tamperedPacket.constData(), tamperedPacket.size(), key) ||
+                packetHashMatches(packet.constData(), packet.size(), PacketAuthenticationKey(QUuid::createUuid()))) {
+            qDebug() << "FAILED: packet MAC verified a tampered packet, or the wrong key";
+            return true;
+        }
+
+        quint64 verifyTimes[2];
+        quint64 verifyAndSendTimes[2];
+        for (int pass = 0; pass < 2; pass++) {
+            bool useLegacy = (pass == 0);
+            QByteArray legacyPacket = packet;
+            legacyPacket.replace(numBytesPacketHeader - NUM_BYTES_PACKET_MAC, NUM_BYTES_PACKET_MAC,
+                                 legacyHash(packet, connectionSecret));
+            const QByteArray& verifiedPacket = useLegacy ? legacyPacket : packet;
+
+            int verified = 0;
+            quint64 start = usecTimestampNow();
+            for (int i = 0; i < BENCHMARK_PACKETS; i++) {
+                if (useLegacy ? legacyHashMatches(verifiedPacket, connectionSecret) :
+                        packetHashMatches(verifiedPacket.constData(), verifiedPacket.size(), key)) {
+                    verified++;
+                }
+            }
+            verifyTimes[pass] = usecTimestampNow() - start;
+
+            start = usecTimestampNow();
+            for (int i = 0; i < BENCHMARK_PACKETS; i++) {
+                if (useLegacy) {
+                    legacyHashMatches(verifiedPacket, connectionSecret);
+                    legacySend(sendingSocket, verifiedPacket.constData(), verifiedPacket.size(),
+                               connectionSecret, port);
+                } else {
+                    packetHashMatches(verifiedPacket.constData(), verifiedPacket.size(), key);
+                    send(sendingSocket, verifiedPacket.constData(), verifiedPacket.size(), key, port);
+                }
+                if (i % PACKETS_PER_DRAIN == 0) {
+                    drainSocket(receivingSocket);
+                }
+            }
+            verifyAndSendTimes[pass] = usecTimestampNow() - start;
+
+            if (verified != BENCHMARK_PACKETS) {
+                qDebug() << "FAILED:" << (useLegacy ? "MD5 hash" : "packet MAC") << "didn't verify every packet";
+                return true;
+            }
+        }
+        drainSocket(receivingSocket);
+
+        qDebug() << PAYLOAD_SIZES[sizeIndex] << "byte payloads, packets per second on one core... verify: MD5"
+            << (quint64) BENCHMARK_PACKETS * USECS_PER_SECOND / std::max(verifyTimes[0], (quint64) 1)
+            << "MAC" << (quint64) BENCHMARK_PACKETS * USECS_PER_SECOND / std::max(verifyTimes[1], (quint64) 1)
+            << "verify and send: MD5"
+            << (quint64) BENCHMARK_PACKETS * USECS_PER_SECOND / std::max(verifyAndSendTimes[0], (quint64) 1)
+            << "MAC" << (quint64) BENCHMARK_PACKETS * USECS_PER_SECOND / std::max(verifyAndSendTimes[1], (quint64) 1);
+    }
+
+    return false;
+}
+
+bool NetworkingTests::runBatchedDatagramBenchmark() {
+    // about the size of a mixed audio packet
+    const int PACKET_SIZE = 1100;
+    
+    QUdpSocket sendingSocket;
+    QUdpSocket receivingSocket;
+    if (!sendingSocket.bind(QHostAddress::LocalHost, 0) || !receivingSocket.bind(QHostAddress::LocalHost, 0)) {
+        qDebug() << "FAILED: couldn't bind the sockets";
+        return true;
+    }
+    HifiSockAddr receivingSockAddr(QHostAddress::LocalHost, receivingSocket.localPort());
+    
+    QByteArray packet;
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        packet.append((char) randIntInRange(0, 255));
+    }
+    
+    quint64 elapsedTimes[2];
+    clock_t cpuTimes[2];
+    quint64 numSystemCalls[2];
+    bool wasBatching = false;
+    for (int pass = 0; pass < 2; pass++) {
+        BatchedDatagramSocket sender(sendingSocket);
+        BatchedDatagramSocket receiver(receivingSocket);
+        bool useBatches = (pass == 1);
+        if (!useBatches) {
+            sender.disableBatching();
+            receiver.disableBatching();
+        }
+        wasBatching = sender.isBatching();
+        
+        int numReceived = 0;
+        bool allMatched = true;
+        quint64 start = usecTimestampNow();
+        clock_t cpuStart = clock();
+        for (int burst = 0; burst < BATCHED_BENCHMARK_BURSTS; burst++) {
+            // one burst is what the audio mixer sends in a frame to a full server, written out and then read back
+            for (int i = 0; i < DATAGRAM_BATCH_SIZE; i++) {
+                sender.queueDatagram(packet.constData(), packet.size(), receivingSockAddr);
+            }
+            sender.flush();
+            
+            const char* data;
+            int size;
+            HifiSockAddr senderSockAddr;
+            while (receiver.nextDatagram(data, size, senderSockAddr)) {
+                if (size != packet.size() || memcmp(data, packet.constData(), size) != 0
+                        || senderSockAddr.getPort() != sendingSocket.localPort()) {
+                    allMatched = false;
+                }
+                numReceived++;
+            }
+        }
+        elapsedTimes[pass] = usecTimestampNow() - start;
+        cpuTimes[pass] = clock() - cpuStart;
+        numSystemCalls[pass] = sender.getNumSendCalls() + receiver.getNumReceiveCalls();
+        
+        if (!allMatched) {
+            qDebug() << "FAILED:" << (useBatches ? "batched" : "unbatched") << "datagrams didn't arrive intact";
+            return true;
+        }
+        // loopback can still drop a datagram under load, but not a meaningful number of them
+        const float MIN_DELIVERED_RATIO = 0.99f;
+        int numSent = BATCHED_BENCHMARK_BURSTS * DATAGRAM_BATCH_SIZE;
+        if (numReceived < numSent * MIN_DELIVERED_RATIO || (int) sender.getNumSentDatagrams() != numSent) {
+            qDebug() << "FAILED:" << (useBatches ? "batched" : "unbatched") << "sent" << sender.getNumSentDatagrams()
+                << "and received" << numReceived << "of" << numSent << "datagrams";
+            return true;
+        }
+    }
+    
+    const quint64 numPackets = BATCHED_BENCHMARK_BURSTS * DATAGRAM_BATCH_SIZE;
+    qDebug() << "Datagrams" << (wasBatching ? "batched with recvmmsg/sendmmsg" : "not batched on this platform")
+        << "- packets per second... unbatched:"
+        << numPackets * USECS_PER_SECOND / std::max(elapsedTimes[0], (quint64) 1)
+        << "batched:" << numPackets * USECS_PER_SECOND / std::max(elapsedTimes[1], (quint64) 1);
+    qDebug() << "CPU usecs per packet... unbatched:"
+        << (float) cpuTimes[0] * USECS_PER_SECOND / CLOCKS_PER_SEC / numPackets
+        << "batched:" << (float) cpuTimes[1] * USECS_PER_SECOND / CLOCKS_PER_SEC / numPackets
+        << "system calls per packet... unbatched:" << (float) numSystemCalls[0] / numPackets
+        << "batched:" << (float) numSystemCalls[1] / numPackets;
+    
+    return false;
+}
+
+bool NetworkingTests::runNodeHashBenchmark() {
+    NodeList* nodeList = NodeList::createInstance(NodeType::AudioMixer);
+    
+    // don't log every node as it's added
+    QtMessageHandler previousHandler = qInstallMessageHandler(ignoreMessage);
+    QVector<QUuid> nodeUUIDs;
+    for (int i = 0; i < BENCHMARK_NODES; i++) {
+        HifiSockAddr nodeSockAddr(QHostAddress::LocalHost, i + 1);
+        nodeUUIDs.append(nodeList->addOrUpdateNode(QUuid::createUuid(), NodeType::Agent, nodeSockAddr,
+                                                   nodeSockAddr)->getUUID());
+    }
+    qInstallMessageHandler(previousHandler);
+    
+    // a packet from every node, to look the sender up from
+    QVector<QByteArray> packets;
+    for (int i = 0; i < BENCHMARK_NODES; i++) {
+        QByteArray packet;
+        populatePacketHeader(packet, PacketTypeMicrophoneAudioNoEcho, nodeUUIDs[i]);
+        packets.append(packet);
+    }
+    
+    // the snapshots have to keep up with nodes coming and going before we bother timing them
+    NodeHash nodeHash = nodeList->getNodeHash();
+    if (nodeHash.size() != BENCHMARK_NODES || nodeList->sendingNodeForPacket(packets[0])->getUUID() != nodeUUIDs[0]) {
+        qDebug() << "FAILED: node hash snapshot is missing nodes";
+        return true;
+    }
+    previousHandler = qInstallMessageHandler(ignoreMessage);
+    nodeList->killNodeWithUUID(nodeUUIDs[0]);
+    bool killedNodeFound = nodeList->nodeWithUUID(nodeUUIDs[0])
+        || nodeList->getNodeHash().size() != BENCHMARK_NODES - 1;
+    HifiSockAddr nodeSockAddr(QHostAddress::LocalHost, 1);
+    nodeList->addOrUpdateNode(nodeUUIDs[0], NodeType::Agent, nodeSockAddr, nodeSockAddr);
+    qInstallMessageHandler(previousHandler);
+    if (killedNodeFound || !nodeList->nodeWithUUID(nodeUUIDs[0]) || nodeHash.size() != BENCHMARK_NODES) {
+        qDebug() << "FAILED: node hash snapshot didn't follow a node being killed and added back";
+        return true;
+    }
+    
+    QMutex legacyMutex(QMutex::Recursive);
+    NodeHash legacyHash = nodeList->getNodeHash();
+    
+    quint64 frameTimes[2];
+    quint64 lookupTimes[2];
+    int otherThreadLookups[2];
+    for (int pass = 0; pass < 2; pass++) {
+        bool useLegacy = (pass == 0);
+        NodeLookupThread lookupThread(nodeUUIDs, useLegacy ? &legacyMutex : NULL, useLegacy ? &legacyHash : NULL);
+        lookupThread.start();
+        
+        // a frame walks the nodes three times, like the audio mixer, and looks up the sender of a packet from each
+        int agentsSeen = 0;
+        int sendersFound = 0;
+        quint64 start = usecTimestampNow();
+        for (int frame = 0; frame < NODE_BENCHMARK_FRAMES; frame++) {
+            for (int walk = 0; walk < 3; walk++) {
+                foreach (const SharedNodePointer& node, useLegacy ? legacyGetNodeHash(legacyMutex, legacyHash) :
+                         nodeList->getNodeHash()) {
+                    if (node->getType() == NodeType::Agent) {
+                        agentsSeen++;
+                    }
+                }
+            }
+            for (int i = 0; i < BENCHMARK_NODES; i++) {
+                if (useLegacy ? legacyNodeWithUUID(legacyMutex, legacyHash, uuidFromPacketHeader(packets[i])) :
+                        nodeList->sendingNodeForPacket(packets[i])) {
+                    sendersFound++;
+                }
+            }
+        }
+        frameTimes[pass] = usecTimestampNow() - start;
+        
+        // and on their own, the lookups done for every packet received
+        start = usecTimestampNow();
+        for (int i = 0; i < NODE_BENCHMARK_FRAMES * BENCHMARK_NODES; i++) {
+            if (useLegacy ? legacyNodeWithUUID(legacyMutex, legacyHash, nodeUUIDs[i % BENCHMARK_NODES]) :
+                    nodeList->nodeWithUUID(nodeUUIDs[i % BENCHMARK_NODES])) {
+                sendersFound++;
+            }
+        }
+        lookupTimes[pass] = usecTimestampNow() - start;
+        
+        lookupThread.stop();
+        lookupThread.wait();
+        otherThreadLookups[pass] = lookupThread.getLookups();
+        
+        if (agentsSeen != 3 * NODE_BENCHMARK_FRAMES * BENCHMARK_NODES ||
+                sendersFound != 2 * NODE_BENCHMARK_FRAMES * BENCHMARK_NODES) {
+            qDebug() << "FAILED:" << (useLegacy ? "locked copies" : "snapshots") << "lost track of nodes";
+            return true;
+        }
+    }
+    
+    const float NSECS_PER_USEC = 1000.0f;
+    qDebug() << BENCHMARK_NODES << "nodes, usecs per mixer frame... locked copies:"
+        << (float) frameTimes[0] / NODE_BENCHMARK_FRAMES
+        << "snapshots:" << (float) frameTimes[1] / NODE_BENCHMARK_FRAMES
+        << "nsecs per packet lookup... locked copies:"
+        << (float) lookupTimes[0] * NSECS_PER_USEC / (NODE_BENCHMARK_FRAMES * BENCHMARK_NODES)
+        << "snapshots:" << (float) lookupTimes[1] * NSECS_PER_USEC / (NODE_BENCHMARK_FRAMES * BENCHMARK_NODES)
+        << "lookups on the other thread meanwhile... locked copies:" << otherThreadLookups[0]
+        << "snapshots:" << otherThreadLookups[1];
+    
+    return false;
+}
+
+bool NetworkingTests::runPacketQueueBenchmark() {
+    const int TOTAL_PACKETS = QUEUE_BENCHMARK_PRODUCERS * QUEUE_BENCHMARK_PACKETS_PER_PRODUCER;
+    PacketBufferPool& pool = PacketBufferPool::getInstance();
+    
+    // the first queue has to give every packet a buffer, the second can drop them when the pool runs out
+    quint64 queueTimes[2];
+    int droppedPackets[2];
+    int overflowPackets[2];
+    for (int pass = 0; pass < 2; pass++) {
+        bool dropsWhenPoolIsEmpty = (pass == 1);
+        PacketQueue queue(dropsWhenPoolIsEmpty);
+        
+        QVector<PacketQueueProducerThread*> producers;
+        for (int i = 0; i < QUEUE_BENCHMARK_PRODUCERS; i++) {
+            producers.append(new PacketQueueProducerThread(&queue, i, QUEUE_BENCHMARK_PACKETS_PER_PRODUCER));
+        }
+        quint64 start = usecTimestampNow();
+        foreach (PacketQueueProducerThread* producer, producers) {
+            producer->start();
+        }
+        
+        // each producer's packets have to come out in the order it queued them, each of them once
+        QVector<int> nextSequences(QUEUE_BENCHMARK_PRODUCERS, 0);
+        int receivedPackets = 0;
+        bool outOfOrder = false;
+        bool corrupted = false;
+        quint64 lastProgress = start;
+        while (receivedPackets + queue.getDroppedPackets() < TOTAL_PACKETS) {
+            PacketBuffer* packet = queue.takePacket();
+            if (!packet) {
+                if (usecTimestampNow() - lastProgress > STRESS_TEST_TIMEOUT_USECS) {
+                    break;
+                }
+                QThread::yieldCurrentThread();
+                continue;
+            }
+            int producerIndex, sequence;
+            if (!readTestPacket(packet->getData(), packet->getSize(), producerIndex, sequence) ||
+                    producerIndex < 0 || producerIndex >= QUEUE_BENCHMARK_PRODUCERS) {
+                corrupted = true;
+            } else if (dropsWhenPoolIsEmpty ? sequence < nextSequences[producerIndex] :
+                    sequence != nextSequences[producerIndex]) {
+                outOfOrder = true;
+            } else {
+                nextSequences[producerIndex] = sequence + 1;
+            }
+            queue.releasePacket(packet);
+            receivedPackets++;
+            lastProgress = usecTimestampNow();
+        }
+        queueTimes[pass] = usecTimestampNow() - start;
+        
+        foreach (PacketQueueProducerThread* producer, producers) {
+            producer->wait();
+            delete producer;
+        }
+        droppedPackets[pass] = queue.getDroppedPackets();
+        overflowPackets[pass] = queue.getOverflowPackets();
+        
+        const char* queueName = dropsWhenPoolIsEmpty ? "dropping queue" : "non-dropping queue";
+        if (corrupted) {
+            qDebug() << "FAILED:" << queueName << "handed out a packet with the wrong contents";
+            return true;
+        }
+        if (outOfOrder) {
+            qDebug() << "FAILED:" << queueName << "handed out a producer's packets twice or out of order";
+            return true;
+        }
+        if (receivedPackets + droppedPackets[pass] != TOTAL_PACKETS || queue.takePacket() || queue.size() != 0) {
+            qDebug() << "FAILED:" << queueName << "received" << receivedPackets << "and dropped" << droppedPackets[pass]
+                << "of" << TOTAL_PACKETS << "packets, with" << queue.size() << "still counted as queued";
+            return true;
+        }
+        if (!dropsWhenPoolIsEmpty && droppedPackets[pass] != 0) {
+            qDebug() << "FAILED: non-dropping queue dropped" << droppedPackets[pass] << "packets";
+            return true;
+        }
+        if (pool.getNumInUse() != 0) {
+            qDebug() << "FAILED:" << queueName << "left" << pool.getNumInUse() << "packet buffers in use";
+            return true;
+        }
+
+        // a reset asked for by another thread, like the stats page's, is left to the consumer's next take
+        queue.resetWaitStats();
+        bool resetWaitedForConsumer = queue.getTotalTakenPackets() == (quint64)receivedPackets;
+        queue.takePacket();
+        if (!resetWaitedForConsumer || queue.getTotalTakenPackets() != 0 || queue.getMaxWaitTime() != 0) {
+            qDebug() << "FAILED:" << queueName << "didn't reset its wait stats on the consumer's next take";
+            return true;
+        }
+    }
+    
+    qDebug() << QUEUE_BENCHMARK_PRODUCERS << "producers, packets per second through the queue... non-dropping:"
+        << (float) TOTAL_PACKETS * USECS_PER_SECOND / queueTimes[0]
+        << "with" << overflowPackets[0] << "in buffers of their own"
+        << "dropping:" << (float) TOTAL_PACKETS * USECS_PER_SECOND / queueTimes[1]
+        << "with" << droppedPackets[1] << "dropped";
+    
+    return false;
+}
+
+bool NetworkingTests::runPacketBufferPoolBenchmark() {
+    PacketBufferPool pool(POOL_BENCHMARK_BUFFERS);
+    
+    QVector<PacketBufferPoolUserThread*> users;
+    for (int i = 0; i < POOL_BENCHMARK_USERS; i++) {
+        users.append(new PacketBufferPoolUserThread(&pool, i, POOL_BENCHMARK_ROUNDS));
+    }
+    quint64 start = usecTimestampNow();
+    foreach (PacketBufferPoolUserThread* user, users) {
+        user->start();
+    }
+    int collisions = 0;
+    foreach (PacketBufferPoolUserThread* user, users) {
+        user->wait();
+        collisions += user->getCollisions();
+        delete user;
+    }
+    quint64 poolTime = usecTimestampNow() - start;
+    
+    if (collisions != 0) {
+        qDebug() << "FAILED: packet buffer pool handed out a buffer that was still in use" << collisions << "times";
+        return true;
+    }
+    if (pool.getNumInUse() != 0 || pool.getNumAllocated() > POOL_BENCHMARK_BUFFERS) {
+        qDebug() << "FAILED: packet buffer pool has" << pool.getNumInUse() << "buffers in use and"
+            << pool.getNumAllocated() << "allocated after every buffer was given back";
+        return true;
+    }
+    
+    // once they've all been given back, every buffer the pool may make has to be there to hand out again
+    QVector<PacketBuffer*> buffers;
+    while (PacketBuffer* buffer = pool.acquire()) {
+        buffers.append(buffer);
+    }
+    int availableBuffers = buffers.size();
+    foreach (PacketBuffer* buffer, buffers) {
+        pool.release(buffer);
+    }
+    if (availableBuffers != POOL_BENCHMARK_BUFFERS) {
+        qDebug() << "FAILED: packet buffer pool of" << POOL_BENCHMARK_BUFFERS << "buffers only had"
+            << availableBuffers << "to hand out";
+        return true;
+    }
+    
+    const float NSECS_PER_USEC = 1000.0f;
+    qDebug() << POOL_BENCHMARK_USERS << "threads sharing" << POOL_BENCHMARK_BUFFERS
+        << "packet buffers, nsecs per acquire and release:"
+        << (float) poolTime * NSECS_PER_USEC /
+            (POOL_BENCHMARK_USERS * POOL_BENCHMARK_ROUNDS * BUFFERS_HELD_PER_POOL_USER)
+        << "failed acquires:" << pool.getNumFailedAcquires();
+    
+    return false;
+}
+
+bool NetworkingTests::runPacketRingBenchmark() {
+    PacketRing ring(RING_BENCHMARK_CAPACITY);
+    PacketRingProducerThread producer(&ring, RING_BENCHMARK_PACKETS);
+    
+    quint64 start = usecTimestampNow();
+    producer.start();
+    
+    int nextSequence = 0;
+    bool outOfOrder = false;
+    int firstOutOfOrder = 0;
+    quint64 lastProgress = start;
+    while (nextSequence < RING_BENCHMARK_PACKETS) {
+        ring.startDraining();
+        PacketBuffer* packet = ring.front();
+        if (!packet) {
+            if (usecTimestampNow() - lastProgress > STRESS_TEST_TIMEOUT_USECS) {
+                producer.stop();
+                break;
+            }
+            QThread::yieldCurrentThread();
+            continue;
+        }
+        int producerIndex, sequence;
+        if (!outOfOrder && (!readTestPacket(packet->getData(), packet->getSize(), producerIndex, sequence) ||
+                sequence != nextSequence)) {
+            outOfOrder = true;
+            firstOutOfOrder = nextSequence;
+        }
+        ring.pop();
+        nextSequence++;
+        lastProgress = usecTimestampNow();
+    }
+    quint64 ringTime = usecTimestampNow() - start;
+    
+    producer.wait();
+    
+    if (outOfOrder) {
+        qDebug() << "FAILED: packet ring handed out packet" << firstOutOfOrder
+            << "out of order or with the wrong contents";
+        return true;
+    }
+    if (nextSequence != RING_BENCHMARK_PACKETS || ring.front() || ring.size() != 0) {
+        qDebug() << "FAILED: packet ring handed out" << nextSequence << "of" << RING_BENCHMARK_PACKETS
+            << "packets, with" << ring.size() << "still waiting";
+        return true;
+    }
+    
+    qDebug() << "Packets per second through a ring of" << RING_BENCHMARK_CAPACITY << "buffers:"
+        << (float) RING_BENCHMARK_PACKETS * USECS_PER_SECOND / ringTime
+        << "full ring retries:" << ring.getDroppedPackets();
+    
+    return false;
+}
+
+NodeLookupThread::NodeLookupThread(const QVector<QUuid>& nodeUUIDs, QMutex* legacyMutex, NodeHash* legacyHash) :
+    _nodeUUIDs(nodeUUIDs),
+    _legacyMutex(legacyMutex),
+    _legacyHash(legacyHash),
+    _stopping(false),
+    _lookups(0) {
+}
+
+void NodeLookupThread::run() {
+    NodeList* nodeList = NodeList::getInstance();
+    while (!_stopping) {
+        const QUuid& nodeUUID = _nodeUUIDs[_lookups % _nodeUUIDs.size()];
+        if (_legacyMutex) {
+            legacyNodeWithUUID(*_legacyMutex, *_legacyHash, nodeUUID);
+        } else {
+            nodeList->nodeWithUUID(nodeUUID);
+        }
+        _lookups++;
+    }
+}
+
+PacketQueueProducerThread::PacketQueueProducerThread(PacketQueue* queue, int producerIndex, int numPackets) :
+    _queue(queue),
+    _producerIndex(producerIndex),
+    _numPackets(numPackets) {
+}
+
+void PacketQueueProducerThread::run() {
+    char data[MAX_PACKET_SIZE];
+    SharedNodePointer noNode;
+    for (int i = 0; i < _numPackets; i++) {
+        _queue->queuePacket(noNode, data, fillTestPacket(data, _producerIndex, i));
+    }
+}
+
+PacketBufferPoolUserThread::PacketBufferPoolUserThread(PacketBufferPool* pool, int userIndex, int numRounds) :
+    _pool(pool),
+    _userIndex(userIndex),
+    _numRounds(numRounds),
+    _collisions(0) {
+}
+
+void PacketBufferPoolUserThread::run() {
+    PacketBuffer* buffers[BUFFERS_HELD_PER_POOL_USER];
+    for (int round = 0; round < _numRounds; round++) {
+        // mark each buffer as ours while we hold it, another thread holding it too would overwrite the mark
+        int held = 0;
+        for (int i = 0; i < BUFFERS_HELD_PER_POOL_USER; i++) {
+            PacketBuffer* buffer = _pool->acquire();
+            if (buffer) {
+                buffer->setSize(fillTestPacket(buffer->getData(), _userIndex, round));
+                buffers[held++] = buffer;
+            }
+        }
+        for (int i = 0; i < held; i++) {
+            int userIndex, sequence;
+            if (!readTestPacket(buffers[i]->getData(), buffers[i]->getSize(), userIndex, sequence) ||
+                    userIndex != _userIndex || sequence != round) {
+                _collisions++;
+            }
+            _pool->release(buffers[i]);
+        }
+    }
+}
+
+PacketRingProducerThread::PacketRingProducerThread(PacketRing* ring, int numPackets) :
+    _ring(ring),
+    _numPackets(numPackets),
+    _spareBuffer(new PacketBuffer()),
+    _stopping(false) {
+}
+
+PacketRingProducerThread::~PacketRingProducerThread() {
+    delete _spareBuffer;
+}
+
+void PacketRingProducerThread::run() {
+    for (int i = 0; i < _numPackets; i++) {
+        _spareBuffer->setSize(fillTestPacket(_spareBuffer->getData(), 0, i));
+        
+        // a full ring hands the packet back, so keep offering it until the consumer makes room
+        PacketBuffer* emptyBuffer;
+        while (!(emptyBuffer = _ring->push(_spareBuffer))) {
+            if (_stopping) {
+                return;
+            }
+            QThread::yieldCurrentThread();
+        }
+        _spareBuffer = emptyBuffer;
+    }
+}
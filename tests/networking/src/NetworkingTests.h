@@ -0,0 +1,152 @@
+//
+//  NetworkingTests.h
+//  networking-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __networking_tests__NetworkingTests__
+#define __networking_tests__NetworkingTests__
+
+#include <QCoreApplication>
+#include <QMutex>
+#include <QThread>
+#include <QUuid>
+#include <QVector>
+
+#include <NodeList.h>
+#include <PacketBufferPool.h>
+#include <PacketQueue.h>
+#include <PacketRing.h>
+
+/// Benchmarks various aspects of the networking in the shared library.
+class NetworkingTests : public QCoreApplication {
+    Q_OBJECT
+
+public:
+
+    NetworkingTests(int& argc, char** argv);
+
+    /// Performs our various benchmarks.
+    /// \return true if any of the benchmarks failed.
+    bool run();
+
+private:
+
+    /// Verifies and sends packets of a few sizes over loopback, with the MD5 hashes and packet copies NodeList used to
+    /// use and then with the in place packet MACs, and reports the packets per second on one core.
+    bool runPacketAuthenticationBenchmark();
+    
+    /// Sends and receives bursts of packets over loopback, one datagram per system call and then batched with
+    /// recvmmsg/sendmmsg where they're available, and reports packets per second and CPU time per packet.
+    bool runBatchedDatagramBenchmark();
+    
+    /// Times mixer style frames and per packet node lookups with 500 nodes while another thread looks nodes up too,
+    /// with the locked copies NodeList used to make and then with its node hash snapshots.
+    bool runNodeHashBenchmark();
+    
+    /// Has several threads queue numbered packets onto one PacketQueue while this thread takes them off, first on a
+    /// queue that never drops and then on one that drops when the pool runs out. Checks that every packet comes out
+    /// once, in the order its thread queued it, or was counted as dropped, and that every buffer is back in the pool.
+    bool runPacketQueueBenchmark();
+    
+    /// Has several threads take buffers from and give them back to one small PacketBufferPool, and checks that no
+    /// buffer is ever held by two of them at once.
+    bool runPacketBufferPoolBenchmark();
+    
+    /// Pushes numbered packets through a PacketRing from another thread and checks they all come out once, in order.
+    bool runPacketRingBenchmark();
+};
+
+/// Looks up nodes as fast as it can, the way another thread handling packets would. Goes through a mutex and hash
+/// like the ones NodeList used to have if it's given them, otherwise through the NodeList.
+class NodeLookupThread : public QThread {
+    Q_OBJECT
+
+public:
+
+    NodeLookupThread(const QVector<QUuid>& nodeUUIDs, QMutex* legacyMutex = NULL, NodeHash* legacyHash = NULL);
+
+    void stop() { _stopping = true; }
+    int getLookups() const { return _lookups; }
+
+protected:
+
+    virtual void run();
+
+private:
+
+    QVector<QUuid> _nodeUUIDs;
+    QMutex* _legacyMutex;
+    NodeHash* _legacyHash;
+    volatile bool _stopping;
+    int _lookups;
+};
+
+/// Queues numbered packets onto a PacketQueue, each one sized and filled from its number so that it can be checked.
+class PacketQueueProducerThread : public QThread {
+    Q_OBJECT
+
+public:
+
+    PacketQueueProducerThread(PacketQueue* queue, int producerIndex, int numPackets);
+
+protected:
+
+    virtual void run();
+
+private:
+
+    PacketQueue* _queue;
+    int _producerIndex;
+    int _numPackets;
+};
+
+/// Takes a few buffers at a time from a PacketBufferPool and gives them back, marking each one while it's held to
+/// catch a buffer that was handed out twice.
+class PacketBufferPoolUserThread : public QThread {
+    Q_OBJECT
+
+public:
+
+    PacketBufferPoolUserThread(PacketBufferPool* pool, int userIndex, int numRounds);
+
+    int getCollisions() const { return _collisions; }
+
+protected:
+
+    virtual void run();
+
+private:
+
+    PacketBufferPool* _pool;
+    int _userIndex;
+    int _numRounds;
+    int _collisions;
+};
+
+/// Pushes numbered packets through a PacketRing, waiting for room whenever it's full.
+class PacketRingProducerThread : public QThread {
+    Q_OBJECT
+
+public:
+
+    PacketRingProducerThread(PacketRing* ring, int numPackets);
+    ~PacketRingProducerThread();
+
+    /// Gives up on a consumer that has stopped making room.
+    void stop() { _stopping = true; }
+
+protected:
+
+    virtual void run();
+
+private:
+
+    PacketRing* _ring;
+    int _numPackets;
+    PacketBuffer* _spareBuffer;
+    volatile bool _stopping;
+};
+
+#endif // __networking_tests__NetworkingTests__
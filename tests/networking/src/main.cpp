@@ -0,0 +1,11 @@
+//
+//  main.cpp
+//  networking-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+
+#include "NetworkingTests.h"
+
+int main(int argc, char** argv) {
+    return NetworkingTests(argc, argv).run();
+}
@@ -0,0 +1,870 @@
+//
+//  OctreeTests.cpp
+//  octree-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <stdlib.h>
+#include <vector>
+
+#include <QDebug>
+#include <QHash>
+#include <QDir>
+#include <QFile>
+
+#include <JurisdictionMap.h>
+#include <OctalCode.h>
+#include <OctreeEditBatch.h>
+#include <OctreeElementBag.h>
+#include <OctreeEpochManager.h>
+#include <OctreeKnownState.h>
+#include <OctreePacketData.h>
+#include <SharedUtil.h>
+#include <ViewFrustum.h>
+#include <VoxelTree.h>
+
+#include "OctreeTests.h"
+
+const float TEST_VOXEL_SIZE = 1.0f / 256.0f;
+const int TEST_VOXEL_COUNT = 20000;
+const quint64 BENCHMARK_DURATION_USECS = 5 * 1000 * 1000;
+const int EDIT_BATCH_VOXELS = 100000;
+const int CULLING_VOXEL_COUNT = 100000;
+const int CULLING_FRAMES_PER_KEY = 60;
+
+// a recorded camera path through the tree, x, y, z in tree units and yaw in degrees for each key
+const float CULLING_CAMERA_PATH[][4] = {
+    { 0.50f, 0.50f, 0.05f,    0.0f },
+    { 0.50f, 0.50f, 0.50f,   45.0f },
+    { 0.80f, 0.40f, 0.60f,  120.0f },
+    { 0.70f, 0.20f, 0.90f,  200.0f },
+    { 0.30f, 0.60f, 0.70f,  270.0f },
+    { 0.10f, 0.90f, 0.30f,  330.0f },
+    { 0.50f, 0.50f, 0.05f,  360.0f }
+};
+const int CULLING_CAMERA_PATH_KEYS = sizeof(CULLING_CAMERA_PATH) / sizeof(CULLING_CAMERA_PATH[0]);
+const int JURISDICTION_END_NODES = 500;
+const float JURISDICTION_END_NODE_SIZE = 1.0f / 64.0f;
+const int FOLD_TEST_VOXELS = 5000;
+const int FOLD_TEST_RAYS = 100;
+const int FOLD_TEST_EDITS = 100;
+const float FOLD_TEST_RAY_TOLERANCE = 0.1f; // meters
+
+static void addRandomVoxel(VoxelTree& tree) {
+    float x = floorf(randFloat() / TEST_VOXEL_SIZE) * TEST_VOXEL_SIZE;
+    float y = floorf(randFloat() / TEST_VOXEL_SIZE) * TEST_VOXEL_SIZE;
+    float z = floorf(randFloat() / TEST_VOXEL_SIZE) * TEST_VOXEL_SIZE;
+    tree.createVoxel(x, y, z, TEST_VOXEL_SIZE, randIntInRange(0, 255), randIntInRange(0, 255), randIntInRange(0, 255));
+}
+
+static void appendVoxelSetRecord(QByteArray& records, float x, float y, float z, float s) {
+    unsigned char* voxelData = pointToVoxel(x, y, z, s, randIntInRange(0, 255), randIntInRange(0, 255),
+                                            randIntInRange(0, 255));
+    int size = bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(voxelData)) + SIZE_OF_COLOR_DATA;
+    records.append(reinterpret_cast<const char*>(voxelData), size);
+    delete[] voxelData;
+}
+
+static void addRecordsToBatch(OctreeEditBatch& batch, const QByteArray& records, PacketType packetType) {
+    batch.addPacket(records);
+    const unsigned char* recordData = reinterpret_cast<const unsigned char*>(records.constData());
+    for (int atByte = 0; atByte < records.size(); ) {
+        int size = bytesRequiredForCodeLength(numberOfThreeBitSectionsInCode(recordData + atByte)) + SIZE_OF_COLOR_DATA;
+        batch.addRecord(packetType, recordData + atByte, size);
+        atByte += size;
+    }
+}
+
+// the way the server used to apply edits, taking the write lock for each record
+static void applyRecordsOneAtATime(VoxelTree& tree, const QByteArray& records, PacketType packetType) {
+    const unsigned char* recordData = reinterpret_cast<const unsigned char*>(records.constData());
+    for (int atByte = 0; atByte < records.size(); ) {
+        tree.lockForWrite();
+        atByte += tree.processEditPacketData(packetType, NULL, 0, recordData + atByte, records.size() - atByte,
+                                             SharedNodePointer());
+        tree.unlock();
+    }
+}
+
+static bool treesMatch(VoxelTree& treeA, VoxelTree& treeB, const OctreeEditBatch& batch) {
+    if (treeA.getOctreeElementsCount() != treeB.getOctreeElementsCount() ||
+            memcmp(treeA.getRoot()->getColor(), treeB.getRoot()->getColor(), SIZE_OF_COLOR_DATA) != 0) {
+        return false;
+    }
+    for (int i = 0; i < batch.size(); i++) {
+        VoxelPositionSize voxel;
+        voxelDetailsForCode(batch.getRecords()[i].editData, voxel);
+        VoxelTreeElement* elementA = treeA.getVoxelAt(voxel.x, voxel.y, voxel.z, voxel.s);
+        VoxelTreeElement* elementB = treeB.getVoxelAt(voxel.x, voxel.y, voxel.z, voxel.s);
+        if (!elementA != !elementB ||
+                (elementA && memcmp(elementA->getColor(), elementB->getColor(), SIZE_OF_COLOR_DATA) != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// encodes the whole tree the way a server sends it to a client that has nothing yet, and reads it into the client tree
+static void sendTree(VoxelTree& tree, const ViewFrustum* viewFrustum, VoxelTree& clientTree) {
+    OctreePacketData packetData;
+    OctreeElementBag bag;
+    ReadBitstreamToTreeParams args(WANT_COLOR, NO_EXISTS_BITS);
+    bag.insert(tree.getRoot());
+    while (!bag.isEmpty()) {
+        OctreeElement* subTree = bag.extract();
+        EncodeBitstreamParams params(INT_MAX, viewFrustum, WANT_COLOR, NO_EXISTS_BITS);
+        int bytesWritten = tree.encodeTreeBitstream(subTree, &packetData, bag, params);
+        if (bytesWritten == 0 && params.stopReason == EncodeBitstreamParams::DIDNT_FIT) {
+            clientTree.readBitstreamToTree(packetData.getFinalizedData(), packetData.getFinalizedSize(), args);
+            packetData.reset();
+            bag.insert(subTree);
+        }
+    }
+    if (packetData.hasContent()) {
+        clientTree.readBitstreamToTree(packetData.getFinalizedData(), packetData.getFinalizedSize(), args);
+    }
+}
+
+static bool collectColoredLeavesOperation(OctreeElement* element, void* extraData) {
+    if (element->isLeaf() && element->hasContent()) {
+        static_cast<std::vector<OctreeElement*>*>(extraData)->push_back(element);
+    }
+    return true;
+}
+
+OctreeTests::OctreeTests(int& argc, char** argv) :
+    QCoreApplication(argc, argv) {
+}
+
+// Culls the way the encode used to, testing each element against all of the frustum and then testing each of its
+// children again before going into them, puts the location of every element it reaches in depth first order.
+static void cullEachElement(const OctreeElement* element, const ViewFrustum& viewFrustum,
+                            std::vector<char>& locations) {
+    ViewFrustum::location location = element->inFrustum(viewFrustum);
+    locations.push_back(location);
+    if (location == ViewFrustum::OUTSIDE) {
+        return;
+    }
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        const OctreeElement* childElement = element->getChildAtIndex(i);
+        if (childElement) {
+            if (childElement->isInView(viewFrustum)) {
+                cullEachElement(childElement, viewFrustum, locations);
+            } else {
+                locations.push_back(ViewFrustum::OUTSIDE);
+            }
+        }
+    }
+}
+
+// Culls the way the encode does now, with the children of an element tested together and only against the planes
+// the element wasn't entirely inside, puts the same locations as cullEachElement().
+static void cullWithTestMasks(const OctreeElement* element, ViewFrustum::location location, unsigned char testMask,
+                              const ViewFrustum& viewFrustum, std::vector<char>& locations) {
+    locations.push_back(location);
+    if (location == ViewFrustum::OUTSIDE) {
+        return;
+    }
+    const OctreeElement* childElements[NUMBER_OF_CHILDREN];
+    glm::vec3 corners[NUMBER_OF_CHILDREN];
+    int numChildren = 0;
+    float scale = 0.0f;
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        const OctreeElement* childElement = element->getChildAtIndex(i);
+        if (childElement) {
+            childElements[numChildren] = childElement;
+            corners[numChildren++] = childElement->getCorner() * (float)TREE_SCALE;
+            scale = childElement->getScale() * (float)TREE_SCALE;
+        }
+    }
+    if (numChildren == 0) {
+        return;
+    }
+    ViewFrustum::location childLocations[NUMBER_OF_CHILDREN];
+    unsigned char childTestMasks[NUMBER_OF_CHILDREN];
+    viewFrustum.boxesInFrustum(corners, scale, numChildren, testMask, childLocations, childTestMasks);
+    for (int i = 0; i < numChildren; i++) {
+        cullWithTestMasks(childElements[i], childLocations[i], childTestMasks[i], viewFrustum, locations);
+    }
+}
+
+static void setViewFrustumOnCameraPath(ViewFrustum& viewFrustum, int frame) {
+    int key = frame / CULLING_FRAMES_PER_KEY;
+    float ratio = (float)(frame % CULLING_FRAMES_PER_KEY) / CULLING_FRAMES_PER_KEY;
+    const float* from = CULLING_CAMERA_PATH[key];
+    const float* to = CULLING_CAMERA_PATH[key + 1];
+    glm::vec3 position = glm::mix(glm::vec3(from[0], from[1], from[2]), glm::vec3(to[0], to[1], to[2]), ratio);
+    float yaw = glm::mix(from[3], to[3], ratio);
+
+    viewFrustum.setPosition(position * (float)TREE_SCALE);
+    viewFrustum.setOrientation(glm::quat(glm::vec3(0.0f, glm::radians(yaw), 0.0f)));
+    viewFrustum.calculate();
+}
+
+// the way JurisdictionMap used to look an element up, comparing against the root and then every end node in turn
+static JurisdictionMap::Area findAreaLinearly(const JurisdictionMap& map, const unsigned char* octalCode) {
+    if (isAncestorOf(octalCode, map.getRootOctalCode())) {
+        return JurisdictionMap::ABOVE;
+    }
+    if (!isAncestorOf(map.getRootOctalCode(), octalCode)) {
+        return JurisdictionMap::BELOW;
+    }
+    for (int i = 0; i < map.getEndNodeCount(); i++) {
+        if (isAncestorOf(map.getEndNodeOctalCode(i), octalCode)) {
+            return JurisdictionMap::BELOW;
+        }
+    }
+    return JurisdictionMap::WITHIN;
+}
+
+static void findAreasLinearly(const JurisdictionMap& map, const OctreeElement* element, std::vector<char>& areas) {
+    areas.push_back(findAreaLinearly(map, element->getOctalCode()));
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        const OctreeElement* childElement = element->getChildAtIndex(i);
+        if (childElement) {
+            findAreasLinearly(map, childElement, areas);
+        }
+    }
+}
+
+static void findAreasByOctalCode(const JurisdictionMap& map, const OctreeElement* element, std::vector<char>& areas) {
+    areas.push_back(map.isMyJurisdiction(element->getOctalCode(), CHECK_NODE_ONLY));
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        const OctreeElement* childElement = element->getChildAtIndex(i);
+        if (childElement) {
+            findAreasByOctalCode(map, childElement, areas);
+        }
+    }
+}
+
+// the way the encode looks elements up, carrying each element's position down to its children
+static void findAreasByPosition(const JurisdictionMap& map, const OctreeElement* element,
+                                const JurisdictionPosition& position, std::vector<char>& areas) {
+    areas.push_back(map.getArea(position));
+    for (int i = 0; i < NUMBER_OF_CHILDREN; i++) {
+        const OctreeElement* childElement = element->getChildAtIndex(i);
+        if (childElement) {
+            findAreasByPosition(map, childElement, map.getChildPosition(position, i), areas);
+        }
+    }
+}
+
+bool OctreeTests::run() {
+
+    qDebug() << "Running octree benchmarks...";
+
+    // seed the random number generator so that our benchmarks are reproducible
+    srand(0xBAAAAABE);
+
+    if (runEncodeContentionBenchmark()) {
+        return true;
+    }
+
+    if (runSnapshotTreesTest()) {
+        return true;
+    }
+
+    if (runKnownStateTest()) {
+        return true;
+    }
+
+    if (runFoldedSubtreesTest()) {
+        return true;
+    }
+
+    if (runLoadBenchmark()) {
+        return true;
+    }
+
+    if (runBagBenchmark()) {
+        return true;
+    }
+
+    if (runEditBatchBenchmark()) {
+        return true;
+    }
+
+    if (runCullingBenchmark()) {
+        return true;
+    }
+
+    if (runJurisdictionBenchmark()) {
+        return true;
+    }
+
+    qDebug() << "All benchmarks passed!";
+
+    return false;
+}
+
+bool OctreeTests::runEncodeContentionBenchmark() {
+    for (int pass = 0; pass < 2; pass++) {
+        bool snapshotReads = (pass == 1);
+
+        VoxelTree tree(true);
+        tree.setWantSnapshotReads(snapshotReads);
+        for (int i = 0; i < TEST_VOXEL_COUNT; i++) {
+            addRandomVoxel(tree);
+        }
+
+        EditStormThread editStorm(&tree);
+        editStorm.start();
+
+        OctreePacketData packetData;
+        OctreeElementBag bag;
+        int packets = 0;
+        int scenes = 0;
+        quint64 totalEncodeTime = 0;
+        quint64 maxEncodeTime = 0;
+        quint64 start = usecTimestampNow();
+        quint64 end = start;
+
+        while (end - start < BENCHMARK_DURATION_USECS) {
+            bag.insert(tree.getRoot());
+            while (!bag.isEmpty()) {
+                quint64 encodeStart = usecTimestampNow();
+                quint64 snapshotToken = tree.beginSnapshotRead();
+                OctreeElement* subTree = bag.extract();
+                if (subTree) {
+                    EncodeBitstreamParams params;
+                    tree.encodeTreeBitstream(subTree, &packetData, bag, params);
+                }
+                tree.endSnapshotRead(snapshotToken);
+                quint64 encodeTime = usecTimestampNow() - encodeStart;
+                totalEncodeTime += encodeTime;
+                maxEncodeTime = std::max(maxEncodeTime, encodeTime);
+
+                if (packetData.hasContent()) {
+                    packets++;
+                    packetData.reset();
+                }
+            }
+            scenes++;
+            end = usecTimestampNow();
+        }
+
+        editStorm.stop();
+        editStorm.wait();
+
+        if (packets == 0) {
+            qDebug() << "FAILED: encoded no packets";
+            return true;
+        }
+
+        float seconds = (end - start) / (float)USECS_PER_SECOND;
+        qDebug() << (snapshotReads ? "snapshot reads:" : "locked reads:  ")
+            << "scenes=" << scenes
+            << "packets/sec=" << (packets / seconds)
+            << "edits/sec=" << (editStorm.getEdits() / seconds)
+            << "avg encode usecs=" << (totalEncodeTime / packets)
+            << "max encode usecs=" << maxEncodeTime;
+    }
+
+    OctreeEpochManager* epochManager = OctreeEpochManager::getInstance();
+    qDebug() << "retired=" << epochManager->getTotalRetired() << "reclaimed=" << epochManager->getTotalReclaimed();
+
+    return false;
+}
+
+bool OctreeTests::runSnapshotTreesTest() {
+    OctreeEpochManager* epochManager = OctreeEpochManager::getInstance();
+
+    // a tree with snapshot reads and one without can live side by side
+    VoxelTree snapshotTree(true);
+    snapshotTree.setWantSnapshotReads(true);
+    VoxelTree lockedTree(true);
+    snapshotTree.createVoxel(0.0f, 0.0f, 0.0f, TEST_VOXEL_SIZE, 255, 0, 0);
+    lockedTree.createVoxel(0.0f, 0.0f, 0.0f, TEST_VOXEL_SIZE, 255, 0, 0);
+
+    VoxelTreeElement* snapshotVoxel = snapshotTree.getVoxelAt(0.0f, 0.0f, 0.0f, TEST_VOXEL_SIZE);
+    VoxelTreeElement* lockedVoxel = lockedTree.getVoxelAt(0.0f, 0.0f, 0.0f, TEST_VOXEL_SIZE);
+    if (!snapshotVoxel || !snapshotVoxel->isSnapshotSafe() || !lockedVoxel || lockedVoxel->isSnapshotSafe()) {
+        qDebug() << "FAILED: snapshot reads leaked between trees";
+        return true;
+    }
+
+    quint64 retiredBefore = epochManager->getTotalRetired();
+    lockedTree.deleteVoxelAt(0.0f, 0.0f, 0.0f, TEST_VOXEL_SIZE);
+    if (epochManager->getTotalRetired() != retiredBefore) {
+        qDebug() << "FAILED: deleting from a locked tree retired elements";
+        return true;
+    }
+
+    // an active reader holds the deleted voxel back, readers never free anything themselves, the next writer does
+    quint64 snapshotToken = snapshotTree.beginSnapshotRead();
+    snapshotTree.deleteVoxelAt(0.0f, 0.0f, 0.0f, TEST_VOXEL_SIZE);
+    snapshotTree.endSnapshotRead(snapshotToken);
+    if (epochManager->getPendingCount() == 0) {
+        qDebug() << "FAILED: a snapshot reader freed retired elements";
+        return true;
+    }
+    snapshotTree.lockForWrite();
+    snapshotTree.unlock();
+    if (epochManager->getPendingCount() != 0) {
+        qDebug() << "FAILED: retired elements weren't reclaimed by the next writer";
+        return true;
+    }
+    return false;
+}
+
+bool OctreeTests::runKnownStateTest() {
+    const int KNOWN_STATE_TEST_VOXELS = 100;
+
+    VoxelTree tree(true);
+    for (int i = 0; i < KNOWN_STATE_TEST_VOXELS; i++) {
+        addRandomVoxel(tree);
+    }
+
+    // send the client the whole tree
+    OctreeKnownState knownState;
+    OctreePacketData packetData;
+    OctreeElementBag bag;
+    bag.insert(tree.getRoot());
+    while (!bag.isEmpty()) {
+        OctreeElement* subTree = bag.extract();
+        EncodeBitstreamParams params(INT_MAX, IGNORE_VIEW_FRUSTUM, WANT_COLOR, NO_EXISTS_BITS);
+        params.knownState = &knownState;
+        int bytesWritten = tree.encodeTreeBitstream(subTree, &packetData, bag, params);
+        if (bytesWritten == 0 && params.stopReason == EncodeBitstreamParams::DIDNT_FIT) {
+            packetData.reset();
+            bag.insert(subTree);
+        }
+    }
+    if (knownState.getKnownSubtreeCount() == 0) {
+        qDebug() << "FAILED: sending the whole tree recorded nothing as known";
+        return true;
+    }
+
+    // once the elements are gone, new elements allocated where they were must not be taken as known
+    tree.eraseAllOctreeElements();
+    if (knownState.getKnownSubtreeCount() != 0) {
+        qDebug() << "FAILED: the known state kept" << knownState.getKnownSubtreeCount() << "deleted elements";
+        return true;
+    }
+    return false;
+}
+
+bool OctreeTests::runFoldedSubtreesTest() {
+    // the same voxels in two trees, one of which gets folded
+    VoxelTree unfoldedTree(true);
+    VoxelTree foldedTree(true);
+    unsigned int seed = rand();
+    srand(seed);
+    for (int i = 0; i < FOLD_TEST_VOXELS; i++) {
+        addRandomVoxel(unfoldedTree);
+    }
+    srand(seed);
+    for (int i = 0; i < FOLD_TEST_VOXELS; i++) {
+        addRandomVoxel(foldedTree);
+    }
+    unsigned long unfoldedElements = foldedTree.getOctreeElementsCount();
+    foldedTree.lockForWrite();
+    int folded = foldedTree.foldSubtrees(usecTimestampNow());
+    foldedTree.unlock();
+    unsigned long foldedElements = foldedTree.getOctreeElementsCount();
+    qDebug() << "folded" << folded << "subtrees, elements=" << unfoldedElements << "down to" << foldedElements;
+    if (folded == 0 || foldedElements >= unfoldedElements) {
+        qDebug() << "FAILED: nothing was folded";
+        return true;
+    }
+
+    // clients are sent the same voxels, all of them and what's in view
+    ViewFrustum viewFrustum;
+    viewFrustum.setFieldOfView(90.0f);
+    viewFrustum.setAspectRatio(16.0f / 9.0f);
+    viewFrustum.setNearClip(0.1f);
+    viewFrustum.setFarClip(TREE_SCALE / 4.0f);
+    viewFrustum.setKeyholeRadius(DEFAULT_KEYHOLE_RADIUS);
+    setViewFrustumOnCameraPath(viewFrustum, CULLING_FRAMES_PER_KEY);
+    for (int pass = 0; pass < 2; pass++) {
+        const ViewFrustum* sentFrustum = (pass == 0) ? IGNORE_VIEW_FRUSTUM : &viewFrustum;
+        VoxelTree sentUnfolded(true);
+        VoxelTree sentFolded(true);
+        sendTree(unfoldedTree, sentFrustum, sentUnfolded);
+        sendTree(foldedTree, sentFrustum, sentFolded);
+        if (sentFolded.getOctreeElementsCount() != sentUnfolded.getOctreeElementsCount() ||
+                memcmp(sentFolded.getRoot()->getColor(), sentUnfolded.getRoot()->getColor(), SIZE_OF_COLOR_DATA) != 0) {
+            qDebug() << "FAILED: the folded tree sent" << sentFolded.getOctreeElementsCount() << "elements, expected"
+                << sentUnfolded.getOctreeElementsCount() << (sentFrustum ? "in view" : "in all");
+            return true;
+        }
+    }
+
+    // rays aimed at voxels hit the folded voxels where they hit the unfolded ones
+    std::vector<OctreeElement*> leaves;
+    unfoldedTree.recurseTreeWithOperation(collectColoredLeavesOperation, &leaves);
+    for (int i = 0; i < FOLD_TEST_RAYS; i++) {
+        OctreeElement* leaf = leaves[randIntInRange(0, leaves.size() - 1)];
+        glm::vec3 origin = glm::vec3(randFloat(), randFloat(), randFloat()) * (float)TREE_SCALE;
+        glm::vec3 direction = glm::normalize(leaf->getAABox().calcCenter() * (float)TREE_SCALE - origin);
+        OctreeElement* unfoldedHit = NULL;
+        OctreeElement* foldedHit = NULL;
+        float unfoldedDistance = 0.0f;
+        float foldedDistance = 0.0f;
+        BoxFace unfoldedFace;
+        BoxFace foldedFace;
+        bool unfoldedFound = unfoldedTree.findRayIntersection(origin, direction, unfoldedHit, unfoldedDistance,
+                                                              unfoldedFace);
+        bool foldedFound = foldedTree.findRayIntersection(origin, direction, foldedHit, foldedDistance, foldedFace);
+        if (unfoldedFound != foldedFound ||
+                (foldedFound && fabsf(foldedDistance - unfoldedDistance) > FOLD_TEST_RAY_TOLERANCE)) {
+            qDebug() << "FAILED: a ray hit the folded tree at" << foldedDistance << "expected" << unfoldedDistance;
+            return true;
+        }
+    }
+
+    // lookups unfold down to the voxel, edits unfold down to what they change
+    foldedTree.lockForWrite();
+    for (int i = 0; i < FOLD_TEST_EDITS; i++) {
+        OctreeElement* leaf = leaves[randIntInRange(0, leaves.size() - 1)];
+        const glm::vec3& corner = leaf->getCorner();
+        VoxelTreeElement* voxel = foldedTree.getVoxelAt(corner.x, corner.y, corner.z, leaf->getScale());
+        if (!voxel || memcmp(voxel->getColor(), static_cast<VoxelTreeElement*>(leaf)->getColor(),
+                             SIZE_OF_COLOR_DATA) != 0) {
+            foldedTree.unlock();
+            qDebug() << "FAILED: looking up a folded voxel didn't find it";
+            return true;
+        }
+    }
+    for (int i = 0; i < FOLD_TEST_EDITS; i++) {
+        OctreeElement* leaf = leaves[i * leaves.size() / FOLD_TEST_EDITS];
+        unsigned char* octalCode = pointToOctalCode(leaf->getCorner().x, leaf->getCorner().y, leaf->getCorner().z,
+                                                    leaf->getScale());
+        foldedTree.loadSubtreesForEdit(octalCode);
+        foldedTree.deleteOctalCodeFromTree(octalCode);
+        delete[] octalCode;
+    }
+    foldedTree.unlock();
+    for (int i = 0; i < FOLD_TEST_EDITS; i++) {
+        // and the same voxels from the unfolded tree, whose leaves we've been holding on to
+        OctreeElement* leaf = leaves[i * leaves.size() / FOLD_TEST_EDITS];
+        unfoldedTree.deleteVoxelAt(leaf->getCorner().x, leaf->getCorner().y, leaf->getCorner().z, leaf->getScale());
+    }
+    VoxelTree sentUnfolded(true);
+    VoxelTree sentFolded(true);
+    sendTree(unfoldedTree, IGNORE_VIEW_FRUSTUM, sentUnfolded);
+    sendTree(foldedTree, IGNORE_VIEW_FRUSTUM, sentFolded);
+    if (sentFolded.getOctreeElementsCount() != sentUnfolded.getOctreeElementsCount()) {
+        qDebug() << "FAILED: deleting folded voxels left" << sentFolded.getOctreeElementsCount() << "elements, expected"
+            << sentUnfolded.getOctreeElementsCount();
+        return true;
+    }
+    return false;
+}
+
+bool OctreeTests::runLoadBenchmark() {
+    const int LOAD_TEST_VOXEL_COUNT = 200000;
+    QString svoFilename = QDir::temp().filePath("octree-tests.svo");
+    QString indexedFilename = QDir::temp().filePath("octree-tests.svo2");
+
+    {
+        VoxelTree tree(true);
+        for (int i = 0; i < LOAD_TEST_VOXEL_COUNT; i++) {
+            addRandomVoxel(tree);
+        }
+        if (!tree.writeToSVOFile(svoFilename.toLocal8Bit().constData()) ||
+                !tree.writeToIndexedSVOFile(indexedFilename.toLocal8Bit().constData())) {
+            qDebug() << "FAILED: couldn't write test files";
+            return true;
+        }
+    }
+
+    // plain SVO, everything is decoded before the server could serve anything
+    quint64 start = usecTimestampNow();
+    VoxelTree svoTree(true);
+    svoTree.readFromSVOFile(svoFilename.toLocal8Bit().constData());
+    quint64 svoLoadTime = usecTimestampNow() - start;
+    unsigned long svoElements = svoTree.getOctreeElementsCount();
+
+    // indexed SVO, the server can serve as soon as the file is open, then loads subtrees in the background
+    start = usecTimestampNow();
+    VoxelTree indexedTree(true);
+    indexedTree.lockForWrite();
+    if (!indexedTree.readFromIndexedSVOFile(indexedFilename.toLocal8Bit().constData())) {
+        indexedTree.unlock();
+        qDebug() << "FAILED: couldn't open indexed file";
+        return true;
+    }
+    quint64 indexedOpenTime = usecTimestampNow() - start;
+    unsigned long openedElements = indexedTree.getOctreeElementsCount();
+    int subtrees = indexedTree.getUnloadedSubtreeCount();
+    while (indexedTree.hasUnloadedSubtrees()) {
+        indexedTree.loadUnloadedSubtrees(USECS_PER_SECOND);
+    }
+    indexedTree.unlock();
+    quint64 indexedLoadTime = usecTimestampNow() - start;
+    unsigned long indexedElements = indexedTree.getOctreeElementsCount();
+
+    qDebug() << "svo load usecs=" << svoLoadTime << "elements=" << svoElements;
+    qDebug() << "indexed open usecs=" << indexedOpenTime << "elements=" << openedElements << "subtrees=" << subtrees;
+    qDebug() << "indexed full load usecs=" << indexedLoadTime << "elements=" << indexedElements;
+
+    // an edit loads just the subtree it's in, and marks the path to it as changed, an edit above the index level
+    // loads every subtree below it
+    VoxelTree editedTree(true);
+    editedTree.lockForWrite();
+    bool editsLoadedSubtrees = editedTree.readFromIndexedSVOFile(indexedFilename.toLocal8Bit().constData());
+    if (editsLoadedSubtrees) {
+        quint64 beforeEdits = usecTimestampNow();
+        int unloadedBeforeEdit = editedTree.getUnloadedSubtreeCount();
+        unsigned char* voxelCode = pointToVoxel(0.5f, 0.5f, 0.5f, TEST_VOXEL_SIZE);
+        editedTree.loadSubtreesForEdit(voxelCode);
+        delete[] voxelCode;
+        editsLoadedSubtrees = editedTree.getUnloadedSubtreeCount() == unloadedBeforeEdit - 1 &&
+            editedTree.getRoot()->hasChangedSince(beforeEdits);
+
+        editedTree.loadSubtreesForEdit(editedTree.getRoot()->getOctalCode());
+        editsLoadedSubtrees = editsLoadedSubtrees && !editedTree.hasUnloadedSubtrees() &&
+            editedTree.getOctreeElementsCount() == svoElements;
+    }
+    editedTree.unlock();
+
+    QFile::remove(svoFilename);
+    QFile::remove(indexedFilename);
+
+    if (indexedElements != svoElements) {
+        qDebug() << "FAILED: indexed file loaded" << indexedElements << "elements, expected" << svoElements;
+        return true;
+    }
+    if (!editsLoadedSubtrees) {
+        qDebug() << "FAILED: edits didn't load the right subtrees from the indexed file";
+        return true;
+    }
+    return false;
+}
+
+bool OctreeTests::runBagBenchmark() {
+    const int BAG_SIZES[] = { 1000, 10000, 100000, 1000000 };
+    const int NUMBER_OF_BAG_SIZES = sizeof(BAG_SIZES) / sizeof(BAG_SIZES[0]);
+    const int DUPLICATE_RATIO = 10; // re-insert one element in ten, the way the encoder puts back what didn't fit
+
+    VoxelTree tree;
+    std::vector<OctreeElement*> elements;
+    for (int i = 0; i < BAG_SIZES[NUMBER_OF_BAG_SIZES - 1]; i++) {
+        elements.push_back(tree.createNewElement());
+    }
+
+    bool failed = false;
+    for (int sizeIndex = 0; sizeIndex < NUMBER_OF_BAG_SIZES && !failed; sizeIndex++) {
+        int bagSize = BAG_SIZES[sizeIndex];
+        std::vector<OctreeElement*> inserts(elements.begin(), elements.begin() + bagSize);
+        std::random_shuffle(inserts.begin(), inserts.end());
+        std::vector<float> priorities;
+        for (int i = 0; i < bagSize; i++) {
+            priorities.push_back(randFloat());
+        }
+
+        OctreeElementBag bag;
+        quint64 start = usecTimestampNow();
+        for (int i = 0; i < bagSize; i++) {
+            bag.insert(inserts[i], priorities[i]);
+        }
+        for (int i = 0; i < bagSize; i += DUPLICATE_RATIO) {
+            bag.insert(inserts[i], priorities[i]);
+        }
+        quint64 insertTime = usecTimestampNow() - start;
+
+        int bagCount = bag.count();
+        std::vector<OctreeElement*> extracted;
+        extracted.reserve(bagSize);
+        start = usecTimestampNow();
+        while (!bag.isEmpty()) {
+            extracted.push_back(bag.extract());
+        }
+        quint64 extractTime = usecTimestampNow() - start;
+
+        // check the ordering afterwards, so that it doesn't count against the extract time
+        QHash<OctreeElement*, float> priorityOf;
+        for (int i = 0; i < bagSize; i++) {
+            priorityOf.insert(inserts[i], priorities[i]);
+        }
+        for (size_t i = 1; i < extracted.size(); i++) {
+            if (priorityOf.value(extracted[i]) > priorityOf.value(extracted[i - 1])) {
+                qDebug() << "FAILED: bag of" << bagSize << "extracted out of priority order at" << i;
+                failed = true;
+                break;
+            }
+        }
+
+        qDebug() << "bag size=" << bagSize
+            << "insert usecs=" << insertTime << "(" << (float)insertTime / (bagSize + bagSize / DUPLICATE_RATIO) << "per)"
+            << "extract usecs=" << extractTime << "(" << (float)extractTime / bagSize << "per)";
+
+        if (bagCount != bagSize || (int)extracted.size() != bagSize) {
+            qDebug() << "FAILED: bag of" << bagSize << "held" << bagCount << "and extracted" << extracted.size();
+            failed = true;
+        }
+    }
+
+    for (size_t i = 0; i < elements.size(); i++) {
+        delete elements[i];
+    }
+    return failed;
+}
+
+bool OctreeTests::runEditBatchBenchmark() {
+    QByteArray records;
+    for (int i = 0; i < EDIT_BATCH_VOXELS; i++) {
+        appendVoxelSetRecord(records, floorf(randFloat() / TEST_VOXEL_SIZE) * TEST_VOXEL_SIZE,
+                             floorf(randFloat() / TEST_VOXEL_SIZE) * TEST_VOXEL_SIZE,
+                             floorf(randFloat() / TEST_VOXEL_SIZE) * TEST_VOXEL_SIZE, TEST_VOXEL_SIZE);
+    }
+
+    VoxelTree singleTree(true);
+    quint64 start = usecTimestampNow();
+    applyRecordsOneAtATime(singleTree, records, PacketTypeVoxelSet);
+    quint64 singleTime = std::max(usecTimestampNow() - start, (quint64)1);
+
+    VoxelTree batchTree(true);
+    OctreeEditBatch batch;
+    addRecordsToBatch(batch, records, PacketTypeVoxelSet);
+    start = usecTimestampNow();
+    batch.sort();
+    batchTree.lockForWrite();
+    quint64 startLock = usecTimestampNow();
+    batchTree.processEditBatch(batch);
+    quint64 lockHoldTime = usecTimestampNow() - startLock;
+    batchTree.unlock();
+    quint64 batchTime = std::max(usecTimestampNow() - start, (quint64)1);
+
+    if (!batch.canApplySorted() || !treesMatch(singleTree, batchTree, batch)) {
+        qDebug() << "FAILED: the batched edits didn't build the same tree as the edits one at a time";
+        return true;
+    }
+    qDebug() << EDIT_BATCH_VOXELS << "voxel set edits, edits per second... one lock per edit:"
+        << (float)EDIT_BATCH_VOXELS * USECS_PER_SECOND / singleTime << "one sorted batch:"
+        << (float)EDIT_BATCH_VOXELS * USECS_PER_SECOND / batchTime << "( lock held for" << lockHoldTime << "usecs )";
+
+    // a destructive set of a voxel after sets of its children has to clear them, which the sorted order would undo
+    QByteArray conflictingRecords;
+    glm::vec3 corner(0.5f, 0.5f, 0.5f);
+    appendVoxelSetRecord(conflictingRecords, corner.x, corner.y, corner.z, TEST_VOXEL_SIZE / 2.0f);
+    appendVoxelSetRecord(conflictingRecords, corner.x, corner.y, corner.z, TEST_VOXEL_SIZE);
+
+    VoxelTree singleConflictTree(true);
+    applyRecordsOneAtATime(singleConflictTree, conflictingRecords, PacketTypeVoxelSetDestructive);
+    VoxelTree batchConflictTree(true);
+    OctreeEditBatch conflictBatch;
+    addRecordsToBatch(conflictBatch, conflictingRecords, PacketTypeVoxelSetDestructive);
+    conflictBatch.sort();
+    batchConflictTree.processEditBatch(conflictBatch);
+    if (conflictBatch.canApplySorted() || !treesMatch(singleConflictTree, batchConflictTree, conflictBatch)) {
+        qDebug() << "FAILED: a destructive set batched after its children didn't clear them";
+        return true;
+    }
+
+    return false;
+}
+
+bool OctreeTests::runCullingBenchmark() {
+    VoxelTree tree;
+    for (int i = 0; i < CULLING_VOXEL_COUNT; i++) {
+        addRandomVoxel(tree);
+    }
+
+    ViewFrustum viewFrustum;
+    viewFrustum.setFieldOfView(90.0f);
+    viewFrustum.setAspectRatio(16.0f / 9.0f);
+    viewFrustum.setNearClip(0.1f);
+    viewFrustum.setFarClip(TREE_SCALE / 4.0f);
+    viewFrustum.setKeyholeRadius(DEFAULT_KEYHOLE_RADIUS);
+
+    int numFrames = (CULLING_CAMERA_PATH_KEYS - 1) * CULLING_FRAMES_PER_KEY;
+    quint64 eachElementTime = 0;
+    quint64 testMaskTime = 0;
+    quint64 elementsReached = 0;
+    std::vector<char> eachElementLocations;
+    std::vector<char> testMaskLocations;
+    for (int frame = 0; frame < numFrames; frame++) {
+        setViewFrustumOnCameraPath(viewFrustum, frame);
+        eachElementLocations.clear();
+        testMaskLocations.clear();
+
+        quint64 start = usecTimestampNow();
+        cullEachElement(tree.getRoot(), viewFrustum, eachElementLocations);
+        eachElementTime += usecTimestampNow() - start;
+
+        start = usecTimestampNow();
+        AABox rootBox = tree.getRoot()->getAABox();
+        rootBox.scale(TREE_SCALE);
+        unsigned char testMask = ALL_FRUSTUM_TESTS;
+        ViewFrustum::location rootLocation = viewFrustum.boxInFrustum(rootBox, testMask);
+        cullWithTestMasks(tree.getRoot(), rootLocation, testMask, viewFrustum, testMaskLocations);
+        testMaskTime += usecTimestampNow() - start;
+
+        if (eachElementLocations != testMaskLocations) {
+            qDebug() << "FAILED: culling with test masks disagreed with testing each element at frame" << frame;
+            return true;
+        }
+        elementsReached += eachElementLocations.size();
+    }
+
+    qDebug() << numFrames << "frames along the camera path, average elements reached per frame:"
+        << (float)elementsReached / numFrames << "usecs per frame... testing each element:"
+        << (float)eachElementTime / numFrames << "with test masks:" << (float)testMaskTime / numFrames;
+    return false;
+}
+
+bool OctreeTests::runJurisdictionBenchmark() {
+    VoxelTree tree;
+    for (int i = 0; i < TEST_VOXEL_COUNT; i++) {
+        addRandomVoxel(tree);
+    }
+
+    // one eighth of the world, carved up by end nodes the way a crowded world's jurisdictions are
+    unsigned char* rootCode = pointToOctalCode(0.0f, 0.0f, 0.0f, 0.5f);
+    std::vector<unsigned char*> endNodes;
+    const float END_NODES_PER_SIDE = 0.5f / JURISDICTION_END_NODE_SIZE;
+    for (int i = 0; i < JURISDICTION_END_NODES; i++) {
+        float x = floorf(randFloat() * END_NODES_PER_SIDE) * JURISDICTION_END_NODE_SIZE;
+        float y = floorf(randFloat() * END_NODES_PER_SIDE) * JURISDICTION_END_NODE_SIZE;
+        float z = floorf(randFloat() * END_NODES_PER_SIDE) * JURISDICTION_END_NODE_SIZE;
+        endNodes.push_back(pointToOctalCode(x, y, z, JURISDICTION_END_NODE_SIZE));
+    }
+    JurisdictionMap map(rootCode, endNodes);
+
+    std::vector<char> linearAreas;
+    quint64 start = usecTimestampNow();
+    findAreasLinearly(map, tree.getRoot(), linearAreas);
+    quint64 linearTime = usecTimestampNow() - start;
+
+    std::vector<char> octalCodeAreas;
+    start = usecTimestampNow();
+    findAreasByOctalCode(map, tree.getRoot(), octalCodeAreas);
+    quint64 octalCodeTime = usecTimestampNow() - start;
+
+    std::vector<char> positionAreas;
+    start = usecTimestampNow();
+    findAreasByPosition(map, tree.getRoot(), map.getPosition(tree.getRoot()->getOctalCode()), positionAreas);
+    quint64 positionTime = usecTimestampNow() - start;
+
+    if (octalCodeAreas != linearAreas || positionAreas != linearAreas) {
+        qDebug() << "FAILED: the compiled jurisdiction disagreed with checking every end node";
+        return true;
+    }
+    qDebug() << linearAreas.size() << "elements looked up in a jurisdiction with" << JURISDICTION_END_NODES
+        << "end nodes, usecs... every end node:" << linearTime << "compiled by octal code:" << octalCodeTime
+        << "carrying positions:" << positionTime;
+    return false;
+}
+
+EditStormThread::EditStormThread(VoxelTree* tree) :
+    _tree(tree),
+    _stopping(false),
+    _edits(0) {
+}
+
+void EditStormThread::run() {
+    while (!_stopping) {
+        _tree->lockForWrite();
+        addRandomVoxel(*_tree);
+        float x = floorf(randFloat() / TEST_VOXEL_SIZE) * TEST_VOXEL_SIZE;
+        float y = floorf(randFloat() / TEST_VOXEL_SIZE) * TEST_VOXEL_SIZE;
+        float z = floorf(randFloat() / TEST_VOXEL_SIZE) * TEST_VOXEL_SIZE;
+        _tree->deleteVoxelAt(x, y, z, TEST_VOXEL_SIZE);
+        _tree->unlock();
+        _edits += 2;
+    }
+}
@@ -0,0 +1,86 @@
+//
+//  OctreeTests.h
+//  octree-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __octree_tests__OctreeTests__
+#define __octree_tests__OctreeTests__
+
+#include <QCoreApplication>
+#include <QThread>
+
+class VoxelTree;
+
+/// Benchmarks various aspects of the octree library.
+class OctreeTests : public QCoreApplication {
+    Q_OBJECT
+
+public:
+
+    OctreeTests(int& argc, char** argv);
+
+    /// Performs our various benchmarks.
+    /// \return true if any of the benchmarks failed.
+    bool run();
+
+private:
+
+    /// Encodes the whole tree over and over while another thread edits it, compares locked and snapshot reads.
+    bool runEncodeContentionBenchmark();
+
+    /// Checks that snapshot reads are set per tree, and that the next writer reclaims what the last reader let go of.
+    bool runSnapshotTreesTest();
+
+    /// Checks that a client's known state forgets elements as they're deleted, since their addresses get reused.
+    bool runKnownStateTest();
+
+    /// Folds a tree's subtrees and checks that clients are sent the same voxels with and without a view frustum, that
+    /// rays hit them at the same distances, and that lookups and edits unfold down to the voxels they reach.
+    bool runFoldedSubtreesTest();
+
+    /// Compares loading a plain SVO file with opening an indexed SVO file and then loading its subtrees.
+    bool runLoadBenchmark();
+
+    /// Times inserting into and extracting from an OctreeElementBag at various bag sizes, and checks its ordering.
+    bool runBagBenchmark();
+
+    /// Applies 100k voxel set records one write lock at a time the way the server used to, and then as one sorted
+    /// OctreeEditBatch, checks that both trees come out the same, and reports the edits per second.
+    bool runEditBatchBenchmark();
+
+    /// Culls the tree for each frame of a recorded camera path, testing each element the way the encode used to, and
+    /// then with the children of each element tested together against the planes their parent wasn't inside, checks
+    /// both find the same locations and reports the time per frame.
+    bool runCullingBenchmark();
+
+    /// Looks every element of a tree up in a jurisdiction with 500 end nodes by comparing against each end node the way
+    /// JurisdictionMap used to, then through the compiled map by octal code and by carried positions, checks all three
+    /// agree and reports their times.
+    bool runJurisdictionBenchmark();
+};
+
+/// Continuously adds and removes voxels from a tree, the way a burst of edit packets would.
+class EditStormThread : public QThread {
+    Q_OBJECT
+
+public:
+
+    EditStormThread(VoxelTree* tree);
+
+    void stop() { _stopping = true; }
+    int getEdits() const { return _edits; }
+
+protected:
+
+    virtual void run();
+
+private:
+
+    VoxelTree* _tree;
+    volatile bool _stopping;
+    int _edits;
+};
+
+#endif /* defined(__octree_tests__OctreeTests__) */
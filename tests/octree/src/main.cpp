@@ -0,0 +1,11 @@
+//
+//  main.cpp
+//  octree-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+
+#include "OctreeTests.h"
+
+int main(int argc, char** argv) {
+    return OctreeTests(argc, argv).run();
+}
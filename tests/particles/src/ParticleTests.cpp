@@ -0,0 +1,493 @@
+//
+//  ParticleTests.cpp
+//  particle-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+
+#include <QDebug>
+
+#include <GeometryUtil.h>
+#include <NodeList.h>
+#include <ParticleBroadPhase.h>
+#include <ParticleScriptContext.h>
+#include <ParticleTree.h>
+#include <ScriptEngine.h>
+#include <SharedUtil.h>
+#include <WorkerPool.h>
+
+#include "ParticleTests.h"
+
+const int BENCHMARK_UPDATES = 10;
+const int MAX_LEGACY_PARTICLES = 10000; // past this the tree search per particle takes too long to wait for
+const int MAX_BRUTE_FORCE_PARTICLES = 1000;
+const float PARTICLE_SPACING = 1.0f; // meters, on average
+const float PARTICLE_RADIUS = 0.3f; // meters
+const int LOOKUP_PARTICLES = 10000;
+const int LEGACY_LOOKUPS = 1000; // each one can search the whole tree
+const int SLEEPING_PARTICLES = 10000;
+const int MOVING_PARTICLE_INTERVAL = 100; // every hundredth particle keeps moving
+const int PARALLEL_PARTICLES = 100000;
+const float PARALLEL_PARTICLE_LIFETIME = 1000.0f; // seconds, so that none of them die however long this takes
+const int SCRIPTED_PARTICLES = 1000;
+const QString PARTICLE_SCRIPT("Particle.update.connect(function () {"
+                               " Particle.setColor({ red: 1, green: 2, blue: 3 }); });");
+
+// both scripts declare "shade", and only take their own value for it if no other script's value is there already
+const int FIRST_SCOPED_SHADE = 10;
+const int SECOND_SCOPED_SHADE = 20;
+const int LEAKED_SHADE = 99;
+const QString FIRST_SCOPED_SCRIPT("var shade = (typeof shade == 'undefined') ? 10 : 99;"
+                                  " Particle.update.connect(function () {"
+                                  " Particle.setColor({ red: shade, green: 0, blue: 0 }); });");
+const QString SECOND_SCOPED_SCRIPT("var shade = (typeof shade == 'undefined') ? 20 : 99;"
+                                   " Particle.update.connect(function () {"
+                                   " Particle.setColor({ red: shade, green: 0, blue: 0 }); });");
+
+// the cloud is a cube with the same density at every size, so the number of collisions grows with the particles
+static void createParticleCloud(int numParticles, std::vector<Particle>& particles) {
+    float cloudSize = powf((float) numParticles, 1.0f / 3.0f) * PARTICLE_SPACING / (float) TREE_SCALE;
+    glm::vec3 cloudCorner(0.25f);
+    rgbColor color = { 255, 255, 255 };
+
+    particles.resize(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        glm::vec3 position = cloudCorner + glm::vec3(randFloat(), randFloat(), randFloat()) * cloudSize;
+        glm::vec3 velocity = glm::vec3(randFloatInRange(-1.0f, 1.0f), randFloatInRange(-1.0f, 1.0f),
+                                       randFloatInRange(-1.0f, 1.0f)) / (float) TREE_SCALE;
+        particles[i].init(position, PARTICLE_RADIUS / (float) TREE_SCALE, color, velocity);
+    }
+}
+
+static std::pair<int, int> pairIndices(const std::vector<Particle>& particles, const Particle* particleA,
+                                       const Particle* particleB) {
+    return std::make_pair((int) (particleA - &particles[0]), (int) (particleB - &particles[0]));
+}
+
+class LegacyFindByIDArgs {
+public:
+    uint32_t id;
+    const Particle* foundParticle;
+};
+
+static bool legacyFindByIDOperation(OctreeElement* element, void* extraData) {
+    LegacyFindByIDArgs* args = static_cast<LegacyFindByIDArgs*>(extraData);
+    if (args->foundParticle) {
+        return false;
+    }
+    args->foundParticle = static_cast<ParticleTreeElement*>(element)->getParticleWithID(args->id);
+    return !args->foundParticle;
+}
+
+// the way ParticleTree used to find a particle, by asking each element in turn until one of them had it
+static const Particle* legacyFindParticleByID(ParticleTree& tree, uint32_t id) {
+    LegacyFindByIDArgs args = { id, NULL };
+    tree.recurseTreeWithOperation(legacyFindByIDOperation, &args);
+    return args.foundParticle;
+}
+
+// the way a particle used to run its update script, in an engine of its own that was set up for just this callback
+static void legacyRunUpdateScript(Particle& particle) {
+    ScriptEngine engine(particle.getScript());
+    ParticleScriptObject particleScriptable(&particle);
+    engine.registerGlobalObject("Particle", &particleScriptable);
+    engine.evaluate();
+    particleScriptable.emitUpdate();
+}
+
+static bool scriptsRan(const std::vector<Particle>& particles) {
+    for (size_t i = 0; i < particles.size(); i++) {
+        xColor color = particles[i].getXColor();
+        if (color.red != 1 || color.green != 2 || color.blue != 3) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ParticleTests::ParticleTests(int& argc, char** argv) :
+    QCoreApplication(argc, argv) {
+}
+
+bool ParticleTests::run() {
+
+    qDebug() << "Running particle benchmarks...";
+
+    // seed the random number generator so that our benchmarks are reproducible
+    srand(0xBAAAAABE);
+
+    if (runCollisionBenchmark()) {
+        return true;
+    }
+
+    if (runLookupBenchmark()) {
+        return true;
+    }
+
+    if (runSleepingBenchmark()) {
+        return true;
+    }
+
+    if (runParallelUpdateBenchmark()) {
+        return true;
+    }
+
+    if (runScriptBenchmark()) {
+        return true;
+    }
+
+    if (runScriptScopeTest()) {
+        return true;
+    }
+
+    qDebug() << "All benchmarks passed!";
+
+    return false;
+}
+
+bool ParticleTests::runCollisionBenchmark() {
+    const int PARTICLE_COUNTS[] = { 1000, 10000, 100000 };
+    const int NUMBER_OF_PARTICLE_COUNTS = sizeof(PARTICLE_COUNTS) / sizeof(PARTICLE_COUNTS[0]);
+
+    for (int countIndex = 0; countIndex < NUMBER_OF_PARTICLE_COUNTS; countIndex++) {
+        int numParticles = PARTICLE_COUNTS[countIndex];
+        std::vector<Particle> particles;
+        createParticleCloud(numParticles, particles);
+
+        ParticleBroadPhase broadPhase;
+        std::vector<ParticleCollisionPair> pairs;
+        quint64 start = usecTimestampNow();
+        for (int update = 0; update < BENCHMARK_UPDATES; update++) {
+            broadPhase.clear();
+            pairs.clear();
+            for (int i = 0; i < numParticles; i++) {
+                broadPhase.addParticle(&particles[i]);
+            }
+            broadPhase.findCollisionPairs(pairs);
+        }
+        quint64 broadPhaseTime = (usecTimestampNow() - start) / BENCHMARK_UPDATES;
+
+        // every pair the broad phase finds has to be a real one, and it can't miss any
+        if (numParticles <= MAX_BRUTE_FORCE_PARTICLES) {
+            std::vector<std::pair<int, int> > expectedPairs;
+            for (int i = 0; i < numParticles; i++) {
+                for (int j = i + 1; j < numParticles; j++) {
+                    glm::vec3 penetration;
+                    const Particle& particleA = particles[i];
+                    const Particle& particleB = particles[j];
+                    if (findSphereSpherePenetration(particleA.getPosition(), particleA.getRadius(),
+                                                    particleB.getPosition(), particleB.getRadius(), penetration)) {
+                        expectedPairs.push_back(std::make_pair(i, j));
+                    }
+                }
+            }
+            std::vector<std::pair<int, int> > foundPairs;
+            for (size_t i = 0; i < pairs.size(); i++) {
+                foundPairs.push_back(pairIndices(particles, pairs[i].particleA, pairs[i].particleB));
+            }
+            std::sort(foundPairs.begin(), foundPairs.end());
+            if (foundPairs != expectedPairs) {
+                qDebug() << "FAILED: broad phase found" << foundPairs.size() << "pairs, brute force found"
+                    << expectedPairs.size();
+                return true;
+            }
+        }
+
+        if (numParticles > MAX_LEGACY_PARTICLES) {
+            qDebug() << numParticles << "particles," << pairs.size() << "colliding pairs, usecs per update..."
+                << "tree search per particle: skipped, broad phase:" << broadPhaseTime
+                << "candidate pairs:" << broadPhase.getNumCandidatePairs();
+            continue;
+        }
+
+        // the collision system used to descend the particle tree for every particle
+        ParticleTree tree;
+        for (int i = 0; i < numParticles; i++) {
+            tree.storeParticle(particles[i]);
+        }
+        int numPenetrating = 0;
+        start = usecTimestampNow();
+        for (int update = 0; update < BENCHMARK_UPDATES; update++) {
+            numPenetrating = 0;
+            for (int i = 0; i < numParticles; i++) {
+                glm::vec3 penetration;
+                Particle* penetratedParticle;
+                if (tree.findSpherePenetration(particles[i].getPosition() * (float) TREE_SCALE,
+                                               particles[i].getRadius() * (float) TREE_SCALE, penetration,
+                                               (void**) &penetratedParticle)) {
+                    numPenetrating++;
+                }
+            }
+        }
+        quint64 treeSearchTime = (usecTimestampNow() - start) / BENCHMARK_UPDATES;
+
+        qDebug() << numParticles << "particles," << pairs.size() << "colliding pairs, usecs per update..."
+            << "tree search per particle:" << treeSearchTime << "(" << numPenetrating << "particles penetrating )"
+            << "broad phase:" << broadPhaseTime << "candidate pairs:" << broadPhase.getNumCandidatePairs();
+    }
+
+    return false;
+}
+
+bool ParticleTests::runLookupBenchmark() {
+    std::vector<Particle> particles;
+    createParticleCloud(LOOKUP_PARTICLES, particles);
+
+    ParticleTree tree;
+    quint64 start = usecTimestampNow();
+    for (int i = 0; i < LOOKUP_PARTICLES; i++) {
+        tree.storeParticle(particles[i]);
+    }
+    quint64 storeTime = usecTimestampNow() - start;
+
+    start = usecTimestampNow();
+    for (int i = 0; i < LEGACY_LOOKUPS; i++) {
+        const Particle* particle = legacyFindParticleByID(tree, particles[i].getID());
+        if (!particle || particle->getID() != particles[i].getID()) {
+            qDebug() << "FAILED: searching the tree didn't find particle" << particles[i].getID();
+            return true;
+        }
+    }
+    float legacyLookupTime = (usecTimestampNow() - start) / (float) LEGACY_LOOKUPS;
+
+    start = usecTimestampNow();
+    for (int i = 0; i < LOOKUP_PARTICLES; i++) {
+        const Particle* particle = tree.findParticleByID(particles[i].getID());
+        if (!particle || particle->getID() != particles[i].getID()) {
+            qDebug() << "FAILED: findParticleByID() didn't find particle" << particles[i].getID();
+            return true;
+        }
+    }
+    float lookupTime = (usecTimestampNow() - start) / (float) LOOKUP_PARTICLES;
+
+    // send every particle to where another one is, so that the update has to move them all to other elements
+    start = usecTimestampNow();
+    for (int i = 0; i < LOOKUP_PARTICLES; i++) {
+        ParticleProperties properties;
+        properties.setPosition(particles[(i + LOOKUP_PARTICLES / 2) % LOOKUP_PARTICLES].getPosition() *
+                               (float) TREE_SCALE);
+        tree.updateParticle(ParticleID(particles[i].getID()), properties);
+    }
+    float editTime = (usecTimestampNow() - start) / (float) LOOKUP_PARTICLES;
+    tree.update();
+
+    // the index has to have followed the particles to their new elements
+    for (int i = 0; i < LOOKUP_PARTICLES; i++) {
+        const Particle* particle = tree.findParticleByID(particles[i].getID());
+        if (!particle || (i < LEGACY_LOOKUPS && particle != legacyFindParticleByID(tree, particles[i].getID()))) {
+            qDebug() << "FAILED: findParticleByID() lost particle" << particles[i].getID() << "when it moved";
+            return true;
+        }
+    }
+
+    start = usecTimestampNow();
+    for (int i = 0; i < LOOKUP_PARTICLES; i += 2) {
+        tree.deleteParticle(ParticleID(particles[i].getID()));
+    }
+    float deleteTime = (usecTimestampNow() - start) / (float) (LOOKUP_PARTICLES / 2);
+    for (int i = 0; i < LOOKUP_PARTICLES; i++) {
+        bool shouldBeDeleted = (i % 2 == 0);
+        if ((tree.findParticleByID(particles[i].getID()) == NULL) != shouldBeDeleted) {
+            qDebug() << "FAILED: particle" << particles[i].getID() << (shouldBeDeleted ? "wasn't" : "was") << "deleted";
+            return true;
+        }
+    }
+
+    qDebug() << LOOKUP_PARTICLES << "particles stored in" << storeTime << "usecs, usecs per particle..."
+        << "tree search:" << legacyLookupTime << "findParticleByID():" << lookupTime
+        << "updateParticle():" << editTime << "deleteParticle():" << deleteTime;
+
+    return false;
+}
+
+bool ParticleTests::runSleepingBenchmark() {
+    std::vector<Particle> particles;
+    createParticleCloud(SLEEPING_PARTICLES, particles);
+
+    // nothing pulls the particles down, and only some of them are moving
+    ParticleTree tree;
+    for (int i = 0; i < SLEEPING_PARTICLES; i++) {
+        particles[i].setGravity(glm::vec3(0.0f));
+        if (i % MOVING_PARTICLE_INTERVAL != 0) {
+            particles[i].setVelocity(glm::vec3(0.0f));
+        }
+        tree.storeParticle(particles[i]);
+    }
+
+    // everything starts awake, and the particles at rest go to sleep on the first update
+    quint64 start = usecTimestampNow();
+    tree.update();
+    quint64 awakeTime = usecTimestampNow() - start;
+
+    for (int i = 0; i < SLEEPING_PARTICLES; i++) {
+        const Particle* particle = tree.findParticleByID(particles[i].getID());
+        bool shouldSleep = (i % MOVING_PARTICLE_INTERVAL != 0);
+        if (!particle || particle->isSleeping() != shouldSleep) {
+            qDebug() << "FAILED: particle" << particles[i].getID() << (shouldSleep ? "didn't sleep" : "slept");
+            return true;
+        }
+    }
+
+    start = usecTimestampNow();
+    for (int update = 0; update < BENCHMARK_UPDATES; update++) {
+        tree.update();
+    }
+    quint64 sleepingTime = (usecTimestampNow() - start) / BENCHMARK_UPDATES;
+
+    // an edit has to wake a sleeping particle up so that it moves again
+    const Particle& sleeper = particles[1];
+    ParticleProperties properties;
+    properties.setVelocity(glm::vec3(1.0f, 0.0f, 0.0f));
+    tree.updateParticle(ParticleID(sleeper.getID()), properties);
+    tree.update();
+    const Particle* wokenParticle = tree.findParticleByID(sleeper.getID());
+    if (!wokenParticle || wokenParticle->isSleeping() || wokenParticle->getVelocity() == glm::vec3(0.0f)) {
+        qDebug() << "FAILED: editing particle" << sleeper.getID() << "didn't wake it up";
+        return true;
+    }
+
+    qDebug() << SLEEPING_PARTICLES << "particles," << SLEEPING_PARTICLES / MOVING_PARTICLE_INTERVAL
+        << "of them moving, usecs per update... all awake:" << awakeTime << "resting ones asleep:" << sleepingTime;
+
+    return false;
+}
+
+bool ParticleTests::runParallelUpdateBenchmark() {
+    std::vector<Particle> particles;
+    createParticleCloud(PARALLEL_PARTICLES, particles);
+    for (int i = 0; i < PARALLEL_PARTICLES; i++) {
+        particles[i].setLifetime(PARALLEL_PARTICLE_LIFETIME);
+    }
+
+    WorkerPool workerPool;
+    workerPool.start();
+    int numberOfThreads = workerPool.getWorkerCount() + 1;
+
+    const int NUMBER_OF_RUNS = 2;
+    float particlesPerSecond[NUMBER_OF_RUNS];
+    for (int run = 0; run < NUMBER_OF_RUNS; run++) {
+        bool isParallel = (run == 1);
+        ParticleTree tree;
+        for (int i = 0; i < PARALLEL_PARTICLES; i++) {
+            tree.storeParticle(particles[i]);
+        }
+        if (isParallel) {
+            tree.setUpdateWorkerPool(&workerPool);
+        }
+
+        quint64 start = usecTimestampNow();
+        for (int update = 0; update < BENCHMARK_UPDATES; update++) {
+            tree.update();
+        }
+        quint64 elapsed = std::max(usecTimestampNow() - start, (quint64) 1);
+        particlesPerSecond[run] = (float) PARALLEL_PARTICLES * BENCHMARK_UPDATES * USECS_PER_SECOND / elapsed;
+        tree.setUpdateWorkerPool(NULL);
+
+        // however the update was split up, every particle has to be back in the tree and still findable
+        for (int i = 0; i < PARALLEL_PARTICLES; i++) {
+            if (!tree.findParticleByID(particles[i].getID())) {
+                qDebug() << "FAILED: particle" << particles[i].getID() << "went missing in"
+                    << (isParallel ? "the parallel update" : "the single threaded update");
+                workerPool.stop();
+                return true;
+            }
+        }
+    }
+    workerPool.stop();
+
+    qDebug() << PARALLEL_PARTICLES << "moving particles, particles updated per second... one thread:"
+        << particlesPerSecond[0] << numberOfThreads << "threads:" << particlesPerSecond[1];
+
+    return false;
+}
+
+bool ParticleTests::runScriptBenchmark() {
+    // the scripting interfaces listen for the jurisdictions of servers, which needs a NodeList even with no servers
+    if (!NodeList::getInstance()) {
+        NodeList::createInstance(NodeType::Agent);
+    }
+
+    std::vector<Particle> particles;
+    createParticleCloud(SCRIPTED_PARTICLES, particles);
+    for (int i = 0; i < SCRIPTED_PARTICLES; i++) {
+        particles[i].setScript(PARTICLE_SCRIPT);
+    }
+
+    quint64 start = usecTimestampNow();
+    for (int i = 0; i < SCRIPTED_PARTICLES; i++) {
+        legacyRunUpdateScript(particles[i]);
+    }
+    float legacyTime = (float) (usecTimestampNow() - start) / SCRIPTED_PARTICLES;
+    if (!scriptsRan(particles)) {
+        qDebug() << "FAILED: the update scripts didn't run with an engine per callback";
+        return true;
+    }
+
+    rgbColor white = { 255, 255, 255 };
+    for (int i = 0; i < SCRIPTED_PARTICLES; i++) {
+        particles[i].setColor(white);
+    }
+    ParticleScriptContext* scriptContext = ParticleScriptContext::getInstance();
+    start = usecTimestampNow();
+    scriptContext->beginTick();
+    for (int i = 0; i < SCRIPTED_PARTICLES; i++) {
+        scriptContext->runUpdate(&particles[i]);
+    }
+    scriptContext->endTick();
+    float contextTime = (float) (usecTimestampNow() - start) / SCRIPTED_PARTICLES;
+    if (!scriptsRan(particles)) {
+        qDebug() << "FAILED: the update scripts didn't run in the script context";
+        return true;
+    }
+    if (scriptContext->getLastTickCallbacks() != SCRIPTED_PARTICLES) {
+        qDebug() << "FAILED: the script context counted" << scriptContext->getLastTickCallbacks() << "callbacks, not"
+            << SCRIPTED_PARTICLES;
+        return true;
+    }
+
+    qDebug() << SCRIPTED_PARTICLES << "scripted particles, usecs per update callback... engine per callback:"
+        << legacyTime << "script context:" << contextTime << "(" << scriptContext->getLastTickScriptUsecs()
+        << "usecs in scripts," << scriptContext->getNumCompiles() << "compiles )";
+
+    return false;
+}
+
+bool ParticleTests::runScriptScopeTest() {
+    if (!NodeList::getInstance()) {
+        NodeList::createInstance(NodeType::Agent);
+    }
+
+    std::vector<Particle> particles;
+    createParticleCloud(2, particles);
+    particles[0].setScript(FIRST_SCOPED_SCRIPT);
+    particles[1].setScript(SECOND_SCOPED_SCRIPT);
+
+    // the second script runs after the first has declared its "shade" in the same tick, and then the first runs
+    // again after the second in a tick of its own
+    ParticleScriptContext* scriptContext = ParticleScriptContext::getInstance();
+    scriptContext->beginTick();
+    scriptContext->runUpdate(&particles[0]);
+    scriptContext->runUpdate(&particles[1]);
+    scriptContext->endTick();
+    scriptContext->runUpdate(&particles[0]);
+
+    const int EXPECTED_SHADES[] = { FIRST_SCOPED_SHADE, SECOND_SCOPED_SHADE };
+    for (int i = 0; i < 2; i++) {
+        int shade = particles[i].getXColor().red;
+        if (shade != EXPECTED_SHADES[i]) {
+            qDebug() << "FAILED: particle script" << i << "got a shade of" << shade << "not" << EXPECTED_SHADES[i]
+                << (shade == LEAKED_SHADE ? "because the other script's global leaked into it" : "");
+            return true;
+        }
+    }
+
+    qDebug() << "Particle scripts that declare the same global kept their own values";
+
+    return false;
+}
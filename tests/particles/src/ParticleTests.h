@@ -0,0 +1,53 @@
+//
+//  ParticleTests.h
+//  particle-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+//
+
+#ifndef __particle_tests__ParticleTests__
+#define __particle_tests__ParticleTests__
+
+#include <QCoreApplication>
+
+/// Benchmarks various aspects of the particles library.
+class ParticleTests : public QCoreApplication {
+    Q_OBJECT
+
+public:
+
+    ParticleTests(int& argc, char** argv);
+
+    /// Performs our various benchmarks.
+    /// \return true if any of the benchmarks failed.
+    bool run();
+
+private:
+
+    /// Finds the overlapping particles in clouds of 1k, 10k and 100k particles, by searching the particle tree for
+    /// each particle the way the collision system used to and then with a ParticleBroadPhase, and reports the time
+    /// per update.
+    bool runCollisionBenchmark();
+
+    /// Finds, edits and deletes particles by ID in a tree of 10k particles, by searching the tree the way ParticleTree
+    /// used to and then through its index of the elements holding each particle, and reports the time per lookup.
+    bool runLookupBenchmark();
+
+    /// Updates a tree of 10k particles where only 1% of them move, first with all of them awake and then once the
+    /// resting ones have gone to sleep, and reports the time per update.
+    bool runSleepingBenchmark();
+
+    /// Updates a tree of 100k moving particles on one thread and then spread across a WorkerPool, and
+    /// reports the particles updated per second.
+    bool runParallelUpdateBenchmark();
+
+    /// Runs the update script of 1k particles that share a script, with a new ScriptEngine per callback the way
+    /// particles used to and then in one tick of the ParticleScriptContext, and reports the time per callback.
+    bool runScriptBenchmark();
+
+    /// Runs the scripts of two particles that declare the same global in the ParticleScriptContext, and checks that
+    /// neither of them sees the other's value, in the same tick or in the ticks after.
+    bool runScriptScopeTest();
+};
+
+#endif // __particle_tests__ParticleTests__
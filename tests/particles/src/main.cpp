@@ -0,0 +1,11 @@
+//
+//  main.cpp
+//  particle-tests
+//
+//  Copyright (c) 2014 High Fidelity, Inc. All rights reserved.
+
+#include "ParticleTests.h"
+
+int main(int argc, char** argv) {
+    return ParticleTests(argc, argv).run();
+}
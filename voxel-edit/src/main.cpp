@@ -233,6 +233,22 @@ void processFillSVOFile(const char* fillSVOFile) {
     qDebug("exiting now");
 }
 
+void processConvertToIndexedSVOFile(const char* svoFile, const char* indexedSVOFile) {
+    qDebug("convertSVO: %s", svoFile);
+
+    VoxelTree tree(true); // reaveraging
+    if (!tree.readFromSVOFile(svoFile)) {
+        qDebug("unable to read %s", svoFile);
+        return;
+    }
+    qDebug("Nodes after loading %lu nodes", tree.getOctreeElementsCount());
+
+    qDebug("outputFile: %s", indexedSVOFile);
+    tree.writeToIndexedSVOFile(indexedSVOFile);
+
+    qDebug("exiting now");
+}
+
 void unitTest(VoxelTree * tree);
 
 
@@ -324,6 +340,16 @@ int main(int argc, const char * argv[])
         return 0;
     }
 
+    // Handles converting an SVO into an indexed SVO, which the octree servers can load lazily
+    const char* CONVERT_SVO = "--convertSVO";
+    const char* INDEXED_SVO = "--indexedSVO";
+    const char* convertSVOFile = getCmdOption(argc, argv, CONVERT_SVO);
+    const char* indexedSVOFile = getCmdOption(argc, argv, INDEXED_SVO);
+    if (convertSVOFile && indexedSVOFile) {
+        processConvertToIndexedSVOFile(convertSVOFile, indexedSVOFile);
+        return 0;
+    }
+
     const char* DONT_CREATE_FILE = "--dontCreateSceneFile";
     bool dontCreateFile = cmdOptionExists(argc, argv, DONT_CREATE_FILE);
 